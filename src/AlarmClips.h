@@ -0,0 +1,83 @@
+// Generated by tools/embedclip - do not edit. Include from one .cpp file only.
+#pragma once
+#include "EmbeddedClip.h"
+
+namespace EmbeddedClips {
+
+// alarm-beep: 1128 samples at 8000 Hz (141 ms)
+constexpr uint8_t alarm_beep_samples[1128] = {
+    0x00, 0x20, 0x40, 0x60, 0x80, 0x82, 0x84, 0x7e, 0x75, 0x75, 0x85, 0x93, 0x8d, 0x74, 0x63, 0x71,
+    0x94, 0xa4, 0x8c, 0x61, 0x54, 0x78, 0xa9, 0xb0, 0x80, 0x4a, 0x4c, 0x8a, 0xc1, 0xb2, 0x68, 0x33,
+    0x50, 0xa5, 0xd6, 0xa8, 0x49, 0x22, 0x61, 0xc7, 0xe2, 0x90, 0x27, 0x1b, 0x80, 0xe6, 0xdd, 0x6d,
+    0x12, 0x2e, 0xa3, 0xf1, 0xc3, 0x4b, 0x0c, 0x4b, 0xc3, 0xf1, 0xa3, 0x2e, 0x12, 0x6d, 0xdd, 0xe6,
+    0x80, 0x19, 0x22, 0x92, 0xed, 0xd1, 0x5c, 0x0e, 0x3c, 0xb4, 0xf3, 0xb4, 0x3c, 0x0e, 0x5c, 0xd1,
+    0xed, 0x92, 0x22, 0x19, 0x80, 0xe6, 0xdd, 0x6d, 0x12, 0x2e, 0xa3, 0xf1, 0xc3, 0x4b, 0x0c, 0x4b,
+    0xc3, 0xf1, 0xa3, 0x2e, 0x12, 0x6d, 0xdd, 0xe6, 0x80, 0x19, 0x22, 0x92, 0xed, 0xd1, 0x5c, 0x0e,
+    0x3c, 0xb4, 0xf3, 0xb4, 0x3c, 0x0e, 0x5c, 0xd1, 0xed, 0x92, 0x22, 0x19, 0x80, 0xe6, 0xdd, 0x6d,
+    0x12, 0x2e, 0xa3, 0xf1, 0xc3, 0x4b, 0x0c, 0x4b, 0xc3, 0xf1, 0xa3, 0x2e, 0x12, 0x6d, 0xdd, 0xe6,
+    0x80, 0x19, 0x22, 0x92, 0xed, 0xd1, 0x5c, 0x0e, 0x3c, 0xb4, 0xf3, 0xb4, 0x3c, 0x0e, 0x5c, 0xd1,
+    0xed, 0x92, 0x22, 0x19, 0x80, 0xe6, 0xdd, 0x6d, 0x12, 0x2e, 0xa3, 0xf1, 0xc3, 0x4b, 0x0c, 0x4b,
+    0xc3, 0xf1, 0xa3, 0x2e, 0x12, 0x6d, 0xdd, 0xe6, 0x80, 0x19, 0x22, 0x92, 0xed, 0xd1, 0x5c, 0x0e,
+    0x3c, 0xb4, 0xf3, 0xb4, 0x3c, 0x0e, 0x5c, 0xd1, 0xed, 0x92, 0x22, 0x19, 0x80, 0xe6, 0xdd, 0x6d,
+    0x12, 0x2e, 0xa3, 0xf1, 0xc3, 0x4b, 0x0c, 0x4b, 0xc3, 0xf1, 0xa3, 0x2e, 0x12, 0x6d, 0xdd, 0xe6,
+    0x80, 0x19, 0x22, 0x92, 0xed, 0xd1, 0x5c, 0x0e, 0x3c, 0xb4, 0xf3, 0xb4, 0x3c, 0x0e, 0x5c, 0xd1,
+    0xed, 0x92, 0x22, 0x19, 0x80, 0xe6, 0xdd, 0x6d, 0x12, 0x2e, 0xa3, 0xf1, 0xc3, 0x4b, 0x0c, 0x4b,
+    0xc3, 0xf1, 0xa3, 0x2e, 0x12, 0x6d, 0xdd, 0xe6, 0x80, 0x19, 0x22, 0x92, 0xed, 0xd1, 0x5c, 0x0e,
+    0x3c, 0xb4, 0xf3, 0xb4, 0x3c, 0x0e, 0x5c, 0xd1, 0xed, 0x92, 0x22, 0x19, 0x80, 0xe6, 0xdd, 0x6d,
+    0x12, 0x2e, 0xa3, 0xf1, 0xc3, 0x4b, 0x0c, 0x4b, 0xc3, 0xf1, 0xa3, 0x2e, 0x12, 0x6d, 0xdd, 0xe6,
+    0x80, 0x19, 0x22, 0x92, 0xed, 0xd1, 0x5c, 0x0e, 0x3c, 0xb4, 0xf3, 0xb4, 0x3c, 0x0e, 0x5c, 0xd1,
+    0xed, 0x92, 0x22, 0x19, 0x80, 0xe6, 0xdd, 0x6d, 0x12, 0x2e, 0xa3, 0xf1, 0xc3, 0x4b, 0x0c, 0x4b,
+    0xc3, 0xf1, 0xa3, 0x2e, 0x12, 0x6d, 0xdd, 0xe6, 0x80, 0x19, 0x22, 0x92, 0xed, 0xd1, 0x5c, 0x0e,
+    0x3c, 0xb4, 0xf3, 0xb4, 0x3c, 0x0e, 0x5c, 0xd1, 0xed, 0x92, 0x22, 0x19, 0x80, 0xe6, 0xdd, 0x6d,
+    0x12, 0x2e, 0xa3, 0xf1, 0xc3, 0x4b, 0x0c, 0x4b, 0xc3, 0xf1, 0xa3, 0x2e, 0x12, 0x6d, 0xdd, 0xe6,
+    0x80, 0x19, 0x22, 0x92, 0xed, 0xd1, 0x5c, 0x0e, 0x3c, 0xb4, 0xf3, 0xb4, 0x3c, 0x0e, 0x5c, 0xd1,
+    0xed, 0x92, 0x22, 0x19, 0x80, 0xe6, 0xdd, 0x6d, 0x12, 0x2e, 0xa3, 0xf1, 0xc3, 0x4b, 0x0c, 0x4b,
+    0xc3, 0xf1, 0xa3, 0x2e, 0x12, 0x6d, 0xdd, 0xe6, 0x80, 0x19, 0x22, 0x92, 0xed, 0xd1, 0x5c, 0x0e,
+    0x3c, 0xb4, 0xf3, 0xb4, 0x3c, 0x0e, 0x5c, 0xd1, 0xed, 0x92, 0x22, 0x19, 0x80, 0xe1, 0xd6, 0x6f,
+    0x20, 0x3a, 0x9d, 0xdb, 0xb4, 0x58, 0x2c, 0x5b, 0xad, 0xc9, 0x96, 0x4f, 0x41, 0x76, 0xb0, 0xb3,
+    0x80, 0x51, 0x58, 0x87, 0xa9, 0x9c, 0x74, 0x5d, 0x6d, 0x8d, 0x99, 0x8a, 0x74, 0x6e, 0x7b, 0x88,
+    0x88, 0x80, 0x7d, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+    0x80, 0x80, 0x80, 0x80, 0x80, 0x82, 0x85, 0x86, 0x80, 0x75, 0x6e, 0x71, 0x80, 0x92, 0x9c, 0x96,
+    0x80, 0x65, 0x57, 0x61, 0x80, 0xa2, 0xb3, 0xa6, 0x80, 0x55, 0x40, 0x51, 0x80, 0xb2, 0xca, 0xb6,
+    0x80, 0x44, 0x29, 0x40, 0x80, 0xc3, 0xe1, 0xc7, 0x80, 0x34, 0x12, 0x30, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1,
+    0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xd1, 0xf3, 0xd1, 0x80, 0x2e, 0x0c, 0x2e, 0x80, 0xcd, 0xea, 0xc9,
+    0x80, 0x3a, 0x20, 0x3e, 0x80, 0xbd, 0xd3, 0xb9, 0x80, 0x4b, 0x38, 0x4f, 0x80, 0xac, 0xbc, 0xa8,
+    0x80, 0x5b, 0x4f, 0x5f, 0x80, 0x9c, 0xa5, 0x98, 0x80, 0x6b, 0x66, 0x6f, 0x80, 0x8c, 0x8e, 0x88,
+    0x80, 0x7b, 0x7d, 0x80, 0x60, 0x40, 0x20, 0x00,
+};
+constexpr EmbeddedClip alarm_beep = { "alarm-beep", alarm_beep_samples, 1128, 8000 };
+
+} // namespace EmbeddedClips
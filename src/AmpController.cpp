@@ -0,0 +1,112 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "AmpController.h"
+#include "utils.h"
+
+AmpController::AmpController(uint8_t _pin, bool _onPinHigh, uint32_t _warmUpMS, uint32_t _idleOffMS)
+{
+    pin = _pin;
+    onPinHigh = _onPinHigh;
+    warmUpMS = _warmUpMS;
+    idleOffMS = _idleOffMS;
+    bWarm = false;
+    bInUse = false;
+    releasedUS = 0;
+    powerCycles = 0;
+    lastOnUS = 0;
+    lastOffUS = 0;
+
+#ifdef ESP_PLATFORM
+    if (pin) {
+        pinMode(pin, OUTPUT);
+    }
+#endif
+    writePin(false);
+}
+
+void AmpController::writePin(bool _on)
+{
+    bPowered = _on;
+#ifdef ESP_PLATFORM
+    if (pin) {
+        digitalWrite(pin, onPinHigh ? _on : !_on);
+    }
+#else
+    emulatedPinLevel = onPinHigh ? _on : !_on;
+#endif
+}
+
+void AmpController::Request()
+{
+    bInUse = true;
+
+    if (bPowered)
+        return;
+
+    writePin(true);
+    lastOnUS = getMicros();
+    bWarm = !warmUpMS;
+    powerCycles++;
+}
+
+void AmpController::Release()
+{
+    if (!bInUse)
+        return;
+
+    bInUse = false;
+    releasedUS = getMicros();
+}
+
+bool AmpController::isReady()
+{
+    if (!bPowered)
+        return false;
+
+    if (!bWarm && getMicros() - lastOnUS >= (uint64_t)warmUpMS * 1000)
+        bWarm = true;
+
+    return bWarm;
+}
+
+void AmpController::Service()
+{
+    if (bPowered && !bInUse && getMicros() - releasedUS >= (uint64_t)idleOffMS * 1000)
+        PowerOff();
+}
+
+void AmpController::PowerOff()
+{
+    if (!bPowered)
+        return;
+
+    writePin(false);
+    lastOffUS = getMicros();
+    bWarm = false;
+    bInUse = false;
+}
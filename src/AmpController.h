@@ -0,0 +1,98 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifdef ESP_PLATFORM
+#include <Arduino.h>
+#else
+#include <stdint.h>
+#endif
+
+/*! @class   AmpController
+ *  @brief   Power management for an external audio amplifier on an enable pin.
+ *  @details The amplifier is switched on when audio is requested and left on for an idle-off
+ *           period after the last clip so that back-to-back clips (and intro to sound) do not
+ *           cycle its power. Warm-up is tracked rather than slept through - the caller keeps
+ *           loading the file and only starts output once isReady() says the amp has settled.
+ *           - Service() must be called periodically (the playlist thread does) for the idle-off.
+ *           - With no pin (pin 0) on ESP32 the state is still tracked, so timing stays the same.
+ *           - On native builds the pin is emulated. Its level, transition times and the number of
+ *             power cycles can be read back to check the timing.
+ */
+class AmpController
+{
+public:
+    /*! @brief Amplifier enable pin setup. Starts with the amplifier off.
+     *  @param _pin - GPIO driving the amplifier enable. 0 for none.
+     *  @param _onPinHigh - active high hardware control when true. Active low when false.
+     *  @param _warmUpMS - time from power on until the amplifier output has settled.
+     *  @param _idleOffMS - time without audio before powering the amplifier down.
+     *  @note Both are timed on the 32-bit microsecond clock, so about 71 minutes at most.
+     */
+    AmpController(uint8_t _pin=0, bool _onPinHigh=true, uint32_t _warmUpMS=100, uint32_t _idleOffMS=3000);
+    //! @brief Audio is about to play. Powers on if needed and cancels any pending idle-off.
+    void Request();
+    //! @brief Audio has stopped. The idle-off countdown starts now.
+    void Release();
+    //! @brief Powered and warmed up - output can start without the turn-on thump being clipped.
+    bool isReady();
+    //! @brief Handles the idle-off. Call periodically from the owning thread.
+    void Service();
+    //! @brief Force the amplifier off right away (e.g. before sleeping).
+    void PowerOff();
+    void SetWarmUpMS(uint32_t _warmUpMS) { warmUpMS = _warmUpMS; };
+    void SetIdleOffMS(uint32_t _idleOffMS) { idleOffMS = _idleOffMS; };
+    bool isPowered() { return bPowered; };
+    //! @brief Number of off to on transitions since construction.
+    uint32_t getPowerCycles() { return powerCycles; };
+    //! @brief getMicros() of the most recent power on and power off.
+    uint32_t getLastOnUS() { return lastOnUS; };
+    uint32_t getLastOffUS() { return lastOffUS; };
+#ifndef ESP_PLATFORM
+    //! @brief Level of the emulated enable pin (honours _onPinHigh).
+    bool getEmulatedPinLevel() { return emulatedPinLevel; };
+#endif
+
+protected:
+    void writePin(bool _on);
+
+    uint8_t pin;
+    bool onPinHigh;
+    uint32_t warmUpMS;
+    uint32_t idleOffMS;
+    volatile bool bPowered;
+    //! Latched once warm-up has elapsed so a long on-time wrapping getMicros() can't un-ready it.
+    bool bWarm;
+    bool bInUse;
+    uint32_t releasedUS;
+    volatile uint32_t powerCycles;
+    volatile uint32_t lastOnUS;
+    volatile uint32_t lastOffUS;
+#ifndef ESP_PLATFORM
+    volatile bool emulatedPinLevel;
+#endif
+};
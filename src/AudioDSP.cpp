@@ -0,0 +1,160 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "AudioDSP.h"
+#include "utils.h"
+
+#include <cmath>
+
+void AudioDSP::toFloat(const int16_t* pIn, size_t count, std::vector<float>& out)
+{
+    out.resize(count);
+    for (size_t i=0; i<count; i++)
+        out[i] = pIn[i] * (1.0f / 32768.0f);
+}
+
+static const int ZEROS = 16;        // Zero crossings each side of the resampling kernel
+static const int STEPS = 64;        // Table points per zero crossing
+
+// One side of the kernel, h(x) for x = 0 .. ZEROS crossings.
+static std::vector<float> makeKernel()
+{
+    std::vector<float> table(ZEROS * STEPS + 2);
+
+    for (size_t j=0; j<table.size(); j++) {
+        double x = (double)j / STEPS;
+        double sinc = j ? sin(M_PI * x) / (M_PI * x) : 1.0;
+        double w = x >= ZEROS ? 0.0 : 0.42 + 0.5 * cos(M_PI * x / ZEROS) + 0.08 * cos(2 * M_PI * x / ZEROS);
+        table[j] = sinc * w;
+    }
+    return table;
+}
+
+void AudioDSP::resample(const std::vector<float>& in, uint32_t inRate, uint32_t outRate, std::vector<float>& out)
+{
+    // Built once, on first use - safely even when several transcoder threads get here together.
+    static const std::vector<float> table = makeKernel();
+
+    if (inRate == outRate || in.empty()) {
+        out = in;
+        return;
+    }
+
+    // In units of input samples: the kernel's zero crossings are 1/cutoff apart.
+    double step = (double)inRate / outRate;
+    double cutoff = 0.95 * (outRate < inRate ? (double)outRate / inRate : 1.0);
+    double halfWidth = ZEROS / cutoff;
+
+    size_t outCount = (size_t)((uint64_t)in.size() * outRate / inRate);
+    out.resize(outCount);
+    for (size_t n=0; n<outCount; n++) {
+        double t = n * step;
+        long first = (long)ceil(t - halfWidth);
+        long last = (long)floor(t + halfWidth);
+        if (first < 0)
+            first = 0;
+        if (last >= (long)in.size())
+            last = in.size() - 1;
+
+        double sum = 0.0;
+        for (long k=first; k<=last; k++) {
+            double pos = fabs(t - k) * cutoff * STEPS;
+            size_t j = (size_t)pos;
+            if (j >= (size_t)ZEROS * STEPS)
+                continue;
+            double frac = pos - j;
+            sum += in[k] * (table[j] + (table[j+1] - table[j]) * frac);
+        }
+        out[n] = sum * cutoff;     // Scaled by the cutoff for unity gain in the passband
+    }
+}
+
+bool AudioDSP::findContent(const std::vector<float>& samples, float thresholdDB, uint32_t padSamples,
+                           size_t& start, size_t& end)
+{
+    float threshold = powf(10.0f, thresholdDB / 20.0f);
+    size_t first = 0, last = samples.size();
+
+    while (first < samples.size() && fabsf(samples[first]) < threshold)
+        first++;
+    if (first == samples.size())
+        return false;
+    while (last > first && fabsf(samples[last-1]) < threshold)
+        last--;
+
+    start = first > padSamples ? first - padSamples : 0;
+    end = last + padSamples < samples.size() ? last + padSamples : samples.size();
+    return true;
+}
+
+float AudioDSP::peak(const float* p, size_t count)
+{
+    float maxValue = 0.0f;
+
+    for (size_t i=0; i<count; i++)
+        maxValue = fabsf(p[i]) > maxValue ? fabsf(p[i]) : maxValue;
+    return maxValue;
+}
+
+float AudioDSP::normalize(std::vector<float>& samples, float targetDB, float maxGainDB)
+{
+    float maxValue = peak(samples.data(), samples.size());
+    if (maxValue <= 0.0f)
+        return 0.0f;
+
+    float gainDB = targetDB - 20.0f * log10f(maxValue);
+    if (gainDB > maxGainDB)
+        gainDB = maxGainDB;
+    float gain = powf(10.0f, gainDB / 20.0f);
+    for (auto& s: samples)
+        s *= gain;
+    return gainDB;
+}
+
+void AudioDSP::toDAC(const float* pIn, uint8_t* pOut, size_t count, Dither dither, uint32_t seed)
+{
+    FastRand rng(seed);
+    float error = 0.0f;     // Last quantization error - fed back when shaping
+
+    for (size_t i=0; i<count; i++) {
+        // Full scale is +/-128 steps of the DAC.
+        float v = pIn[i] * 128.0f;
+        if (dither == Shaped)
+            v -= error;
+        float d = 0.0f;
+        if (dither != NoDither) {
+            // Two uniform values summed - triangular, +/-1 LSB.
+            d = (rng.Next() >> 8) * (1.0f / 16777216.0f) - (rng.Next() >> 8) * (1.0f / 16777216.0f);
+        }
+        float q = floorf(v + d + 0.5f);
+        q = q > 127.0f ? 127.0f : (q < -128.0f ? -128.0f : q);
+        // A clipped sample's error isn't noise - don't feed it forward.
+        error = q - v;
+        error = error > 2.0f ? 2.0f : (error < -2.0f ? -2.0f : error);
+        pOut[i] = (int)q + 128;
+    }
+}
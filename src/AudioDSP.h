@@ -0,0 +1,83 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+#include <stddef.h>
+
+#include <vector>
+
+/*! @class   AudioDSP
+ *  @brief   Offline processing stages for getting audio into DAC-ready shape.
+ *  @details Works on mono float samples (full scale is +/-1.0) and is meant for whole clips, not the
+ *           fill path - the transcoder tool chains them as resample(), findContent(), normalize()
+ *           and finally toDAC(). Each stage is a static function with no hidden state.
+ */
+class AudioDSP
+{
+public:
+    //! @brief 16-bit signed to float.
+    static void toFloat(const int16_t* pIn, size_t count, std::vector<float>& out);
+
+    /*! @brief Band-limited sample rate conversion.
+     *  @details Windowed sinc (Blackman, 16 zero crossings each side) from a table interpolated
+     *           between 64 points per crossing. The cutoff sits at 95% of the lower Nyquist, so
+     *           downsampling doesn't alias and upsampling doesn't image.
+     */
+    static void resample(const std::vector<float>& in, uint32_t inRate, uint32_t outRate, std::vector<float>& out);
+
+    /*! @brief Where the audible part of a clip starts and ends - for trimming leading/trailing silence.
+     *  @param thresholdDB - level (dBFS, negative) below which a sample counts as silence
+     *  @param padSamples - kept either side of the first/last loud sample so soft attacks and
+     *                      decays aren't clipped
+     *  @param start, end - the range to keep, [start, end)
+     *  @return false if the whole clip is below the threshold.
+     */
+    static bool findContent(const std::vector<float>& samples, float thresholdDB, uint32_t padSamples,
+                            size_t& start, size_t& end);
+
+    //! @brief Largest absolute sample value.
+    static float peak(const float* p, size_t count);
+    /*! @brief Scale the peak to targetDB (dBFS) with the gain capped at maxGainDB, so a near-silent
+     *         clip isn't turned into loud noise.
+     *  @return gain applied in dB.
+     */
+    static float normalize(std::vector<float>& samples, float targetDB=-1.0f, float maxGainDB=24.0f);
+
+    enum Dither {
+        NoDither,       //!< Plain rounding - quantization error follows the signal (distortion)
+        Tpdf,           //!< Triangular dither - error becomes a flat noise floor
+        Shaped          //!< Triangular dither with first-order error feedback - noise tilted up
+                        //!  towards Nyquist and away from the midrange where it is heard most
+    };
+    /*! @brief Reduce to 8-bit unsigned - the DAC format.
+     *  @param seed - dither generator seed, so a conversion can be repeated exactly
+     */
+    static void toDAC(const float* pIn, uint8_t* pOut, size_t count, Dither dither=Shaped, uint32_t seed=1);
+};
@@ -0,0 +1,125 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "AudioEventNotifier.h"
+
+AudioEventNotifier::AudioEventNotifier(LockFreeQueue<AudioPlayerEvent, 32>& _events, LevelMeter* _pMeter)
+    : RoboTask("afpNotify"), events(_events), pMeter(_pMeter)
+{
+    slotsClaimed = 0;
+    delivered = 0;
+    unclaimed = 0;
+    for (uint8_t i=0; i<MAX_SUBSCRIBERS; i++) {
+        subs[i].callback = nullptr;
+        subs[i].context = nullptr;
+        subs[i].mask = 0;
+    }
+
+    setBaseRunDelay(1);
+    Start();
+}
+
+AudioEventNotifier::~AudioEventNotifier()
+{
+    // Stop the thread while the subscriber table still exists.
+    Terminate();
+}
+
+int8_t AudioEventNotifier::Subscribe(AudioEventCallback callback, void* context, uint16_t mask)
+{
+    Change change;
+    uint8_t claimed = slotsClaimed.load();
+    int8_t slot;
+
+    if (!callback)
+        return -1;
+
+    do {
+        for (slot=0; slot<MAX_SUBSCRIBERS && (claimed & (1 << slot)); slot++)
+            ;
+        if (slot == MAX_SUBSCRIBERS)
+            return -1;
+    } while (!slotsClaimed.compare_exchange_weak(claimed, claimed | (1 << slot)));
+
+    change.slot = slot;
+    change.sub.callback = callback;
+    change.sub.context = context;
+    change.sub.mask = mask;
+    if (!changes.push(change)) {
+        slotsClaimed.fetch_and(~(1 << slot));
+        return -1;
+    }
+    return slot;
+}
+
+bool AudioEventNotifier::Unsubscribe(int8_t id)
+{
+    Change change;
+
+    if (id < 0 || id >= MAX_SUBSCRIBERS || !(slotsClaimed.load() & (1 << id)))
+        return false;
+
+    change.slot = id;
+    change.sub.callback = nullptr;
+    change.sub.context = nullptr;
+    change.sub.mask = 0;
+    if (!changes.push(change))
+        return false;
+
+    // The removal is queued ahead of anything a new owner of this slot could queue.
+    slotsClaimed.fetch_and(~(1 << id));
+    return true;
+}
+
+void AudioEventNotifier::Run()
+{
+    Change change;
+    AudioPlayerEvent ev;
+
+    while (changes.pop(change))
+        subs[change.slot] = change.sub;
+
+    if (pMeter)
+        pMeter->process();
+
+    while (events.pop(ev)) {
+        bool bClaimed = false;
+        uint16_t bit = AudioPlayerEvent::maskOf(ev.type);
+
+        for (uint8_t i=0; i<MAX_SUBSCRIBERS; i++) {
+            if (subs[i].callback && (subs[i].mask & bit)) {
+                subs[i].callback(ev, subs[i].context);
+                bClaimed = true;
+            }
+        }
+
+        if (bClaimed)
+            delivered++;
+        else
+            unclaimed++;
+    }
+}
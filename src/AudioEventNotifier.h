@@ -0,0 +1,117 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+
+#include "robotask.h"
+#include "LockFreeQueue.h"
+#include "LevelMeter.h"
+
+#include <atomic>
+
+/*! @struct AudioPlayerEvent
+ *  @brief  Notification posted by the player (ISR or thread) for its owner and subscribers.
+ */
+struct AudioPlayerEvent
+{
+    enum Type : uint8_t {
+        Loaded,          //!< A source has been attached and is ready to start.
+        Started,         //!< PlayFile() was called.
+        FirstSample,     //!< The first sample after PlayFile() went out to the DAC.
+        Paused,          //!< PauseFile() was called.
+        BufferLow,       //!< Read-ahead buffer fell below the low-water mark. value = fullness %.
+        Underrun,        //!< The output caught up with the reader before the end of the file.
+        PositionReached, //!< The position marker was reached. value = sample number.
+        Finished         //!< The last sample has been played.
+    };
+    Type type;
+    //! getMicros() at the time the event was posted.
+    uint32_t timeUS;
+    //! Type-specific detail, zero when unused.
+    uint32_t value;
+
+    //! @brief Subscription mask bit for an event type.
+    static uint16_t maskOf(Type type) { return 1 << type; };
+    static const uint16_t AllEvents = 0xffff;
+};
+
+//! @brief Subscriber callback. Runs on the notifier thread - never in the ISR.
+typedef void (*AudioEventCallback)(const AudioPlayerEvent& ev, void* context);
+
+/*! @class   AudioEventNotifier
+ *  @brief   Delivers player events to subscribers on a thread of its own.
+ *  @details The player posts events from its timer ISR (ESP32) or playout thread (native) into a
+ *           lock-free queue - nothing more happens in that context. This task drains the queue
+ *           every millisecond and calls each subscriber whose mask includes the event, so a
+ *           callback may take its time (print, post a command, load a file) without disturbing
+ *           output. Subscribe()/Unsubscribe() may be called from any thread. The change is queued
+ *           and applied ahead of the next events delivered. When given a LevelMeter, the same
+ *           pass meters the output blocks completed since the last one.
+ */
+class AudioEventNotifier : RoboTask
+{
+public:
+    AudioEventNotifier(LockFreeQueue<AudioPlayerEvent, 32>& _events, LevelMeter* _pMeter=nullptr);
+    ~AudioEventNotifier();
+    /*! @brief Register a callback for the event types in mask. @see AudioPlayerEvent::maskOf
+     *  @return subscription id for Unsubscribe() or -1 if all slots are taken.
+     */
+    int8_t Subscribe(AudioEventCallback callback, void* context=nullptr, uint16_t mask=AudioPlayerEvent::AllEvents);
+    //! @brief Stop a subscription. A callback already being delivered may still complete.
+    bool Unsubscribe(int8_t id);
+    //! @brief Events handed to at least one subscriber, and events no subscriber wanted.
+    uint32_t getDeliveredCount() { return delivered; };
+    uint32_t getUnclaimedCount() { return unclaimed; };
+    void Run();
+
+    static const uint8_t MAX_SUBSCRIBERS = 8;
+
+protected:
+    struct Subscription {
+        AudioEventCallback callback;
+        void* context;
+        uint16_t mask;
+    };
+    //! Subscribe/unsubscribe request. A null callback removes the slot.
+    struct Change {
+        int8_t slot;
+        Subscription sub;
+    };
+
+    LockFreeQueue<AudioPlayerEvent, 32>& events;
+    LevelMeter* pMeter;
+    LockFreeQueue<Change, 16> changes;
+    //! Bit per claimed slot. Claimed with a compare-exchange so ids can be handed out on any thread.
+    std::atomic<uint8_t> slotsClaimed;
+    //! Only touched on the notifier thread.
+    Subscription subs[MAX_SUBSCRIBERS];
+    volatile uint32_t delivered;
+    volatile uint32_t unclaimed;
+};
@@ -41,8 +41,22 @@
 #define PRESCALER 80
 
 uint8_t AudioFilePlayer::pinDAC = 0;
-WaveFileType* AudioFilePlayer::pWave = nullptr;
+AudioSampleSource* AudioFilePlayer::pWave = nullptr;
 uint8_t AudioFilePlayer::curVolume = 100;
+uint16_t AudioFilePlayer::clipGain = 256;
+LockFreeQueue<AudioPlayerEvent, 32> AudioFilePlayer::eventQueue;
+LevelMeter AudioFilePlayer::meter;
+volatile bool AudioFilePlayer::bFinishPosted = false;
+volatile uint32_t AudioFilePlayer::samplesPlayed = 0;
+volatile uint32_t AudioFilePlayer::positionMarker = 0;
+volatile bool AudioFilePlayer::bFirstSamplePending = false;
+volatile bool AudioFilePlayer::bBufferLowPosted = false;
+volatile bool AudioFilePlayer::bUnderrunPosted = false;
+volatile uint8_t AudioFilePlayer::bufferLowPercent = 25;
+volatile bool AudioFilePlayer::bStartScheduled = false;
+volatile uint32_t AudioFilePlayer::scheduledStartUS = 0;
+volatile uint32_t AudioFilePlayer::startToleranceUS = 0;
+volatile int32_t AudioFilePlayer::lastStartErrorUS = 0;
 // Just init with dont-care data - 256 entries.
 uint8_t AudioFilePlayer::pDataTable[256] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 
     0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 
@@ -56,8 +70,10 @@ uint8_t AudioFilePlayer::pDataTable[256] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1,
     0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5};
 
 AudioFilePlayer::AudioFilePlayer(uint8_t esp32Timer, uint8_t esp32Pin)
+    : notifier(eventQueue, &meter), embeddedWave(nullptr, 0, 0)
 {
     pWave = nullptr;
+    pLastMixer = nullptr;
     taskSleepTimeTarget=0;
     SetVolume(100);
 
@@ -79,17 +95,32 @@ AudioFilePlayer::AudioFilePlayer(uint8_t esp32Timer, uint8_t esp32Pin)
 
 AudioFilePlayer::~AudioFilePlayer()
 {
+    // The playout thread reads pWave - stop it before the source goes.
+    Terminate();
 #ifdef ESP_PLATFORM
     killTimer();
 #endif
 
-    if (pWave) {
-        delete pWave;
-        pWave = nullptr;
+    deleteSource(pWave);
+    pWave = nullptr;
+}
+
+void AudioFilePlayer::deleteSource(AudioSampleSource* pSource)
+{
+    for (auto& mixer: mixers) {
+        if (pSource == &mixer) {
+            deleteSource(mixer.getFront());
+            deleteSource(mixer.getBack());
+            mixer.reset();
+            return;
+        }
     }
+
+    if (pSource && pSource != &embeddedWave && pSource != &toneWave)
+        delete pSource;
 }
 
-bool AudioFilePlayer::LoadFile(const char* fname)
+void AudioFilePlayer::releaseWave()
 {
 #ifdef ESP_PLATFORM
     pauseTimer();
@@ -98,16 +129,124 @@ bool AudioFilePlayer::LoadFile(const char* fname)
     Pause();
 #endif
 
-    if (pWave) {
+    if (pWave && pWave != &embeddedWave && pWave != &toneWave)
         PrintLN("AFP::LoadFile - pWave already exists. Deleting for re-load.");
-        delete pWave;
-        pWave = nullptr;
+    deleteSource(pWave);
+    pWave = nullptr;
+    bStartScheduled = false;
+}
+
+void AudioFilePlayer::attachWave()
+{
+    // Once we're loaded and we know the file parameters/settings, use that.
+    taskSleepTimeTarget = 1000000 / pWave->getSampleRate();
+
+#ifdef ESP_PLATFORM
+    // // Setup the timer callback but don't enable it yet.
+    // HWTimer = timerBegin(timerNumber, PRESCALER, true);
+    // timerAttachInterrupt(HWTimer, &timerISRCallback, true);
+    timerAlarmWrite(HWTimer, taskSleepTimeTarget, true);
+#endif
+
+    bFinishPosted = false;
+    samplesPlayed = 0;
+    positionMarker = 0;
+    bBufferLowPosted = false;
+    bUnderrunPosted = false;
+    if (clipGain != 256)
+        SetClipGain(256);
+    postEvent(AudioPlayerEvent::Loaded);
+}
+
+#ifdef ESP_PLATFORM
+void IRAM_ATTR AudioFilePlayer::postEvent(AudioPlayerEvent::Type type, uint32_t value)
+#else
+void AudioFilePlayer::postEvent(AudioPlayerEvent::Type type, uint32_t value)
+#endif
+{
+    AudioPlayerEvent ev;
+    ev.type = type;
+    ev.timeUS = getMicros();
+    ev.value = value;
+    eventQueue.push(ev);
+}
+
+#ifdef ESP_PLATFORM
+bool IRAM_ATTR AudioFilePlayer::checkStarved()
+#else
+bool AudioFilePlayer::checkStarved()
+#endif
+{
+    if (!pWave->isStarved()) {
+        bUnderrunPosted = false;
+        return false;
+    }
+
+    // Hold the output where it is rather than replaying stale buffer contents.
+    if (!bUnderrunPosted) {
+        bUnderrunPosted = true;
+        postEvent(AudioPlayerEvent::Underrun, samplesPlayed);
+    }
+    return true;
+}
+
+#ifdef ESP_PLATFORM
+bool IRAM_ATTR AudioFilePlayer::holdForStart()
+#else
+bool AudioFilePlayer::holdForStart()
+#endif
+{
+    if (!bStartScheduled)
+        return false;
+
+    int32_t late = (int32_t)(getMicros() - scheduledStartUS);
+    if (late < -(int32_t)startToleranceUS)
+        return true;
+
+    lastStartErrorUS = late;
+    bStartScheduled = false;
+    return false;
+}
+
+#ifdef ESP_PLATFORM
+void IRAM_ATTR AudioFilePlayer::sampleDone()
+#else
+void AudioFilePlayer::sampleDone()
+#endif
+{
+    pWave->advanceReadPointer();
+    samplesPlayed++;
+
+    if (bFirstSamplePending) {
+        bFirstSamplePending = false;
+        postEvent(AudioPlayerEvent::FirstSample, samplesPlayed);
+    }
+
+    if (samplesPlayed == positionMarker) {
+        positionMarker = 0;
+        postEvent(AudioPlayerEvent::PositionReached, samplesPlayed);
     }
 
+    // Buffer level only needs a look every so often.
+    if (!(samplesPlayed & 0xff)) {
+        uint8_t fullness = pWave->getBufferFullPercentage();
+        if (fullness >= bufferLowPercent || pWave->getFileReadPercentage() >= 100)
+            bBufferLowPosted = false;
+        else if (!bBufferLowPosted) {
+            bBufferLowPosted = true;
+            postEvent(AudioPlayerEvent::BufferLow, fullness);
+        }
+    }
+}
+
+bool AudioFilePlayer::LoadFile(const char* fname)
+{
+    releaseWave();
+
     try {
         pWave = new WaveFileType(fname);
         assert(pWave);
-    } catch(std::exception& e) {
+    } catch(...) {
 #ifdef ESP_PLATFORM
         Serial.println("Unable to load file.");
 #else
@@ -116,20 +255,134 @@ bool AudioFilePlayer::LoadFile(const char* fname)
         return false;
     }
 
-    // Once we're loaded and we know the file parameters/settings, use that.
-    taskSleepTimeTarget = 1000000 / pWave->getSampleRate();
+    attachWave();
+
+    // Need the first buffer fill to land or we get static/noise. That fill starts as soon as the
+    // reader is constructed so this is normally a few milliseconds - bounded in case of slow media.
+    for (uint8_t i=0; i<50 && !pWave->isBufferPrimed(); i++)
+        SleepMS(5);
+    return true;
+}
+
+bool AudioFilePlayer::LoadWave(AudioSampleSource* pPrepared)
+{
+    if (!pPrepared)
+        return false;
+
+    releaseWave();
+    pWave = pPrepared;
+    attachWave();
+
+    // A prefetched reader has normally done its first fill long before it is needed.
+    // Only wait (bounded) in the case where it was built moments ago.
+    for (uint8_t i=0; i<50 && !pWave->isBufferPrimed(); i++)
+        SleepMS(5);
+
+    return true;
+}
+
+bool AudioFilePlayer::LoadEmbedded(const EmbeddedClip& clip)
+{
+    if (!clip.samples || !clip.length || !clip.sampleRate)
+        return false;
+
+    releaseWave();
+    embeddedWave = WaveMemorySource(clip);
+    pWave = &embeddedWave;
+    attachWave();
+    return true;
+}
+
+bool AudioFilePlayer::LoadTone(const ToneStep* pSteps, uint8_t count, uint16_t repeats, uint32_t sampleRate)
+{
+    if (!pSteps || !count || !sampleRate)
+        return false;
+
+    releaseWave();
+    toneWave.setSampleRate(sampleRate);
+    toneWave.start(pSteps, count, repeats);
+    pWave = &toneWave;
+    attachWave();
+    return true;
+}
+
+bool AudioFilePlayer::LoadTone(const ToneStep& step, uint32_t sampleRate)
+{
+    if (!sampleRate)
+        return false;
+
+    releaseWave();
+    toneWave.setSampleRate(sampleRate);
+    toneWave.start(step);
+    pWave = &toneWave;
+    attachWave();
+    return true;
+}
+
+bool AudioFilePlayer::Interrupt(AudioSampleSource* pFront, DuckingMixer::Mode mode, bool bResume, uint8_t duckPercent,
+                                uint16_t frontGainQ8)
+{
+    if (!pFront || !pWave || pWave->isPlaybackComplete())
+        return false;
+
+    DuckingMixer* pMixer = nullptr;
+    for (auto& mixer: mixers) {
+        if (!mixer.isActive()) {
+            pMixer = &mixer;
+            break;
+        }
+    }
+    if (!pMixer)
+        return false;
+
+    // Same bounded wait as LoadWave() - a file needs its first fill, memory and tones don't.
+    for (uint8_t i=0; i<50 && !pFront->isBufferPrimed(); i++)
+        SleepMS(5);
 
 #ifdef ESP_PLATFORM
-    // // Setup the timer callback but don't enable it yet.
-    // HWTimer = timerBegin(timerNumber, PRESCALER, true);
-    // timerAttachInterrupt(HWTimer, &timerISRCallback, true);
-    timerAlarmWrite(HWTimer, taskSleepTimeTarget, true);
+    // Swap between two ticks so the ISR never works on half of each.
+    assert(HWTimer);
+    bool bRunning = timerAlarmEnabled(HWTimer);
+    if (bRunning)
+        timerAlarmDisable(HWTimer);
+    pMixer->begin(pWave, pFront, mode, bResume, duckPercent, clipGain, frontGainQ8);
+    pWave = pMixer;
+    SetClipGain(256);
+    if (bRunning)
+        timerAlarmEnable(HWTimer);
+#else
+    // The playout thread re-reads pWave on every sample, so it just carries on with the mixer.
+    // At most one sample goes out through the old table.
+    pMixer->begin(pWave, pFront, mode, bResume, duckPercent, clipGain, frontGainQ8);
+    pWave = pMixer;
+    SetClipGain(256);
 #endif
-
-    SleepMS(250);       // Need a little time for buffers to get set or we get static/noise
+    pLastMixer = pMixer;
+    bFinishPosted = false;
     return true;
 }
 
+uint8_t AudioFilePlayer::getInterruptDepth()
+{
+    uint8_t depth = 0;
+    for (auto& mixer: mixers) {
+        if (mixer.isActive() && mixer.isInterrupting())
+            depth++;
+    }
+    return depth;
+}
+
+bool AudioFilePlayer::SetLoop(uint16_t crossfadeMS)
+{
+    if (!pWave)
+        return false;
+
+    uint32_t startFrame, endFrame;
+    if (!pWave->getClipLoop(startFrame, endFrame))
+        startFrame = endFrame = 0;
+    return pWave->setLoop(startFrame, endFrame, (uint32_t)crossfadeMS * pWave->getSampleRate() / 1000);
+}
+
 void AudioFilePlayer::SetVolume(uint8_t _vol) {
     if (_vol > 100)
         curVolume = 100;
@@ -139,6 +392,11 @@ void AudioFilePlayer::SetVolume(uint8_t _vol) {
     calcDataTableBasedOnVolume();
 }
 
+void AudioFilePlayer::SetClipGain(uint16_t gainQ8) {
+    clipGain = gainQ8;
+    calcDataTableBasedOnVolume();
+}
+
 void AudioFilePlayer::printDataTable() {
 #ifdef ESP_PLATFORM
     Serial.printf("\n\nDataTable Lookup for Volume=%u\n", curVolume);
@@ -163,12 +421,13 @@ void AudioFilePlayer::printDataTable() {
 }
 
 void AudioFilePlayer::calcDataTableBasedOnVolume() {
-    int8_t sig1;
+    int32_t sig1;
 
 //    unsigned long st = micros();
 
     for (uint16_t i=0; i<=255; i++) {
-        sig1 = ((i-127) * curVolume / 100);
+        sig1 = ((int32_t)(i-127) * curVolume * clipGain / (100 * 256));
+        sig1 = sig1 > 127 ? 127 : (sig1 < -128 ? -128 : sig1);
         pDataTable[i] = sig1+128;
 //        Serial.printf("  At i=%3u, v.sig=%4d, output=%3u\n", i, v.sig, pDataTable[i]);
     }
@@ -212,12 +471,48 @@ void AudioFilePlayer::PlayFile()
 {
     assert(pWave);
 
+    bStartScheduled = false;
 #ifdef ESP_PLATFORM
     assert(HWTimer);
+    bFirstSamplePending = true;
     timerAlarmEnable(HWTimer);
 #else
+    bFirstSamplePending = true;
     Start();
 #endif
+    postEvent(AudioPlayerEvent::Started);
+}
+
+bool AudioFilePlayer::PlayAt(uint32_t startUS)
+{
+    if (!pWave)
+        return false;
+
+    // Pre-fill - normally long done by LoadFile()/LoadWave(). Give up at the deadline though.
+    while (!pWave->isBufferPrimed() && (int32_t)(startUS - getMicros()) > 1000)
+        SleepMS(1);
+
+    scheduledStartUS = startUS;
+    bStartScheduled = true;
+
+#ifdef ESP_PLATFORM
+    assert(HWTimer);
+    // The tick and micros() count from different clocks - let a tick a hair early count.
+    startToleranceUS = taskSleepTimeTarget / 2;
+    // Phase the timer so that, counting in whole sample periods, a tick falls on startUS. The
+    // ISR lets the ticks before it go by.
+    int32_t lead = (int32_t)(startUS - getMicros());
+    if (lead > 0)
+        timerWrite(HWTimer, taskSleepTimeTarget - lead % taskSleepTimeTarget);
+    bFirstSamplePending = true;
+    timerAlarmEnable(HWTimer);
+#else
+    startToleranceUS = 0;
+    bFirstSamplePending = true;
+    Start();
+#endif
+    postEvent(AudioPlayerEvent::Started);
+    return true;
 }
 
 void AudioFilePlayer::PauseFile()
@@ -231,18 +526,38 @@ void AudioFilePlayer::PauseFile()
 #else
     Pause();
 #endif
+    bStartScheduled = false;
+    postEvent(AudioPlayerEvent::Paused);
 }
 
 void AudioFilePlayer::Run()
 {
     static int32_t offsetSleep=0;
 
-    if (!pWave || isDonePlaying())
+    if (!pWave)
         return;
 
+    if (isDonePlaying()) {
+        if (!bFinishPosted) {
+            bFinishPosted = true;
+            postEvent(AudioPlayerEvent::Finished);
+        }
+        return;
+    }
+
 #ifdef ESP_PLATFORM
     assert("AudioFilePlayer::Run() - should not be here on ESP32."==nullptr);
 #else
+    if (holdForStart()) {
+        // Sleep most of the way to a PlayAt() deadline, then come round again to finish finely.
+        int32_t early = (int32_t)(scheduledStartUS - getMicros());
+        if (early > 2000)
+            std::this_thread::sleep_for(std::chrono::microseconds(early - 1000));
+        else
+            std::this_thread::yield();
+        return;
+    }
+
     static std::chrono::high_resolution_clock::time_point lastPT = std::chrono::high_resolution_clock::now();
     static std::chrono::high_resolution_clock::time_point curPT;
     std::chrono::duration<double, std::micro> span;
@@ -250,7 +565,11 @@ void AudioFilePlayer::Run()
     curPT = std::chrono::high_resolution_clock::now();
     span = curPT - lastPT;
 
-    pWave->advanceReadPointer();
+    if (!checkStarved()) {
+        // Nothing to write to natively, but the meter sees what the DAC would have been given.
+        meter.push(pDataTable[*pWave->getReadPointer()]);
+        sampleDone();
+    }
 
 #if 0
     if (span.count() > taskSleepTimeTarget*1.2 || span.count() < taskSleepTimeTarget*0.8) {
@@ -289,12 +608,23 @@ void AudioFilePlayer::Run()
 #ifdef ESP_PLATFORM
 void IRAM_ATTR AudioFilePlayer::timerISRCallback() {
   static uint8_t lastValue=0x7f;
-  static uint8_t* pDataLoc = nullptr;
+  static const uint8_t* pDataLoc = nullptr;
   static uint8_t dataVal;
 
     // Shouldn't happen that pWave is null if timers are all handled well when changing files.
     // However, should it happen, let's just exit.
-    if (!pWave || pWave->isPlaybackComplete())
+    if (!pWave)
+        return;
+
+    if (pWave->isPlaybackComplete()) {
+        if (!bFinishPosted) {
+            bFinishPosted = true;
+            postEvent(AudioPlayerEvent::Finished);
+        }
+        return;
+    }
+
+    if (holdForStart() || checkStarved())
         return;
 
     pDataLoc = pWave->getReadPointer();
@@ -305,6 +635,7 @@ void IRAM_ATTR AudioFilePlayer::timerISRCallback() {
     dataVal = *pDataLoc;
     dataVal = pDataTable[dataVal];
 //    dataVal = DataBasedOnVolume(dataVal);
+    meter.push(dataVal);
 
     // Don't send the same value to the DAC twice in a row.
     if (dataVal != lastValue) {
@@ -312,7 +643,7 @@ void IRAM_ATTR AudioFilePlayer::timerISRCallback() {
         lastValue = dataVal;
     }
 
-    pWave->advanceReadPointer();
+    sampleDone();
 
 }
 
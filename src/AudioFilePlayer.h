@@ -39,6 +39,12 @@
 
 #include "utils.h"
 #include "robotask.h"
+#include "LockFreeQueue.h"
+#include "AudioSampleSource.h"
+#include "WaveMemorySource.h"
+#include "ToneGenerator.h"
+#include "DuckingMixer.h"
+#include "AudioEventNotifier.h"
 
 /*! \class   AudioFilePlayer
  *  \brief   Support for playing and pausing a single file.
@@ -59,16 +65,108 @@ public:
     //! @brief This method causes the file header to be parsed and processed to be ready for playout.
     //! @return true on success or false if file could not be loaded/found/parsed.
     bool LoadFile(const char* fname);
+    /*! @brief Take ownership of an already-constructed source and make it ready for playout.
+     *  @details Skips the open/header/first-fill cost of LoadFile() when a reader was built ahead
+     *           of time (prefetch) or when the samples are already in memory (WaveMemorySource).
+     *  @return false if pPrepared is null.
+     */
+    bool LoadWave(AudioSampleSource* pPrepared);
+    /*! @brief Make a clip compiled into the program ready for playout.
+     *  @details The player plays straight from the const array through a source it keeps for the
+     *           purpose - no file, no thread and no allocation. Ready the moment this returns.
+     */
+    bool LoadEmbedded(const EmbeddedClip& clip);
+    /*! @brief Make a synthesized tone sequence ready for playout.
+     *  @details Like LoadEmbedded() there is nothing to open or fill - the samples are computed as
+     *           they are played. The steps are not copied and must outlive playback.
+     *  @param repeats - ToneGenerator::FOREVER plays until stopped.
+     */
+    bool LoadTone(const ToneStep* pSteps, uint8_t count, uint16_t repeats=1, uint32_t sampleRate=16000);
+    //! @brief A single beep. The step is copied.
+    bool LoadTone(const ToneStep& step, uint32_t sampleRate=16000);
     //! @brief Kick off the playout of the file.
     void PlayFile();
+    /*! @brief Start playout on the sample tick at startUS (getMicros() time) rather than now.
+     *  @details Waits for the reader's first fill (bounded by the deadline), then arms the output
+     *           and returns - it does not block until startUS. On the ESP32 the timer is phased so
+     *           one of its ticks lands on startUS; natively the playout thread sleeps up to it.
+     *           A deadline already past starts at once and shows up as a late start.
+     *  @see getLastStartErrorUS
+     */
+    bool PlayAt(uint32_t startUS);
+    //! @brief How far the first sample of the last PlayAt() was from its deadline - positive is late.
+    int32_t getLastStartErrorUS() { return lastStartErrorUS; };
+    /*! @brief Play pFront over whatever is playing now - for a sound that can't wait its turn.
+     *  @details What is playing is faded out (Preempt) or turned down to duckPercent under pFront
+     *           (Duck) from the next sample on. Once pFront is done it is faded back in (bResume)
+     *           or the output finishes and Finished is posted. Output isn't started here - a
+     *           loaded or paused player stays so until PlayFile(). An interruption may itself be
+     *           interrupted, up to MAX_INTERRUPTS deep. The clip gain moves into the mixer with
+     *           the interrupted source and the volume table goes to unity, so each plays at its
+     *           own gain. @see DuckingMixer
+     *  @param pFront - taken over (on success) and deleted with the source it interrupted.
+     *  @param frontGainQ8 - pFront's clip gain, as for SetClipGain().
+     *  @return false when nothing is loaded, the loaded source is done or it's too deep already.
+     */
+    bool Interrupt(AudioSampleSource* pFront, DuckingMixer::Mode mode, bool bResume, uint8_t duckPercent=20,
+                   uint16_t frontGainQ8=256);
+    //! @brief Interruptions whose front is still playing.
+    uint8_t getInterruptDepth();
+    //! @brief getMicros() when the latest interruption's first sample went out. 0 until it has.
+    uint32_t getInterruptStartUS() { return pLastMixer ? pLastMixer->getFrontStartUS() : 0; };
+    static const uint8_t MAX_INTERRUPTS = 2;
     //! @brief Pause playback. @todo this needs further testing
     void PauseFile();
     /*! @brief Attenuation of the signal in software. This does not control hardware.
      *  @param _vol is a range of 0-100 where 100 is a fully unmodified playout.
      */
     void SetVolume(uint8_t _vol);
+    /*! @brief Gain for the loaded file on top of SetVolume() - folded into the same table, so
+     *         it costs nothing per sample. Peaks beyond the DAC's range are clipped.
+     *         Loading a file goes back to unity, so set it after LoadFile()/LoadWave().
+     *  @param gainQ8 - 256 is unity, 128 is -6 dB, 512 is +6 dB.
+     */
+    void SetClipGain(uint16_t gainQ8);
+    uint16_t getClipGain() { return clipGain; };
     //! @brief Status of when the file is done being played fully.
     bool isDonePlaying();
+    /*! @brief Get called back on player events instead of polling isDonePlaying().
+     *  @details Events are posted from the timer ISR (ESP32) or the playout thread (native) through
+     *           a lock-free queue and delivered on the notifier thread within about a millisecond.
+     *  @param mask - OR of AudioPlayerEvent::maskOf() for the wanted types. All by default.
+     *  @return id for Unsubscribe() or -1 when there's no room for another subscriber.
+     */
+    int8_t Subscribe(AudioEventCallback callback, void* context=nullptr, uint16_t mask=AudioPlayerEvent::AllEvents) {
+        return notifier.Subscribe(callback, context, mask);
+    };
+    bool Unsubscribe(int8_t id) { return notifier.Unsubscribe(id); };
+    //! @brief Post PositionReached once this many samples of the loaded file have played. 0 disarms.
+    //!        Loading a file disarms it, so set it after LoadFile()/LoadWave().
+    void SetPositionMarker(uint32_t sampleNumber) { positionMarker = sampleNumber; };
+    //! @brief Buffer fullness (percent) below which BufferLow is posted. Default 25.
+    void SetBufferLowThreshold(uint8_t percent) { bufferLowPercent = percent; };
+    //! @brief Samples output since the current file was loaded.
+    uint32_t getSamplesPlayed() { return samplesPlayed; };
+    /*! @brief Move the loaded file's playback to ms from its start - before PlayFile() to start
+     *         part-way in, or while playing. @see AudioSampleSource::seekToFrame
+     */
+    bool SeekToTime(uint32_t ms) { return pWave && pWave->seekToTime(ms); };
+    //! @brief Where playback is in the loaded file, in milliseconds.
+    uint32_t getPositionMS() { return pWave ? pWave->getPositionMS() : 0; };
+    /*! @brief Peak, RMS and clip count of the latest block of output (after the volume table).
+     *  @details Lock-free - any thread, as often as wanted. Updated every LevelMeter::BLOCK_SIZE
+     *           samples, about a millisecond after the block has played.
+     *  @return false until the first block has been metered.
+     */
+    bool GetLevels(LevelSnapshot& levels) { return meter.getSnapshot(levels); };
+    /*! @brief Loop the loaded file until StopLooping() - the 'smpl' chunk's loop if it has one,
+     *         otherwise the whole file. Passes after the first play from memory with no gap.
+     *  @param crossfadeMS - optional - blend the loop end into its start over this long.
+     *  @see AudioSampleSource::setLoop
+     */
+    bool SetLoop(uint16_t crossfadeMS=0);
+    //! @brief Finish the current pass of the loop and play the rest of the file out.
+    void StopLooping() { if (pWave) pWave->stopLooping(); };
     //! @brief RoboTask's thread-based worker for native mode. In ESP32 mode, the ISR handles DAC writing.
     void Run();
     //! @brief Utility for inspecting what values will be used given a volume set via SetVolume()
@@ -78,8 +176,8 @@ public:
     //! @brief Interrupt service routine for ESP32 to control precise writing of DAC values.
     static void IRAM_ATTR timerISRCallback();
 #endif
-    //! @brief Base class instance for the loaded wave file to be processed/played
-    static WaveFileType* pWave;
+    //! @brief Base class instance for the loaded wave file (or in-memory clip) to be processed/played
+    static AudioSampleSource* pWave;
     //! @brief Holding place for the pin used as the DAC output.
     static uint8_t pinDAC;
 
@@ -94,8 +192,63 @@ protected:
     static uint8_t pDataTable[256];
     //! Holder for the current volume value.
     static uint8_t curVolume;
+    //! Per-file gain (Q8) applied with curVolume. @see SetClipGain
+    static uint16_t clipGain;
+    //! Player to subscriber notifications. Static so the ISR can reach it.
+    static LockFreeQueue<AudioPlayerEvent, 32> eventQueue;
+    //! Output levels. The output path pushes samples, the notifier thread meters them.
+    static LevelMeter meter;
+    //! Drains eventQueue and calls the subscribers.
+    AudioEventNotifier notifier;
+    //! Finished is posted once per loaded file.
+    static volatile bool bFinishPosted;
+    //! @name Output-path bookkeeping for the events
+    //!@{
+    static volatile uint32_t samplesPlayed;
+    static volatile uint32_t positionMarker;
+    static volatile bool bFirstSamplePending;
+    static volatile bool bBufferLowPosted;
+    static volatile bool bUnderrunPosted;
+    static volatile uint8_t bufferLowPercent;
+    //!@}
+    //! @name PlayAt() scheduling
+    //!@{
+    static volatile bool bStartScheduled;
+    static volatile uint32_t scheduledStartUS;
+    //! A tick this close ahead of the deadline is on it. Half a sample period on the ESP32.
+    static volatile uint32_t startToleranceUS;
+    static volatile int32_t lastStartErrorUS;
+    //!@}
+    //! @brief Queue an event. Never blocks - safe from the ISR.
+#ifdef ESP_PLATFORM
+    static void IRAM_ATTR postEvent(AudioPlayerEvent::Type type, uint32_t value=0);
+    //! @brief Step past the sample just output and post any events it triggers.
+    static void IRAM_ATTR sampleDone();
+    //! @brief True (and Underrun posted once) if the reader has nothing for us yet.
+    static bool IRAM_ATTR checkStarved();
+    //! @brief True while a PlayAt() deadline is still ahead. Records the start error once it isn't.
+    static bool IRAM_ATTR holdForStart();
+#else
+    static void postEvent(AudioPlayerEvent::Type type, uint32_t value=0);
+    static void sampleDone();
+    static bool checkStarved();
+    static bool holdForStart();
+#endif
     //! Worker for calculating `pDataTable[]` values once the volume is changed in SetVolume
     void calcDataTableBasedOnVolume();
+    //! Stop output and release any currently loaded wave ahead of loading another.
+    void releaseWave();
+    //! pWave points here while an embedded clip is loaded - it is never deleted.
+    WaveMemorySource embeddedWave;
+    //! pWave points here while a tone is loaded - it is never deleted either.
+    ToneGenerator toneWave;
+    //! pWave points at one of these while interrupted - they are never deleted, their sources are.
+    DuckingMixer mixers[MAX_INTERRUPTS];
+    DuckingMixer* pLastMixer;
+    //! @brief Delete a source unless it is one of the members above. Mixers pass it on to theirs.
+    void deleteSource(AudioSampleSource* pSource);
+    //! Timing setup once pWave is in place and its sample rate is known.
+    void attachWave();
 #ifdef ESP_PLATFORM
     //! Manage the hardware resource.
     void killTimer();
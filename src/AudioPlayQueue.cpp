@@ -0,0 +1,240 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "AudioPlayQueue.h"
+
+#include <algorithm>
+
+AudioPlayQueue::AudioPlayQueue(uint32_t seed)
+{
+    mode = Shuffle;
+    entryCount = 0;
+    requestedWindow = 1;
+    noRepeatWindow = 0;
+    seqCursor = 0;
+    orderCursor = 0;
+    bWeightsDirty = true;
+
+    if (!seed) {
+#ifdef ESP_PLATFORM
+        seed = esp_random();
+#else
+        seed = (uint32_t)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+#endif
+    }
+    prng.Seed(seed);
+}
+
+void AudioPlayQueue::SetEntryCount(uint32_t count)
+{
+    entryCount = count;
+    weights.assign(count, 1);
+    bWeightsDirty = true;
+    order.clear();
+    orderCursor = 0;
+    seqCursor = 0;
+    recent.clear();
+    upcoming.clear();
+    applyWindow();
+}
+
+void AudioPlayQueue::SetMode(Mode _mode)
+{
+    mode = _mode;
+    Reset();
+}
+
+void AudioPlayQueue::Seed(uint32_t seed)
+{
+    prng.Seed(seed);
+    Reset();
+}
+
+void AudioPlayQueue::SetNoRepeatWindow(uint32_t window)
+{
+    requestedWindow = window;
+    applyWindow();
+}
+
+void AudioPlayQueue::applyWindow()
+{
+    noRepeatWindow = std::min<uint32_t>(requestedWindow, entryCount ? entryCount - 1 : 0);
+    while (recent.size() > noRepeatWindow)
+        recent.pop_front();
+}
+
+void AudioPlayQueue::SetWeight(uint32_t entryNum, uint8_t weight)
+{
+    if (entryNum >= entryCount)
+        return;
+
+    weights[entryNum] = weight;
+    bWeightsDirty = true;
+
+    // Anything already decided was decided on the old weights.
+    if (mode == Weighted)
+        upcoming.clear();
+}
+
+void AudioPlayQueue::Reset()
+{
+    upcoming.clear();
+    order.clear();
+    orderCursor = 0;
+}
+
+int32_t AudioPlayQueue::Next()
+{
+    if (!entryCount)
+        return -1;
+
+    if (upcoming.empty())
+        decideOne();
+
+    int32_t entry = upcoming.front();
+    upcoming.pop_front();
+    return entry;
+}
+
+int32_t AudioPlayQueue::Peek(uint16_t ahead)
+{
+    if (!entryCount || ahead >= MAX_LOOKAHEAD)
+        return -1;
+
+    while (upcoming.size() <= ahead)
+        decideOne();
+
+    return upcoming[ahead];
+}
+
+void AudioPlayQueue::decideOne()
+{
+    int32_t entry;
+
+    if (mode == Sequential)
+        entry = nextSequential();
+    else if (mode == Shuffle)
+        entry = nextShuffle();
+    else
+        entry = nextWeighted();
+
+    if (entry >= 0)
+        noteChosen(entry);
+
+    upcoming.push_back(entry);
+}
+
+int32_t AudioPlayQueue::nextSequential()
+{
+    if (seqCursor >= entryCount)
+        seqCursor = 0;
+
+    return seqCursor++;
+}
+
+int32_t AudioPlayQueue::nextShuffle()
+{
+    if (orderCursor >= order.size())
+        reshuffle();
+
+    return order[orderCursor++];
+}
+
+//
+// Fisher-Yates the whole list, then walk the head of the new pass and swap out anything
+// that was played within the no-repeat window at the tail of the previous pass.
+//
+void AudioPlayQueue::reshuffle()
+{
+    order.resize(entryCount);
+    for (uint32_t i=0; i<entryCount; i++)
+        order[i] = i;
+
+    for (uint32_t i=entryCount-1; i>0; i--) {
+        uint32_t j = prng.Below(i+1);
+        std::swap(order[i], order[j]);
+    }
+
+    uint32_t window = noRepeatWindow;
+    for (uint32_t i=0; i<window && i<entryCount; i++) {
+        if (!isRecent(order[i]))
+            continue;
+
+        // Find a replacement further into the pass which is not recent.
+        for (uint32_t j=window; j<entryCount; j++) {
+            if (!isRecent(order[j])) {
+                std::swap(order[i], order[j]);
+                break;
+            }
+        }
+    }
+
+    orderCursor = 0;
+}
+
+int32_t AudioPlayQueue::nextWeighted()
+{
+    if (bWeightsDirty) {
+        uint32_t sum = 0;
+        cumulative.resize(entryCount);
+        for (uint32_t i=0; i<entryCount; i++) {
+            sum += weights[i];
+            cumulative[i] = sum;
+        }
+        bWeightsDirty = false;
+    }
+
+    uint32_t total = cumulative.empty() ? 0 : cumulative.back();
+    if (!total)
+        return -1;
+
+    // A few redraws to honor the no-repeat window. Heavily skewed weights may not allow it.
+    int32_t entry = -1;
+    for (uint8_t tries=0; tries<8; tries++) {
+        uint32_t pick = prng.Below(total);
+        entry = std::upper_bound(cumulative.begin(), cumulative.end(), pick) - cumulative.begin();
+        if (!isRecent(entry))
+            break;
+    }
+
+    return entry;
+}
+
+bool AudioPlayQueue::isRecent(uint32_t entryNum)
+{
+    return std::find(recent.begin(), recent.end(), entryNum) != recent.end();
+}
+
+void AudioPlayQueue::noteChosen(uint32_t entryNum)
+{
+    if (!noRepeatWindow)
+        return;
+
+    recent.push_back(entryNum);
+    while (recent.size() > noRepeatWindow)
+        recent.pop_front();
+}
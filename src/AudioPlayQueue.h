@@ -0,0 +1,109 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+
+#include "utils.h"
+
+#include <vector>
+#include <deque>
+
+/*! @class   AudioPlayQueue
+ *  @brief   Decides which playlist entry plays next.
+ *  @details The queue only deals in entry numbers - it knows nothing about files. Modes:
+ *           - Sequential: 0, 1, 2 ... and wraps around.
+ *           - Shuffle: Fisher-Yates permutation of all entries. Each entry plays once per pass and
+ *             the no-repeat window keeps the start of a new pass from repeating the end of the last.
+ *           - Weighted: each entry is drawn with a probability proportional to its weight.
+ *             The no-repeat window is honored when the weights allow it.
+ *
+ *           Upcoming entries are decided ahead of time and held in a short lookahead list.
+ *           That lets Peek() report the real future order so the playlist manager can prefetch
+ *           the next few files, and Next() will hand out exactly what Peek() promised.
+ */
+class AudioPlayQueue
+{
+public:
+    //! @enum Ordering used when choosing the next entry.
+    enum Mode { Sequential, Shuffle, Weighted };
+
+    //! @brief A seed of zero picks up a seed from the system clock/hardware.
+    AudioPlayQueue(uint32_t seed=0);
+    //! @brief Number of entries in the playlist. Resets the order and weights.
+    void SetEntryCount(uint32_t count);
+    //! @brief Change modes. Resets the lookahead so the new mode takes effect immediately.
+    void SetMode(Mode _mode);
+    Mode getMode() { return mode; };
+    //! @brief Re-seed the PRNG for repeatable orders (testing, synchronized units).
+    void Seed(uint32_t seed);
+    //! @brief How many of the most recently chosen entries may not be chosen again.
+    //!        Clamped to count-1 so a pass can always complete - again whenever the count changes.
+    void SetNoRepeatWindow(uint32_t window);
+    //! @brief Relative weight for an entry in Weighted mode. Zero means never chosen.
+    void SetWeight(uint32_t entryNum, uint8_t weight);
+    //! @brief Consume and return the next entry or -1 if the queue is empty.
+    int32_t Next();
+    //! @brief Look ahead without consuming. Peek(0) is what Next() will return.
+    //! @return -1 when empty or when 'ahead' is beyond the lookahead limit.
+    int32_t Peek(uint16_t ahead);
+    //! @brief Forget any decided-but-not-played entries.
+    void Reset();
+
+    //! Maximum number of entries which can be decided ahead of time.
+    static const uint8_t MAX_LOOKAHEAD = 8;
+
+protected:
+    //! @brief Decide one more entry and append it to the lookahead.
+    void decideOne();
+    int32_t nextSequential();
+    int32_t nextShuffle();
+    int32_t nextWeighted();
+    void reshuffle();
+    bool isRecent(uint32_t entryNum);
+    void noteChosen(uint32_t entryNum);
+    //! @brief Clamp the requested window to the entry count and trim the recent list to it.
+    void applyWindow();
+
+    Mode mode;
+    FastRand prng;
+    uint32_t entryCount;
+    //! As set, and as clamped to the entry count.
+    uint32_t requestedWindow;
+    uint32_t noRepeatWindow;
+    uint32_t seqCursor;
+    //! Current shuffle pass and position within it.
+    std::vector<uint32_t> order;
+    uint32_t orderCursor;
+    //! Weights and their running sum for Weighted mode.
+    std::vector<uint8_t> weights;
+    std::vector<uint32_t> cumulative;
+    bool bWeightsDirty;
+    //! Most recent choices - newest at the back. Never longer than noRepeatWindow.
+    std::deque<uint32_t> recent;
+    //! Decided entries not yet consumed by Next().
+    std::deque<int32_t> upcoming;
+};
@@ -27,94 +27,738 @@
 //
 #include "AudioPlaylistManager.h"
 
+#include <algorithm>
+#include <math.h>
+
 AudioPlaylistManager::AudioPlaylistManager(uint8_t esp32Timer, uint8_t esp32Pin, const char* _initLoc, uint8_t _ampControlPin, bool _onPinHigh)
+    : amp(_ampControlPin, _onPinHigh)
 {
     assert(esp32Timer < 4);
     assert(esp32Pin < 40 && esp32Pin > 0);
-    
-    ClearFileList();
-    if (_initLoc) {
-        AddFilesFrom(_initLoc);
-    }
+
+    files = std::make_shared<const FileList>();
+    std::atomic_store(&publishedFiles, files);
+    banks = std::make_shared<const BankList>();
+    std::atomic_store(&publishedBanks, banks);
+    scanGeneration = 0;
+    scansPending = 0;
+    scanFound = 0;
+    scanErrors = 0;
+    bScanning = false;
+    bScanFailed = false;
+    scanPublished = 0;
+#ifndef ESP_PLATFORM
+    scanDir = nullptr;
+#endif
 
     pAFP = make_unique<AudioFilePlayer>(esp32Timer, esp32Pin);
     assert(pAFP);
+    pAFP->Subscribe(&AudioPlaylistManager::onPlayerEvent, this,
+                    AudioPlayerEvent::maskOf(AudioPlayerEvent::Loaded) | AudioPlayerEvent::maskOf(AudioPlayerEvent::Started)
+                    | AudioPlayerEvent::maskOf(AudioPlayerEvent::Finished));
 
-    ampPowerPin = _ampControlPin;
-    ampPowerPinHigh = _onPinHigh;
-#ifdef ESP_PLATFORM
-    if (ampPowerPin) {
-        pinMode(ampPowerPin, OUTPUT);
-    }
-
-    SetAmpPower(false);
-#endif
-
+    bPlayWhenAmpReady = false;
     entryNumberForIntro = -1;
     entryNumberToPlay = -1;
+    pEmbeddedToPlay = nullptr;
+    pTonesToPlay = nullptr;
+    toneCount = 0;
+    toneRepeats = 1;
+    bScheduledStart = false;
+    scheduledStartUS = 0;
+    prefetchDepth = 1;
+    introSampleRate = 0;
+    introFinishedUS = 0;
+    bAwaitingLoaded = false;
+    bIntroGapPending = false;
+    lastIntroGapUS = 0;
+    commandsQueued = 0;
+    commandsProcessed = 0;
+    requestPolicy = DropWhileBusy;
+    requestPolicyParam = 0;
+    pendingHead = 0;
+    pendingCount = 0;
+    lastAdmittedUS = 0;
+    bHaveAdmitted = false;
+    requestsReceived = 0;
+    requestsStarted = 0;
+    requestsCoalesced = 0;
+    requestsDropped = 0;
+    requestsPreempted = 0;
+    preemptPolicy = PreemptAndResume;
+    duckPercent = 20;
+    curPriority = 0;
+    interruptDepth = 0;
+    preemptRequestUS = 0;
+    loudnessNext = 0;
+    loudnessMeasured = 0;
+    loudnessFailed = 0;
+    loudnessTarget = -1800;
+    bTrimSilence = true;
+
+#ifdef ESP_PLATFORM
+    seedrand(esp_random());
+#else
+    seedrand((uint32_t)std::chrono::high_resolution_clock::now().time_since_epoch().count());
+#endif
 
     curState = Idle;
+    adoptFileList();
+
+    pScanner = make_unique<ScanTask>(*this);
+    // Measuring is mostly decoding, so one worker per core. They sit idle once the list is measured.
+#ifdef ESP_PLATFORM
+    for (int i=0; i<2; i++)
+        loudnessWorkers.push_back(make_unique<LoudnessTask>(*this, 4096));
+#else
+    unsigned int cores = std::thread::hardware_concurrency();
+    for (unsigned int i=0; i<(cores ? (cores < 4 ? cores : 4) : 1); i++)
+        loudnessWorkers.push_back(make_unique<LoudnessTask>(*this, ROBOSTACKSIZE));
+#endif
+    if (_initLoc) {
+        AddFilesFrom(_initLoc);
+    }
+    // Events are drained every pass so keep the pass short. Each pass is just a queue check when idle.
+    setBaseRunDelay(2);
     Start();
 }
 
-void AudioPlaylistManager::PlayRandomEntry()
+bool AudioPlaylistManager::postCommand(PlaylistCommand::Type type, int32_t value, const char* name, uint32_t param,
+                                       const EmbeddedClip* pClip, const ToneStep* pSteps, uint32_t timeUS,
+                                       uint8_t priority)
+{
+    PlaylistCommand cmd;
+
+    cmd.type = type;
+    cmd.value = value;
+    cmd.param = param;
+    cmd.pClip = pClip;
+    cmd.pSteps = pSteps;
+    cmd.timeUS = timeUS;
+    cmd.priority = priority;
+    cmd.postedUS = getMicros();
+    cmd.name[0] = '\0';
+    if (name) {
+        if (strlen(name) >= sizeof(cmd.name)) {
+            PrintLN("APM: name too long for the command queue. Ignored.");
+            return false;
+        }
+        strcpy(cmd.name, name);
+    }
+
+    if (!commandQueue.push(cmd))
+        return false;
+
+    commandsQueued.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool AudioPlaylistManager::PlayRandomEntry()
+{
+    return postCommand(PlaylistCommand::PlayRandom);
+}
+
+bool AudioPlaylistManager::PlayNextEntry()
+{
+    return postCommand(PlaylistCommand::PlayNext);
+}
+
+bool AudioPlaylistManager::SetQueueMode(AudioPlayQueue::Mode _mode)
+{
+    return postCommand(PlaylistCommand::QueueMode, _mode);
+}
+
+bool AudioPlaylistManager::SetPrefetchDepth(uint8_t depth)
+{
+    return postCommand(PlaylistCommand::PrefetchDepth, depth);
+}
+
+bool AudioPlaylistManager::SetIntroSoundIndex(uint32_t entryNum)
+{
+    return postCommand(PlaylistCommand::IntroIndex, entryNum);
+}
+
+bool AudioPlaylistManager::SetIntroSoundName(const char* fname)
+{
+    return fname && postCommand(PlaylistCommand::IntroName, 0, fname);
+}
+
+bool AudioPlaylistManager::PlayEntryIndex(uint32_t entryNum, uint8_t priority)
+{
+    return postCommand(PlaylistCommand::PlayIndex, entryNum, nullptr, 0, nullptr, nullptr, 0, priority);
+}
+
+bool AudioPlaylistManager::PlayEntryIndexAt(uint32_t entryNum, uint32_t startUS)
+{
+    return postCommand(PlaylistCommand::PlayIndexAt, entryNum, nullptr, 0, nullptr, nullptr, startUS);
+}
+
+bool AudioPlaylistManager::PlayEntryName(const char* fname, uint8_t priority)
+{
+    return fname && postCommand(PlaylistCommand::PlayName, 0, fname, 0, nullptr, nullptr, 0, priority);
+}
+
+bool AudioPlaylistManager::PlayEmbedded(const EmbeddedClip& clip, uint8_t priority)
+{
+    return postCommand(PlaylistCommand::PlayEmbedded, 0, nullptr, 0, &clip, nullptr, 0, priority);
+}
+
+bool AudioPlaylistManager::PlayTone(const ToneStep* pSteps, uint8_t count, uint16_t repeats, uint8_t priority)
+{
+    return pSteps && count && postCommand(PlaylistCommand::PlayTone, count, nullptr, repeats, nullptr, pSteps, 0, priority);
+}
+
+bool AudioPlaylistManager::Play()
+{
+    return postCommand(PlaylistCommand::Play);
+}
+
+bool AudioPlaylistManager::Pause()
+{
+    return postCommand(PlaylistCommand::Pause);
+}
+
+bool AudioPlaylistManager::SetVolume(uint8_t _vol)
+{
+    return postCommand(PlaylistCommand::Volume, _vol);
+}
+
+bool AudioPlaylistManager::SetAmpTiming(uint32_t warmUpMS, uint32_t idleOffMS)
+{
+    // The value is signed - the warm-up goes through as its bit pattern and comes back out whole.
+    return postCommand(PlaylistCommand::AmpTiming, (int32_t)warmUpMS, nullptr, idleOffMS);
+}
+
+bool AudioPlaylistManager::SetRequestPolicy(RequestPolicy policy, uint16_t param)
+{
+    return postCommand(PlaylistCommand::Policy, policy, nullptr, param);
+}
+
+bool AudioPlaylistManager::SetPreemptPolicy(PreemptPolicy policy, uint8_t percent)
+{
+    return postCommand(PlaylistCommand::Preempt, policy, nullptr, percent);
+}
+
+bool AudioPlaylistManager::SetLoudnessTarget(int8_t lufs)
+{
+    return postCommand(PlaylistCommand::LoudnessTarget, lufs);
+}
+
+bool AudioPlaylistManager::SetSilenceTrim(bool bEnable)
+{
+    return postCommand(PlaylistCommand::SilenceTrim, bEnable);
+}
+
+
+void AudioPlaylistManager::executeCommand(const PlaylistCommand& cmd)
+{
+    switch (cmd.type) {
+    case PlaylistCommand::PlayRandom:    doPlayRandomEntry(); break;
+    case PlaylistCommand::PlayNext:      doPlayNextEntry(); break;
+    case PlaylistCommand::PlayIndex:     doPlayEntryIndex(cmd.value); break;
+    case PlaylistCommand::PlayIndexAt:   doPlayEntryIndexAt(cmd.value, cmd.timeUS); break;
+    case PlaylistCommand::PlayName:      doPlayEntryName(cmd.name); break;
+    case PlaylistCommand::PlayEmbedded:  doPlayEmbedded(cmd.pClip); break;
+    case PlaylistCommand::PlayTone:      doPlayTone(cmd.pSteps, cmd.value, cmd.param); break;
+    case PlaylistCommand::IntroIndex:    doSetIntroSoundIndex(cmd.value); break;
+    case PlaylistCommand::IntroName:     doSetIntroSoundName(cmd.name); break;
+    case PlaylistCommand::Play:          doPlay(); break;
+    case PlaylistCommand::Pause:         doPause(); break;
+    case PlaylistCommand::Volume:        doSetVolume(cmd.value); break;
+    case PlaylistCommand::QueueMode:     doSetQueueMode((AudioPlayQueue::Mode)cmd.value); break;
+    case PlaylistCommand::PrefetchDepth: doSetPrefetchDepth(cmd.value); break;
+    case PlaylistCommand::Policy:        doSetRequestPolicy((RequestPolicy)cmd.value, cmd.param); break;
+    case PlaylistCommand::AmpTiming:     doSetAmpTiming((uint32_t)cmd.value, cmd.param); break;
+    case PlaylistCommand::LoudnessTarget: doSetLoudnessTarget(cmd.value); break;
+    case PlaylistCommand::SilenceTrim:   doSetSilenceTrim(cmd.value); break;
+    case PlaylistCommand::Preempt:       doSetPreemptPolicy((PreemptPolicy)cmd.value, cmd.param); break;
+    }
+
+    commandsProcessed.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool AudioPlaylistManager::isPlayRequest(const PlaylistCommand& cmd)
+{
+    return cmd.type == PlaylistCommand::PlayRandom || cmd.type == PlaylistCommand::PlayNext
+        || cmd.type == PlaylistCommand::PlayIndex  || cmd.type == PlaylistCommand::PlayName
+        || cmd.type == PlaylistCommand::PlayEmbedded || cmd.type == PlaylistCommand::PlayTone
+        || cmd.type == PlaylistCommand::PlayIndexAt;
+}
+
+void AudioPlaylistManager::admitPlayRequest(const PlaylistCommand& cmd)
+{
+    bool bReplaceNewest = false;
+
+    requestsReceived.fetch_add(1, std::memory_order_relaxed);
+    // Nothing below opens a file - a refused request costs a counter bump and nothing else.
+    commandsProcessed.fetch_add(1, std::memory_order_relaxed);
+
+    if (preemptWith(cmd)) {
+        requestsStarted.fetch_add(1, std::memory_order_relaxed);
+        requestsPreempted.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    switch (requestPolicy) {
+    case DropWhileBusy:
+        if (curState != Idle || pendingCount) {
+            requestsDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        break;
+    case LatestWins:
+        bReplaceNewest = true;
+        break;
+    case QueueUpToN:
+        if (pendingCount >= requestPolicyParam) {
+            requestsDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        break;
+    case MinInterval:
+        if (bHaveAdmitted && getMicros() - lastAdmittedUS < (uint32_t)requestPolicyParam * 1000) {
+            requestsCoalesced.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        bReplaceNewest = true;
+        break;
+    }
+
+    lastAdmittedUS = getMicros();
+    bHaveAdmitted = true;
+
+    if (bReplaceNewest && pendingCount) {
+        pendingPlays[(pendingHead + pendingCount - 1) % MAX_PENDING_PLAYS] = cmd;
+        requestsCoalesced.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    pendingPlays[(pendingHead + pendingCount) % MAX_PENDING_PLAYS] = cmd;
+    pendingCount++;
+}
+
+void AudioPlaylistManager::startPendingPlay()
+{
+    if (curState != Idle || !pendingCount)
+        return;
+
+    PlaylistCommand& head = pendingPlays[pendingHead];
+    if (head.type == PlaylistCommand::PlayName && files->find(head.name) < 0) {
+        // Hold on until the scan has indexed it - and only give up once the scan is complete.
+        if (!isScanComplete())
+            return;
+        adoptFileList();
+    }
+
+    PlaylistCommand cmd = head;
+    pendingHead = (pendingHead + 1) % MAX_PENDING_PLAYS;
+    pendingCount--;
+
+    requestsStarted.fetch_add(1, std::memory_order_relaxed);
+    curPriority = cmd.priority;
+    switch (cmd.type) {
+    case PlaylistCommand::PlayRandom:    doPlayRandomEntry(); break;
+    case PlaylistCommand::PlayNext:      doPlayNextEntry(); break;
+    case PlaylistCommand::PlayIndex:     doPlayEntryIndex(cmd.value); break;
+    case PlaylistCommand::PlayName:      doPlayEntryName(cmd.name); break;
+    case PlaylistCommand::PlayEmbedded:  doPlayEmbedded(cmd.pClip); break;
+    case PlaylistCommand::PlayTone:      doPlayTone(cmd.pSteps, cmd.value, cmd.param); break;
+    case PlaylistCommand::PlayIndexAt:   doPlayEntryIndexAt(cmd.value, cmd.timeUS); break;
+    default: break;
+    }
+}
+
+bool AudioPlaylistManager::preemptWith(const PlaylistCommand& cmd)
+{
+    if (cmd.priority <= curPriority || (curState != PlayingIntro && curState != PlayingSound)
+        || bAwaitingLoaded || interruptDepth >= AudioFilePlayer::MAX_INTERRUPTS)
+        return false;
+
+    // The interrupting sound is opened here rather than loaded - the player keeps what it has.
+    AudioSampleSource* pFront = nullptr;
+    int32_t entryNum = -1;
+    switch (cmd.type) {
+    case PlaylistCommand::PlayEmbedded:
+        pFront = new WaveMemorySource(*cmd.pClip);
+        break;
+    case PlaylistCommand::PlayTone: {
+        // At the output rate, so the mixer has nothing to step.
+        ToneGenerator* pTone = new ToneGenerator(pAFP->pWave->getSampleRate());
+        pTone->start(cmd.pSteps, cmd.value, cmd.param);
+        pFront = pTone;
+        break;
+    }
+    case PlaylistCommand::PlayIndex:
+        entryNum = cmd.value >= 0 && cmd.value < (int32_t)files->size() ? cmd.value : -1;
+        break;
+    case PlaylistCommand::PlayName:
+        entryNum = files->find(cmd.name);
+        break;
+    default:
+        return false;
+    }
+    if (entryNum != -1)
+        pFront = takeEntry(entryNum);
+    if (!pFront)
+        return false;
+
+    bool bResume = preemptPolicy == PreemptAndResume || preemptPolicy == DuckAndResume;
+    DuckingMixer::Mode mode = (preemptPolicy == DuckAndResume || preemptPolicy == DuckAndDrop) ? DuckingMixer::Duck : DuckingMixer::Preempt;
+    // Embedded clips and tones play at unity, entries at their own normalization gain.
+    if (!pAFP->Interrupt(pFront, mode, bResume, duckPercent, entryNum != -1 ? loudnessGain(entryNum) : 256)) {
+        delete pFront;
+        return false;
+    }
+
+    interruptedPriority[interruptDepth++] = curPriority;
+    curPriority = cmd.priority;
+    preemptRequestUS = cmd.postedUS;
+    if (!bResume) {
+        // The clip is gone, and so is anything the intro was leading up to.
+        curState = PlayingSound;
+        bIntroGapPending = false;
+    }
+
+    // A paused or still warming-up player starts with it like any other play.
+    amp.Request();
+    startPlayback();
+    return true;
+}
+
+void AudioPlaylistManager::doSetPreemptPolicy(PreemptPolicy policy, uint8_t percent)
+{
+    preemptPolicy = policy;
+    duckPercent = percent > 100 ? 100 : percent;
+}
+
+void AudioPlaylistManager::doSetRequestPolicy(RequestPolicy policy, uint16_t param)
+{
+    requestPolicy = policy;
+    if (policy == QueueUpToN)
+        requestPolicyParam = param < 1 ? 1 : (param > MAX_PENDING_PLAYS ? MAX_PENDING_PLAYS : param);
+    else
+        requestPolicyParam = param;
+
+    // Whatever is waiting beyond what the new policy allows goes away.
+    uint8_t keep = policy == QueueUpToN ? requestPolicyParam : 1;
+    if (pendingCount > keep) {
+        requestsDropped.fetch_add(pendingCount - keep, std::memory_order_relaxed);
+        // A queue keeps its oldest, as if the rest had been refused. Latest-wins keeps the newest.
+        if (policy != QueueUpToN)
+            pendingHead = (pendingHead + pendingCount - keep) % MAX_PENDING_PLAYS;
+        pendingCount = keep;
+    }
+    bHaveAdmitted = false;
+}
+
+void AudioPlaylistManager::doSetAmpTiming(uint32_t warmUpMS, uint32_t idleOffMS)
+{
+    amp.SetWarmUpMS(warmUpMS);
+    amp.SetIdleOffMS(idleOffMS);
+}
+
+void AudioPlaylistManager::doSetLoudnessTarget(int8_t lufs)
+{
+    loudnessTarget = lufs ? lufs * 100 : FileNameArena::NO_LOUDNESS;
+}
+
+void AudioPlaylistManager::doSetSilenceTrim(bool bEnable)
+{
+    bTrimSilence = bEnable;
+    // Readers already built were trimmed (or not) the old way.
+    flushPrefetch();
+}
+
+void AudioPlaylistManager::doPlayRandomEntry()
 {
     assert(pAFP);
 
-    if (filenames.size()) {
-        int16_t entry = getrand(0, filenames.size()-1);
-        PlayEntryIndex(entry);
+    if (files->size()) {
+        int32_t entry = getrand(0, (int32_t)files->size()-1);
+        doPlayEntryIndex(entry);
+    }
+}
+
+void AudioPlaylistManager::doPlayNextEntry()
+{
+    int32_t entry = playQueue.Next();
+
+    if (entry < 0)
+        return;
+
+    doPlayEntryIndex(entry);
+    refillPrefetch();
+}
+
+void AudioPlaylistManager::doSetQueueMode(AudioPlayQueue::Mode _mode)
+{
+    playQueue.SetMode(_mode);
+    flushPrefetch();
+}
+
+void AudioPlaylistManager::doSetPrefetchDepth(uint8_t depth)
+{
+    prefetchDepth = depth < AudioPlayQueue::MAX_LOOKAHEAD ? depth : AudioPlayQueue::MAX_LOOKAHEAD;
+    refillPrefetch();
+}
+
+void AudioPlaylistManager::flushPrefetch()
+{
+    prefetched.clear();
+}
+
+void AudioPlaylistManager::refillPrefetch()
+{
+    std::vector<int32_t> wanted;
+
+    for (uint8_t i=0; i<prefetchDepth; i++) {
+        int32_t entry = playQueue.Peek(i);
+        if (entry >= 0 && entry < (int32_t)files->size())
+            wanted.push_back(entry);
+    }
+
+    // Drop anything which is no longer coming up. The main clip being primed while the intro
+    // plays is coming up too, even though the queue has already moved past it.
+    for (auto it=prefetched.begin(); it!=prefetched.end(); ) {
+        if (std::find(wanted.begin(), wanted.end(), it->entryNum) == wanted.end()
+            && !(curState == PlayingIntro && it->entryNum == entryNumberToPlay))
+            it = prefetched.erase(it);
+        else
+            it++;
+    }
+
+    for (auto entry: wanted)
+        prefetchEntry(entry);
+}
+
+bool AudioPlaylistManager::prefetchEntry(int32_t entryNum)
+{
+    for (auto& slot: prefetched) {
+        if (slot.entryNum == entryNum)
+            return true;
+    }
+
+    PrefetchSlot slot;
+    slot.entryNum = entryNum;
+    slot.pWave.reset(openEntry(entryNum));
+    if (!slot.pWave) {
+        PrintLN("Prefetch: unable to open upcoming entry. It will be loaded normally.");
+        return false;
+    }
+    prefetched.push_back(std::move(slot));
+    return true;
+}
+
+bool AudioPlaylistManager::loadEntry(int32_t entryNum)
+{
+    AudioSampleSource* pWave = takeEntry(entryNum);
+    if (!pWave) {
+        PrintLN("loadEntry: unable to open the entry.");
+        return false;
     }
+
+    bAwaitingLoaded = true;
+    pAFP->LoadWave(pWave);
+    applyLoudnessGain(entryNum);
+    return true;
 }
 
-void AudioPlaylistManager::SetIntroSoundIndex(uint16_t entryNum)
+AudioSampleSource* AudioPlaylistManager::takeEntry(int32_t entryNum)
 {
-    if (entryNum < filenames.size()) {
-        entryNumberToPlay = entryNum;
+    for (auto it=prefetched.begin(); it!=prefetched.end(); it++) {
+        if (it->entryNum == entryNum) {
+            AudioSampleSource* pWave = it->pWave.release();
+            prefetched.erase(it);
+            return pWave;
+        }
+    }
+
+    return openEntry(entryNum);
+}
+
+AudioSampleSource* AudioPlaylistManager::openEntry(int32_t entryNum)
+{
+    AudioSampleSource* pWave = nullptr;
+
+    try {
+        int32_t clip;
+        std::shared_ptr<const ClipBank> bank = findBank(entryNum, clip);
+        if (bank)
+            pWave = ClipBank::openClip(bank, clip);
+        else
+            pWave = new WaveFileType(files->getPath(entryNum).c_str());
+    } catch(...) {
+        return nullptr;
     }
+    if (pWave)
+        applyTrim(pWave, entryNum);
+    return pWave;
 }
 
-void AudioPlaylistManager::SetIntroSoundName(const char* fname)
+void AudioPlaylistManager::applyTrim(AudioSampleSource* pWave, int32_t entryNum)
+{
+    if (!bTrimSilence || entryNum < 0 || entryNum >= (int32_t)files->size())
+        return;
+
+    uint16_t leadMS = files->getLeadTrimMS(entryNum);
+    uint16_t tailMS = files->getTailTrimMS(entryNum);
+    uint32_t total = pWave->getTotalFrames();
+    if ((!leadMS && !tailMS) || !total)
+        return;
+
+    uint32_t rate = pWave->getSampleRate();
+    uint32_t start = (uint64_t)leadMS * rate / 1000;
+    uint32_t tail = (uint64_t)tailMS * rate / 1000;
+    if (start + tail < total)
+        pWave->setPlayRange(start, total - tail);
+}
+
+uint16_t AudioPlaylistManager::loudnessGain(int32_t entryNum)
+{
+    if (loudnessTarget == FileNameArena::NO_LOUDNESS || entryNum < 0 || entryNum >= (int32_t)files->size()
+        || files->getLoudness(entryNum) == FileNameArena::NO_LOUDNESS)
+        return 256;
+
+    // Hundredths of a dB.
+    int32_t gain = loudnessTarget - files->getLoudness(entryNum);
+    gain = gain > 1200 ? 1200 : (gain < -3000 ? -3000 : gain);
+    float linear = powf(10.0f, gain / 2000.0f);
+    uint8_t peak = files->getPeak(entryNum);
+    if (peak && linear * peak > 128)
+        linear = 128.0f / peak;
+    return (uint16_t)lroundf(linear * 256);
+}
+
+void AudioPlaylistManager::applyLoudnessGain(int32_t entryNum)
+{
+    // Loading reset the player to unity - that stands unless there's a measurement to go on.
+    uint16_t gain = loudnessGain(entryNum);
+    if (gain != 256)
+        pAFP->SetClipGain(gain);
+}
+
+void AudioPlaylistManager::doSetIntroSoundIndex(uint32_t entryNum)
+{
+    if (entryNum < files->size()) {
+        entryNumberForIntro = entryNum;
+        pinIntro();
+    }
+}
+
+void AudioPlaylistManager::doSetIntroSoundName(const char* fname)
 {
     if (!fname)
         return;
 
-    auto it = std::find(begin(filenames), end(filenames), fname );
+    entryNumberForIntro = files->find(fname);
+    introNameWaiting.clear();
 
-    if (it != std::end(filenames))
-        entryNumberForIntro = it - begin(filenames); 
-    else
-        entryNumberForIntro = -1;
+    // Not indexed yet - pick it up when the scan gets there.
+    if (entryNumberForIntro == -1 && !isScanComplete())
+        introNameWaiting = fname;
+
+    pinIntro();
+}
+
+void AudioPlaylistManager::pinIntro()
+{
+    // Any clip still playing keeps its own reference - this only drops ours.
+    pIntroClip.reset();
+
+    if (entryNumberForIntro == -1)
+        return;
+
+    int32_t clip;
+    std::shared_ptr<const ClipBank> bank = findBank(entryNumberForIntro, clip);
+    if (bank && bank->isMapped()) {
+        PrintLN("pinIntro: intro is in a mapped bank - it plays from there without a copy.");
+        return;
+    }
+
+    std::shared_ptr<std::vector<uint8_t> > pClip = std::make_shared<std::vector<uint8_t> >();
+    try {
+        WaveFileType reader(bank ? bank->getPath().c_str() : files->getPath(entryNumberForIntro).c_str(), false,
+                            bank ? &bank->getEntry(clip) : nullptr);
+        if (reader.getSampleRate() > WaveFileBufferReader::MAX_PLAYBACK_RATE) {
+            PrintLN("pinIntro: intro's sample rate is above what the player can stream.");
+            return;
+        }
+        applyTrim(&reader, entryNumberForIntro);
+        if (!reader.readAllSamples(*pClip)) {
+            PrintLN("pinIntro: unable to decode intro. It will be streamed instead.");
+            return;
+        }
+        introSampleRate = reader.getSampleRate();
+    } catch(...) {
+        PrintLN("pinIntro: unable to open intro. It will be streamed instead.");
+        return;
+    }
+
+    pClip->shrink_to_fit();
+    pIntroClip = pClip;
+#ifdef ESP_PLATFORM
+    Serial.printf("Intro pinned in RAM: %u samples at %u Hz\n", pIntroClip->size(), introSampleRate);
+#else
+    printf("Intro pinned in RAM: %lu samples at %u Hz\n", pIntroClip->size(), introSampleRate);
+#endif
 }
 
-void AudioPlaylistManager::PlayEntryIndex(uint16_t entryNum)
+void AudioPlaylistManager::doPlayEntryIndex(uint32_t entryNum)
 {
-    if (entryNum >= filenames.size())
+    if (entryNum >= files->size())
         return;
 
     entryNumberToPlay = entryNum;
 
-    Play();
+    doPlay();
+}
+
+void AudioPlaylistManager::doPlayEntryIndexAt(uint32_t entryNum, uint32_t startUS)
+{
+    if (entryNum >= files->size() || curState != Idle)
+        return;
+
+    // The deadline is for the entry itself, so no intro in front of it.
+    entryNumberToPlay = entryNum;
+    bScheduledStart = true;
+    scheduledStartUS = startUS;
+    NextState(PlayingSound);
 }
 
-void AudioPlaylistManager::PlayEntryName(const char* fname)
+void AudioPlaylistManager::doPlayEntryName(const char* fname)
 {
     if (!fname)
         return;
 
-    auto it = std::find(begin(filenames), end(filenames), fname );
+    entryNumberToPlay = files->find(fname);
 
-    if (it != std::end(filenames))
-        entryNumberToPlay = it - begin(filenames); 
-    else
-        entryNumberToPlay = -1;
+    doPlay();
+}
+
+void AudioPlaylistManager::doPlayEmbedded(const EmbeddedClip* pClip)
+{
+    if (!pClip || curState != Idle)
+        return;
+
+    // Alarm-style clips go out at once - no intro in front of them.
+    pEmbeddedToPlay = pClip;
+    NextState(PlayingSound);
+}
+
+void AudioPlaylistManager::doPlayTone(const ToneStep* pSteps, uint8_t count, uint16_t repeats)
+{
+    if (!pSteps || !count || curState != Idle)
+        return;
 
-    Play();
+    pTonesToPlay = pSteps;
+    toneCount = count;
+    toneRepeats = repeats;
+    NextState(PlayingSound);
 }
 
-void AudioPlaylistManager::Play()
+void AudioPlaylistManager::doPlay()
 {
-    if (entryNumberToPlay == -1)
+    if (entryNumberToPlay == -1 && curState == Idle)
         return;
 
     if (curState==Idle) {
@@ -122,17 +766,45 @@ void AudioPlaylistManager::Play()
     }
     else {
         PrintLN("Play() - just saying 'play' as we're not in idle.");
-        pAFP->PlayFile();
+        amp.Request();
+        startPlayback();
     }
 }
 
-void AudioPlaylistManager::Pause()
+void AudioPlaylistManager::doPause()
 {
-    if (curState == PlayingIntro || curState == PlayingSound)
+    if (curState == PlayingIntro || curState == PlayingSound) {
+        bPlayWhenAmpReady = false;
         pAFP->PauseFile();
+        amp.Release();
+    }
 }
 
-void AudioPlaylistManager::SetVolume(uint8_t _vol)
+void AudioPlaylistManager::startPlayback()
+{
+    if (amp.isReady()) {
+        bPlayWhenAmpReady = false;
+        if (bScheduledStart) {
+            bScheduledStart = false;
+            pAFP->PlayAt(scheduledStartUS);
+        }
+        else
+            pAFP->PlayFile();
+    }
+    else
+        bPlayWhenAmpReady = true;
+}
+
+void AudioPlaylistManager::abandonPlay()
+{
+    bAwaitingLoaded = false;
+    bPlayWhenAmpReady = false;
+    bScheduledStart = false;
+    amp.Release();
+    NextState(Idle);
+}
+
+void AudioPlaylistManager::doSetVolume(uint8_t _vol)
 {
     if (_vol > 100)
         return;
@@ -143,84 +815,400 @@ void AudioPlaylistManager::SetVolume(uint8_t _vol)
 
 void AudioPlaylistManager::ClearFileList()
 {
-    filenames.clear();
-    entryNumberForIntro = -1;
+    scanGeneration++;
+    std::atomic_store(&publishedFiles, std::make_shared<const FileList>());
+    std::atomic_store(&publishedBanks, std::make_shared<const BankList>());
+    loudnessNext = 0;
+}
+
+bool AudioPlaylistManager::AddFilesFrom(const char* _dirname)
+{
+    return queueScan(_dirname ? _dirname : "", ScanRequest::Directory);
 }
 
-void AudioPlaylistManager::AddFilesFrom(const char* _dirname)
+bool AudioPlaylistManager::LoadBank(const char* path, bool bMapped)
 {
-    std::vector<std::string> myFiles;
+    return path && queueScan(path, bMapped ? ScanRequest::MappedBank : ScanRequest::Bank);
+}
 
-    if (!GetFiles(_dirname, myFiles)) {
-        PrintLN("Unable to get list of files");
-        exit(1);
+bool AudioPlaylistManager::queueScan(const char* path, ScanRequest::Kind kind)
+{
+    ScanRequest req;
+
+    if (strlen(path) >= sizeof(req.dir)) {
+        PrintLN("Scan: path too long. Ignored.");
+        return false;
     }
+    strcpy(req.dir, path);
+    req.generation = scanGeneration.load();
+    req.kind = kind;
 
-    for (auto it=myFiles.begin() ; it!=myFiles.end(); it++)
-        filenames.push_back(*it);
+    scansPending++;
+    if (!scanQueue.push(req)) {
+        PrintLN("Scan: too many scans queued. Ignored.");
+        scansPending--;
+        return false;
+    }
+    return true;
+}
+
+bool AudioPlaylistManager::WaitForScan(uint32_t timeoutMS)
+{
+    uint32_t waited = 0;
+
+    while (!isScanComplete()) {
+        if (waited >= timeoutMS)
+            return false;
+        SleepMS(5);
+        waited += 5;
+    }
+    return true;
+}
 
+void AudioPlaylistManager::publishFiles(const FileNameArena& more)
+{
+    // Copy, append, publish. Should another writer get in first, redo the copy from its version.
+    FileListHandle current = std::atomic_load(&publishedFiles);
+    FileListHandle updated;
+    do {
+        std::shared_ptr<FileList> next = std::make_shared<FileList>(*current);
+        next->append(more);
+        next->shrinkToFit();
+        updated = next;
+    } while (!std::atomic_compare_exchange_weak(&publishedFiles, &current, updated));
 }
 
-void AudioPlaylistManager::GetFileList(std::vector<std::string>& fList)
+void AudioPlaylistManager::publishBank(std::shared_ptr<const ClipBank> pBank)
 {
-    fList = filenames;
+    std::shared_ptr<const BankList> current = std::atomic_load(&publishedBanks);
+    std::shared_ptr<const BankList> updated;
+    do {
+        std::shared_ptr<BankList> next = std::make_shared<BankList>(*current);
+        next->push_back(pBank);
+        updated = next;
+    } while (!std::atomic_compare_exchange_weak(&publishedBanks, &current, updated));
 }
 
-void AudioPlaylistManager::SetAmpPower(bool _on)
+void AudioPlaylistManager::scanBank()
 {
+    std::shared_ptr<ClipBank> pBank = std::make_shared<ClipBank>();
+
+    if (!(curScan.kind == ScanRequest::MappedBank ? pBank->map(curScan.dir) : pBank->load(curScan.dir))) {
 #ifdef ESP_PLATFORM
-    if (ampPowerPin) {
-        if (ampPowerPinHigh) {
-            digitalWrite(ampPowerPin, _on);
-        }
-        else {
-            digitalWrite(ampPowerPin, !_on);
+        Serial.printf("Scan: unable to load bank '%s'\n", curScan.dir);
+#else
+        printf("Scan: unable to load bank '%s'\n", curScan.dir);
+#endif
+        scanErrors++;
+        finishScan(false);
+        return;
+    }
+
+    // The whole index is in hand - one batch. The bank goes first so no list names a clip before
+    // its bank can be found.
+    std::string prefix = curScan.dir;
+    prefix += "/";
+    scanBatch.clear();
+    for (uint16_t i=0; i<pBank->size(); i++)
+        scanBatch.add((prefix + pBank->getName(i)).c_str());
+    if (curScan.generation == scanGeneration.load()) {
+        publishBank(pBank);
+        publishFiles(scanBatch);
+        scanFound += pBank->size();
+    }
+    finishScan(true);
+}
+
+std::shared_ptr<const ClipBank> AudioPlaylistManager::findBank(const FileList& list, const BankList& bankList,
+                                                               int32_t entryNum, int32_t& clip)
+{
+    if (bankList.empty() || entryNum < 0 || entryNum >= (int32_t)list.size())
+        return nullptr;
+
+    std::string path = list.getPath(entryNum);
+    for (auto& bank: bankList) {
+        const std::string& bankPath = bank->getPath();
+        if (path.size() > bankPath.size() + 1 && path[bankPath.size()] == '/'
+            && !path.compare(0, bankPath.size(), bankPath)) {
+            clip = bank->find(path.c_str() + bankPath.size() + 1);
+            if (clip >= 0)
+                return bank;
         }
     }
-#endif
+    return nullptr;
 }
 
+bool AudioPlaylistManager::scanStep()
+{
+    std::string path;
+
+    if (!bScanning) {
+        if (!scanQueue.pop(curScan))
+            return false;
+        if (curScan.generation != scanGeneration.load()) {
+            finishScan(true);       // Cancelled by ClearFileList() before it started.
+            return true;
+        }
+        if (curScan.kind != ScanRequest::Directory) {
+            scanBank();
+            return true;
+        }
+        if (!openScan(curScan.dir)) {
 #ifdef ESP_PLATFORM
-bool AudioPlaylistManager::GetFiles(const char* dirLocation, std::vector<std::string>& fileList) {
-    assert(dirLocation==nullptr || dirLocation=="");
+            Serial.printf("Scan: unable to open '%s'\n", curScan.dir);
+#else
+            printf("Scan: unable to open '%s'\n", curScan.dir);
+#endif
+            scanErrors++;
+            finishScan(false);
+            return true;
+        }
+        bScanning = true;
+        scanPublished = 0;
+        scanBatch.clear();
+    }
+
+    if (curScan.generation != scanGeneration.load()) {
+        closeScan();
+        finishScan(true);
+        return true;
+    }
+
+    uint32_t sliceStartUS = getMicros();
+    for (uint32_t i=1; ; i++) {
+        if (!nextScanEntry(path)) {
+            if (!scanBatch.empty())
+                publishFiles(scanBatch);
+            closeScan();
+            finishScan(true);
+            return true;
+        }
+        scanBatch.add(path.c_str());
+        scanFound++;
+        if (!(i % 16) && getMicros() - sliceStartUS >= SCAN_SLICE_US)
+            break;
+    }
+
+    // Publish the first entries straight away, then in batches growing with what's already
+    // published. Each publish copies the list so this keeps the total copying linear.
+    if (!scanPublished || scanBatch.size() >= scanPublished / 4) {
+        publishFiles(scanBatch);
+        scanPublished += scanBatch.size();
+        scanBatch.clear();
+    }
+    return true;
+}
+
+void AudioPlaylistManager::finishScan(bool ok)
+{
+    bScanning = false;
+    scanBatch.clear();
+    if (!ok)
+        bScanFailed = true;
+
+    if (scansPending.fetch_sub(1) == 1) {
+        bool allOk = !bScanFailed;
+        bScanFailed = false;
+        if (scanCallback)
+            scanCallback(GetFileList()->size(), allOk);
+    }
+}
+
+bool AudioPlaylistManager::loudnessStep(std::vector<LoudnessResult>& pending, uint32_t& lastPublishUS)
+{
+    FileListHandle list = GetFileList();
+    uint32_t entry = loudnessNext.load();
 
-    File root = FSTYPE.open("/");
-    File file = root.openNextFile();
-    std::string fn;
+    // Claim the next entry. Whoever moves loudnessNext on owns it.
+    do {
+        if (entry >= list->size()) {
+            if (!pending.empty())
+                publishLoudness(pending);
+            return false;
+        }
+    } while (!loudnessNext.compare_exchange_weak(entry, entry + 1));
+
+    // Measured already - carried over from an earlier version of the list.
+    if (list->getLoudness(entry) != FileNameArena::NO_LOUDNESS)
+        return true;
+
+    LoudnessResult result;
+    if (!measureLoudness(*list, entry, result)) {
+        loudnessFailed++;
+        return true;
+    }
+    pending.push_back(result);
+    loudnessMeasured++;
+
+    // Every publish copies the list - batch them up, more of them the bigger the list so the copying
+    // stays linear overall, but don't sit on results for long.
+    if (pending.size() >= std::max<size_t>(32, list->size() / 64) || getMicros() - lastPublishUS >= 1000000) {
+        publishLoudness(pending);
+        lastPublishUS = getMicros();
+    }
+    return true;
+}
+
+bool AudioPlaylistManager::measureLoudness(const FileList& list, int32_t entryNum, LoudnessResult& result)
+{
+    // Banks are published ahead of the entries naming their clips, so this one has any it needs.
+    std::shared_ptr<const BankList> bankList = std::atomic_load(&publishedBanks);
+    int32_t clip;
+    std::shared_ptr<const ClipBank> bank = findBank(list, *bankList, entryNum, clip);
+    std::unique_ptr<LoudnessAnalyzer> pAnalyzer;
+    uint32_t rate;
+
+    result.entry = entryNum;
+    result.path = list.getPath(entryNum);
+    if (bank && bank->isMapped()) {
+        const ClipBankEntry& entry = bank->getEntry(clip);
+        rate = entry.sampleRate;
+        pAnalyzer = make_unique<LoudnessAnalyzer>(rate);
+        pAnalyzer->add(bank->getSamples(clip), entry.length);
+    }
+    else {
+        try {
+            WaveFileType reader(bank ? bank->getPath().c_str() : result.path.c_str(), false,
+                                bank ? &bank->getEntry(clip) : nullptr);
+            rate = reader.getSampleRate();
+            pAnalyzer = make_unique<LoudnessAnalyzer>(rate);
+            uint8_t block[256];
+            size_t got;
+            while ((got = reader.readNextSamples(block, sizeof(block))) > 0)
+                pAnalyzer->add(block, got);
+        } catch(...) {
+            return false;
+        }
+    }
+
+    result.centiLUFS = (int16_t)lroundf(pAnalyzer->getLoudness() * 100);
+    result.peak = pAnalyzer->getPeak();
+
+    // Frames to milliseconds rounding down, so a trim never cuts into the pad.
+    uint32_t start, end, length = pAnalyzer->getLength();
+    uint32_t pad = TRIM_PAD_MS * rate / 1000;
+    result.leadTrimMS = result.tailTrimMS = 0;
+    if (pAnalyzer->getContent(start, end)) {
+        uint64_t lead = start > pad ? start - pad : 0;
+        uint64_t tail = length - end > pad ? length - end - pad : 0;
+        result.leadTrimMS = lead * 1000 / rate < 0xFFFF ? lead * 1000 / rate : 0xFFFF;
+        result.tailTrimMS = tail * 1000 / rate < 0xFFFF ? tail * 1000 / rate : 0xFFFF;
+    }
+    return true;
+}
+
+void AudioPlaylistManager::publishLoudness(std::vector<LoudnessResult>& pending)
+{
+    FileListHandle current = std::atomic_load(&publishedFiles);
+    FileListHandle updated;
+    do {
+        std::shared_ptr<FileList> next = std::make_shared<FileList>(*current);
+        // Results for entries which have since gone (ClearFileList()) are dropped.
+        for (auto& result: pending) {
+            int32_t entry = result.entry < next->size() && next->getPath(result.entry) == result.path
+                          ? result.entry : next->find(result.path.c_str());
+            if (entry != -1) {
+                next->setLoudness(entry, result.centiLUFS, result.peak);
+                next->setTrim(entry, result.leadTrimMS, result.tailTrimMS);
+            }
+        }
+        updated = next;
+    } while (!std::atomic_compare_exchange_weak(&publishedFiles, &current, updated));
+    pending.clear();
+}
+
+AudioPlaylistManager::FileListHandle AudioPlaylistManager::GetFileList()
+{
+    return std::atomic_load(&publishedFiles);
+}
 
-    while(file) {
-        fn = "/";
-        fn += file.name();
-        fileList.push_back(fn);
+void AudioPlaylistManager::adoptFileList()
+{
+    FileListHandle latest = std::atomic_load(&publishedFiles);
 
-        file = root.openNextFile();
+    if (latest == files)
+        return;
+
+    // Only loudness values changed - entry numbers and prefetched readers all still hold.
+    if (latest->hasSameEntries(*files)) {
+        files = latest;
+        return;
+    }
+
+    // Indices belong to a version - carry the intro and last played entry across by name.
+    FileListHandle previous = files;
+    files = latest;
+    // Loaded after the list - a bank is always published before the entries naming its clips.
+    banks = std::atomic_load(&publishedBanks);
+
+    int32_t introEntry = entryNumberForIntro == -1 ? -1 : files->find(previous->getPath(entryNumberForIntro).c_str());
+    if (entryNumberToPlay != -1)
+        entryNumberToPlay = files->find(previous->getPath(entryNumberToPlay).c_str());
+
+    flushPrefetch();
+    playQueue.SetEntryCount(files->size());
+
+    entryNumberForIntro = introEntry;
+    if (introEntry == -1)
+        pIntroClip.reset();
+
+    if (!introNameWaiting.empty()) {
+        introEntry = files->find(introNameWaiting.c_str());
+        if (introEntry != -1) {
+            introNameWaiting.clear();
+            entryNumberForIntro = introEntry;
+            pinIntro();
+        }
     }
+}
+
+#ifdef ESP_PLATFORM
+bool AudioPlaylistManager::openScan(const char* dirLocation) {
+    assert(dirLocation==nullptr || !*dirLocation);
+
+    scanRoot = FSTYPE.open("/");
+    return (bool)scanRoot;
+}
+
+bool AudioPlaylistManager::nextScanEntry(std::string& path) {
+    File file = scanRoot.openNextFile();
+
+    if (!file)
+        return false;
+
+    path = "/";
+    path += file.name();
     return true;
 }
+
+void AudioPlaylistManager::closeScan() {
+    scanRoot.close();
+}
 #else
-bool AudioPlaylistManager::GetFiles(const char* dirLocation, std::vector<std::string>& fileList) {
-  DIR *dir;
-  struct dirent *ent;
-  std::string fullName;
+bool AudioPlaylistManager::openScan(const char* dirLocation) {
   assert(dirLocation);
-  if ((dir = opendir (dirLocation)) != NULL) {
-    /* print all the files and directories within directory */
-    while ((ent = readdir (dir)) != NULL) {
-//      printf ("%s\n", ent->d_name);
-      if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, "..")) {
-        fullName = dirLocation;
-        fullName += "/";
-        fullName += ent->d_name;
-        fileList.push_back(fullName);
-      }
-    }
-    closedir (dir);
-  } else {
-    /* could not open directory */
-    return false;
+  scanDir = opendir(dirLocation);
+  return scanDir != NULL;
+}
+
+bool AudioPlaylistManager::nextScanEntry(std::string& path) {
+  struct dirent *ent;
+
+  while ((ent = readdir(scanDir)) != NULL) {
+    if (strcmp(ent->d_name, ".") && strcmp(ent->d_name, "..")) {
+      path = curScan.dir;
+      path += "/";
+      path += ent->d_name;
+      return true;
+    }
   }
+  return false;
+}
 
-  return true;
+void AudioPlaylistManager::closeScan() {
+  if (scanDir)
+    closedir(scanDir);
+  scanDir = nullptr;
 }
 #endif
 
@@ -228,17 +1216,31 @@ void AudioPlaylistManager::NextState(State nextState) {
     if (nextState == Idle) {
         PrintLN("NextState: Going back to Idle.");
         curState = Idle;
+        curPriority = 0;
+        interruptDepth = 0;
         return;
     }
 
     if (curState == Idle) {
         if (nextState == PlayingIntro) {
             if (entryNumberForIntro != -1) {
-                SetAmpPower(true);
-                SleepMS(100);
-                pAFP->LoadFile(filenames[entryNumberForIntro].c_str());
-                pAFP->PlayFile();
+                // Warm-up runs while the intro loads. startPlayback() holds output until it's done.
+                amp.Request();
+                if (pIntroClip) {
+                    bAwaitingLoaded = true;
+                    pAFP->LoadWave(new WaveMemorySource(pIntroClip, introSampleRate, "intro"));
+                    applyLoudnessGain(entryNumberForIntro);
+                }
+                else if (!loadEntry(entryNumberForIntro)) {
+                    // A broken intro shouldn't cost the sound itself.
+                    NextState(PlayingSound);
+                    return;
+                }
+                startPlayback();
                 curState = PlayingIntro;
+                // Open and prime the main clip while the intro plays.
+                if (entryNumberToPlay != -1)
+                    prefetchEntry(entryNumberToPlay);
                 return;
             }
             else {
@@ -250,12 +1252,42 @@ void AudioPlaylistManager::NextState(State nextState) {
         }
 
         if (nextState == PlayingSound) {
+            if (pEmbeddedToPlay) {
+                amp.Request();
+                bAwaitingLoaded = true;
+                bool ok = pAFP->LoadEmbedded(*pEmbeddedToPlay);
+                pEmbeddedToPlay = nullptr;
+                if (!ok) {
+                    abandonPlay();
+                    return;
+                }
+                pAFP->pWave->printFileInfo();
+                startPlayback();
+                curState = PlayingSound;
+                return;
+            }
+            if (pTonesToPlay) {
+                amp.Request();
+                bAwaitingLoaded = true;
+                bool ok = pAFP->LoadTone(pTonesToPlay, toneCount, toneRepeats);
+                pTonesToPlay = nullptr;
+                if (!ok) {
+                    abandonPlay();
+                    return;
+                }
+                pAFP->pWave->printFileInfo();
+                startPlayback();
+                curState = PlayingSound;
+                return;
+            }
             if (entryNumberToPlay != -1) {
-                SetAmpPower(true);
-                SleepMS(100);
-                pAFP->LoadFile(filenames[entryNumberToPlay].c_str());
+                amp.Request();
+                if (!loadEntry(entryNumberToPlay)) {
+                    abandonPlay();
+                    return;
+                }
                 pAFP->pWave->printFileInfo();
-                pAFP->PlayFile();
+                startPlayback();
                 curState = PlayingSound;
                 return;
             }
@@ -264,10 +1296,13 @@ void AudioPlaylistManager::NextState(State nextState) {
     else if (curState == PlayingIntro) {
         if (nextState == PlayingSound) {
             if (entryNumberToPlay != -1) {
-                SetAmpPower(true);
-                SleepMS(100);
-                pAFP->LoadFile(filenames[entryNumberToPlay].c_str());
-                pAFP->PlayFile();
+                // The amplifier stayed on through the intro - no warm-up here.
+                if (!loadEntry(entryNumberToPlay)) {
+                    pAFP->PauseFile();
+                    abandonPlay();
+                    return;
+                }
+                startPlayback();
                 curState = PlayingSound;
                 return;
             }
@@ -282,33 +1317,88 @@ void AudioPlaylistManager::NextState(State nextState) {
 
 }
 
-void AudioPlaylistManager::Run()
+void AudioPlaylistManager::onPlayerEvent(const AudioPlayerEvent& ev, void* context)
 {
-    if (hasElapsed(500)) {
-        resetElapsedTimer();
+    // Notifier thread - hand it over to the manager thread which owns the state.
+    ((AudioPlaylistManager*)context)->playerEvents.push(ev);
+}
 
-        if (curState == Idle) {
+void AudioPlaylistManager::handlePlayerEvent(const AudioPlayerEvent& ev)
+{
+    if (ev.type == AudioPlayerEvent::Loaded) {
+        bAwaitingLoaded = false;
+        return;
+    }
 
-        }
-        else if (curState == PlayingIntro) {
-            if (pAFP->isDonePlaying()) {
-                SetAmpPower(false);
-                NextState(PlayingSound);
-                return;
-            }
+    // Anything still queued from the previous file is stale.
+    if (bAwaitingLoaded)
+        return;
 
+    if (ev.type == AudioPlayerEvent::Started) {
+        if (curState == PlayingSound && bIntroGapPending) {
+            bIntroGapPending = false;
+            lastIntroGapUS = ev.timeUS - introFinishedUS;
+#ifdef ESP_PLATFORM
+            Serial.printf("Intro to sound gap: %u uS\n", lastIntroGapUS);
+#else
+            printf("Intro to sound gap: %u uS\n", lastIntroGapUS);
+#endif
         }
-        else if (curState == PlayingSound) {
-            if (pAFP->isDonePlaying()) {
-                SetAmpPower(false);
-                pAFP->PauseFile();
-                NextState(Idle);
-                return;
-            }
+        return;
+    }
 
-        }
-        else if (curState == Paused) {
+    if (ev.type != AudioPlayerEvent::Finished)
+        return;
+
+    if (curState == PlayingIntro) {
+        introFinishedUS = ev.timeUS;
+        bIntroGapPending = true;
+        NextState(PlayingSound);
+    }
+    else if (curState == PlayingSound) {
+        pAFP->PauseFile();
+        amp.Release();
+        NextState(Idle);
+    }
+}
+
+void AudioPlaylistManager::Run()
+{
+    AudioPlayerEvent ev;
+    PlaylistCommand cmd;
+
+    // A new file list is only taken up between clips. Playback runs on the version it started with.
+    if (curState == Idle)
+        adoptFileList();
+
+    while (commandQueue.pop(cmd)) {
+        if (isPlayRequest(cmd))
+            admitPlayRequest(cmd);
+        else
+            executeCommand(cmd);
+    }
+
+    while (playerEvents.pop(ev))
+        handlePlayerEvent(ev);
+
+    // An interruption which has played out hands the priority back to what it interrupted.
+    while (interruptDepth > pAFP->getInterruptDepth())
+        curPriority = interruptedPriority[--interruptDepth];
+
+    startPendingPlay();
+
+    if (bPlayWhenAmpReady)
+        startPlayback();
+    amp.Service();
+
+    // Safety net only - should an event ever be dropped, don't get stuck in a playing state.
+    if (hasElapsed(500)) {
+        resetElapsedTimer();
 
+        if ((curState == PlayingIntro || curState == PlayingSound) && !bAwaitingLoaded && pAFP->isDonePlaying()) {
+            ev.type = AudioPlayerEvent::Finished;
+            ev.timeUS = getMicros();
+            handlePlayerEvent(ev);
         }
     }
 }
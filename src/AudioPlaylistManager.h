@@ -36,28 +36,65 @@
 
 #include "utils.h"
 #include "AudioFilePlayer.h"
+#include "AudioPlayQueue.h"
+#include "WaveMemorySource.h"
+#include "AmpController.h"
+#include "FileNameArena.h"
+#include "ClipBank.h"
+#include "LoudnessAnalyzer.h"
 
 #include <vector>
 #include <string>
 #include <memory>
+#include <atomic>
+#include <functional>
 #include "robotask.h"
+#include "LockFreeQueue.h"
 
 /*! @class   AudioPlaylistManager 
  *  @brief   Organizer/Manager class for enabling playback of audio files from a list
  *  @details Features include:
- *           - Scanning for files in an _initLoc location to gather the full set of files.
+ *           - Scanning for files in an _initLoc location to gather the full set of files. The scan
+ *             runs on its own thread and publishes entries as they are found, so construction
+ *             returns right away and a file can be played as soon as it has been indexed.
  *           - Features the ability to set one of the audio files as an /Intro/. When there is an
  *             intro file, playout of any audio file will be preceeded by the playout of the intro.
+ *             The intro is decoded into RAM once when it is set and then played from memory, while
+ *             the main clip is opened and primed in parallel.
  *           - Handles the statefulness of playing audio files including the Intro audio 
  *           - Thread-based so that it can handle stateful transitions and playout without any
  *             external polling or 'babysitting' of the class. 
+ *           - Transitions are driven by events posted by the AudioFilePlayer (Finished etc.) so the
+ *             next state starts within a couple of milliseconds rather than on a polling interval.
  *           - Volume controls via software - not controlling an amplifier
  *           - Allows for a pin to be utilized for controlling an amplifier as an on/off mechnism.
  *             The purpose here is about power savings. If the audio is primarily unused, this allows
  *             the amplifier to be turned off using a transitor or MOSFET to do so in hardware.
+ *             The amplifier stays on across back-to-back clips and goes off after an idle timeout.
+ *             Its warm-up runs while the clip loads rather than delaying the state machine.
  *           - Amplifier control pin can be active high or low via _onPinHigh
  *           - PlayRandomEntry() simply picks an entry from the list at random
+ *           - PlayNextEntry() follows the play queue (sequential, shuffle or weighted). Since the
+ *             queue knows what comes next, the next few entries are prefetched (opened, header
+ *             parsed and first buffer filled) so that they start without the load delay.
  *           - Audio file list can be managed via ClearFileList() and AddFilesFrom()
+ *           - LoadBank() lists the clips of a ClipBank instead of scanning a directory. Its clips
+ *             start with one seek into the bank file, or straight from memory when it is mapped.
+ *           - PlayEmbedded() plays a clip compiled into the program (EmbeddedClip) - no intro,
+ *             no storage, nothing to open.
+ *           - PlayTone() plays synthesized beeps, chirps and note sequences (ToneGenerator) the
+ *             same way.
+ *           - Loudness normalization. Worker threads measure each entry's loudness as the list
+ *             fills (LoudnessAnalyzer) and keep it in the list. Entries are then played with a
+ *             gain to SetLoudnessTarget() folded into the volume table - nothing is analysed at
+ *             play time.
+ *           - Silence trimming. The same pass notes each entry's leading and trailing silence.
+ *             Entries then start at their first sound and stop after their last.
+ *           - Priorities. A play request with a higher priority than the clip playing doesn't
+ *             wait its turn - it preempts it (fast fade out) or ducks it (mixed under), and the
+ *             interrupted clip is resumed or dropped afterwards. @see SetPreemptPolicy
+ *           - Playback control calls are thread-safe. They are queued to the manager thread which is
+ *             the only thread touching the playback state.
  */
 class AudioPlaylistManager : public RoboTask
 {
@@ -70,53 +107,489 @@ public:
      *  @param _onPinHigh - active high hardware control when true. Active low when false.
      */
     AudioPlaylistManager(uint8_t esp32Timer, uint8_t esp32Pin, const char* _initLoc, uint8_t _ampControlPin=0, bool _onPinHigh=true);
+    //! @brief Stops the manager thread before any of the members its Run() uses are destroyed.
+    ~AudioPlaylistManager() { Terminate(); };
     //! @brief Handles stateful playout of intro and desired audio clip in a thread.
     void Run();
+    /*! @name Playback control
+     *  These may be called from any thread (or several). Each call is queued for the manager
+     *  thread which owns all playback state. They never block. A false return means the command
+     *  queue was full and the call was dropped (counted in getCommandStats()).
+     */
+    //!@{
     //! @brief Simply allows a random entry from the list to be played.
-    void PlayRandomEntry();
+    bool PlayRandomEntry();
+    //! @brief Play the next entry according to the play queue mode.
+    bool PlayNextEntry();
+    //! @brief Choose how PlayNextEntry() orders the list. @see AudioPlayQueue::Mode
+    bool SetQueueMode(AudioPlayQueue::Mode _mode);
+    /*! @brief How many upcoming queue entries to keep prefetched.
+     *  @details Each prefetched entry holds an open file and a wave buffer (byteRate/2 bytes),
+     *           so keep this small on an ESP32. Zero disables prefetching.
+     */
+    bool SetPrefetchDepth(uint8_t depth);
     //! @brief Setting the intro sound file via the index
-    void SetIntroSoundIndex(uint16_t entryNum);
+    bool SetIntroSoundIndex(uint32_t entryNum);
     //! @brief Setting the intro sound file via the name of the file sans folder name
-    void SetIntroSoundName(const char* fname);
-    //! @brief Setting the file to play out via the index
-    void PlayEntryIndex(uint16_t entryNum);
+    bool SetIntroSoundName(const char* fname);
+    /*! @brief Setting the file to play out via the index
+     *  @param priority - higher than the clip playing interrupts it. @see SetPreemptPolicy
+     */
+    bool PlayEntryIndex(uint32_t entryNum, uint8_t priority=0);
+    /*! @brief Play an entry with its first sample at startUS (getMicros() time). @see AudioFilePlayer::PlayAt
+     *  @details Goes through the request policy, then loads (or takes the prefetched reader) and
+     *           arms the player straight away - no intro. Ask early enough to cover the load and
+     *           any amplifier warm-up; anything later starts late and getLastStartErrorUS() says by how much.
+     */
+    bool PlayEntryIndexAt(uint32_t entryNum, uint32_t startUS);
     //! @brief Setting the file to playout via the name of the file sans folder name
-    void PlayEntryName(const char* fname);
+    bool PlayEntryName(const char* fname, uint8_t priority=0);
+    /*! @brief Play a clip compiled into the program. @see EmbeddedClip
+     *  @details Goes through the request policy like the other play calls, then starts straight
+     *           away with no intro and no storage access. The clip must outlive its playout -
+     *           generated clips are static so that is a given.
+     */
+    bool PlayEmbedded(const EmbeddedClip& clip, uint8_t priority=0);
+    /*! @brief Play a synthesized tone sequence. @see ToneStep
+     *  @details Handled like PlayEmbedded() - nothing to load. The steps are not copied so they
+     *           must outlive playback; a static const array is the usual way.
+     *  @param repeats - ToneGenerator::FOREVER plays until something else is played or Pause().
+     */
+    bool PlayTone(const ToneStep* pSteps, uint8_t count, uint16_t repeats=1, uint8_t priority=0);
     //! @brief Play/pause control
-    void Play();
+    bool Play();
     //! @brief Play/pause control
-    void Pause();
-
+    bool Pause();
     //! @brief Sets the volume level (in software) from 0-100
-    void SetVolume(uint8_t _vol);
+    bool SetVolume(uint8_t _vol);
+    /*! @brief Amplifier timing. @see AmpController
+     *  @param warmUpMS - settle time after power on. Output is held back (not slept) until then.
+     *  @param idleOffMS - how long the amplifier stays on after the last clip finishes.
+     */
+    bool SetAmpTiming(uint32_t warmUpMS, uint32_t idleOffMS);
+    /*! @brief Loudness entries are normalized to, in LUFS (relative to DAC full scale). Default -18.
+     *  @details Gain is limited to +12/-30 dB and never pushes the entry's peak past full scale.
+     *           Entries not measured yet play at unity. 0 turns normalization off.
+     */
+    bool SetLoudnessTarget(int8_t lufs);
+    //! @brief Skip the leading and trailing silence found when entries were measured. On by default.
+    bool SetSilenceTrim(bool bEnable);
+    //!@}
+
+    /*! @enum RequestPolicy
+     *  @brief How bursts of play requests (PlayRandomEntry, PlayNextEntry, PlayEntryIndex and
+     *         PlayEntryName) are collapsed. Requests are admitted or discarded on the manager
+     *         thread before anything is opened, so a discarded request never touches storage.
+     *         Admitted requests start in order once the manager is idle.
+     */
+    enum RequestPolicy {
+        DropWhileBusy,  //!< Requests arriving while a clip plays (or one is already waiting) are dropped.
+        LatestWins,     //!< Only the newest request waits for the current clip to finish.
+        QueueUpToN,     //!< Up to N requests wait in order. More than that are dropped.
+        MinInterval     //!< Requests within N milliseconds of the last admitted one are dropped. Else latest-wins.
+    };
+    /*! @brief Set the play request policy.
+     *  @param param - QueueUpToN: the depth (1-MAX_PENDING_PLAYS). MinInterval: milliseconds. Else unused.
+     */
+    bool SetRequestPolicy(RequestPolicy policy, uint16_t param=0);
+    static const uint8_t MAX_PENDING_PLAYS = 8;
+
+    /*! @enum PreemptPolicy
+     *  @brief What a play request with a higher priority than the clip playing does to it. Such a
+     *         request skips the request policy and starts at once. Only PlayEntryIndex,
+     *         PlayEntryName, PlayEmbedded and PlayTone carry a priority. Interruptions nest up to
+     *         AudioFilePlayer::MAX_INTERRUPTS deep - beyond that the request policy applies.
+     */
+    enum PreemptPolicy {
+        PreemptAndResume,   //!< Fade the clip out fast, play the new one, fade the clip back in where it was.
+        PreemptAndDrop,     //!< Fade the clip out fast and play the new one in its place.
+        DuckAndResume,      //!< Turn the clip down under the new one, then back up. It plays on throughout.
+        DuckAndDrop         //!< Turn the clip down under the new one and finish along with it.
+    };
+    /*! @brief Set the preempt policy. PreemptAndResume by default.
+     *  @param duckPercent - level of a ducked clip, 0-100.
+     */
+    bool SetPreemptPolicy(PreemptPolicy policy, uint8_t duckPercent=20);
+
+    //! @brief Play request accounting - received = started + coalesced + dropped + still pending.
+    struct RequestStats {
+        uint32_t received;   //!< Play requests seen by the manager thread.
+        uint32_t started;    //!< Requests which went on to load and play.
+        uint32_t coalesced;  //!< Requests superseded by a newer one (latest-wins) or debounced.
+        uint32_t dropped;    //!< Requests refused because the manager was busy or the pending queue was full.
+        uint32_t preempted;  //!< Started requests which interrupted a lower-priority clip.
+    };
+    void getRequestStats(RequestStats& stats) {
+        stats.received = requestsReceived.load(); stats.started = requestsStarted.load();
+        stats.coalesced = requestsCoalesced.load(); stats.dropped = requestsDropped.load();
+        stats.preempted = requestsPreempted.load();
+    };
+
+    //! @brief Amplifier power cycles (off to on) since construction.
+    uint32_t getAmpPowerCycles() { return amp.getPowerCycles(); };
+
+    //! @brief Direct access to the queue for seeding, weights and the no-repeat window.
+    //! @note Not synchronized with the manager thread - configure it before playback starts.
+    AudioPlayQueue& GetQueue() { return playQueue; };
+    //! @brief Commands accepted, executed and dropped (queue full) since construction.
+    void getCommandStats(uint32_t& queued, uint32_t& processed, uint32_t& dropped) {
+        queued = commandsQueued.load(); processed = commandsProcessed.load(); dropped = commandQueue.getDropCount();
+    };
+
     //! @brief Utility/debug routine for printing the modified values given the volume setting.
     void printDataTable() { if (pAFP) pAFP->printDataTable(); };
+    //! @brief Gain (Q8) loudness normalization gave the loaded clip. 256 is unity. @see SetLoudnessTarget
+    uint16_t getClipGain() { return pAFP ? pAFP->getClipGain() : 256; };
 
-    //! @brief the audio file list contents.
+    //! Paths are kept in a FileNameArena - shared directory prefixes, names packed in one block.
+    typedef FileNameArena FileList;
+    //! @brief An immutable version of the file list. Stays valid for as long as it is held.
+    typedef std::shared_ptr<const FileList> FileListHandle;
+    /*! @name File list
+     *  The list is published as immutable versions. Writers build a new version and swap it in,
+     *  readers just take a reference to the current one. The manager thread picks up a new
+     *  version when it is idle - a clip in progress finishes on the version it started with.
+     *  The intro and last played entry are carried over by name.
+     */
+    //!@{
+    //! @brief Publish an empty list. Scans still in progress are cancelled.
     void ClearFileList();
-    //! @brief Add (more) files to the current file list from a given _dirname
-    void AddFilesFrom(const char* _dirname);
-    //! @brief Obtain the current audio list as a vector of strings fList
-    void GetFileList(std::vector<std::string>& fList);
+    /*! @brief Queue a background scan adding the files in _dirname to the list.
+     *  @details Entries are published in growing batches while the scan runs.
+     *  @return false if the directory name is too long or too many scans are already queued.
+     */
+    bool AddFilesFrom(const char* _dirname);
+    /*! @brief Queue loading a clip bank's index and add its clips to the list.
+     *  @details Clips are listed as "<path>/<clip name>" and may be played or set as the intro by
+     *           that name like any file. The index is read on the scan thread, so this never blocks.
+     *  @param bMapped - map the bank into memory (@see ClipBank::map) so clips play without I/O.
+     *                   On ESP32 path is then the label of the data partition holding the bank.
+     *  @return false if the path is too long or too many scans are already queued.
+     */
+    bool LoadBank(const char* path, bool bMapped=false);
+    //! @brief The current version of the file list - a reference, not a copy.
+    FileListHandle GetFileList();
+    //! @brief True when no scan is queued or running.
+    bool isScanComplete() { return scansPending.load() == 0; };
+    //! @brief Entries found by all scans so far, and directories which could not be read.
+    void getScanProgress(uint32_t& found, uint32_t& errors) { found = scanFound.load(); errors = scanErrors.load(); };
+    /*! @brief Called on the scan thread each time the last queued scan finishes.
+     *  @details Arguments are the number of entries in the list and whether every scan succeeded.
+     *           Set it before queueing scans - the callback itself is not synchronized.
+     */
+    void SetScanCompleteCallback(std::function<void(uint32_t, bool)> callback) { scanCallback = callback; };
+    //! @brief Block until the scans are done. @return false on timeout.
+    bool WaitForScan(uint32_t timeoutMS=10000);
+    /*! @brief Entries measured for loudness so far and entries which could not be read.
+     *  @details Measured values are published into the list in batches, so GetFileList() may
+     *           trail these counts by a moment.
+     */
+    void getLoudnessProgress(uint32_t& measured, uint32_t& failed) { measured = loudnessMeasured.load(); failed = loudnessFailed.load(); };
+    //!@}
 
     //! @enum Statefulness is handled by this group of enums.
     enum State { Idle, PlayingIntro, PlayingSound, Paused };
+    //! @brief Where the manager thread is. A snapshot - it may move on straight after.
+    State getState() { return curState; };
+
+    //! @brief Time from the intro finishing to the main clip starting, for the most recent play.
+    //! @return microseconds or 0 if no intro has been played yet.
+    uint32_t getLastIntroGapUS() { return lastIntroGapUS; };
+    //! @brief Distance of the last PlayEntryIndexAt() first sample from its deadline - positive is late.
+    int32_t getLastStartErrorUS() { return pAFP ? pAFP->getLastStartErrorUS() : 0; };
+    /*! @brief Time from the call of the latest preempting request to its first sample going out.
+     *  @return microseconds or 0 until that sample has played.
+     */
+    uint32_t getLastPreemptLatencyUS() {
+        uint32_t startUS = pAFP ? pAFP->getInterruptStartUS() : 0;
+        return startUS ? startUS - preemptRequestUS : 0;
+    };
 
 protected:
+    //! @brief Control request carried from the caller's thread to the manager thread.
+    struct PlaylistCommand {
+        enum Type : uint8_t { PlayRandom, PlayNext, PlayIndex, PlayName, IntroIndex, IntroName,
+                              Play, Pause, Volume, QueueMode, PrefetchDepth, Policy,
+                              AmpTiming, PlayEmbedded, LoudnessTarget, SilenceTrim, PlayTone, PlayIndexAt,
+                              Preempt };
+        Type type;
+        int32_t value;
+        uint32_t param;
+        //! Name-based commands carry a copy of the name so the caller's string may go away.
+        char name[96];
+        //! PlayEmbedded only.
+        const EmbeddedClip* pClip;
+        //! PlayTone only - value is the step count and param the repeats.
+        const ToneStep* pSteps;
+        //! PlayIndexAt only - getMicros() deadline.
+        uint32_t timeUS;
+        //! Play requests only. @see PreemptPolicy
+        uint8_t priority;
+        //! getMicros() when the caller queued it.
+        uint32_t postedUS;
+    };
+    //! Bounded multi-producer queue drained by Run(). Full means the command is dropped.
+    LockFreeQueue<PlaylistCommand, 32> commandQueue;
+    //! Player events waiting for the manager thread. Declared ahead of pAFP so it outlives the notifier.
+    LockFreeQueue<AudioPlayerEvent, 16> playerEvents;
+    std::atomic<uint32_t> commandsQueued;
+    std::atomic<uint32_t> commandsProcessed;
+
+    //! @brief Queue a command from any thread. Never blocks.
+    bool postCommand(PlaylistCommand::Type type, int32_t value=0, const char* name=nullptr, uint32_t param=0,
+                     const EmbeddedClip* pClip=nullptr, const ToneStep* pSteps=nullptr, uint32_t timeUS=0,
+                     uint8_t priority=0);
+    //! @brief Run a command on the manager thread.
+    void executeCommand(const PlaylistCommand& cmd);
+
+    //! @brief True for the commands which load and play an entry - these go through the request policy.
+    static bool isPlayRequest(const PlaylistCommand& cmd);
+    //! @brief Apply the request policy to a play command - either hold it as pending or discard it.
+    void admitPlayRequest(const PlaylistCommand& cmd);
+    //! @brief Start the oldest pending play request once the manager is idle.
+    void startPendingPlay();
+    /*! @brief Play a request over the clip playing now if its priority is higher.
+     *  @return false when it isn't or it can't be - the request policy then applies.
+     */
+    bool preemptWith(const PlaylistCommand& cmd);
+
+    RequestPolicy requestPolicy;
+    uint16_t requestPolicyParam;
+    //! Admitted play requests waiting for Idle. A small ring - head is the oldest.
+    PlaylistCommand pendingPlays[MAX_PENDING_PLAYS];
+    uint8_t pendingHead;
+    uint8_t pendingCount;
+    //! getMicros() of the last admitted request - for MinInterval.
+    uint32_t lastAdmittedUS;
+    bool bHaveAdmitted;
+    std::atomic<uint32_t> requestsReceived;
+    std::atomic<uint32_t> requestsStarted;
+    std::atomic<uint32_t> requestsCoalesced;
+    std::atomic<uint32_t> requestsDropped;
+    std::atomic<uint32_t> requestsPreempted;
+    PreemptPolicy preemptPolicy;
+    uint8_t duckPercent;
+    //! Priority of the request playing now, and of the ones it interrupted (innermost last).
+    uint8_t curPriority;
+    uint8_t interruptedPriority[AudioFilePlayer::MAX_INTERRUPTS];
+    uint8_t interruptDepth;
+    //! postedUS of the latest preempting request.
+    uint32_t preemptRequestUS;
+    //! @name Manager-thread implementations of the public control calls
+    //!@{
+    void doPlayRandomEntry();
+    void doPlayNextEntry();
+    void doSetQueueMode(AudioPlayQueue::Mode _mode);
+    void doSetPrefetchDepth(uint8_t depth);
+    void doSetIntroSoundIndex(uint32_t entryNum);
+    void doSetIntroSoundName(const char* fname);
+    void doPlayEntryIndex(uint32_t entryNum);
+    void doPlayEntryIndexAt(uint32_t entryNum, uint32_t startUS);
+    void doPlayEntryName(const char* fname);
+    void doPlayEmbedded(const EmbeddedClip* pClip);
+    void doPlayTone(const ToneStep* pSteps, uint8_t count, uint16_t repeats);
+    void doPlay();
+    void doPause();
+    void doSetVolume(uint8_t _vol);
+    void doSetRequestPolicy(RequestPolicy policy, uint16_t param);
+    void doSetAmpTiming(uint32_t warmUpMS, uint32_t idleOffMS);
+    void doSetLoudnessTarget(int8_t lufs);
+    void doSetSilenceTrim(bool bEnable);
+    void doSetPreemptPolicy(PreemptPolicy policy, uint8_t percent);
+    //!@}
+
     State curState;
-    uint8_t ampPowerPin;
-    bool ampPowerPinHigh;
-    //! @brief List of audio file names ready to be played.
-    std::vector<std::string> filenames;
+    AmpController amp;
+    //! A clip is loaded and waiting only for the amplifier warm-up before PlayFile().
+    bool bPlayWhenAmpReady;
+    //! Latest published list. Only accessed through std::atomic_load/store/compare_exchange.
+    FileListHandle publishedFiles;
+    //! The version the manager thread plays from. Manager thread only.
+    FileListHandle files;
+    //! @brief Switch to the latest published list and re-map entry numbers. Manager thread, Idle only.
+    void adoptFileList();
+    //! @brief Append entries to the published list (copy, append, compare-exchange).
+    void publishFiles(const FileNameArena& more);
+    //! Clip banks loaded so far. Published ahead of the file list naming their clips.
+    typedef std::vector<std::shared_ptr<const ClipBank> > BankList;
+    //! Latest published banks. Only accessed through std::atomic_load/store/compare_exchange.
+    std::shared_ptr<const BankList> publishedBanks;
+    //! The banks the manager thread plays from - taken up along with files. Manager thread only.
+    std::shared_ptr<const BankList> banks;
+    void publishBank(std::shared_ptr<const ClipBank> pBank);
+    //! @brief The bank holding an entry and the clip number in it. nullptr for a plain file.
+    std::shared_ptr<const ClipBank> findBank(int32_t entryNum, int32_t& clip) { return findBank(*files, *banks, entryNum, clip); };
+    static std::shared_ptr<const ClipBank> findBank(const FileList& list, const BankList& bankList, int32_t entryNum, int32_t& clip);
+    //! An intro set by name before the scan reached it. Resolved when the file shows up.
+    std::string introNameWaiting;
+
+    //! Directory scan requested by AddFilesFrom() - or a bank from LoadBank(). Dropped if
+    //! ClearFileList() bumps the generation.
+    struct ScanRequest {
+        enum Kind : uint8_t { Directory, Bank, MappedBank };
+        char dir[96];
+        uint32_t generation;
+        Kind kind;
+    };
+    LockFreeQueue<ScanRequest, 8> scanQueue;
+    std::atomic<uint32_t> scanGeneration;
+    //! Scans queued or in progress.
+    std::atomic<uint32_t> scansPending;
+    std::atomic<uint32_t> scanFound;
+    std::atomic<uint32_t> scanErrors;
+    std::function<void(uint32_t, bool)> scanCallback;
+    //! @name Scan thread state - only touched by scanStep()
+    //!@{
+    ScanRequest curScan;
+    bool bScanning;
+    bool bScanFailed;
+    FileNameArena scanBatch;
+    uint32_t scanPublished;
+#ifdef ESP_PLATFORM
+    File scanRoot;
+#else
+    DIR* scanDir;
+#endif
+    //!@}
+    //! Time spent reading entries per scanStep() - keeps each pass short so the scan thread yields regularly.
+    static const uint32_t SCAN_SLICE_US = 5000;
+    /*! @brief One pass of the scan thread: read a few entries, publish when the batch is big enough.
+     *  @return false when there was nothing to scan.
+     */
+    bool scanStep();
+    //! @brief Load the bank named by curScan and publish it and its clips.
+    void scanBank();
+    //! @brief Queue a scan request of any kind.
+    bool queueScan(const char* path, ScanRequest::Kind kind);
+    bool openScan(const char* dirLocation);
+    //! @brief Next path in the directory being scanned. false at the end.
+    bool nextScanEntry(std::string& path);
+    void closeScan();
+    void finishScan(bool ok);
+
+    //! @brief Runs scanStep() on its own thread so scanning never holds up playback or the caller.
+    class ScanTask : public RoboTask {
+    public:
+        ScanTask(AudioPlaylistManager& _owner) : RoboTask("apmScan"), owner(_owner) { Start(); };
+        ~ScanTask() { Terminate(); };
+        //! Short passes back to back while there is work, a relaxed poll otherwise.
+        void Run() { setBaseRunDelay(owner.scanStep() ? 1 : 20); };
+    protected:
+        AudioPlaylistManager& owner;
+    };
+
+    //! A measured entry waiting to be published. Entries are only appended within a scan so the
+    //! index normally still holds; the path catches a list cleared or rebuilt since it was measured.
+    struct LoudnessResult {
+        uint32_t entry;
+        std::string path;
+        int16_t centiLUFS;
+        uint8_t peak;
+        uint16_t leadTrimMS;
+        uint16_t tailTrimMS;
+    };
+    //! Silence kept ahead of the first sound and after the last, so soft attacks and decays survive.
+    static const uint16_t TRIM_PAD_MS = 10;
+    //! Next entry of the published list to measure. Workers claim entries by moving it on.
+    std::atomic<uint32_t> loudnessNext;
+    std::atomic<uint32_t> loudnessMeasured;
+    std::atomic<uint32_t> loudnessFailed;
+    //! Manager thread only. FileNameArena::NO_LOUDNESS when normalization is off.
+    int16_t loudnessTarget;
+    //! Manager thread only.
+    bool bTrimSilence;
+    /*! @brief One pass of a loudness worker: measure the next unmeasured entry.
+     *  @param pending - the worker's results not yet published. Published in batches.
+     *  @return false when there was nothing to measure.
+     */
+    bool loudnessStep(std::vector<LoudnessResult>& pending, uint32_t& lastPublishUS);
+    //! @brief Run an entry through a LoudnessAnalyzer for its loudness and trims. false if it can't be read.
+    bool measureLoudness(const FileList& list, int32_t entryNum, LoudnessResult& result);
+    //! @brief Write results into a copy of the published list and publish it (compare-exchange).
+    void publishLoudness(std::vector<LoudnessResult>& pending);
+    //! @brief Normalization gain for an entry, as for SetClipGain(). 256 when there's nothing to go on.
+    uint16_t loudnessGain(int32_t entryNum);
+    //! @brief Apply the normalization gain for an entry to the loaded clip. Manager thread.
+    void applyLoudnessGain(int32_t entryNum);
+    //! @brief Narrow a source to the entry's audible part, if it has trims. Before it plays.
+    void applyTrim(AudioSampleSource* pWave, int32_t entryNum);
+    //! @brief A trimmed source for an entry - a file reader or a bank clip. nullptr if it won't open.
+    AudioSampleSource* openEntry(int32_t entryNum);
+
+    //! @brief Measures entries on its own thread. Several run side by side.
+    class LoudnessTask : public RoboTask {
+    public:
+        LoudnessTask(AudioPlaylistManager& _owner, int stacksize)
+            : RoboTask("apmLoud", 1, stacksize), owner(_owner), lastPublishUS(0) { Start(); };
+        ~LoudnessTask() { Terminate(); };
+        void Run() { setBaseRunDelay(owner.loudnessStep(pending, lastPublishUS) ? 1 : 50); };
+    protected:
+        AudioPlaylistManager& owner;
+        std::vector<LoudnessResult> pending;
+        uint32_t lastPublishUS;
+    };
+
     //! Single instance of the AudioFilePlayer which is re-used for each playout.
     std::unique_ptr<AudioFilePlayer> pAFP;
-    int16_t entryNumberForIntro;
-    int16_t entryNumberToPlay;
+    int32_t entryNumberForIntro;
+    int32_t entryNumberToPlay;
+    //! Set by doPlayEmbedded() for the next PlayingSound in place of entryNumberToPlay.
+    const EmbeddedClip* pEmbeddedToPlay;
+    //! Set by doPlayTone() the same way.
+    const ToneStep* pTonesToPlay;
+    uint8_t toneCount;
+    uint16_t toneRepeats;
+    //! Set by doPlayEntryIndexAt() - startPlayback() uses PlayAt() with scheduledStartUS.
+    bool bScheduledStart;
+    uint32_t scheduledStartUS;
+    //! Ordering of entries for PlayNextEntry()
+    AudioPlayQueue playQueue;
 
-    //! @brief Turns on or off the amplifier power. This is managed by the thread internally.
-    void SetAmpPower(bool _on);
-    //! @brief Worker function for iterating through the files in a folder
-    bool GetFiles(const char* dirLocation, std::vector<std::string>& fileList);
+    //! A reader which was built ahead of time for an upcoming entry.
+    struct PrefetchSlot {
+        int32_t entryNum;
+        std::unique_ptr<AudioSampleSource> pWave;
+    };
+    std::vector<PrefetchSlot> prefetched;
+    uint8_t prefetchDepth;
+
+    //! Intro decoded to DAC-ready samples. Shared with the player's source while it plays.
+    std::shared_ptr<const std::vector<uint8_t> > pIntroClip;
+    uint32_t introSampleRate;
+    //! @brief Decode the current intro entry into pIntroClip (or release it if there is none).
+    void pinIntro();
+
+    //! @brief Build a reader for an entry ahead of time unless one is already prefetched.
+    bool prefetchEntry(int32_t entryNum);
+    //! @brief Bring the prefetched set in line with the next prefetchDepth entries of the queue.
+    void refillPrefetch();
+    //! @brief Drop all prefetched readers - used when the file list changes.
+    void flushPrefetch();
+    //! @brief Load an entry into the player, using a prefetched reader when one is available.
+    //! @return false if it won't open - the player keeps what it had and no Loaded event follows.
+    bool loadEntry(int32_t entryNum);
+    //! @brief The prefetched reader for an entry, or a newly opened one. nullptr if it won't open.
+    AudioSampleSource* takeEntry(int32_t entryNum);
+
+    //! @brief Start output of the loaded clip now, or as soon as the amplifier has warmed up.
+    void startPlayback();
+    //! @brief A load failed - stop waiting for it, give the amplifier back and go Idle.
+    void abandonPlay();
     //! @brief Stateful transition utility for the thread.
     void NextState(State nextState);
+    //! @brief React to a player event. Called on the manager thread.
+    void handlePlayerEvent(const AudioPlayerEvent& ev);
+    //! @brief Player subscription callback - queues the event for the manager thread.
+    static void onPlayerEvent(const AudioPlayerEvent& ev, void* context);
+
+    //! getMicros() when the intro posted Finished - used for the intro gap metric.
+    uint32_t introFinishedUS;
+    //! Set when a file is being loaded. Events queued before its 'Loaded' belong to the old file.
+    bool bAwaitingLoaded;
+    bool bIntroGapPending;
+    uint32_t lastIntroGapUS;
+
+    //! Declared last so the scan and loudness threads are stopped before the members they use go away.
+    std::unique_ptr<ScanTask> pScanner;
+    std::vector<std::unique_ptr<LoudnessTask> > loudnessWorkers;
 };
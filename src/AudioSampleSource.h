@@ -0,0 +1,88 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+
+/*! @class   AudioSampleSource
+ *  @brief   What the AudioFilePlayer needs from anything it plays.
+ *  @details The player's output path (timer ISR on ESP32, playout thread on native) only ever asks
+ *           for the current DAC-ready 8-bit sample, moves to the next one and checks for the end.
+ *           WaveFileBufferReader provides this from a file through its ring buffer. Sources that
+ *           already hold their samples in memory implement it directly - no thread, no file I/O.
+ */
+class AudioSampleSource
+{
+public:
+    virtual ~AudioSampleSource() {};
+    //! @brief Address of the current 8-bit unsigned sample. nullptr if nothing is available.
+    virtual const uint8_t* getReadPointer() = 0;
+    //! @brief Step to the next sample.
+    virtual void advanceReadPointer() = 0;
+    //! @brief True once the final sample has been consumed.
+    virtual bool isPlaybackComplete() = 0;
+    //! @brief Output sample rate in samples per second.
+    virtual uint32_t getSampleRate() = 0;
+    //! @brief True when output can start without static. Memory sources are always ready.
+    virtual bool isBufferPrimed() { return true; };
+    //! @brief True when the output has caught up with a reader which hasn't reached the end yet.
+    virtual bool isStarved() { return false; };
+    //! @brief 0-100 fullness of any read-ahead buffer. Memory sources are always full.
+    virtual uint8_t getBufferFullPercentage() { return 100; };
+    //! @brief 0-100 of how much of the underlying storage has been read.
+    virtual uint8_t getFileReadPercentage() { return 100; };
+    //! @brief Utility method for knowing what is being played.
+    virtual void printFileInfo() = 0;
+    /*! @brief Move playback to a frame (one sample per channel) of the clip.
+     *  @return false if the source can't seek or the frame could not be reached.
+     */
+    virtual bool seekToFrame(uint32_t /*frame*/) { return false; };
+    //! @brief seekToFrame() in milliseconds from the start of the clip.
+    bool seekToTime(uint32_t ms) { return seekToFrame((uint64_t)ms * getSampleRate() / 1000); };
+    //! @brief The frame about to be output - where playback is, not how far the reader has got.
+    virtual uint32_t getPositionFrames() { return 0; };
+    //! @brief Length of the clip in frames. 0 if unknown.
+    virtual uint32_t getTotalFrames() { return 0; };
+    uint32_t getPositionMS() { return (uint64_t)getPositionFrames() * 1000 / getSampleRate(); };
+    /*! @brief Repeat frames [startFrame, endFrame) until stopLooping(). endFrame 0 is the end of the clip.
+     *  @param crossfadeFrames - optional - blend the end of the loop into its start over this many frames.
+     *  @return false if the source can't loop this region.
+     */
+    virtual bool setLoop(uint32_t /*startFrame*/, uint32_t /*endFrame*/, uint32_t /*crossfadeFrames*/=0) { return false; };
+    //! @brief Let the pass of the loop in progress finish, then play on to the end of the clip.
+    virtual void stopLooping() {};
+    //! @brief Loop points stored with the clip itself (the WAVE 'smpl' chunk). False if there are none.
+    virtual bool getClipLoop(uint32_t& /*startFrame*/, uint32_t& /*endFrame*/) { return false; };
+    /*! @brief Play only frames [startFrame, endFrame) - to skip leading and trailing silence. Call
+     *         before playback starts. The ramp-in leads up to startFrame's sample and the ramp-out
+     *         leaves from the sample before endFrame.
+     *  @return false if the source can't be trimmed or the range is empty.
+     */
+    virtual bool setPlayRange(uint32_t /*startFrame*/, uint32_t /*endFrame*/) { return false; };
+};
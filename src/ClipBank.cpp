@@ -0,0 +1,434 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "ClipBank.h"
+#include "FileNameArena.h"
+#include "utils.h"
+
+#include <cassert>
+#include <cstring>
+
+#ifdef ESP_PLATFORM
+#include "WaveFileLittleFSReader.h"
+#include "WaveFileSPIFFSReader.h"
+#include "esp_partition.h"
+#else
+#include "WaveFileStdioReader.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Everything in a bank is little-endian whatever the host.
+static uint16_t get16(const uint8_t* p) { return p[1]<<8 | p[0]; }
+static uint32_t get32(const uint8_t* p) { return (uint32_t)p[3]<<24 | p[2]<<16 | p[1]<<8 | p[0]; }
+
+ClipBank::ClipBank()
+{
+    pMapped = nullptr;
+    mappedSize = 0;
+#ifdef ESP_PLATFORM
+    mmapHandle = 0;
+    bPartitionMapped = false;
+#else
+    bFileMapped = false;
+#endif
+}
+
+ClipBank::~ClipBank()
+{
+    unmap();
+}
+
+void ClipBank::unmap()
+{
+#ifdef ESP_PLATFORM
+    if (bPartitionMapped)
+        esp_partition_munmap(mmapHandle);
+    bPartitionMapped = false;
+#else
+    if (bFileMapped)
+        munmap((void*)pMapped, mappedSize);
+    bFileMapped = false;
+#endif
+    pMapped = nullptr;
+    mappedSize = 0;
+}
+
+bool ClipBank::parseIndex(const uint8_t* pData, size_t available, size_t bankSize)
+{
+    if (available < HEADER_SIZE || strncmp((const char*)pData, "CLPB", 4)) {
+        PrintLN("ClipBank: not a clip bank.");
+        return false;
+    }
+    if (get16(pData + 4) != VERSION) {
+        PrintLN("ClipBank: unsupported bank version.");
+        return false;
+    }
+
+    uint16_t count = get16(pData + 6);
+    uint32_t namesOffset = get32(pData + 12);
+    uint32_t namesBytes = get32(pData + 16);
+    uint32_t totalSize = get32(pData + 24);
+    // Compared as differences - a damaged size mustn't wrap the sum back into range.
+    if (namesOffset != HEADER_SIZE + (uint32_t)count * ENTRY_SIZE || namesOffset > available
+        || namesBytes > available - namesOffset || totalSize > bankSize || !namesBytes
+        || pData[namesOffset + namesBytes - 1]) {
+        PrintLN("ClipBank: index is truncated or damaged.");
+        return false;
+    }
+
+    entries.resize(count);
+    for (uint16_t i=0; i<count; i++) {
+        const uint8_t* p = pData + HEADER_SIZE + i * ENTRY_SIZE;
+        ClipBankEntry& e = entries[i];
+        e.nameHash = get32(p);
+        e.offset = get32(p + 4);
+        e.length = get32(p + 8);
+        e.sampleRate = get32(p + 12);
+        e.format = get16(p + 16);
+        e.firstSample = p[18];
+        e.lastSample = p[19];
+        e.nameOffset = get32(p + 20);
+        if ((uint64_t)e.offset + e.length > totalSize || e.nameOffset >= namesBytes || !e.sampleRate) {
+            PrintLN("ClipBank: index entry points outside the bank.");
+            entries.clear();
+            return false;
+        }
+    }
+    names.assign(pData + namesOffset, pData + namesOffset + namesBytes);
+    return true;
+}
+
+bool ClipBank::load(const char* _path)
+{
+    std::vector<uint8_t> index(HEADER_SIZE);
+    size_t fileSize;
+    bool ok = false;
+
+    unmap();
+    entries.clear();
+    path = _path;
+
+#ifdef ESP_PLATFORM
+    if (!FSTYPE.begin(true)) {
+        Serial.println("An Error has occurred while mounting the filesystem");
+        return false;
+    }
+    fs::File f = FSTYPE.open(_path, FILE_READ);
+    if (!f)
+        return false;
+    fileSize = f.size();
+    if (f.read(index.data(), HEADER_SIZE) == HEADER_SIZE) {
+        uint64_t indexSize = (uint64_t)get32(&index[12]) + get32(&index[16]);
+        if (indexSize > HEADER_SIZE && indexSize <= fileSize) {
+            index.resize(indexSize);
+            ok = f.read(&index[HEADER_SIZE], indexSize - HEADER_SIZE) == indexSize - HEADER_SIZE;
+        }
+    }
+    f.close();
+#else
+    FILE* f = fopen(_path, "rb");
+    if (!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    fileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (fread(index.data(), 1, HEADER_SIZE, f) == HEADER_SIZE) {
+        uint64_t indexSize = (uint64_t)get32(&index[12]) + get32(&index[16]);
+        if (indexSize > HEADER_SIZE && indexSize <= fileSize) {
+            index.resize(indexSize);
+            ok = fread(&index[HEADER_SIZE], 1, indexSize - HEADER_SIZE, f) == indexSize - HEADER_SIZE;
+        }
+    }
+    fclose(f);
+#endif
+
+    if (!ok) {
+        PrintLN("ClipBank: unable to read the index.");
+        return false;
+    }
+    return parseIndex(index.data(), index.size(), fileSize);
+}
+
+bool ClipBank::map(const char* _path)
+{
+    unmap();
+    entries.clear();
+    path = _path;
+
+#ifdef ESP_PLATFORM
+    const esp_partition_t* pPart = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, _path);
+    const void* pBase;
+    if (!pPart || esp_partition_mmap(pPart, 0, pPart->size, ESP_PARTITION_MMAP_DATA, &pBase, &mmapHandle) != ESP_OK) {
+        Serial.printf("ClipBank: unable to map partition '%s'\n", _path);
+        return false;
+    }
+    bPartitionMapped = true;
+    pMapped = (const uint8_t*)pBase;
+    mappedSize = pPart->size;
+#else
+    int fd = open(_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0)
+        return false;
+    if (fstat(fd, &st) || st.st_size < HEADER_SIZE) {
+        ::close(fd);
+        return false;
+    }
+    void* pBase = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);        // The mapping keeps the file alive.
+    if (pBase == MAP_FAILED) {
+        printf("ClipBank: unable to mmap '%s'\n", _path);
+        return false;
+    }
+    bFileMapped = true;
+    pMapped = (const uint8_t*)pBase;
+    mappedSize = st.st_size;
+#endif
+
+    if (!parseIndex(pMapped, mappedSize, mappedSize)) {
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+bool ClipBank::map(const uint8_t* pBase, size_t size, const char* name)
+{
+    unmap();
+    entries.clear();
+    path = name ? name : "";
+
+    if (!pBase || !parseIndex(pBase, size, size))
+        return false;
+    pMapped = pBase;
+    mappedSize = size;
+    return true;
+}
+
+int32_t ClipBank::find(const char* name) const
+{
+    uint32_t hash = FileNameArena::hashName(name);
+
+    for (size_t i=0; i<entries.size(); i++) {
+        if (entries[i].nameHash == hash && !strcmp(getName(i), name))
+            return i;
+    }
+    return -1;
+}
+
+AudioSampleSource* ClipBank::openClip(const std::shared_ptr<const ClipBank>& bank, uint16_t clip)
+{
+    if (!bank || clip >= bank->size())
+        return nullptr;
+
+    if (bank->isMapped())
+        return new ClipBankSource(bank, clip);
+
+    return new WaveFileType(bank->getPath().c_str(), true, &bank->getEntry(clip));
+}
+
+ClipBankSource::ClipBankSource(std::shared_ptr<const ClipBank> _pBank, uint16_t clip, uint16_t _rampTime)
+    : pBank(_pBank), entry(_pBank->getEntry(clip)), pSamples(_pBank->getSamples(clip)),
+      rangeStart(0), length(entry.length), rampTime(_rampTime), position(0), rampValue(0)
+{
+    assert(pSamples);
+    prepRamps();
+}
+
+void ClipBankSource::prepRamps()
+{
+    // Same steps as readAllSamples(): up from zero in rampInDelta steps, down to zero in rampOutDelta.
+    uint8_t first = length ? pSamples[rangeStart] : 0;
+    uint8_t last = length ? pSamples[rangeStart + length - 1] : 0;
+    uint16_t rampSteps = rampTime / (1000000 / entry.sampleRate);
+    rampInDelta = rampSteps ? first / rampSteps : 0;
+    rampOutDelta = rampSteps ? last / rampSteps : 0;
+    rampInLength = rampInDelta ? (first + rampInDelta - 1) / rampInDelta : 0;
+    rampOutLength = rampOutDelta ? last / rampOutDelta : 0;
+    totalLength = rampInLength + length + rampOutLength;
+}
+
+bool ClipBankSource::setPlayRange(uint32_t startFrame, uint32_t endFrame)
+{
+    if (endFrame > entry.length)
+        endFrame = entry.length;
+    if (endFrame <= startFrame)
+        return false;
+
+    rangeStart = startFrame;
+    length = endFrame - startFrame;
+    prepRamps();
+    position = 0;
+    return true;
+}
+
+const uint8_t* ClipBankSource::getReadPointer()
+{
+    uint32_t pos = position;
+
+    if (pos < rampInLength) {
+        rampValue = pos * rampInDelta;
+        return &rampValue;
+    }
+    pos -= rampInLength;
+    if (pos < length)
+        return pSamples + rangeStart + pos;
+    pos -= length;
+    if (pos < rampOutLength) {
+        rampValue = pSamples[rangeStart + length - 1] - (pos + 1) * rampOutDelta;
+        return &rampValue;
+    }
+    return nullptr;
+}
+
+void ClipBankSource::printFileInfo() {
+#ifdef ESP_PLATFORM
+    Serial.printf("Bank: %s:%s - %u samples, %u Hz, Total Playout Time:%u ms\n", pBank->getPath().c_str(),
+        pBank->getName(&entry - &pBank->getEntry(0)), entry.length, entry.sampleRate,
+        (uint32_t)((uint64_t)entry.length * 1000 / entry.sampleRate));
+#else
+    printf("Bank: %s:%s - %u samples, %u Hz, Total Playout Time:%u ms\n", pBank->getPath().c_str(),
+        pBank->getName(&entry - &pBank->getEntry(0)), entry.length, entry.sampleRate,
+        (uint32_t)((uint64_t)entry.length * 1000 / entry.sampleRate));
+#endif
+}
+
+#ifndef ESP_PLATFORM
+static void put16(std::vector<uint8_t>& out, uint16_t v) { out.push_back(v); out.push_back(v >> 8); }
+static void put32(std::vector<uint8_t>& out, uint32_t v) { put16(out, v); put16(out, v >> 16); }
+
+ClipBankWriter::ClipBankWriter(uint32_t _alignment) : alignment(_alignment ? _alignment : 1)
+{
+}
+
+bool ClipBankWriter::addClip(const char* name, const std::vector<uint8_t>& samples, uint32_t sampleRate)
+{
+    if (!name || !*name || samples.empty() || !sampleRate || clips.size() >= 0xffff)
+        return false;
+    for (auto& c: clips) {
+        if (c.name == name) {
+            printf("ClipBankWriter: '%s' is already in the bank.\n", name);
+            return false;
+        }
+    }
+
+    Clip clip;
+    clip.name = name;
+    clip.samples = samples;
+    clip.sampleRate = sampleRate;
+    clips.push_back(std::move(clip));
+    return true;
+}
+
+bool ClipBankWriter::addFile(const char* fileName, const char* name)
+{
+    std::vector<uint8_t> samples;
+    uint32_t sampleRate;
+
+    if (!name) {
+        const char* slash = strrchr(fileName, '/');
+        name = slash ? slash + 1 : fileName;
+    }
+
+    try {
+        WaveFileStdioReader reader(fileName, false);
+        if (!reader.readAllSamples(samples, false))
+            return false;
+        sampleRate = reader.getSampleRate();
+    } catch(...) {
+        printf("ClipBankWriter: unable to decode '%s'\n", fileName);
+        return false;
+    }
+    return addClip(name, samples, sampleRate);
+}
+
+bool ClipBankWriter::write(const char* fileName)
+{
+    std::vector<uint8_t> head;
+    std::vector<char> names;
+    std::vector<uint32_t> offsets;
+
+    for (auto& c: clips)
+        names.insert(names.end(), c.name.c_str(), c.name.c_str() + c.name.size() + 1);
+    if (names.empty())
+        names.push_back('\0');
+
+    // Payloads follow the names, each rounded up to the alignment.
+    uint32_t namesOffset = ClipBank::HEADER_SIZE + clips.size() * ClipBank::ENTRY_SIZE;
+    uint64_t pos = namesOffset + names.size();
+    for (auto& c: clips) {
+        pos = (pos + alignment - 1) / alignment * alignment;
+        offsets.push_back(pos);
+        pos += c.samples.size();
+    }
+    if (pos > 0xffffffffu) {
+        PrintLN("ClipBankWriter: bank would be over 4GB.");
+        return false;
+    }
+
+    head.insert(head.end(), { 'C', 'L', 'P', 'B' });
+    put16(head, ClipBank::VERSION);
+    put16(head, clips.size());
+    put32(head, alignment);
+    put32(head, namesOffset);
+    put32(head, names.size());
+    put32(head, offsets.empty() ? pos : offsets[0]);
+    put32(head, pos);
+    put32(head, 0);
+
+    uint32_t nameOffset = 0;
+    for (size_t i=0; i<clips.size(); i++) {
+        const Clip& c = clips[i];
+        put32(head, FileNameArena::hashName(c.name.c_str()));
+        put32(head, offsets[i]);
+        put32(head, c.samples.size());
+        put32(head, c.sampleRate);
+        put16(head, ClipBankEntry::FORMAT_DAC8);
+        head.push_back(c.samples.front());
+        head.push_back(c.samples.back());
+        put32(head, nameOffset);
+        nameOffset += c.name.size() + 1;
+    }
+    head.insert(head.end(), names.begin(), names.end());
+
+    FILE* f = fopen(fileName, "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(head.data(), 1, head.size(), f) == head.size();
+    std::vector<uint8_t> pad(alignment, 0);
+    pos = head.size();
+    for (size_t i=0; ok && i<clips.size(); i++) {
+        ok = fwrite(pad.data(), 1, offsets[i] - pos, f) == offsets[i] - pos
+            && fwrite(clips[i].samples.data(), 1, clips[i].samples.size(), f) == clips[i].samples.size();
+        pos = offsets[i] + clips[i].samples.size();
+    }
+    return fclose(f) == 0 && ok;
+}
+#endif
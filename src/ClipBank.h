@@ -0,0 +1,222 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+
+#include "AudioSampleSource.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/*! @struct  ClipBankEntry
+ *  @brief   One clip in a bank's index - where its samples are and what they are.
+ *  @details First and last sample are kept so that the ramp-in and ramp-out can be laid down
+ *           without touching the payload, which matters most for the end of a streamed clip.
+ */
+struct ClipBankEntry
+{
+    uint32_t nameHash;      //!< FileNameArena::hashName() of the clip name
+    uint32_t offset;        //!< Bank file offset of the first sample - a multiple of the bank alignment
+    uint32_t length;        //!< Samples (bytes) in the payload
+    uint32_t sampleRate;
+    uint16_t format;        //!< FORMAT_DAC8 is the only one for now
+    uint8_t firstSample;
+    uint8_t lastSample;
+    uint32_t nameOffset;    //!< Into the bank's name block
+
+    //! 8-bit unsigned mono - what the player outputs, so a payload needs no conversion at all.
+    static const uint16_t FORMAT_DAC8 = 1;
+};
+
+/*! @class   ClipBank
+ *  @brief   Many short clips packed into one file behind an index.
+ *  @details Hundreds of small WAV files cost a directory lookup, an open and a header walk per
+ *           play, and on LittleFS each small file wastes most of a block. A bank is one file:
+ *
+ *           | Offset | Size       | Contents                                                 |
+ *           |--------|------------|----------------------------------------------------------|
+ *           | 0      | 32         | "CLPB", version, clip count, alignment, name block place |
+ *           | 32     | 24 x count | ClipBankEntry per clip, little-endian                    |
+ *           | ...    | ...        | NUL-terminated clip names                                |
+ *           | ...    | ...        | DAC-ready payloads, each starting on an alignment boundary |
+ *
+ *           load() reads the header, index and names once. After that a clip is played by opening
+ *           the bank and doing a single seek to its payload. map() instead points the bank at
+ *           memory - the file mmap()ed on native, a data partition on ESP32 - and clips are played
+ *           straight out of it without a copy. Banks are built with ClipBankWriter.
+ */
+class ClipBank
+{
+public:
+    ClipBank();
+    ~ClipBank();
+    ClipBank(const ClipBank&) = delete;
+    ClipBank& operator=(const ClipBank&) = delete;
+
+    //! @brief Read the index of a bank file. Payloads are streamed from the file when played.
+    bool load(const char* path);
+    /*! @brief Map a whole bank into memory for zero-copy playback.
+     *  @param path - native: a bank file to mmap(). ESP32: the label of a data partition holding
+     *                the bank (flashed with esptool/parttool), mapped through the flash cache.
+     */
+    bool map(const char* path);
+    /*! @brief Use a bank that is already in memory - a const array in flash, say.
+     *  @details Not owned. The memory has to stay put for as long as the bank and its sources live.
+     */
+    bool map(const uint8_t* pBase, size_t size, const char* name);
+
+    uint16_t size() const { return entries.size(); };
+    const ClipBankEntry& getEntry(uint16_t clip) const { return entries[clip]; };
+    const char* getName(uint16_t clip) const { return &names[entries[clip].nameOffset]; };
+    //! @brief Index of a clip by name or -1.
+    int32_t find(const char* name) const;
+    //! @brief The file (or partition) the bank came from.
+    const std::string& getPath() const { return path; };
+    bool isMapped() const { return pMapped != nullptr; };
+    //! @brief A clip's samples when the bank is mapped. nullptr otherwise.
+    const uint8_t* getSamples(uint16_t clip) const { return pMapped ? pMapped + entries[clip].offset : nullptr; };
+
+    /*! @brief Make a source the player can play for one clip.
+     *  @details Mapped banks give a ClipBankSource, which holds a reference to the bank. Otherwise
+     *           it is a streaming reader on the bank file, positioned with one seek.
+     *  @return nullptr if clip is out of range. Throws like the readers if the file won't open.
+     */
+    static AudioSampleSource* openClip(const std::shared_ptr<const ClipBank>& bank, uint16_t clip);
+
+    static const uint16_t VERSION = 1;
+    static const uint8_t HEADER_SIZE = 32;
+    static const uint8_t ENTRY_SIZE = 24;
+
+protected:
+    //! @brief Check the header and pull in the index and names. pData starts at the header.
+    bool parseIndex(const uint8_t* pData, size_t available, size_t bankSize);
+    void unmap();
+
+    std::string path;
+    std::vector<ClipBankEntry> entries;
+    std::vector<char> names;
+    const uint8_t* pMapped;
+    size_t mappedSize;
+    //! @name How pMapped was obtained - so it can be given back.
+    //!@{
+#ifdef ESP_PLATFORM
+    uint32_t mmapHandle;
+    bool bPartitionMapped;
+#else
+    bool bFileMapped;
+#endif
+    //!@}
+};
+
+/*! @class   ClipBankSource
+ *  @brief   Plays a clip out of a mapped bank with no copy.
+ *  @details Like WaveMemorySource but the payload has no ramps in it, so the ramp-in and ramp-out
+ *           are produced on the fly from the index's first and last sample. They come out the same
+ *           as the ramps readAllSamples() applies.
+ */
+class ClipBankSource : public AudioSampleSource
+{
+public:
+    ClipBankSource(std::shared_ptr<const ClipBank> _pBank, uint16_t clip, uint16_t _rampTime=500);
+
+    const uint8_t* getReadPointer();
+    void advanceReadPointer() { if (position < totalLength) position++; };
+    bool isPlaybackComplete() { return position >= totalLength; };
+    uint32_t getSampleRate() { return entry.sampleRate; };
+    void printFileInfo();
+    //! @brief Start over from the ramp-in.
+    void rewind() { position = 0; };
+    //! @brief Straight to a payload sample - the ramp-in is only played from the top.
+    bool seekToFrame(uint32_t frame) {
+        frame = frame > rangeStart ? frame - rangeStart : 0;
+        position = rampInLength + (frame < length ? frame : length);
+        return true;
+    };
+    uint32_t getPositionFrames() {
+        uint32_t pos = position;
+        return rangeStart + (pos <= rampInLength ? 0 : (pos - rampInLength < length ? pos - rampInLength : length));
+    };
+    uint32_t getTotalFrames() { return entry.length; };
+    //! @brief Narrow the payload to [startFrame, endFrame). The ramps are worked out again for its ends.
+    bool setPlayRange(uint32_t startFrame, uint32_t endFrame);
+
+protected:
+    //! @brief Ramp lengths and steps for the payload between rangeStart and rangeStart + length.
+    void prepRamps();
+
+    std::shared_ptr<const ClipBank> pBank;
+    const ClipBankEntry& entry;
+    const uint8_t* pSamples;
+    //! The part of the payload played - all of it unless setPlayRange() says otherwise.
+    uint32_t rangeStart;
+    uint32_t length;
+    uint16_t rampTime;
+    uint16_t rampInLength;
+    uint16_t rampOutLength;
+    uint8_t rampInDelta;
+    uint8_t rampOutDelta;
+    uint32_t totalLength;
+    volatile uint32_t position;
+    //! Ramp samples don't exist anywhere, so the read pointer points here while they play.
+    uint8_t rampValue;
+};
+
+#ifndef ESP_PLATFORM
+/*! @class   ClipBankWriter
+ *  @brief   Builds a clip bank file. Native only - banks are made on the host and uploaded.
+ *  @details Clips are decoded to DAC-ready samples (no ramps) as they are added and written out,
+ *           index first, by write().
+ */
+class ClipBankWriter
+{
+public:
+    //! @param _alignment - payload alignment in bytes. 4 suits memcpy/DMA, 4096 lines up with flash sectors.
+    ClipBankWriter(uint32_t _alignment=4);
+    //! @brief Add samples which are already DAC-ready 8-bit mono. @return false on a duplicate name.
+    bool addClip(const char* name, const std::vector<uint8_t>& samples, uint32_t sampleRate);
+    /*! @brief Decode any file the readers can play and add it.
+     *  @param name - optional - defaults to the file name without its directory.
+     */
+    bool addFile(const char* fileName, const char* name=nullptr);
+    //! @brief Write the bank. @return false if the file couldn't be written.
+    bool write(const char* fileName);
+    size_t size() const { return clips.size(); };
+
+protected:
+    struct Clip {
+        std::string name;
+        std::vector<uint8_t> samples;
+        uint32_t sampleRate;
+    };
+    std::vector<Clip> clips;
+    uint32_t alignment;
+};
+#endif
@@ -0,0 +1,299 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "DuckingMixer.h"
+#include "utils.h"
+
+const uint8_t DuckingMixer::FADE_MS;
+const uint8_t DuckingMixer::DUCK_MS;
+
+// Unity gain, Q16.
+static const int32_t GAIN_UNITY = 65536;
+
+DuckingMixer::DuckingMixer()
+    : pBack(nullptr), pFront(nullptr), mode(Preempt), bResume(false), stage(Done), current(0),
+      backSample(0), frontSample(0), bFrontStarted(false), frontStartUS(0), backLevel(256), frontLevel(256),
+      frontStep(0), frontAcc(0), frontTotal(0),
+      fadeFrom(0), fadeTarget(0), fadeLen(1), fadeLeft(0), backGain(GAIN_UNITY), duckGain(0),
+      backGainDelta(1), frontGain(0), frontGainDelta(1), frontFadeLen(1)
+{
+}
+
+void DuckingMixer::begin(AudioSampleSource* _pBack, AudioSampleSource* _pFront, Mode _mode, bool _bResume, uint8_t duckPercent,
+                         uint16_t backLevelQ8, uint16_t frontLevelQ8)
+{
+    stage = Done;
+    pBack = _pBack;
+    pFront = _pFront;
+    mode = _mode;
+    bResume = _bResume;
+    backLevel = backLevelQ8;
+    frontLevel = frontLevelQ8;
+    bFrontStarted = false;
+    frontStartUS = 0;
+
+    uint32_t rate = pBack->getSampleRate();
+    uint32_t frontRate = pFront->getSampleRate();
+    frontStep = ((uint64_t)frontRate << 16) / rate;
+    frontAcc = 0;
+    frontSample = 0;
+    frontTotal = pFront->getTotalFrames();
+
+    // The output path may still be on the back - look, don't move it on.
+    const uint8_t* p = pBack->getReadPointer();
+    backSample = p ? applyLevel(*p, backLevel) : 0;
+    current = backSample;
+
+    fadeLen = (uint32_t)FADE_MS * rate / 1000;
+    fadeLen = fadeLen ? fadeLen : 1;
+    uint32_t duckLen = (uint32_t)DUCK_MS * rate / 1000;
+    duckLen = duckLen ? duckLen : 1;
+    duckGain = (int32_t)(duckPercent > 100 ? 100 : duckPercent) * GAIN_UNITY / 100;
+    backGain = GAIN_UNITY;
+    backGainDelta = (GAIN_UNITY - duckGain) / (int32_t)duckLen;
+    backGainDelta = backGainDelta ? backGainDelta : 1;
+    frontGain = 0;
+    frontGainDelta = GAIN_UNITY / (int32_t)duckLen;
+    frontGainDelta = frontGainDelta ? frontGainDelta : 1;
+    frontFadeLen = (uint32_t)DUCK_MS * frontRate / 1000;
+    frontFadeLen = frontFadeLen ? frontFadeLen : 1;
+
+    // Down to where the front's ramp starts from, so a front at another level doesn't jump there.
+    if (mode == Preempt)
+        startFade(FadeOut, applyLevel(0, frontLevel));
+    else
+        stage = Ducked;
+}
+
+#ifdef ESP_PLATFORM
+uint8_t IRAM_ATTR DuckingMixer::applyLevel(uint8_t sample, uint16_t levelQ8)
+#else
+uint8_t DuckingMixer::applyLevel(uint8_t sample, uint16_t levelQ8)
+#endif
+{
+    if (levelQ8 == 256)
+        return sample;
+
+    // 127 is where the volume table pivots - the same gain here and there gives the same output.
+    int32_t scaled = 127 + ((((int32_t)sample - 127) * levelQ8 + 128) >> 8);
+    return scaled < 0 ? 0 : (scaled > 255 ? 255 : scaled);
+}
+
+#ifdef ESP_PLATFORM
+const uint8_t* IRAM_ATTR DuckingMixer::getReadPointer()
+#else
+const uint8_t* DuckingMixer::getReadPointer()
+#endif
+{
+    if (stage == Back) {
+        const uint8_t* p = pBack->getReadPointer();
+        if (!p || backLevel == 256)
+            return p;
+        current = applyLevel(*p, backLevel);
+        return &current;
+    }
+    return stage == Done ? nullptr : &current;
+}
+
+#ifdef ESP_PLATFORM
+bool IRAM_ATTR DuckingMixer::isPlaybackComplete()
+#else
+bool DuckingMixer::isPlaybackComplete()
+#endif
+{
+    return !pBack || stage == Done || (stage == Back && pBack->isPlaybackComplete());
+}
+
+#ifdef ESP_PLATFORM
+uint8_t IRAM_ATTR DuckingMixer::takeBack()
+#else
+uint8_t DuckingMixer::takeBack()
+#endif
+{
+    // A starved back holds its last sample rather than replaying stale buffer contents.
+    const uint8_t* p = pBack->isStarved() ? nullptr : pBack->getReadPointer();
+    if (p) {
+        backSample = applyLevel(*p, backLevel);
+        pBack->advanceReadPointer();
+    }
+    return backSample;
+}
+
+#ifdef ESP_PLATFORM
+uint8_t IRAM_ATTR DuckingMixer::takeFront()
+#else
+uint8_t DuckingMixer::takeFront()
+#endif
+{
+    const uint8_t* p = pFront->isStarved() ? nullptr : pFront->getReadPointer();
+    if (!p)
+        return frontSample;
+
+    frontSample = applyLevel(*p, frontLevel);
+    if (!bFrontStarted) {
+        bFrontStarted = true;
+        frontStartUS = getMicros();
+    }
+    for (frontAcc += frontStep; frontAcc >= (uint32_t)GAIN_UNITY; frontAcc -= GAIN_UNITY)
+        pFront->advanceReadPointer();
+    return frontSample;
+}
+
+#ifdef ESP_PLATFORM
+void IRAM_ATTR DuckingMixer::startFade(Stage _stage, uint8_t target)
+#else
+void DuckingMixer::startFade(Stage _stage, uint8_t target)
+#endif
+{
+    fadeFrom = current;
+    fadeTarget = target;
+    fadeLeft = fadeLen;
+    stage = _stage;
+}
+
+#ifdef ESP_PLATFORM
+uint8_t IRAM_ATTR DuckingMixer::fadeStep()
+#else
+uint8_t DuckingMixer::fadeStep()
+#endif
+{
+    return ((uint32_t)fadeFrom * fadeLeft + (uint32_t)fadeTarget * (fadeLen - fadeLeft)) / fadeLen;
+}
+
+#ifdef ESP_PLATFORM
+void IRAM_ATTR DuckingMixer::endFront()
+#else
+void DuckingMixer::endFront()
+#endif
+{
+    if (!bResume) {
+        // Preempt has already ramped out with the front.
+        if (mode == Duck)
+            startFade(DropOut, 0);
+        else
+            stage = Done;
+        return;
+    }
+
+    if (mode == Duck) {
+        stage = Unduck;
+        return;
+    }
+
+    // The back was held where it was faded out - come back in to that very sample, from where
+    // the front's ramp left off.
+    const uint8_t* p = pBack->isPlaybackComplete() ? nullptr : pBack->getReadPointer();
+    if (!p) {
+        stage = Done;
+        return;
+    }
+    startFade(FadeIn, applyLevel(*p, backLevel));
+}
+
+#ifdef ESP_PLATFORM
+void IRAM_ATTR DuckingMixer::advanceReadPointer()
+#else
+void DuckingMixer::advanceReadPointer()
+#endif
+{
+    switch (stage) {
+    case FadeOut:
+        if (--fadeLeft) {
+            current = fadeStep();
+            break;
+        }
+        stage = Front;
+        // fall through
+    case Front:
+        if (pFront->isPlaybackComplete())
+            endFront();
+        else
+            current = takeFront();
+        break;
+    case FadeIn:
+        if (--fadeLeft)
+            current = fadeStep();
+        else
+            stage = Back;
+        break;
+    case Unduck:
+        if (backGain >= GAIN_UNITY) {
+            stage = Back;
+            break;
+        }
+        backGain = backGain + backGainDelta < GAIN_UNITY ? backGain + backGainDelta : GAIN_UNITY;
+        // fall through
+    case Ducked: {
+        // Mixed about the midpoint - both sources' zero is 128 here, not the DAC's 0.
+        int32_t mixed = 128 + ((((int32_t)takeBack() - 128) * backGain + 0x8000) >> 16);
+        if (stage == Ducked) {
+            if (pFront->isPlaybackComplete())
+                endFront();
+            else {
+                mixed += (((int32_t)takeFront() - 128) * frontGain + 0x8000) >> 16;
+                backGain = backGain - backGainDelta > duckGain ? backGain - backGainDelta : duckGain;
+
+                // Fade the front out over its last samples - its ramp to zero then never shows.
+                int32_t cap = GAIN_UNITY;
+                if (frontTotal) {
+                    uint32_t pos = pFront->getPositionFrames();
+                    uint32_t left = pos < frontTotal ? frontTotal - pos : 0;
+                    if (left < frontFadeLen)
+                        cap = (uint64_t)left * GAIN_UNITY / frontFadeLen;
+                }
+                frontGain = frontGain + frontGainDelta < cap ? frontGain + frontGainDelta : cap;
+            }
+        }
+        current = mixed < 0 ? 0 : (mixed > 255 ? 255 : mixed);
+        break;
+    }
+    case DropOut:
+        if (--fadeLeft)
+            current = fadeStep();
+        else
+            stage = Done;
+        break;
+    case Back:
+        pBack->advanceReadPointer();
+        break;
+    case Done:
+        break;
+    }
+}
+
+void DuckingMixer::printFileInfo()
+{
+#ifdef ESP_PLATFORM
+    Serial.printf("Mixer: %s, then %s.\n", mode == Duck ? "ducking" : "preempting", bResume ? "resume" : "drop");
+#else
+    printf("Mixer: %s, then %s.\n", mode == Duck ? "ducking" : "preempting", bResume ? "resume" : "drop");
+#endif
+    if (pFront)
+        pFront->printFileInfo();
+    if (pBack)
+        pBack->printFileInfo();
+}
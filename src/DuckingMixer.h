@@ -0,0 +1,149 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+
+#include "AudioSampleSource.h"
+
+/*! @class   DuckingMixer
+ *  @brief   Plays a front source over a back source - how a higher-priority sound interrupts the
+ *           one playing.
+ *  @details Preempt fades the back to the front's zero in FADE_MS and holds it where it is while
+ *           the front plays with its own ramps. Duck turns the back down to a percentage over
+ *           DUCK_MS and mixes the front over it about the midpoint. The front is faded in over the
+ *           same time and out over its last DUCK_MS, which also keeps its ramps to and from zero
+ *           out of the mix. Once the front is done the back is faded back in (resume) or the
+ *           output ramps out and playback is complete (drop).
+ *           Output runs at the back's rate - the front is stepped at its own rate and each of
+ *           its samples held for as long as it lasts. Positions, seeks and buffer levels are the
+ *           back's. Neither source is owned.
+ *           Each source has its own level, applied the way the player's volume table applies
+ *           SetClipGain(), so the table can stay at unity while two clips share the output.
+ *           The per-sample methods are in IRAM on ESP32 - the player's timer ISR calls them.
+ */
+class DuckingMixer : public AudioSampleSource
+{
+public:
+    enum Mode : uint8_t { Preempt, Duck };
+
+    DuckingMixer();
+
+    /*! @brief Start playing pFront over pBack - pBack is normally the source playing right now.
+     *  @details Only peeks at pBack, so it may be called while the output path is still reading it.
+     *  @param bResume - carry on with pBack after pFront. Otherwise finish with pFront.
+     *  @param duckPercent - Duck only - level of pBack under pFront, 0-100.
+     *  @param backLevelQ8, frontLevelQ8 - each source's clip gain, 256 for unity.
+     */
+    void begin(AudioSampleSource* _pBack, AudioSampleSource* _pFront, Mode _mode, bool _bResume, uint8_t duckPercent=20,
+               uint16_t backLevelQ8=256, uint16_t frontLevelQ8=256);
+    //! @brief Let go of both sources. The owner deletes them.
+    void reset() { pBack = pFront = nullptr; stage = Done; };
+    bool isActive() { return pBack != nullptr; };
+    //! @brief True until the front is done - while the back is faded, held or ducked.
+    bool isInterrupting() { return stage == FadeOut || stage == Front || stage == Ducked; };
+    AudioSampleSource* getBack() { return pBack; };
+    AudioSampleSource* getFront() { return pFront; };
+    //! @brief getMicros() when the front's first sample was mixed in. 0 until then.
+    uint32_t getFrontStartUS() { return frontStartUS; };
+
+    const uint8_t* getReadPointer();
+    void advanceReadPointer();
+    bool isPlaybackComplete();
+    uint32_t getSampleRate() { return pBack ? pBack->getSampleRate() : 1; };
+    bool isBufferPrimed() { return pFront ? pFront->isBufferPrimed() : true; };
+    //! @brief Only once the back plays alone - until then starving sources are held, not waited on.
+    bool isStarved() { return stage == Back && pBack->isStarved(); };
+    uint8_t getBufferFullPercentage() { return pBack ? pBack->getBufferFullPercentage() : 100; };
+    uint8_t getFileReadPercentage() { return pBack ? pBack->getFileReadPercentage() : 100; };
+    void printFileInfo();
+    //! @brief Only once the back plays alone.
+    bool seekToFrame(uint32_t frame) { return stage == Back && pBack->seekToFrame(frame); };
+    uint32_t getPositionFrames() { return pBack ? pBack->getPositionFrames() : 0; };
+    uint32_t getTotalFrames() { return pBack ? pBack->getTotalFrames() : 0; };
+    void stopLooping() { if (pBack) pBack->stopLooping(); };
+
+    //! Time to fade the back to or from the DAC's zero.
+    static const uint8_t FADE_MS = 2;
+    //! Time to duck the back and fade the front in or out over it.
+    static const uint8_t DUCK_MS = 10;
+
+protected:
+    enum Stage : uint8_t { FadeOut, Front, FadeIn, Ducked, Unduck, DropOut, Back, Done };
+
+    //! @brief The back's sample, moving it on unless it is waiting on its reader.
+    uint8_t takeBack();
+    //! @brief The front's sample for this output sample, moving it on at its own rate.
+    uint8_t takeFront();
+    //! @brief The front has played out - go on to the back or finish.
+    void endFront();
+    //! @brief Ramp linearly from the current sample to target.
+    void startFade(Stage _stage, uint8_t target);
+    //! @brief The next sample of the fade in progress.
+    uint8_t fadeStep();
+    //! @brief A sample scaled by a Q8 level about the volume table's midpoint.
+    static uint8_t applyLevel(uint8_t sample, uint16_t levelQ8);
+
+    AudioSampleSource* pBack;
+    AudioSampleSource* pFront;
+    Mode mode;
+    bool bResume;
+    volatile Stage stage;
+    uint8_t current;
+    uint8_t backSample;
+    uint8_t frontSample;
+    bool bFrontStarted;
+    volatile uint32_t frontStartUS;
+    uint16_t backLevel;
+    uint16_t frontLevel;
+
+    //! Front samples per output sample, Q16.
+    uint32_t frontStep;
+    uint32_t frontAcc;
+    //! The front's length, read once in begin() rather than for every mixed sample. 0 if unknown.
+    uint32_t frontTotal;
+
+    //! @name Fades to and from zero
+    //!@{
+    uint8_t fadeFrom;
+    uint8_t fadeTarget;
+    uint32_t fadeLen;
+    uint32_t fadeLeft;
+    //!@}
+    //! @name Duck gains, Q16
+    //!@{
+    int32_t backGain;
+    int32_t duckGain;
+    int32_t backGainDelta;
+    int32_t frontGain;
+    int32_t frontGainDelta;
+    //! The front's fade-out, in front samples.
+    uint32_t frontFadeLen;
+    //!@}
+};
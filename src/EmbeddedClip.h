@@ -0,0 +1,51 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+
+/*! @struct  EmbeddedClip
+ *  @brief   A clip compiled into the program - samples and metadata as constexpr data.
+ *  @details Headers of these are generated from audio files by tools/embedclip. The samples are
+ *           DAC-ready 8-bit unsigned mono with the ramp-in and ramp-out already applied, so they
+ *           play exactly as the file would. Being const they stay in flash on the ESP32 (no RAM)
+ *           and need no filesystem, thread or allocation to play.
+ *           @see AudioFilePlayer::LoadEmbedded, AudioPlaylistManager::PlayEmbedded
+ *  @note    A generated header defines the arrays, so include it from one .cpp file only -
+ *           C++11 gives each including file its own copy.
+ */
+struct EmbeddedClip
+{
+    const char* name;
+    const uint8_t* samples;
+    uint32_t length;
+    uint32_t sampleRate;
+
+    constexpr uint32_t durationMS() const { return (uint64_t)length * 1000 / sampleRate; }
+};
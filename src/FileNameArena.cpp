@@ -0,0 +1,185 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "FileNameArena.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+const int16_t FileNameArena::NO_LOUDNESS;
+
+//! Zero is kept for an empty arena.
+static std::atomic<uint32_t> nextEntriesStamp(1);
+
+FileNameArena::FileNameArena()
+{
+    lastDir = 0;
+    entriesStamp = 0;
+}
+
+uint32_t FileNameArena::hashName(const char* name)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*name) {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int32_t FileNameArena::findDir(const char* dir, size_t len) const
+{
+    if (lastDir < dirs.size() && dirs[lastDir].size() == len && !dirs[lastDir].compare(0, len, dir, len))
+        return lastDir;
+
+    for (size_t i=0; i<dirs.size(); i++) {
+        if (dirs[i].size() == len && !dirs[i].compare(0, len, dir, len))
+            return i;
+    }
+
+    return -1;
+}
+
+void FileNameArena::addSplit(const char* dir, size_t dirLen, const char* name)
+{
+    int32_t found = findDir(dir, dirLen);
+
+    if (found < 0) {
+        assert(dirs.size() < 0xffff);
+        dirs.push_back(std::string(dir, dirLen));
+        found = dirs.size() - 1;
+    }
+    lastDir = found;
+    entriesStamp = nextEntriesStamp++;
+
+    nameOffsets.push_back(names.size());
+    dirIndex.push_back(lastDir);
+    nameHashes.push_back(hashName(name));
+    loudness.push_back(NO_LOUDNESS);
+    peaks.push_back(0);
+    trims.push_back(0);
+    trims.push_back(0);
+    names.insert(names.end(), name, name + strlen(name) + 1);
+}
+
+void FileNameArena::add(const char* path)
+{
+    assert(path);
+    const char* slash = strrchr(path, '/');
+    size_t dirLen = slash ? slash - path + 1 : 0;
+
+    addSplit(path, dirLen, path + dirLen);
+}
+
+void FileNameArena::append(const FileNameArena& other)
+{
+    names.reserve(names.size() + other.names.size());
+    nameOffsets.reserve(size() + other.size());
+    dirIndex.reserve(size() + other.size());
+    nameHashes.reserve(size() + other.size());
+    loudness.reserve(size() + other.size());
+    peaks.reserve(size() + other.size());
+    trims.reserve((size() + other.size()) * 2);
+
+    for (size_t i=0; i<other.size(); i++) {
+        const std::string& dir = other.getDir(i);
+        addSplit(dir.c_str(), dir.size(), other.getName(i));
+        setLoudness(size() - 1, other.getLoudness(i), other.getPeak(i));
+        setTrim(size() - 1, other.getLeadTrimMS(i), other.getTailTrimMS(i));
+    }
+}
+
+void FileNameArena::clear()
+{
+    dirs.clear();
+    names.clear();
+    nameOffsets.clear();
+    dirIndex.clear();
+    nameHashes.clear();
+    loudness.clear();
+    peaks.clear();
+    trims.clear();
+    lastDir = 0;
+    entriesStamp = 0;
+}
+
+void FileNameArena::shrinkToFit()
+{
+    dirs.shrink_to_fit();
+    names.shrink_to_fit();
+    nameOffsets.shrink_to_fit();
+    dirIndex.shrink_to_fit();
+    nameHashes.shrink_to_fit();
+    loudness.shrink_to_fit();
+    peaks.shrink_to_fit();
+    trims.shrink_to_fit();
+}
+
+int32_t FileNameArena::find(const char* path) const
+{
+    if (!path)
+        return -1;
+
+    const char* slash = strrchr(path, '/');
+    size_t dirLen = slash ? slash - path + 1 : 0;
+    const char* name = path + dirLen;
+    int32_t dir = findDir(path, dirLen);
+
+    if (dir < 0)
+        return -1;
+
+    uint32_t hash = hashName(name);
+    for (size_t i=0; i<nameHashes.size(); i++) {
+        if (nameHashes[i] == hash && dirIndex[i] == dir && !strcmp(getName(i), name))
+            return i;
+    }
+    return -1;
+}
+
+bool FileNameArena::hasSameEntries(const FileNameArena& other) const
+{
+    if (entriesStamp == other.entriesStamp)
+        return true;
+    if (size() != other.size())
+        return false;
+
+    return nameOffsets == other.nameOffsets && dirIndex == other.dirIndex && names == other.names && dirs == other.dirs;
+}
+
+size_t FileNameArena::getBytesUsed() const
+{
+    size_t bytes = names.capacity() + nameOffsets.capacity() * sizeof(uint32_t)
+                 + dirIndex.capacity() * sizeof(uint16_t) + nameHashes.capacity() * sizeof(uint32_t)
+                 + loudness.capacity() * sizeof(int16_t) + peaks.capacity() + trims.capacity() * sizeof(uint16_t)
+                 + dirs.capacity() * sizeof(std::string);
+
+    for (auto& dir: dirs)
+        bytes += dir.capacity() + 1;
+    return bytes;
+}
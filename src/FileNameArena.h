@@ -0,0 +1,112 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+
+#include <vector>
+#include <string>
+
+/*! @class   FileNameArena
+ *  @brief   Compact storage for a large list of file paths.
+ *  @details A std::string per entry costs its own header plus a heap block holding the full path,
+ *           directory prefix and all, for every file. Here:
+ *           - Directory prefixes (up to and including the last '/') are interned once.
+ *           - File names are packed NUL-terminated, back to back, in one contiguous block.
+ *           - Each entry is an offset into that block, a directory index, a name hash, its
+ *             loudness and peak and its silence trims (17 bytes) - flat arrays, so a few
+ *             allocations in total however many entries.
+ *
+ *           Entries are append-only. getName()/getDir() give allocation-free access for iterating,
+ *           getPath() assembles the full path for opening the file.
+ */
+class FileNameArena
+{
+public:
+    FileNameArena();
+    //! @brief Add a full path. The directory part is split off and interned.
+    void add(const char* path);
+    //! @brief Append every entry of another arena.
+    void append(const FileNameArena& other);
+    //! @brief Drop all entries and directories.
+    void clear();
+    //! @brief Release spare capacity once the list is built.
+    void shrinkToFit();
+
+    size_t size() const { return nameOffsets.size(); };
+    bool empty() const { return nameOffsets.empty(); };
+    //! @brief File name without its directory. Valid until the arena is modified.
+    const char* getName(size_t entry) const { return &names[nameOffsets[entry]]; };
+    //! @brief Interned directory prefix of an entry, including the trailing '/'.
+    const std::string& getDir(size_t entry) const { return dirs[dirIndex[entry]]; };
+    //! @brief The full path as it was added.
+    std::string getPath(size_t entry) const { return getDir(entry) + getName(entry); };
+    //! @brief Index of a full path or -1 if it isn't in the list.
+    int32_t find(const char* path) const;
+    //! @brief Same paths in the same order - the per-entry loudness may differ.
+    //!        Constant time for a copy of this arena with none added since, or a different size.
+    bool hasSameEntries(const FileNameArena& other) const;
+
+    //! getLoudness() of an entry which hasn't been measured.
+    static const int16_t NO_LOUDNESS = -32768;
+    //! @brief Loudness of an entry in hundredths of a LUFS (relative to DAC full scale). @see LoudnessAnalyzer
+    int16_t getLoudness(size_t entry) const { return loudness[entry]; };
+    //! @brief Sample peak of an entry as a distance from the DAC midpoint, 0-128.
+    uint8_t getPeak(size_t entry) const { return peaks[entry]; };
+    void setLoudness(size_t entry, int16_t centiLUFS, uint8_t peak) { loudness[entry] = centiLUFS; peaks[entry] = peak; };
+    //! @brief Leading and trailing silence of an entry in milliseconds. 0 when none or not measured.
+    uint16_t getLeadTrimMS(size_t entry) const { return trims[entry * 2]; };
+    uint16_t getTailTrimMS(size_t entry) const { return trims[entry * 2 + 1]; };
+    void setTrim(size_t entry, uint16_t leadMS, uint16_t tailMS) { trims[entry * 2] = leadMS; trims[entry * 2 + 1] = tailMS; };
+
+    //! @brief Heap bytes held by the arena (capacity, not just what is in use).
+    size_t getBytesUsed() const;
+    size_t getDirCount() const { return dirs.size(); };
+    //! @brief FNV-1a - a cheap first check before comparing names. Clip banks store the same hash.
+    static uint32_t hashName(const char* name);
+
+protected:
+    //! @brief Index of an interned directory or -1.
+    int32_t findDir(const char* dir, size_t len) const;
+    void addSplit(const char* dir, size_t dirLen, const char* name);
+
+    std::vector<std::string> dirs;
+    std::vector<char> names;
+    std::vector<uint32_t> nameOffsets;
+    std::vector<uint16_t> dirIndex;
+    std::vector<uint32_t> nameHashes;
+    std::vector<int16_t> loudness;
+    std::vector<uint8_t> peaks;
+    //! Lead and tail trim of each entry, interleaved.
+    std::vector<uint16_t> trims;
+    //! Most recently used directory. Files arrive a directory at a time so this nearly always hits.
+    uint16_t lastDir;
+    //! Changed by every add and clear, carried by copies. Equal stamps mean equal entries.
+    uint32_t entriesStamp;
+};
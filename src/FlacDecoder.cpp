@@ -0,0 +1,467 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "FlacDecoder.h"
+
+#include <string.h>
+
+////////////////////////////////////
+//
+// B I T   R E A D E R
+//
+////////////////////////////////////
+
+void FlacDecoder::BitReader::refill() {
+    while (bits <= 56) {
+        uint8_t next = 0;
+        if (pNext < pEnd)
+            next = *pNext++;
+        else
+            padded++;
+        cache |= (uint64_t)next << (56 - bits);
+        bits += 8;
+    }
+}
+
+uint32_t FlacDecoder::BitReader::get(uint8_t n) {
+    if (!n)
+        return 0;
+    if (bits < n)
+        refill();
+    uint32_t value = (uint32_t)(cache >> (64 - n));
+    cache <<= n;
+    bits -= n;
+    return value;
+}
+
+int32_t FlacDecoder::BitReader::getSigned(uint8_t n) {
+    if (!n)
+        return 0;
+    // Sign-extend from n bits.
+    return (int32_t)(get(n) << (32 - n)) >> (32 - n);
+}
+
+uint32_t FlacDecoder::BitReader::getUnary() {
+    uint32_t count = 0;
+    while (true) {
+        if (!bits)
+            refill();
+        // Bits past 'bits' in the cache are always zero, so a zero cache means no 1 bit is loaded.
+        if (cache) {
+            uint8_t zeros = __builtin_clzll(cache);
+            if (zeros < bits) {
+                count += zeros;
+                cache <<= zeros + 1;
+                bits -= zeros + 1;
+                return count;
+            }
+        }
+        count += bits;
+        cache = 0;
+        bits = 0;
+        if (overran())
+            return count;   // Ran off the end - caller sees overran()
+    }
+}
+
+////////////////////////////////////
+//
+// S T R E A M   S E T U P
+//
+////////////////////////////////////
+
+FlacDecoder::FlacDecoder()
+{
+    maxBlockSize = 0;
+    maxFrameSize = 0;
+    sampleRate = 0;
+    numChannels = 0;
+    bitsPerSample = 0;
+    totalSamples = 0;
+    pInput = nullptr;
+    inputSize = inputCount = inputPos = 0;
+    bInputEnd = false;
+    pChannel[0] = pChannel[1] = nullptr;
+    pDecoded = nullptr;
+    decodedCount = decodedPos = 0;
+    samplesDecoded = 0;
+}
+
+FlacDecoder::~FlacDecoder()
+{
+    delete [] pInput;
+    delete [] pChannel[0];
+    delete [] pChannel[1];
+    delete [] pDecoded;
+}
+
+bool FlacDecoder::parseStreamInfo(const uint8_t* p) {
+    if (pInput)
+        return false;   // Only one STREAMINFO per stream
+
+    maxBlockSize = p[2]<<8 | p[3];
+    maxFrameSize = p[7]<<16 | p[8]<<8 | p[9];
+    sampleRate = p[10]<<12 | p[11]<<4 | p[12]>>4;
+    numChannels = ((p[12]>>1) & 0x07) + 1;
+    bitsPerSample = ((p[12]&0x01)<<4 | p[13]>>4) + 1;
+    totalSamples = (uint64_t)(p[13]&0x0f)<<32 | (uint32_t)(p[14]<<24 | p[15]<<16 | p[16]<<8 | p[17]);
+
+    if (maxBlockSize < 16 || numChannels > 2 || bitsPerSample < 4 || bitsPerSample > 24 || !sampleRate)
+        return false;
+
+    // Worst case is a verbatim frame (side channel one bit wider) plus header, subframe headers
+    // and CRC. Encoders that record the real maximum let us buffer less.
+    uint32_t worstFrame = ((uint32_t)maxBlockSize * (numChannels * bitsPerSample + 1) + 7) / 8 + 32;
+    if (!maxFrameSize || maxFrameSize > worstFrame)
+        maxFrameSize = worstFrame;
+
+    // Headroom past one frame so reads come in reasonable chunks rather than a few bytes at a time.
+    inputSize = maxFrameSize + 2048;
+    pInput = new uint8_t[inputSize];
+    for (uint8_t ch=0; ch<numChannels; ch++)
+        pChannel[ch] = new int32_t[maxBlockSize];
+    pDecoded = new uint8_t[maxBlockSize];
+    return true;
+}
+
+void FlacDecoder::addSeekPoint(const uint8_t* p) {
+    SeekPoint point;
+    point.sampleNumber = 0;
+    point.offset = 0;
+    for (uint8_t i=0; i<8; i++) {
+        point.sampleNumber = point.sampleNumber<<8 | p[i];
+        point.offset = point.offset<<8 | p[8+i];
+    }
+    if (point.sampleNumber != 0xFFFFFFFFFFFFFFFFull)
+        seekPoints.push_back(point);
+}
+
+bool FlacDecoder::findSeekPoint(uint64_t sample, uint64_t& sampleNumber, uint64_t& offset) {
+    // Points are in ascending sample order per the spec.
+    bool bFound = false;
+    for (size_t i=0; i<seekPoints.size() && seekPoints[i].sampleNumber <= sample; i++) {
+        sampleNumber = seekPoints[i].sampleNumber;
+        offset = seekPoints[i].offset;
+        bFound = true;
+    }
+    if (!bFound)
+        sampleNumber = offset = 0;
+    return bFound;
+}
+
+uint8_t* FlacDecoder::getInputSpace(size_t& room) {
+    if (inputPos) {
+        memmove(pInput, pInput + inputPos, inputCount - inputPos);
+        inputCount -= inputPos;
+        inputPos = 0;
+    }
+    room = inputSize - inputCount;
+    return pInput + inputCount;
+}
+
+void FlacDecoder::reset(uint64_t atSample) {
+    inputCount = inputPos = 0;
+    bInputEnd = false;
+    decodedCount = decodedPos = 0;
+    samplesDecoded = atSample;
+}
+
+size_t FlacDecoder::take(uint8_t* pDest, size_t maxSamples) {
+    size_t count = available();
+    if (count > maxSamples)
+        count = maxSamples;
+    memcpy(pDest, pDecoded + decodedPos, count);
+    decodedPos += count;
+    return count;
+}
+
+size_t FlacDecoder::take(int16_t* pDest, size_t maxSamples) {
+    size_t count = available();
+    if (count > maxSamples)
+        count = maxSamples;
+
+    // The channel blocks still hold the whole frame - the DAC bytes were made from them.
+    int8_t shift = bitsPerSample - 16;
+    for (size_t i=0; i<count; i++) {
+        int32_t sum = 0;
+        for (uint8_t ch=0; ch<numChannels; ch++) {
+            int32_t s = pChannel[ch][decodedPos + i];
+            sum += shift >= 0 ? s >> shift : s << -shift;
+        }
+        pDest[i] = sum / numChannels;
+    }
+    decodedPos += count;
+    return count;
+}
+
+////////////////////////////////////
+//
+// F R A M E   D E C O D I N G
+//
+////////////////////////////////////
+
+bool FlacDecoder::decodeFrame() {
+    decodedCount = decodedPos = 0;
+    if (!pInput)
+        return false;
+
+    // Find the frame sync (0xFFF8 or 0xFFF9). Normally it is the very next two bytes.
+    while (inputCount - inputPos >= 2 && !(pInput[inputPos] == 0xFF && (pInput[inputPos+1] & 0xFE) == 0xF8))
+        inputPos++;
+    if (inputCount - inputPos < 16)
+        return false;
+
+    br.init(pInput + inputPos, inputCount - inputPos);
+    br.get(16);     // sync + reserved + blocking strategy
+    uint8_t blockSizeCode = br.get(4);
+    uint8_t sampleRateCode = br.get(4);
+    uint8_t channelAssignment = br.get(4);
+    uint8_t sampleSizeCode = br.get(3);
+    br.get(1);
+
+    // Frame or sample number, UTF-8 style - only its length matters here.
+    uint32_t first = br.get(8);
+    for (uint8_t mask=0x80; (first & mask) && mask > 0x01; mask >>= 1) {
+        if (mask != 0x80)
+            br.get(8);
+    }
+
+    uint32_t blockSize;
+    if (blockSizeCode == 1)
+        blockSize = 192;
+    else if (blockSizeCode >= 2 && blockSizeCode <= 5)
+        blockSize = 576 << (blockSizeCode - 2);
+    else if (blockSizeCode == 6)
+        blockSize = br.get(8) + 1;
+    else if (blockSizeCode == 7)
+        blockSize = br.get(16) + 1;
+    else if (blockSizeCode >= 8)
+        blockSize = 256 << (blockSizeCode - 8);
+    else
+        return false;
+
+    // Rate is taken from STREAMINFO. Just step over any explicit value.
+    if (sampleRateCode == 12)
+        br.get(8);
+    else if (sampleRateCode == 13 || sampleRateCode == 14)
+        br.get(16);
+
+    static const uint8_t sampleSizes[8] = { 0, 8, 12, 0, 16, 20, 24, 32 };
+    uint8_t frameBits = sampleSizeCode ? sampleSizes[sampleSizeCode] : bitsPerSample;
+    uint8_t frameChannels = channelAssignment < 8 ? channelAssignment + 1 : 2;
+    br.get(8);      // CRC-8 of the header
+
+    if (blockSize > maxBlockSize || frameChannels != numChannels || frameBits != bitsPerSample || channelAssignment > 10)
+        return false;
+
+    for (uint8_t ch=0; ch<numChannels; ch++) {
+        // The side channel carries one extra bit.
+        bool bSide = (channelAssignment == 8 && ch == 1) || (channelAssignment == 9 && ch == 0)
+            || (channelAssignment == 10 && ch == 1);
+        if (!decodeSubframe(pChannel[ch], blockSize, frameBits + (bSide ? 1 : 0)))
+            return false;
+    }
+    br.alignToByte();
+    br.get(16);     // CRC-16 of the frame
+    if (br.overran())
+        return false;
+    inputPos += br.bytesConsumed();
+
+    int32_t* left = pChannel[0];
+    int32_t* right = pChannel[1];
+    if (channelAssignment == 8) {
+        for (uint32_t i=0; i<blockSize; i++)
+            right[i] = left[i] - right[i];
+    }
+    else if (channelAssignment == 9) {
+        for (uint32_t i=0; i<blockSize; i++)
+            left[i] += right[i];
+    }
+    else if (channelAssignment == 10) {
+        for (uint32_t i=0; i<blockSize; i++) {
+            int32_t mid = (uint32_t)left[i] << 1 | (right[i] & 1);
+            int32_t side = right[i];
+            left[i] = (mid + side) >> 1;
+            right[i] = (mid - side) >> 1;
+        }
+    }
+
+    toDAC(blockSize);
+    samplesDecoded += blockSize;
+    return true;
+}
+
+bool FlacDecoder::decodeSubframe(int32_t* pOut, uint32_t blockSize, uint8_t sampleBits) {
+    if (br.get(1))
+        return false;   // Padding bit must be zero
+    uint8_t type = br.get(6);
+    uint8_t wasted = 0;
+    if (br.get(1)) {
+        wasted = br.getUnary() + 1;
+        if (wasted >= sampleBits)
+            return false;
+        sampleBits -= wasted;
+    }
+
+    if (type == 0) {
+        int32_t value = br.getSigned(sampleBits);
+        for (uint32_t i=0; i<blockSize; i++)
+            pOut[i] = value;
+    }
+    else if (type == 1) {
+        for (uint32_t i=0; i<blockSize; i++)
+            pOut[i] = br.getSigned(sampleBits);
+    }
+    else if (type >= 8 && type <= 12) {
+        uint8_t order = type - 8;
+        if (order > blockSize)
+            return false;
+        for (uint8_t i=0; i<order; i++)
+            pOut[i] = br.getSigned(sampleBits);
+        if (!decodeResidual(pOut, blockSize, order))
+            return false;
+        // Fixed polynomial predictors, applied in place over the residual.
+        switch (order) {
+        case 1:
+            for (uint32_t i=1; i<blockSize; i++)
+                pOut[i] += pOut[i-1];
+            break;
+        case 2:
+            for (uint32_t i=2; i<blockSize; i++)
+                pOut[i] += 2*pOut[i-1] - pOut[i-2];
+            break;
+        case 3:
+            for (uint32_t i=3; i<blockSize; i++)
+                pOut[i] += 3*pOut[i-1] - 3*pOut[i-2] + pOut[i-3];
+            break;
+        case 4:
+            for (uint32_t i=4; i<blockSize; i++)
+                pOut[i] += 4*pOut[i-1] - 6*pOut[i-2] + 4*pOut[i-3] - pOut[i-4];
+            break;
+        }
+    }
+    else if (type >= 32) {
+        uint8_t order = type - 31;
+        if (order > blockSize)
+            return false;
+        for (uint8_t i=0; i<order; i++)
+            pOut[i] = br.getSigned(sampleBits);
+        uint8_t precision = br.get(4) + 1;
+        int8_t shift = br.getSigned(5);
+        if (precision == 16 || shift < 0)
+            return false;
+        int32_t coefs[32];
+        for (uint8_t i=0; i<order; i++)
+            coefs[i] = br.getSigned(precision);
+        if (!decodeResidual(pOut, blockSize, order))
+            return false;
+
+        // 32-bit sums are enough for 16-bit content - the ESP32 has no fast 64-bit multiply.
+        uint8_t orderBits = 0;
+        while ((1u << orderBits) < order)
+            orderBits++;
+        if (sampleBits + precision + orderBits <= 32) {
+            for (uint32_t i=order; i<blockSize; i++) {
+                int32_t sum = 0;
+                const int32_t* history = pOut + i;
+                for (uint8_t j=0; j<order; j++)
+                    sum += coefs[j] * history[-1-j];
+                pOut[i] += sum >> shift;
+            }
+        }
+        else {
+            for (uint32_t i=order; i<blockSize; i++) {
+                int64_t sum = 0;
+                const int32_t* history = pOut + i;
+                for (uint8_t j=0; j<order; j++)
+                    sum += (int64_t)coefs[j] * history[-1-j];
+                pOut[i] += (int32_t)(sum >> shift);
+            }
+        }
+    }
+    else
+        return false;   // Reserved subframe type
+
+    if (wasted) {
+        for (uint32_t i=0; i<blockSize; i++)
+            pOut[i] = (uint32_t)pOut[i] << wasted;
+    }
+    return !br.overran();
+}
+
+bool FlacDecoder::decodeResidual(int32_t* pOut, uint32_t blockSize, uint8_t order) {
+    uint8_t method = br.get(2);
+    if (method > 1)
+        return false;
+    uint8_t paramBits = method ? 5 : 4;
+    uint8_t escape = method ? 31 : 15;
+    uint8_t partitionOrder = br.get(4);
+    uint32_t partitionSize = blockSize >> partitionOrder;
+    if ((partitionSize << partitionOrder) != blockSize || partitionSize < order)
+        return false;
+
+    int32_t* p = pOut + order;
+    for (uint32_t partition=0; partition < (1u << partitionOrder); partition++) {
+        uint32_t count = partition ? partitionSize : partitionSize - order;
+        uint8_t param = br.get(paramBits);
+        if (param == escape) {
+            uint8_t rawBits = br.get(5);
+            for (uint32_t i=0; i<count; i++)
+                *p++ = br.getSigned(rawBits);
+        }
+        else {
+            for (uint32_t i=0; i<count; i++) {
+                uint32_t value = br.getUnary() << param | br.get(param);
+                *p++ = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+            }
+        }
+        if (br.overran())
+            return false;
+    }
+    return true;
+}
+
+void FlacDecoder::toDAC(uint32_t blockSize) {
+    // Same reduction the PCM path uses: each channel to 8-bit unsigned, then averaged.
+    int8_t shift = bitsPerSample - 8;
+    if (numChannels == 1) {
+        const int32_t* mono = pChannel[0];
+        for (uint32_t i=0; i<blockSize; i++)
+            pDecoded[i] = (shift >= 0 ? mono[i] >> shift : mono[i] << -shift) + 128;
+    }
+    else {
+        const int32_t* left = pChannel[0];
+        const int32_t* right = pChannel[1];
+        for (uint32_t i=0; i<blockSize; i++) {
+            int32_t l = (shift >= 0 ? left[i] >> shift : left[i] << -shift) + 128;
+            int32_t r = (shift >= 0 ? right[i] >> shift : right[i] << -shift) + 128;
+            pDecoded[i] = (l + r) / 2;
+        }
+    }
+    decodedCount = blockSize;
+    decodedPos = 0;
+}
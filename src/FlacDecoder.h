@@ -0,0 +1,152 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+#include <stddef.h>
+#include <vector>
+
+/*! @class   FlacDecoder
+ *  @brief   Streaming FLAC frame decoder down to DAC-ready 8-bit mono.
+ *  @details Lossless, and typically 50-70% of the size of the 16-bit PCM it came from, so flash
+ *           use and read bandwidth shrink without touching quality. Like ImaAdpcmDecoder it does
+ *           no I/O of its own - the reader fills getInputSpace() until needsInput() is false,
+ *           calls decodeFrame() and take()s samples into the ring buffer.
+ *           The whole working set (compressed input, one block of samples per channel, one
+ *           block of output) is sized from STREAMINFO and allocated once in parseStreamInfo().
+ *           Decoding a frame never allocates. The seek table is read once at open.
+ *           Supports every subframe type (constant, verbatim, fixed, LPC), wasted bits, both
+ *           residual coding methods and all stereo decorrelation modes. Frame CRCs are not checked.
+ *           Up to 2 channels and 24 bits per sample.
+ */
+class FlacDecoder
+{
+public:
+    FlacDecoder();
+    ~FlacDecoder();
+
+    //! @brief Parse the 34-byte STREAMINFO body and allocate the working set. False if unsupported.
+    bool parseStreamInfo(const uint8_t* p);
+    //! @brief Room for the seek table, ahead of addSeekPoint() calls.
+    void reserveSeekPoints(uint32_t count) { seekPoints.reserve(count); };
+    //! @brief Add one 18-byte SEEKTABLE entry. Placeholder points are ignored.
+    void addSeekPoint(const uint8_t* p);
+    uint32_t getSeekPointCount() { return seekPoints.size(); };
+    /*! @brief Closest seek point at or before sample.
+     *  @param sampleNumber - first sample of the frame at offset
+     *  @param offset - byte offset of that frame from the first frame header
+     *  @return false if there is no seek table (or no usable point) - the caller starts from the
+     *          first frame.
+     */
+    bool findSeekPoint(uint64_t sample, uint64_t& sampleNumber, uint64_t& offset);
+
+    uint32_t getSampleRate() { return sampleRate; };
+    uint8_t getNumChannels() { return numChannels; };
+    uint8_t getBitsPerSample() { return bitsPerSample; };
+    uint64_t getTotalSamples() { return totalSamples; };
+    //! @brief 0-100 of the stream decoded so far. 0 when STREAMINFO doesn't give a length.
+    uint8_t getPercentDecoded() { return totalSamples ? (uint8_t)(samplesDecoded * 100 / totalSamples) : 0; };
+    //! @brief Bytes allocated for the working set.
+    size_t getWorkingSetBytes() { return inputSize + (size_t)maxBlockSize * (numChannels * sizeof(int32_t) + 1); };
+
+    //! @brief Where the next compressed bytes go. Unread bytes are first moved to the front.
+    uint8_t* getInputSpace(size_t& room);
+    //! @brief Count bytes written to getInputSpace().
+    void inputAdded(size_t count) { inputCount += count; };
+    //! @brief No more input is coming - decode whatever is buffered.
+    void setInputEnd() { bInputEnd = true; };
+    //! @brief True until a worst-case frame is buffered (or the input has ended).
+    bool needsInput() { return !bInputEnd && inputCount - inputPos < maxFrameSize; };
+    //! @brief Decode the next frame. False at the end of the stream or on a damaged frame.
+    bool decodeFrame();
+
+    //! @brief Decoded samples not yet handed out.
+    uint32_t available() { return decodedCount - decodedPos; };
+    //! @brief Copy up to maxSamples decoded samples to pDest. Returns how many were copied.
+    size_t take(uint8_t* pDest, size_t maxSamples);
+    //! @brief Same but as 16-bit signed mono, straight from the decoded block - no 8-bit step.
+    size_t take(int16_t* pDest, size_t maxSamples);
+    //! @brief Drop buffered input and output - e.g. after the file position changes.
+    void reset(uint64_t atSample);
+
+protected:
+    struct SeekPoint {
+        uint64_t sampleNumber;
+        uint64_t offset;
+    };
+
+    //! MSB-first bit reader with a 64-bit cache. Reading past the end returns zeros and is
+    //! reported by overran() so a frame cut short by EOF is rejected rather than read wild.
+    class BitReader {
+    public:
+        void init(const uint8_t* p, size_t len) { pStart = pNext = p; pEnd = p + len; cache = 0; bits = 0; padded = 0; };
+        uint32_t get(uint8_t n);
+        int32_t getSigned(uint8_t n);
+        uint32_t getUnary();
+        void alignToByte() { uint8_t drop = bits & 7; cache <<= drop; bits -= drop; };
+        size_t bytesConsumed() { return (pNext - pStart) + padded - bits/8; };
+        bool overran() { return padded*8 > bits; };
+    protected:
+        void refill();
+        const uint8_t* pStart;
+        const uint8_t* pNext;
+        const uint8_t* pEnd;
+        uint64_t cache;
+        uint8_t bits;
+        uint32_t padded;
+    };
+
+    bool decodeSubframe(int32_t* pOut, uint32_t blockSize, uint8_t sampleBits);
+    bool decodeResidual(int32_t* pOut, uint32_t blockSize, uint8_t order);
+    void toDAC(uint32_t blockSize);
+
+    // STREAMINFO
+    uint16_t maxBlockSize;
+    uint32_t maxFrameSize;
+    uint32_t sampleRate;
+    uint8_t numChannels;
+    uint8_t bitsPerSample;
+    uint64_t totalSamples;
+
+    std::vector<SeekPoint> seekPoints;
+
+    // Working set - sized once in parseStreamInfo()
+    uint8_t* pInput;
+    size_t inputSize;
+    size_t inputCount;
+    size_t inputPos;
+    bool bInputEnd;
+    int32_t* pChannel[2];
+    uint8_t* pDecoded;
+    uint32_t decodedCount;
+    uint32_t decodedPos;
+    uint64_t samplesDecoded;
+
+    BitReader br;
+};
@@ -0,0 +1,58 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+#include <stddef.h>
+
+/*! @class   G711Decoder
+ *  @brief   Table-driven G.711 A-law (WAVE format 6) and mu-law (WAVE format 7) decoding.
+ *  @details G.711 is 8 bits per sample like 8-bit PCM, but it is companded to about 13-14 bits of
+ *           dynamic range - quiet voice prompts keep their detail at the same byte rate.
+ *           Every code maps straight through a 256-entry const table (in flash on the ESP32):
+ *           one to 16-bit linear and one straight to the DAC's 8-bit unsigned value, which is what
+ *           the fill path uses. Both are plain loads - no branches per sample.
+ */
+class G711Decoder
+{
+public:
+    //! @brief 16-bit linear value for each code. nullptr unless formatTag is 6 or 7.
+    static const int16_t* getLinearTable(uint16_t formatTag);
+    //! @brief 8-bit unsigned DAC value for each code - linear >> 8, re-centered at 128.
+    static const uint8_t* getDACTable(uint16_t formatTag);
+    //! @brief Decode count codes to 16-bit linear.
+    static void decode(const uint8_t* pIn, int16_t* pOut, size_t count, const int16_t* pTable);
+    //! @brief Decode count codes to DAC samples. pIn and pOut may be the same buffer.
+    static void decodeToDAC(const uint8_t* pIn, uint8_t* pOut, size_t count, const uint8_t* pTable);
+    //! @brief Decode count interleaved stereo frames to DAC samples, averaging the channels in 16-bit.
+    static void decodeStereoToDAC(const uint8_t* pIn, uint8_t* pOut, size_t frames, const int16_t* pTable);
+
+    static const uint16_t WAVE_FORMAT_ALAW = 0x0006;
+    static const uint16_t WAVE_FORMAT_MULAW = 0x0007;
+};
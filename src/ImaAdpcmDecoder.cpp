@@ -0,0 +1,147 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "ImaAdpcmDecoder.h"
+
+#include <string.h>
+
+static const int16_t stepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t indexTable[16] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+//! Per-channel predictor state while walking a block.
+struct AdpcmChannel {
+    int32_t predictor;
+    int8_t index;
+
+    void start(const uint8_t* pHead) {
+        predictor = (int16_t)(pHead[1]<<8 | pHead[0]);
+        index = pHead[2] > 88 ? 88 : pHead[2];
+    };
+
+    int16_t next(uint8_t nibble) {
+        int32_t step = stepTable[index];
+        int32_t diff = step >> 3;
+        if (nibble & 4) diff += step;
+        if (nibble & 2) diff += step >> 1;
+        if (nibble & 1) diff += step >> 2;
+        predictor += (nibble & 8) ? -diff : diff;
+        if (predictor > 32767)
+            predictor = 32767;
+        else if (predictor < -32768)
+            predictor = -32768;
+        index += indexTable[nibble];
+        if (index < 0)
+            index = 0;
+        else if (index > 88)
+            index = 88;
+        return (int16_t)predictor;
+    };
+};
+
+// Signed 16-bit down to the DAC's unsigned 8-bit - same as the PCM path.
+static inline uint8_t toDAC(int32_t sample) {
+    return (uint8_t)((sample >> 8) + 128);
+}
+
+ImaAdpcmDecoder::ImaAdpcmDecoder(uint16_t _blockAlign, uint8_t _numChannels) : blockAlign(_blockAlign), numChannels(_numChannels)
+{
+    if (!numChannels || numChannels > 2 || blockAlign <= 4*numChannels)
+        throw "ImaAdpcmDecoder::Unsupported block layout.";
+
+    pBlock = new uint8_t[blockAlign];
+    pDecoded = new uint8_t[samplesPerBlock(blockAlign, numChannels)];
+    decodedCount = decodedPos = 0;
+}
+
+ImaAdpcmDecoder::~ImaAdpcmDecoder()
+{
+    delete [] pBlock;
+    delete [] pDecoded;
+}
+
+uint16_t ImaAdpcmDecoder::samplesPerBlock(uint16_t blockAlign, uint8_t numChannels) {
+    // Header sample plus two per data byte, spread across the channels.
+    return (blockAlign - 4*numChannels) * 2 / numChannels + 1;
+}
+
+uint16_t ImaAdpcmDecoder::decodeBlock(const uint8_t* pIn, uint32_t inLen, uint8_t numChannels, uint8_t* pOut) {
+    AdpcmChannel left, right;
+    uint8_t* pStart = pOut;
+
+    if (inLen < 4u*numChannels)
+        return 0;
+
+    if (numChannels == 1) {
+        left.start(pIn);
+        *pOut++ = toDAC(left.predictor);
+        // Low nibble first.
+        for (const uint8_t* p = pIn+4; p < pIn+inLen; p++) {
+            *pOut++ = toDAC(left.next(*p & 0x0f));
+            *pOut++ = toDAC(left.next(*p >> 4));
+        }
+    }
+    else {
+        left.start(pIn);
+        right.start(pIn+4);
+        *pOut++ = toDAC((left.predictor + right.predictor) >> 1);
+        // Data is interleaved in 4-byte words - 8 samples of left then 8 samples of right.
+        int16_t l[8];
+        for (const uint8_t* p = pIn+8; p+8 <= pIn+inLen; p += 8) {
+            for (uint8_t i=0; i<4; i++) {
+                l[2*i] = left.next(p[i] & 0x0f);
+                l[2*i+1] = left.next(p[i] >> 4);
+            }
+            for (uint8_t i=0; i<4; i++) {
+                *pOut++ = toDAC((l[2*i] + right.next(p[4+i] & 0x0f)) >> 1);
+                *pOut++ = toDAC((l[2*i+1] + right.next(p[4+i] >> 4)) >> 1);
+            }
+        }
+    }
+
+    return pOut - pStart;
+}
+
+void ImaAdpcmDecoder::decodeBlock(uint32_t inLen) {
+    decodedCount = decodeBlock(pBlock, inLen > blockAlign ? blockAlign : inLen, numChannels, pDecoded);
+    decodedPos = 0;
+}
+
+size_t ImaAdpcmDecoder::take(uint8_t* pDest, size_t maxSamples) {
+    size_t count = available();
+    if (count > maxSamples)
+        count = maxSamples;
+    memcpy(pDest, pDecoded + decodedPos, count);
+    decodedPos += count;
+    return count;
+}
@@ -0,0 +1,82 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+#include <stddef.h>
+
+/*! @class   ImaAdpcmDecoder
+ *  @brief   Block decoder for IMA/DVI ADPCM (WAVE format 0x11) down to DAC-ready 8-bit mono.
+ *  @details 4 bits per sample, so a file holds about 4x the audio of 16-bit PCM (2x of 8-bit)
+ *           and the fill thread reads that much less per second. Each block starts with a
+ *           4-byte header per channel (first sample and step index) so blocks decode on their
+ *           own - a short final block or a seek just means starting a fresh block.
+ *           The compressed block and its decoded samples live in two buffers allocated once
+ *           at construction. The fill thread reads a block into getBlockBuffer(), calls
+ *           decodeBlock() and then take()s samples into the ring buffer as room allows.
+ *           Stereo is averaged to mono since the DAC output is a single channel.
+ */
+class ImaAdpcmDecoder
+{
+public:
+    /*! @param _blockAlign - compressed block size in bytes from the 'fmt ' chunk
+     *  @param _numChannels - 1 or 2
+     */
+    ImaAdpcmDecoder(uint16_t _blockAlign, uint8_t _numChannels);
+    ~ImaAdpcmDecoder();
+    //! @brief Samples per full block as the 'fmt ' chunk should declare it.
+    static uint16_t samplesPerBlock(uint16_t blockAlign, uint8_t numChannels);
+    /*! @brief Decode one block into 8-bit unsigned mono.
+     *  @param pIn - compressed block. May be short (end of file) - only whole nibble groups are used.
+     *  @param inLen - bytes available at pIn
+     *  @param pOut - room for samplesPerBlock() samples
+     *  @return number of samples written
+     */
+    static uint16_t decodeBlock(const uint8_t* pIn, uint32_t inLen, uint8_t numChannels, uint8_t* pOut);
+
+    //! @brief Where the next compressed block should be read to. getBlockAlign() bytes of room.
+    uint8_t* getBlockBuffer() { return pBlock; };
+    uint16_t getBlockAlign() { return blockAlign; };
+    //! @brief Decode the block sitting in getBlockBuffer(). Any samples not yet taken are dropped.
+    void decodeBlock(uint32_t inLen);
+    //! @brief Decoded samples not yet handed out.
+    uint16_t available() { return decodedCount - decodedPos; };
+    //! @brief Copy up to maxSamples decoded samples to pDest. Returns how many were copied.
+    size_t take(uint8_t* pDest, size_t maxSamples);
+    //! @brief Forget any decoded samples - e.g. after the file position changes.
+    void reset() { decodedCount = decodedPos = 0; };
+
+protected:
+    const uint16_t blockAlign;
+    const uint8_t numChannels;
+    uint8_t* pBlock;
+    uint8_t* pDecoded;
+    uint16_t decodedCount;
+    uint16_t decodedPos;
+};
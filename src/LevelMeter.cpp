@@ -0,0 +1,178 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "LevelMeter.h"
+
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+LevelMeter::LevelMeter() : writeIndex(0), writeBlock(0), blocksWritten(0), blocksMetered(0),
+                           sequence(0), levels(0), block(0), totalClips(0), dropped(0)
+{
+    current.peak = 0;
+    current.rms = 0;
+    current.clips = 0;
+    current.block = 0;
+    current.totalClips = 0;
+    current.dropped = 0;
+}
+
+void LevelMeter::process() {
+    uint32_t written = blocksWritten.load(std::memory_order_acquire);
+    bool bUpdated = false;
+
+    // The block being written is off limits, so at most NUM_BLOCKS-1 are waiting. Any more and
+    // the oldest have already been written over.
+    if (written - blocksMetered > NUM_BLOCKS - 1) {
+        current.dropped += written - blocksMetered - (NUM_BLOCKS - 1);
+        blocksMetered = written - (NUM_BLOCKS - 1);
+    }
+
+    while (blocksMetered != written) {
+        uint8_t peak;
+        uint32_t sumSquares, clips;
+        reduce(blocks[blocksMetered & (NUM_BLOCKS - 1)], BLOCK_SIZE, peak, sumSquares, clips);
+
+        // Only good if the output path didn't come back round to this block meanwhile.
+        if (blocksWritten.load(std::memory_order_acquire) - blocksMetered > NUM_BLOCKS - 1)
+            current.dropped++;
+        else {
+            current.peak = peak;
+            current.rms = (uint8_t)(sqrtf((float)sumSquares / BLOCK_SIZE) + 0.5f);
+            current.clips = clips;
+            current.totalClips += clips;
+            current.block++;
+            bUpdated = true;
+        }
+        blocksMetered++;
+    }
+
+    if (bUpdated)
+        publish(current);
+}
+
+void LevelMeter::publish(const LevelSnapshot& snap) {
+    uint32_t seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    levels.store(snap.peak | snap.rms << 8 | (uint32_t)snap.clips << 16, std::memory_order_relaxed);
+    block.store(snap.block, std::memory_order_relaxed);
+    totalClips.store(snap.totalClips, std::memory_order_relaxed);
+    dropped.store(snap.dropped, std::memory_order_relaxed);
+    sequence.store(seq + 2, std::memory_order_release);
+}
+
+bool LevelMeter::getSnapshot(LevelSnapshot& snap) {
+    uint32_t before, after, packed;
+
+    do {
+        before = sequence.load(std::memory_order_acquire);
+        packed = levels.load(std::memory_order_relaxed);
+        snap.block = block.load(std::memory_order_relaxed);
+        snap.totalClips = totalClips.load(std::memory_order_relaxed);
+        snap.dropped = dropped.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+
+    snap.peak = packed & 0xff;
+    snap.rms = (packed >> 8) & 0xff;
+    snap.clips = packed >> 16;
+    return snap.block != 0;
+}
+
+void LevelMeter::reduce(const uint8_t* pSamples, size_t count, uint8_t& peak, uint32_t& sumSquares, uint32_t& clips) {
+    size_t i = 0;
+    uint8_t lo = 128, hi = 128;
+    uint32_t squares = 0, clipped = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi8((char)0xff);
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    __m128i vLo = bias, vHi = bias, vSquares = zero, vClips = zero;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(pSamples + i));
+        vLo = _mm_min_epu8(vLo, v);
+        vHi = _mm_max_epu8(vHi, v);
+        // 0xff in each clipped lane - summed against zero that is 255 per clip.
+        __m128i clip = _mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, full));
+        vClips = _mm_add_epi64(vClips, _mm_sad_epu8(clip, zero));
+        // Flipping the top bit gives the signed sample. Widen to 16 bits, square and pair up.
+        __m128i s = _mm_xor_si128(v, bias);
+        __m128i sLo = _mm_srai_epi16(_mm_unpacklo_epi8(s, s), 8);
+        __m128i sHi = _mm_srai_epi16(_mm_unpackhi_epi8(s, s), 8);
+        vSquares = _mm_add_epi32(vSquares, _mm_add_epi32(_mm_madd_epi16(sLo, sLo), _mm_madd_epi16(sHi, sHi)));
+    }
+
+    uint8_t lanes[16];
+    uint32_t sums[4];
+    _mm_storeu_si128((__m128i*)lanes, vLo);
+    for (uint8_t k=0; k<16; k++)
+        lo = lanes[k] < lo ? lanes[k] : lo;
+    _mm_storeu_si128((__m128i*)lanes, vHi);
+    for (uint8_t k=0; k<16; k++)
+        hi = lanes[k] > hi ? lanes[k] : hi;
+    _mm_storeu_si128((__m128i*)sums, vSquares);
+    squares = sums[0] + sums[1] + sums[2] + sums[3];
+    clipped = (_mm_cvtsi128_si32(vClips) + _mm_cvtsi128_si32(_mm_srli_si128(vClips, 8))) / 255;
+#endif
+
+    for (; i < count; i++) {
+        uint8_t v = pSamples[i];
+        int16_t s = (int16_t)v - 128;
+        lo = v < lo ? v : lo;
+        hi = v > hi ? v : hi;
+        squares += s * s;
+        clipped += v == 0 || v == 255;
+    }
+
+    peak = hi - 128 > 128 - lo ? hi - 128 : 128 - lo;
+    sumSquares = squares;
+    clips = clipped;
+}
+
+void LevelMeter::reduceScalar(const uint8_t* pSamples, size_t count, uint8_t& peak, uint32_t& sumSquares, uint32_t& clips) {
+    uint8_t top = 0;
+    uint32_t squares = 0, clipped = 0;
+
+    for (size_t i=0; i<count; i++) {
+        int16_t s = (int16_t)pSamples[i] - 128;
+        uint8_t level = s < 0 ? -s : s;
+        top = level > top ? level : top;
+        squares += s * s;
+        clipped += pSamples[i] == 0 || pSamples[i] == 255;
+    }
+
+    peak = top;
+    sumSquares = squares;
+    clips = clipped;
+}
@@ -0,0 +1,110 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+
+#include <atomic>
+#include <cstddef>
+
+/*! @struct LevelSnapshot
+ *  @brief  Output level of the most recent metered block. Levels are distances from the DAC
+ *          midpoint (128), so 128 is full scale.
+ */
+struct LevelSnapshot
+{
+    uint8_t peak;        //!< Largest |sample - 128| in the block.
+    uint8_t rms;         //!< RMS of sample - 128 over the block.
+    uint16_t clips;      //!< Samples in the block at 0 or 255.
+    uint32_t block;      //!< Blocks metered so far. Changes whenever a new block is published.
+    uint32_t totalClips; //!< Clipped samples over every metered block.
+    uint32_t dropped;    //!< Blocks the output path reused before they could be metered.
+};
+
+/*! @class   LevelMeter
+ *  @brief   Block-based peak/RMS/clip metering of what goes to the DAC.
+ *  @details The output path (ISR or playout thread) only stores each sample into a small ring
+ *           of blocks - push() is one store and an increment. process(), run off the output path
+ *           (the player's notifier thread), reduces each completed block in one pass - SSE2 on
+ *           hosts which have it, a plain loop elsewhere - and publishes the result. Readers get
+ *           the latest result from getSnapshot() through a sequence lock: the writer never waits
+ *           and a reader only retries if it overlapped a publish.
+ */
+class LevelMeter
+{
+public:
+    static const uint16_t BLOCK_SIZE = 256;
+    static const uint8_t NUM_BLOCKS = 4;
+
+    LevelMeter();
+    //! @brief Output path. Record a sample as it goes to the DAC.
+    //!        Always inlined, so the ISR never calls out to flash for it on ESP32.
+    __attribute__((always_inline)) void push(uint8_t sample) {
+        blocks[writeBlock][writeIndex] = sample;
+        if (++writeIndex == BLOCK_SIZE) {
+            writeIndex = 0;
+            writeBlock = (writeBlock + 1) & (NUM_BLOCKS - 1);
+            blocksWritten.fetch_add(1, std::memory_order_release);
+        }
+    };
+    //! @brief Meter any blocks completed since the last call and publish the newest.
+    void process();
+    //! @brief Latest published levels. False until the first block has been metered.
+    bool getSnapshot(LevelSnapshot& snap);
+    /*! @brief One pass over samples: peak, sum of squares and clip count. SIMD where available.
+     *  @details sumSquares fits 32 bits for up to 262144 samples.
+     */
+    static void reduce(const uint8_t* pSamples, size_t count, uint8_t& peak, uint32_t& sumSquares, uint32_t& clips);
+    //! @brief reduce() one sample at a time - the reference the SIMD path must agree with.
+    static void reduceScalar(const uint8_t* pSamples, size_t count, uint8_t& peak, uint32_t& sumSquares, uint32_t& clips);
+
+protected:
+    void publish(const LevelSnapshot& snap);
+
+    //! @name Output path side
+    //!@{
+    uint8_t blocks[NUM_BLOCKS][BLOCK_SIZE];
+    uint16_t writeIndex;
+    uint8_t writeBlock;
+    std::atomic<uint32_t> blocksWritten;
+    //!@}
+
+    //! Only touched by process().
+    uint32_t blocksMetered;
+    LevelSnapshot current;
+
+    //! @name Published snapshot - odd sequence while a publish is under way
+    //!@{
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint32_t> levels;       // peak | rms << 8 | clips << 16
+    std::atomic<uint32_t> block;
+    std::atomic<uint32_t> totalClips;
+    std::atomic<uint32_t> dropped;
+    //!@}
+};
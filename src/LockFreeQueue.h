@@ -0,0 +1,124 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/*! @class   LockFreeQueue
+ *  @brief   Bounded, lock-free queue of small POD items.
+ *  @details Fixed-size ring (no allocation after construction) where every slot carries a
+ *           sequence number. Producers and consumers claim a position with a compare-exchange
+ *           and then publish the slot by bumping its sequence. Nobody ever waits on a lock so
+ *           push() is safe from an ISR, a timer callback or any number of producer threads.
+ *           When full, push() fails immediately rather than blocking - the caller decides
+ *           whether that is a dropped event or a retry.
+ *  @tparam  T     Item type. Should be trivially copyable and small.
+ *  @tparam  SIZE  Number of slots. Must be a power of two.
+ */
+template<typename T, uint16_t SIZE>
+class LockFreeQueue
+{
+    static_assert(SIZE >= 2 && (SIZE & (SIZE-1)) == 0, "LockFreeQueue SIZE must be a power of two");
+
+public:
+    LockFreeQueue() : enqueuePos(0), dequeuePos(0), dropCount(0) {
+        for (uint32_t i=0; i<SIZE; i++)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    };
+
+    //! @brief Add an item. Never blocks. Always inlined, so an ISR never calls out to flash for it on ESP32.
+    //! @return false when the queue is full (the item is counted as dropped).
+    __attribute__((always_inline)) bool push(const T& item) {
+        Slot* pSlot;
+        uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+        for (;;) {
+            pSlot = &slots[pos & (SIZE-1)];
+            uint32_t seq = pSlot->sequence.load(std::memory_order_acquire);
+            int32_t diff = (int32_t)seq - (int32_t)pos;
+
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0) {
+                dropCount.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+                pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+
+        pSlot->item = item;
+        pSlot->sequence.store(pos+1, std::memory_order_release);
+        return true;
+    };
+
+    //! @brief Remove the oldest item into 'item'.
+    //! @return false when the queue is empty.
+    bool pop(T& item) {
+        Slot* pSlot;
+        uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+
+        for (;;) {
+            pSlot = &slots[pos & (SIZE-1)];
+            uint32_t seq = pSlot->sequence.load(std::memory_order_acquire);
+            int32_t diff = (int32_t)seq - (int32_t)(pos+1);
+
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+
+        item = pSlot->item;
+        pSlot->sequence.store(pos+SIZE, std::memory_order_release);
+        return true;
+    };
+
+    //! @brief Number of items which could not be queued because the queue was full.
+    uint32_t getDropCount() { return dropCount.load(std::memory_order_relaxed); };
+    //! @brief Approximate - only exact when producers and consumers are quiet.
+    bool isEmpty() { return enqueuePos.load(std::memory_order_acquire) == dequeuePos.load(std::memory_order_acquire); };
+
+protected:
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        T item;
+    };
+
+    Slot slots[SIZE];
+    std::atomic<uint32_t> enqueuePos;
+    std::atomic<uint32_t> dequeuePos;
+    std::atomic<uint32_t> dropCount;
+};
@@ -0,0 +1,145 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "LoudnessAnalyzer.h"
+
+#include <math.h>
+
+constexpr float LoudnessAnalyzer::SILENCE;
+const uint32_t LoudnessAnalyzer::NONE;
+
+LoudnessAnalyzer::LoudnessAnalyzer(uint32_t sampleRate, uint8_t _silenceLevel)
+    : subBlockFill(0), subBlockSum(0), subBlockCount(0), totalSum(0), totalCount(0),
+      histogram(HISTOGRAM_MAX - HISTOGRAM_MIN + 1, 0), peak(0), silenceLevel(_silenceLevel),
+      samples(0), firstLoud(NONE), lastLoud(0)
+{
+    // BS.1770 K-weighting stage 1: high shelf, +4 dB above about 1.7 kHz.
+    double K = tan(M_PI * 1681.974450955533 / sampleRate);
+    double Q = 0.7071752369554196;
+    double Vh = pow(10.0, 3.999843853973347 / 20.0);
+    double Vb = pow(Vh, 0.4996667741545416);
+    double a0 = 1.0 + K / Q + K * K;
+    shelf.b0 = (Vh + Vb * K / Q + K * K) / a0;
+    shelf.b1 = 2.0 * (K * K - Vh) / a0;
+    shelf.b2 = (Vh - Vb * K / Q + K * K) / a0;
+    shelf.a1 = 2.0 * (K * K - 1.0) / a0;
+    shelf.a2 = (1.0 - K / Q + K * K) / a0;
+
+    // Stage 2: high-pass at about 38 Hz.
+    K = tan(M_PI * 38.13547087602444 / sampleRate);
+    Q = 0.5003270373238773;
+    a0 = 1.0 + K / Q + K * K;
+    highPass.b0 = 1.0;
+    highPass.b1 = -2.0;
+    highPass.b2 = 1.0;
+    highPass.a1 = 2.0 * (K * K - 1.0) / a0;
+    highPass.a2 = (1.0 - K / Q + K * K) / a0;
+
+    shelf.z1 = shelf.z2 = highPass.z1 = highPass.z2 = 0;
+    subBlockLength = sampleRate / 10 ? sampleRate / 10 : 1;
+    for (int i=0; i<4; i++)
+        subBlocks[i] = 0;
+}
+
+void LoudnessAnalyzer::add(const uint8_t* pSamples, size_t count) {
+    float sum = 0;
+    uint8_t top = peak;
+
+    for (size_t i=0; i<count; i++) {
+        int16_t s = (int16_t)pSamples[i] - 128;
+        uint8_t level = s < 0 ? -s : s;
+        top = level > top ? level : top;
+        if (level > silenceLevel) {
+            if (firstLoud == NONE)
+                firstLoud = samples + i;
+            lastLoud = samples + i;
+        }
+
+        float y = highPass.process(shelf.process(s * (1.0f / 128)));
+        sum += y * y;
+        if (++subBlockFill == subBlockLength) {
+            subBlockSum += sum;
+            totalSum += sum;
+            sum = 0;
+            totalCount += subBlockFill;
+            subBlockFill = 0;
+
+            subBlocks[subBlockCount++ & 3] = subBlockSum;
+            subBlockSum = 0;
+            if (subBlockCount >= 4)
+                addBlock((subBlocks[0] + subBlocks[1] + subBlocks[2] + subBlocks[3]) / (4.0 * subBlockLength));
+        }
+    }
+    subBlockSum += sum;
+    totalSum += sum;
+    peak = top;
+    samples += count;
+}
+
+void LoudnessAnalyzer::addBlock(double meanSquare) {
+    float lufs = toLUFS(meanSquare);
+    if (lufs <= SILENCE)
+        return;
+    int32_t bin = lroundf(lufs * 10);
+    bin = bin > HISTOGRAM_MAX ? HISTOGRAM_MAX : bin;
+    histogram[bin - HISTOGRAM_MIN]++;
+}
+
+float LoudnessAnalyzer::toLUFS(double meanSquare) {
+    return meanSquare > 0 ? -0.691f + 10.0f * (float)log10(meanSquare) : SILENCE;
+}
+
+float LoudnessAnalyzer::getLoudness() {
+    if (subBlockCount < 4) {
+        // Shorter than one block - the whole clip is the block.
+        uint32_t samples = totalCount + subBlockFill;
+        float lufs = samples ? toLUFS(totalSum / samples) : SILENCE;
+        return lufs > SILENCE ? lufs : SILENCE;
+    }
+
+    // Each bin stands for blocks at its centre loudness.
+    double energy[2] = { 0, 0 };
+    uint32_t blocks[2] = { 0, 0 };
+    for (size_t i=0; i<histogram.size(); i++) {
+        if (histogram[i]) {
+            energy[0] += histogram[i] * pow(10.0, ((HISTOGRAM_MIN + (int32_t)i) / 10.0 + 0.691) / 10.0);
+            blocks[0] += histogram[i];
+        }
+    }
+    if (!blocks[0])
+        return SILENCE;
+
+    // Relative gate: 10 LU below the loudness of everything past the absolute gate.
+    int32_t gate = lroundf((toLUFS(energy[0] / blocks[0]) - 10.0f) * 10) - HISTOGRAM_MIN;
+    for (size_t i=gate > 0 ? gate : 0; i<histogram.size(); i++) {
+        if (histogram[i]) {
+            energy[1] += histogram[i] * pow(10.0, ((HISTOGRAM_MIN + (int32_t)i) / 10.0 + 0.691) / 10.0);
+            blocks[1] += histogram[i];
+        }
+    }
+    return blocks[1] ? toLUFS(energy[1] / blocks[1]) : SILENCE;
+}
@@ -0,0 +1,109 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+#include <stddef.h>
+
+#include <vector>
+
+/*! @class   LoudnessAnalyzer
+ *  @brief   Integrated loudness of a clip, EBU R128 style, fed a block at a time.
+ *  @details An approximation of ITU-R BS.1770 for mono DAC-ready samples:
+ *           - K-weighting (the standard shelf and high-pass biquads, designed for the clip's rate).
+ *           - Mean square over 400 ms blocks stepped every 100 ms.
+ *           - The -70 LUFS absolute gate, then the relative gate 10 LU below the gated mean.
+ *           Block loudness is kept in a 0.1 LU histogram rather than block by block, so memory is
+ *           fixed (about 3 kB) however long the clip is. A clip shorter than one block is measured
+ *           over its whole length. Levels are relative to DAC full scale - a full-scale sine
+ *           measures about -3 LUFS.
+ *
+ *           Along the way it notes the first and last samples louder than a silence level, so
+ *           leading and trailing silence can be trimmed without another pass.
+ */
+class LoudnessAnalyzer
+{
+public:
+    //! @param _silenceLevel - a sample within this of the midpoint counts as silence. 2 is about -36 dBFS.
+    LoudnessAnalyzer(uint32_t sampleRate, uint8_t _silenceLevel=2);
+    //! @brief Feed the next samples (8-bit unsigned, 128 is zero).
+    void add(const uint8_t* pSamples, size_t count);
+    //! @brief Gated loudness so far in LUFS. SILENCE if nothing made it past the absolute gate.
+    float getLoudness();
+    //! @brief Largest |sample - 128| so far.
+    uint8_t getPeak() { return peak; };
+    //! @brief Samples fed so far.
+    uint32_t getLength() { return samples; };
+    /*! @brief The part of the clip between its first and last non-silent samples, [start, end).
+     *  @return false if every sample so far is silence.
+     */
+    bool getContent(uint32_t& start, uint32_t& end) {
+        if (firstLoud == NONE)
+            return false;
+        start = firstLoud;
+        end = lastLoud + 1;
+        return true;
+    };
+
+    static constexpr float SILENCE = -70.0f;
+
+protected:
+    struct Biquad {
+        float b0, b1, b2, a1, a2;
+        float z1, z2;
+        float process(float x) {
+            float y = b0 * x + z1;
+            z1 = b1 * x - a1 * y + z2;
+            z2 = b2 * x - a2 * y;
+            return y;
+        };
+    };
+    void addBlock(double meanSquare);
+    static float toLUFS(double meanSquare);
+
+    static const int16_t HISTOGRAM_MIN = -700;   // Tenths of a LU
+    static const int16_t HISTOGRAM_MAX = 100;
+    static const uint32_t NONE = 0xFFFFFFFF;
+
+    Biquad shelf;
+    Biquad highPass;
+    uint32_t subBlockLength;    // 100 ms of samples
+    uint32_t subBlockFill;
+    double subBlockSum;
+    double subBlocks[4];        // The last four 100 ms sums - one 400 ms block.
+    uint32_t subBlockCount;
+    double totalSum;            // For clips too short for a block.
+    uint32_t totalCount;
+    std::vector<uint32_t> histogram;
+    uint8_t peak;
+    uint8_t silenceLevel;
+    uint32_t samples;
+    uint32_t firstLoud;
+    uint32_t lastLoud;
+};
@@ -0,0 +1,159 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "PcmConverter.h"
+
+#include <string.h>
+
+// One channel's sample as 8-bit unsigned. Signed integers keep their top byte, sign bit flipped.
+template<uint8_t BYTES>
+static inline uint8_t intToDAC(const uint8_t* p) {
+    return BYTES == 1 ? p[0] : (uint8_t)(p[BYTES-1] ^ 0x80);
+}
+
+static inline uint8_t floatToDAC(const uint8_t* p) {
+    float value;
+    memcpy(&value, p, sizeof(value));
+    // Written so NaN lands on -1.0 rather than in an undefined float to int conversion.
+    value = !(value >= -1.0f) ? -1.0f : (value > 1.0f ? 1.0f : value);
+    // Offset before truncating so it rounds down like the integer paths' arithmetic shift.
+    int32_t scaled = (int32_t)(value * 128.0f + 128.0f);
+    return (uint8_t)(scaled > 255 ? 255 : scaled);
+}
+
+// Constant channel count and sample size - the compiler sees the whole stride.
+template<uint8_t BYTES, uint8_t CHANNELS>
+static void convertInt(const uint8_t* pIn, uint8_t* pOut, size_t frames, uint8_t) {
+    for (size_t i=0; i<frames; i++) {
+        uint32_t sum = 0;
+        for (uint8_t ch=0; ch<CHANNELS; ch++)
+            sum += intToDAC<BYTES>(pIn + (i*CHANNELS + ch)*BYTES);
+        pOut[i] = sum / CHANNELS;
+    }
+}
+
+template<uint8_t CHANNELS>
+static void convertFloat(const uint8_t* pIn, uint8_t* pOut, size_t frames, uint8_t) {
+    for (size_t i=0; i<frames; i++) {
+        uint32_t sum = 0;
+        for (uint8_t ch=0; ch<CHANNELS; ch++)
+            sum += floatToDAC(pIn + (i*CHANNELS + ch)*4);
+        pOut[i] = sum / CHANNELS;
+    }
+}
+
+// Any channel count - multichannel downmix.
+template<uint8_t BYTES>
+static void convertIntN(const uint8_t* pIn, uint8_t* pOut, size_t frames, uint8_t numChannels) {
+    for (size_t i=0; i<frames; i++) {
+        uint32_t sum = 0;
+        for (uint8_t ch=0; ch<numChannels; ch++)
+            sum += intToDAC<BYTES>(pIn + (i*numChannels + ch)*BYTES);
+        pOut[i] = sum / numChannels;
+    }
+}
+
+static void convertFloatN(const uint8_t* pIn, uint8_t* pOut, size_t frames, uint8_t numChannels) {
+    for (size_t i=0; i<frames; i++) {
+        uint32_t sum = 0;
+        for (uint8_t ch=0; ch<numChannels; ch++)
+            sum += floatToDAC(pIn + (i*numChannels + ch)*4);
+        pOut[i] = sum / numChannels;
+    }
+}
+
+PcmConverter::PcmConverter(Encoding _encoding, uint8_t _numChannels) : encoding(_encoding), numChannels(_numChannels)
+{
+    if (!numChannels || numChannels > 8)
+        throw "PcmConverter::1 to 8 channels supported.";
+
+    bool bMono = numChannels == 1;
+    bool bStereo = numChannels == 2;
+    switch (encoding) {
+    case Unsigned8:
+        pConvert = bMono ? convertInt<1,1> : (bStereo ? convertInt<1,2> : convertIntN<1>);
+        bytesPerFrame = numChannels;
+        break;
+    case Signed16:
+        pConvert = bMono ? convertInt<2,1> : (bStereo ? convertInt<2,2> : convertIntN<2>);
+        bytesPerFrame = 2 * numChannels;
+        break;
+    case Signed24:
+        pConvert = bMono ? convertInt<3,1> : (bStereo ? convertInt<3,2> : convertIntN<3>);
+        bytesPerFrame = 3 * numChannels;
+        break;
+    case Signed32:
+        pConvert = bMono ? convertInt<4,1> : (bStereo ? convertInt<4,2> : convertIntN<4>);
+        bytesPerFrame = 4 * numChannels;
+        break;
+    case Float32:
+    default:
+        pConvert = bMono ? convertFloat<1> : (bStereo ? convertFloat<2> : convertFloatN);
+        bytesPerFrame = 4 * numChannels;
+        break;
+    }
+}
+
+void PcmConverter::convert16(const uint8_t* pIn, int16_t* pOut, size_t frames) {
+    uint8_t width = bytesPerFrame / numChannels;
+
+    for (size_t i=0; i<frames; i++) {
+        int32_t sum = 0;
+        for (uint8_t ch=0; ch<numChannels; ch++, pIn+=width) {
+            if (encoding == Unsigned8)
+                sum += (pIn[0] - 128) << 8;
+            else if (encoding == Float32) {
+                float v;
+                memcpy(&v, pIn, 4);
+                v = v > 1.0f ? 1.0f : (v < -1.0f ? -1.0f : v);
+                if (v != v)
+                    v = 0.0f;
+                sum += (int32_t)(v * 32767.0f);
+            }
+            else
+                sum += (int16_t)(pIn[width-1] << 8 | pIn[width-2]);
+        }
+        pOut[i] = sum / numChannels;
+    }
+}
+
+bool PcmConverter::getEncoding(uint16_t formatTag, uint16_t bitsPerSample, Encoding& encoding) {
+    if (formatTag == WAVE_FORMAT_IEEE_FLOAT) {
+        encoding = Float32;
+        return bitsPerSample == 32;
+    }
+    if (formatTag != 0x0001)
+        return false;
+
+    switch (bitsPerSample) {
+    case 8:     encoding = Unsigned8;   return true;
+    case 16:    encoding = Signed16;    return true;
+    case 24:    encoding = Signed24;    return true;
+    case 32:    encoding = Signed32;    return true;
+    default:    return false;
+    }
+}
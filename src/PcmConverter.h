@@ -0,0 +1,74 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+#include <stddef.h>
+
+/*! @class   PcmConverter
+ *  @brief   Converts interleaved PCM frames of any supported layout to DAC-ready 8-bit mono.
+ *  @details Integer PCM of 8, 16, 24 (packed) or 32 bits, or 32-bit float, with 1 to 8 channels.
+ *           Each channel is reduced to 8-bit unsigned and the channels are averaged - the same
+ *           result the 16-bit path has always produced. For signed integers that is just the
+ *           most significant byte with its sign bit flipped, so 24-bit costs no more than 16-bit.
+ *           The common layouts (1 or 2 channels of each encoding) are compiled as their own loops
+ *           with constant stride so the compiler can vectorize them. Everything else goes through
+ *           a generic loop.
+ */
+class PcmConverter
+{
+public:
+    enum Encoding { Unsigned8, Signed16, Signed24, Signed32, Float32 };
+
+    PcmConverter(Encoding _encoding, uint8_t _numChannels);
+    /*! @brief Encoding for a WAVE format tag and bit depth.
+     *  @return false if the combination isn't PCM this class handles.
+     */
+    static bool getEncoding(uint16_t formatTag, uint16_t bitsPerSample, Encoding& encoding);
+
+    uint8_t getBytesPerFrame() { return bytesPerFrame; };
+    //! @brief 8-bit mono needs no conversion - the file bytes are the DAC samples.
+    bool isPassThrough() { return encoding == Unsigned8 && numChannels == 1; };
+    //! @brief Convert frames from pIn to one DAC sample each at pOut. pOut may equal pIn.
+    void convert(const uint8_t* pIn, uint8_t* pOut, size_t frames) { pConvert(pIn, pOut, frames, numChannels); };
+    /*! @brief Convert frames to 16-bit signed mono instead - for offline processing where the
+     *         8-bit reduction comes last. A plain loop, not tuned like convert().
+     */
+    void convert16(const uint8_t* pIn, int16_t* pOut, size_t frames);
+
+    static const uint16_t WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+
+protected:
+    typedef void (*ConvertFunction)(const uint8_t* pIn, uint8_t* pOut, size_t frames, uint8_t numChannels);
+
+    const Encoding encoding;
+    const uint8_t numChannels;
+    uint8_t bytesPerFrame;
+    ConvertFunction pConvert;
+};
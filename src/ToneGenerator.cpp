@@ -0,0 +1,289 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "ToneGenerator.h"
+#include "utils.h"
+
+const uint16_t ToneGenerator::FOREVER;
+
+// One cycle of sine at Q14 (+/-16383).
+#ifdef ESP_PLATFORM
+static const int16_t DRAM_ATTR sineTable[256] = {
+#else
+static const int16_t sineTable[256] = {
+#endif
+    0, 402, 804, 1205, 1606, 2005, 2404, 2801, 3196, 3590, 3981, 4370, 4756, 5139, 5519, 5896,
+    6270, 6639, 7005, 7366, 7723, 8075, 8423, 8765, 9102, 9433, 9759, 10079, 10393, 10701, 11002, 11297,
+    11585, 11865, 12139, 12405, 12664, 12915, 13159, 13394, 13622, 13841, 14052, 14255, 14449, 14634, 14810, 14977,
+    15136, 15285, 15425, 15556, 15678, 15790, 15892, 15985, 16068, 16142, 16206, 16260, 16304, 16339, 16363, 16378,
+    16383, 16378, 16363, 16339, 16304, 16260, 16206, 16142, 16068, 15985, 15892, 15790, 15678, 15556, 15425, 15285,
+    15136, 14977, 14810, 14634, 14449, 14255, 14052, 13841, 13622, 13394, 13159, 12915, 12664, 12405, 12139, 11865,
+    11585, 11297, 11002, 10701, 10393, 10079, 9759, 9433, 9102, 8765, 8423, 8075, 7723, 7366, 7005, 6639,
+    6270, 5896, 5519, 5139, 4756, 4370, 3981, 3590, 3196, 2801, 2404, 2005, 1606, 1205, 804, 402,
+    0, -402, -804, -1205, -1606, -2005, -2404, -2801, -3196, -3590, -3981, -4370, -4756, -5139, -5519, -5896,
+    -6270, -6639, -7005, -7366, -7723, -8075, -8423, -8765, -9102, -9433, -9759, -10079, -10393, -10701, -11002, -11297,
+    -11585, -11865, -12139, -12405, -12664, -12915, -13159, -13394, -13622, -13841, -14052, -14255, -14449, -14634, -14810, -14977,
+    -15136, -15285, -15425, -15556, -15678, -15790, -15892, -15985, -16068, -16142, -16206, -16260, -16304, -16339, -16363, -16378,
+    -16383, -16378, -16363, -16339, -16304, -16260, -16206, -16142, -16068, -15985, -15892, -15790, -15678, -15556, -15425, -15285,
+    -15136, -14977, -14810, -14634, -14449, -14255, -14052, -13841, -13622, -13394, -13159, -12915, -12664, -12405, -12139, -11865,
+    -11585, -11297, -11002, -10701, -10393, -10079, -9759, -9433, -9102, -8765, -8423, -8075, -7723, -7366, -7005, -6639,
+    -6270, -5896, -5519, -5139, -4756, -4370, -3981, -3590, -3196, -2801, -2404, -2005, -1606, -1205, -804, -402,
+};
+
+// Full envelope, Q16.
+static const int32_t ENV_FULL = 65536;
+// DAC ramp time to and from zero in microseconds - the readers' default.
+static const uint16_t RAMP_TIME_US = 500;
+
+ToneGenerator::ToneGenerator(uint32_t _sampleRate)
+    : sampleRate(_sampleRate), pSteps(nullptr), stepCount(0), stepIndex(0), repeats(0), repeatsLeft(0),
+      bForever(false), bStopping(false), phase(Done), current(0), rampDelta(0), position(0), totalFrames(0),
+      phaseAcc(0), phaseInc(0), phaseIncDelta(0), segment(Attack), env(0), envDelta(0),
+      stepPos(0), stepLength(0), segmentEnd(0), attackLen(0), decayLen(0), releaseLen(0)
+{
+    singleStep = ToneStep::rest(0);
+}
+
+void ToneGenerator::start(const ToneStep& step)
+{
+    singleStep = step;
+    start(&singleStep, 1, 1);
+}
+
+void ToneGenerator::start(const ToneStep* _pSteps, uint8_t count, uint16_t _repeats)
+{
+    phase = Done;
+    if (!_pSteps || !count || !sampleRate)
+        return;
+
+    pSteps = _pSteps;
+    stepCount = count;
+    stepIndex = 0;
+    repeats = _repeats;
+    bForever = repeats == FOREVER;
+    repeatsLeft = bForever ? 1 : repeats;
+    bStopping = false;
+    position = 0;
+
+    totalFrames = 0;
+    if (!bForever) {
+        for (uint8_t i=0; i<count; i++)
+            totalFrames += (uint64_t)pSteps[i].durationMS * sampleRate / 1000;
+        totalFrames *= repeats;
+    }
+
+    uint16_t rampSteps = RAMP_TIME_US / (1000000 / sampleRate);
+    rampDelta = rampSteps ? (128 + rampSteps - 1) / rampSteps : 128;
+    current = 0;
+    beginStep();
+    phase = RampIn;
+}
+
+#ifdef ESP_PLATFORM
+void IRAM_ATTR ToneGenerator::beginStep()
+#else
+void ToneGenerator::beginStep()
+#endif
+{
+    const ToneStep& step = pSteps[stepIndex];
+
+    stepLength = (uint64_t)step.durationMS * sampleRate / 1000;
+    stepPos = 0;
+
+    // Keep the phase running from the previous step so back-to-back notes don't click.
+    phaseInc = ((uint64_t)step.startHz << 32) / sampleRate;
+    uint32_t endInc = ((uint64_t)step.endHz << 32) / sampleRate;
+    phaseIncDelta = stepLength ? (int32_t)(((int64_t)endInc - phaseInc) / (int64_t)stepLength) : 0;
+
+    // Squeeze the envelope into the step: release first, then attack, then decay.
+    releaseLen = (uint64_t)step.releaseMS * sampleRate / 1000;
+    releaseLen = releaseLen < stepLength ? releaseLen : stepLength;
+    attackLen = (uint64_t)step.attackMS * sampleRate / 1000;
+    attackLen = attackLen < stepLength - releaseLen ? attackLen : stepLength - releaseLen;
+    decayLen = (uint64_t)step.decayMS * sampleRate / 1000;
+    decayLen = decayLen < stepLength - releaseLen - attackLen ? decayLen : stepLength - releaseLen - attackLen;
+
+    segment = Attack;
+    env = 0;
+    envDelta = attackLen ? ENV_FULL / (int32_t)attackLen : 0;
+    segmentEnd = attackLen;
+    if (!attackLen) {
+        env = ENV_FULL;
+        nextSegment();
+    }
+}
+
+#ifdef ESP_PLATFORM
+void IRAM_ATTR ToneGenerator::nextSegment()
+#else
+void ToneGenerator::nextSegment()
+#endif
+{
+    const ToneStep& step = pSteps[stepIndex];
+    int32_t sustainEnv = step.sustain * (ENV_FULL / 256) + (step.sustain == 255 ? ENV_FULL / 256 : 0);
+
+    // Each case falls through while the segment it moves to is empty.
+    switch (segment) {
+    case Attack:
+        env = ENV_FULL;
+        segment = Decay;
+        segmentEnd = attackLen + decayLen;
+        envDelta = decayLen ? (sustainEnv - ENV_FULL) / (int32_t)decayLen : 0;
+        if (decayLen)
+            break;
+        // fall through
+    case Decay:
+        env = sustainEnv;
+        segment = Sustain;
+        segmentEnd = stepLength - releaseLen;
+        envDelta = 0;
+        if (segmentEnd > stepPos)
+            break;
+        // fall through
+    case Sustain:
+        segment = Release;
+        segmentEnd = stepLength;
+        envDelta = releaseLen ? -env / (int32_t)releaseLen : 0;
+        break;
+    case Release:
+        break;
+    }
+}
+
+#ifdef ESP_PLATFORM
+const uint8_t* IRAM_ATTR ToneGenerator::getReadPointer()
+#else
+const uint8_t* ToneGenerator::getReadPointer()
+#endif
+{
+    return phase == Done ? nullptr : &current;
+}
+
+#ifdef ESP_PLATFORM
+bool IRAM_ATTR ToneGenerator::isPlaybackComplete()
+#else
+bool ToneGenerator::isPlaybackComplete()
+#endif
+{
+    return phase == Done;
+}
+
+#ifdef ESP_PLATFORM
+void IRAM_ATTR ToneGenerator::advanceReadPointer()
+#else
+void ToneGenerator::advanceReadPointer()
+#endif
+{
+    switch (phase) {
+    case RampIn:
+        // Up from the DAC's zero to the midpoint the tone swings around.
+        current = current < 128 - rampDelta ? current + rampDelta : 128;
+        if (current == 128)
+            phase = Playing;
+        return;
+    case RampOut:
+        current = current > rampDelta ? current - rampDelta : 0;
+        if (!current)
+            phase = Done;
+        return;
+    case Done:
+        return;
+    case Playing:
+        break;
+    }
+
+    // Next step (or repeat) once this one is played out.
+    while (stepPos >= stepLength) {
+        if (++stepIndex == stepCount) {
+            stepIndex = 0;
+            if (!bForever)
+                repeatsLeft--;
+        }
+        if (bStopping || !repeatsLeft) {
+            phase = RampOut;
+            current = 128;
+            return;
+        }
+        beginStep();
+    }
+    while (stepPos >= segmentEnd && segment != Release)
+        nextSegment();
+
+    const ToneStep& step = pSteps[stepIndex];
+    int32_t s;
+    switch (step.wave) {
+    case ToneStep::Sine: {
+        // Interpolate between table entries on the next 8 bits of phase.
+        uint8_t i = phaseAcc >> 24;
+        int32_t frac = (phaseAcc >> 16) & 0xFF;
+        s = sineTable[i] + (((sineTable[(uint8_t)(i + 1)] - sineTable[i]) * frac) >> 8);
+        break;
+    }
+    case ToneStep::Square:
+        s = phaseAcc < 0x80000000 ? 16383 : -16383;
+        break;
+    case ToneStep::Triangle: {
+        // Up over the first half of the cycle, down over the second.
+        int32_t ramp = phaseAcc >> 17;      // 0-32767
+        s = ramp < 16384 ? ramp * 2 - 16383 : 16383 - (ramp - 16384) * 2;
+        break;
+    }
+    default:
+        s = 0;
+        break;
+    }
+
+    // Q14 sample x level (Q7) x envelope (Q16 taken as Q8) - back down to +/-127.
+    int32_t out = ((s * step.level) >> 7) * (env >> 8) >> 8;
+    current = 128 + (out >> 7);
+
+    phaseAcc += phaseInc;
+    phaseInc += phaseIncDelta;
+    env += envDelta;
+    env = env < 0 ? 0 : env;
+    stepPos++;
+    position++;
+}
+
+#ifdef ESP_PLATFORM
+uint32_t IRAM_ATTR ToneGenerator::getTotalFrames()
+#else
+uint32_t ToneGenerator::getTotalFrames()
+#endif
+{
+    return totalFrames;
+}
+
+void ToneGenerator::printFileInfo() {
+#ifdef ESP_PLATFORM
+    Serial.printf("Tone: %u steps x %u, %u Hz, Total Playout Time:%u ms\n", stepCount, repeats,
+        sampleRate, (uint32_t)((uint64_t)getTotalFrames() * 1000 / sampleRate));
+#else
+    printf("Tone: %u steps x %u, %u Hz, Total Playout Time:%u ms\n", stepCount, repeats,
+        sampleRate, (uint32_t)((uint64_t)getTotalFrames() * 1000 / sampleRate));
+#endif
+}
@@ -0,0 +1,157 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+#ifndef ESP_PLATFORM
+#include <stdint.h>
+#endif
+
+#include "AudioSampleSource.h"
+
+/*! @struct  ToneStep
+ *  @brief   One note of a synthesized alert - waveform, pitch (or a sweep), length, level and envelope.
+ *  @details A plain aggregate, so sequences can be const arrays that stay in flash:
+ *           @code
+ *           static const ToneStep doorbell[] = {
+ *               ToneStep::tone(ToneStep::Sine, 660, 250),
+ *               ToneStep::tone(ToneStep::Sine, 523, 400),
+ *           };
+ *           @endcode
+ *           The attack/decay/release shape the level over the note. Release is part of the
+ *           duration, not added to it.
+ */
+struct ToneStep
+{
+    enum Wave : uint8_t { Sine, Square, Triangle, Rest };
+
+    Wave wave;
+    uint16_t startHz;
+    uint16_t endHz;         //!< Differs from startHz for a chirp - the pitch sweeps linearly between them.
+    uint16_t durationMS;
+    uint8_t level;          //!< Peak level, 0-127 of DAC full scale.
+    uint16_t attackMS;
+    uint16_t decayMS;
+    uint8_t sustain;        //!< Level held after the decay, 0-255 of level.
+    uint16_t releaseMS;
+
+    //! @brief A steady note with a short attack and release to keep it click-free.
+    static constexpr ToneStep tone(Wave wave, uint16_t hz, uint16_t ms, uint8_t level=100) {
+        return ToneStep{ wave, hz, hz, ms, level, 5, 0, 255, 5 };
+    }
+    //! @brief A sine sweeping from fromHz to toHz.
+    static constexpr ToneStep chirp(uint16_t fromHz, uint16_t toHz, uint16_t ms, uint8_t level=100) {
+        return ToneStep{ Sine, fromHz, toHz, ms, level, 5, 0, 255, 5 };
+    }
+    //! @brief Silence between notes.
+    static constexpr ToneStep rest(uint16_t ms) {
+        return ToneStep{ Rest, 0, 0, ms, 0, 0, 0, 0, 0 };
+    }
+};
+
+/*! @class   ToneGenerator
+ *  @brief   Synthesizes beeps, chirps and short note sequences as the player asks for samples.
+ *  @details Alerts without a file: no I/O, no thread and no allocation, so a tone is ready the
+ *           moment start() returns. Each sample is a fixed-point step - a 32-bit phase accumulator
+ *           indexes a 256-entry sine table (interpolated) or forms a square/triangle directly, and
+ *           a Q16 envelope scales it. Pitch sweeps move the phase increment by a constant each
+ *           sample. Output ramps in from and back out to the DAC's zero like the file readers do.
+ *           The steps of a sequence are not copied - keep them alive until playback is finished.
+ *           The per-sample methods and the sine table are in IRAM/DRAM on ESP32 for the player's ISR.
+ */
+class ToneGenerator : public AudioSampleSource
+{
+public:
+    ToneGenerator(uint32_t _sampleRate=16000);
+
+    //! @brief Play one step. It is copied, so a temporary is fine.
+    void start(const ToneStep& step);
+    /*! @brief Play steps in order, repeats times over.
+     *  @param repeats - FOREVER plays until stop().
+     */
+    void start(const ToneStep* pSteps, uint8_t count, uint16_t repeats=1);
+    //! @brief Finish the step being played, then ramp out.
+    void stop() { bStopping = true; };
+    static const uint16_t FOREVER = 0;
+
+    //! @brief Sample rate for the next start(). Default 16 kHz.
+    void setSampleRate(uint32_t rate) { sampleRate = rate; };
+
+    const uint8_t* getReadPointer();
+    void advanceReadPointer();
+    bool isPlaybackComplete();
+    uint32_t getSampleRate() { return sampleRate; };
+    void printFileInfo();
+    //! @brief Samples of the steps played so far - the ramps aren't counted.
+    uint32_t getPositionFrames() { return position; };
+    //! @brief All steps and repeats in samples. 0 when repeating forever.
+    uint32_t getTotalFrames();
+
+protected:
+    enum Phase : uint8_t { RampIn, Playing, RampOut, Done };
+
+    //! @brief Set up the oscillator and envelope for pSteps[stepIndex].
+    void beginStep();
+    //! @brief Move the envelope on to its next segment when stepPos reaches the end of this one.
+    void nextSegment();
+
+    uint32_t sampleRate;
+    const ToneStep* pSteps;
+    uint8_t stepCount;
+    uint8_t stepIndex;
+    uint16_t repeats;
+    uint16_t repeatsLeft;
+    bool bForever;
+    volatile bool bStopping;
+    ToneStep singleStep;
+
+    volatile Phase phase;
+    uint8_t current;
+    uint8_t rampDelta;
+    uint32_t position;
+    //! Worked out once in start() - the mixer and the player's ISR ask for it as they go.
+    uint32_t totalFrames;
+
+    //! @name Oscillator
+    //!@{
+    uint32_t phaseAcc;
+    uint32_t phaseInc;
+    int32_t phaseIncDelta;      // Per sample, for a sweep.
+    //!@}
+    //! @name Envelope - Q16, stepped per sample towards the end of its segment.
+    //!@{
+    enum Segment : uint8_t { Attack, Decay, Sustain, Release };
+    Segment segment;
+    int32_t env;
+    int32_t envDelta;
+    uint32_t stepPos;
+    uint32_t stepLength;
+    uint32_t segmentEnd;
+    uint32_t attackLen;
+    uint32_t decayLen;
+    uint32_t releaseLen;
+    //!@}
+};
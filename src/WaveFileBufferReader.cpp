@@ -68,7 +68,7 @@ void printHex(uint8_t* ptr, u_int16_t len) {
 #endif
 }
 
-WaveFileBufferReader::WaveFileBufferReader(const char* fname, uint16_t rampTiming) : rampTime(rampTiming)
+WaveFileBufferReader::WaveFileBufferReader(const char* fname, uint16_t rampTiming, bool _streaming) : rampTime(rampTiming), bStreaming(_streaming)
 {
     fileName="";
     totalWavBytesReadSoFar=0;
@@ -81,8 +81,34 @@ WaveFileBufferReader::WaveFileBufferReader(const char* fname, uint16_t rampTimin
     bIsFirstFill=true;
     bIsBufferReady=false;
     bIsDoneReadingFile=false;
+    bIsPrimed=false;
     pHeader=nullptr;
 
+    formatTag=0;
+    pG711 = nullptr;
+    pG711DAC = nullptr;
+    audioStart = 0;
+    dataStart = 0;
+    frameBytes = 0;
+    totalFrames = 0;
+    positionBase = 0;
+    samplesOut = 0;
+    rampInSamples = 0;
+    bSeeking = false;
+    loopLength = 0;
+    loopStart = 0;
+    loopSwitch = 0;
+    loopPos = 0;
+    bLooping = false;
+    bStopLooping = false;
+    bInLoopCycle = false;
+    readFrame = 0;
+    playEnd = 0;
+    streamIndex = 0;
+    loopEntryIndex = NO_INDEX;
+    loopExitIndex = NO_INDEX;
+    rampOutSamples = 0;
+    dataBytesLeft=0;
     numChannels=0;
     bitsPerSample=0;
     sampleRate=0;
@@ -118,6 +144,8 @@ WaveFileBufferReader::WaveFileBufferReader(const char* fname, uint16_t rampTimin
 
 WaveFileBufferReader::~WaveFileBufferReader()
 {
+    stopFilling();
+
     if (pHeader) {
         delete pHeader;
         pHeader = nullptr;
@@ -138,13 +166,20 @@ void WaveFileBufferReader::readAndProcessWavHeader(void)
     uint32_t subChunkSize;
 
     if (!read((uint8_t*)pHeader, WAV_HEADER_TO_CHUNKLEN)) {
-        assert("Early file header read failed."==nullptr);
         throw "WaveFileBufferReader::Early File header read failed.";
     }
 
 //    printHex((uint8_t*)ptr, WAV_HEADER_TO_CHUNKLEN);
 
-    assert(strncmp((char*)ptr, "RIFF", 4)==0);
+    if (strncmp((char*)ptr, "fLaC", 4)==0) {
+        readAndProcessFlacHeader();
+        beginStreaming();
+        return;
+    }
+
+    // Lists are filled from whole directories, so this is bad input rather than a bug - throw.
+    if (strncmp((char*)ptr, "RIFF", 4))
+        throw "WaveFileBufferReader::Not a RIFF file.";
 
     // chunksize - skip
     ptr = pHeader + 4;
@@ -153,40 +188,61 @@ void WaveFileBufferReader::readAndProcessWavHeader(void)
 //    printf("Chunksize at RIFF header says: %d\n", tmp32);
 
     ptr = pHeader + 8;
-    assert(strncmp((char*)ptr, "WAVE", 4)==0);
+    if (strncmp((char*)ptr, "WAVE", 4))
+        throw "WaveFileBufferReader::Not a WAVE file.";
 
     ptr = pHeader + 12;
-    assert(strncmp((char*)ptr, "fmt ", 4)==0);
+    if (strncmp((char*)ptr, "fmt ", 4))
+        throw "WaveFileBufferReader::No 'fmt ' chunk where expected.";
 
     ptr = pHeader + 16;
     subChunkSize = ptr[3]<<24 | ptr[2]<<16 | ptr[1]<<8 | ptr[0];
-    if (subChunkSize !=16 && subChunkSize !=18) {
+    if (subChunkSize !=16 && subChunkSize !=18 && subChunkSize !=20 && subChunkSize !=40) {
 #ifdef ESP_PLATFORM
-        Serial.printf("WARN: May not be PCM. After 'fmt ', Subchunk size was not 16 or 18. Instead it is %d.\n", subChunkSize);
+        Serial.printf("WARN: May not be PCM/ADPCM. After 'fmt ', Subchunk size was not 16, 18, 20 or 40. Instead it is %d.\n", subChunkSize);
 #else
-        printf("WARN: May not be PCM. After 'fmt ', Subchunk size was not 16 or 18. Instead it is %d.\n", subChunkSize);
+        printf("WARN: May not be PCM/ADPCM. After 'fmt ', Subchunk size was not 16, 18, 20 or 40. Instead it is %d.\n", subChunkSize);
 #endif
     }
 
-    // Now we have a value for the number of bytes remaining. It should be 16 or 18.
+    // Now we have a value for the number of bytes remaining. It should be 16 or 18 (20 for ADPCM,
+    // 40 for EXTENSIBLE).
     // And we're going to read an extra 8 bytes to get the ID and Size from the next chunk header.
+    if (WAV_HEADER_TO_CHUNKLEN + subChunkSize + 8 > WAV_HEADER)
+        throw "WaveFileBufferReader::'fmt ' chunk is larger than supported.";
     if (!read((uint8_t*)pHeader+WAV_HEADER_TO_CHUNKLEN, subChunkSize+8))
         throw "WaveFileBufferReader::Later File header read failed.";
 
     ptr = pHeader + 20;
-    tmp16 = ptr[1]<<8 | ptr[0];
-    if (tmp16 != 1) {
+    formatTag = ptr[1]<<8 | ptr[0];
+    if (formatTag == WAVE_FORMAT_EXTENSIBLE) {
+        // The real format lives in the first two bytes of the subformat GUID at +44. The other
+        // 14 bytes are the fixed KSDATAFORMAT_SUBTYPE tail shared by every WAVE format.
+        static const uint8_t guidTail[14] = { 0x00,0x00, 0x00,0x00, 0x10,0x00, 0x80,0x00,
+                                              0x00,0xAA, 0x00,0x38, 0x9B,0x71 };
+        if (subChunkSize < 40 || memcmp(pHeader + 46, guidTail, sizeof(guidTail)))
+            throw "WaveFileBufferReader::EXTENSIBLE subformat is not a WAVE format GUID.";
+        ptr = pHeader + 44;
+        formatTag = ptr[1]<<8 | ptr[0];
+    }
+    pG711 = G711Decoder::getLinearTable(formatTag);
+    pG711DAC = G711Decoder::getDACTable(formatTag);
+    if (formatTag != WAVE_FORMAT_PCM && formatTag != PcmConverter::WAVE_FORMAT_IEEE_FLOAT
+        && formatTag != WAVE_FORMAT_IMA_ADPCM && !pG711) {
         printHex(pHeader, WAV_HEADER);
-        assert(tmp16==1 && "@20:PCM==1");
+        throw "WaveFileBufferReader::Unsupported format (PCM, float, A-law, mu-law or IMA ADPCM only).";
     }
 
     ptr = pHeader + 22;
     numChannels = ptr[1]<<8 | ptr[0];
-    assert(numChannels<=2);
+    // Plain PCM/float is downmixed by the converter. The codecs only deal in mono or stereo.
+    if (!numChannels || numChannels > ((formatTag == WAVE_FORMAT_IMA_ADPCM || pG711) ? 2 : 8))
+        throw "WaveFileBufferReader::Unsupported channel count.";
 
     ptr = pHeader + 24;
     sampleRate = ptr[3]<<24 | ptr[2]<<16 | ptr[1]<<8 | ptr[0];
-    assert(sampleRate <= 48000);
+    if (!sampleRate || (bStreaming && sampleRate > MAX_PLAYBACK_RATE))
+        throw "WaveFileBufferReader::Sample rate is above what the player can stream.";
 
     ptr = pHeader + 28;
     byteRate = ptr[3]<<24 | ptr[2]<<16 | ptr[1]<<8 | ptr[0];
@@ -198,16 +254,43 @@ void WaveFileBufferReader::readAndProcessWavHeader(void)
 
     ptr = pHeader + 34;
     bitsPerSample = ptr[1]<<8 | ptr[0];
-    assert(bitsPerSample==8 || bitsPerSample==16);
 
-    // Validate a few things now that we have all the data.
-    // Byterate was given to us but it should be chan*bitspersample/8*samplerate
-//    printf("byteRate read is:%lu. numch=%d, bitspersample=%d, samplerate=%lu\n", 
-//        byteRate, numChannels, bitsPerSample, sampleRate);
-    assert(byteRate == numChannels*bitsPerSample/8*sampleRate);
-    // Blockalign is in stack var blockAlign and should be numchannels*bitspersample/8;
-    assert(blockAlign == numChannels*bitsPerSample/8);
-    assert(sampleRate <= 48000);
+    if (formatTag == WAVE_FORMAT_IMA_ADPCM) {
+        // Blockalign is the compressed block size here and the extension (cbSize=2) carries
+        // samples-per-block which has to agree with it. Byterate is the compressed rate.
+        if (bitsPerSample != 4 || subChunkSize < 20)
+            throw "WaveFileBufferReader::Malformed IMA ADPCM 'fmt ' chunk.";
+        ptr = pHeader + 38;
+        tmp16 = ptr[1]<<8 | ptr[0];
+        if (tmp16 != ImaAdpcmDecoder::samplesPerBlock(blockAlign, numChannels))
+            throw "WaveFileBufferReader::IMA ADPCM samples per block disagrees with the block size.";
+        pAdpcm.reset(new ImaAdpcmDecoder(blockAlign, numChannels));
+    }
+    else {
+        // G.711 is laid out exactly like 8-bit PCM - one byte per sample per channel.
+        PcmConverter::Encoding encoding;
+        if (pG711) {
+            if (bitsPerSample != 8)
+                throw "WaveFileBufferReader::G.711 must be 8 bits per sample.";
+        }
+        else if (!PcmConverter::getEncoding(formatTag, bitsPerSample, encoding))
+            throw "WaveFileBufferReader::Unsupported PCM bit depth.";
+        else if (encoding != PcmConverter::Unsigned8 || numChannels != 1) {
+            pPcm.reset(new PcmConverter(encoding, numChannels));
+            uint16_t frames = 1024 / pPcm->getBytesPerFrame();
+            convertBuffer.resize(frames * pPcm->getBytesPerFrame());
+        }
+
+        // Validate a few things now that we have all the data.
+        // Byterate was given to us but it should be chan*bitspersample/8*samplerate
+//        printf("byteRate read is:%lu. numch=%d, bitspersample=%d, samplerate=%lu\n", 
+//            byteRate, numChannels, bitsPerSample, sampleRate);
+        if (byteRate != numChannels*bitsPerSample/8*sampleRate)
+            throw "WaveFileBufferReader::Byte rate disagrees with the format.";
+        // Blockalign is in stack var blockAlign and should be numchannels*bitspersample/8;
+        if (blockAlign != numChannels*bitsPerSample/8)
+            throw "WaveFileBufferReader::Block align disagrees with the format.";
+    }
 
 // Now we need to iterate through chunks until we encounter 'data' as the chunk ID
 // Then read the final data chunk size and leave the seek position in the file 'ready to read data'
@@ -230,11 +313,9 @@ void WaveFileBufferReader::readAndProcessWavHeader(void)
             // }
 //            else if (!seek(payloadSize)) {
             if (!seekRel(payloadSize)) {
-                assert("SEEK failed for CHUNK."==nullptr);
                 throw "Failed to seek while iterating through CHUNKs";
             }
             if (!read((uint8_t*)head, 8)) {
-                assert("READ failed for CHUNK."==nullptr);
                 throw "Failed to read next 8 bytes in seeking through CHUNKs";
             }
 //            printf("NEXT CHUNK HEAD: ");
@@ -242,7 +323,6 @@ void WaveFileBufferReader::readAndProcessWavHeader(void)
 
             payloadSize = head[7]<<24 | head[6]<<16 | head[5]<<8 | head[4];
             if (!payloadSize) {
-                assert("SEEK failed for CHUNK."==nullptr);
                 throw "Payload failure.";
             }
 
@@ -260,6 +340,110 @@ void WaveFileBufferReader::readAndProcessWavHeader(void)
     }
 
 //    printf("Total byte size of the 'data' chunk payload is: %lu\n", totalWaveBytes);
+    dataBytesLeft = totalWaveBytes;
+    dataStart = totalWavBytesReadSoFar;
+    frameBytes = blockAlign;
+    if (pAdpcm) {
+        // Whole blocks, then whatever a short final block holds.
+        uint32_t tail = totalWaveBytes % blockAlign;
+        totalFrames = totalWaveBytes / blockAlign * ImaAdpcmDecoder::samplesPerBlock(blockAlign, numChannels);
+        if (tail > 4u*numChannels)
+            totalFrames += ImaAdpcmDecoder::samplesPerBlock(tail, numChannels);
+    }
+    else
+        totalFrames = totalWaveBytes / blockAlign;
+    beginStreaming();
+}
+
+void WaveFileBufferReader::readAndProcessFlacHeader(void)
+{
+    uint8_t blockHead[4];
+    bool bLast = false;
+
+    // The probe read took 16 bytes past "fLaC". Step back to the first metadata block.
+    if (!seekRel(4 - WAV_HEADER_TO_CHUNKLEN))
+        throw "WaveFileBufferReader::FLAC seek failed.";
+
+    pFlac.reset(new FlacDecoder());
+    formatTag = FORMAT_FLAC;
+
+    try {
+        while (!bLast) {
+            read(blockHead, 4);
+            bLast = blockHead[0] & 0x80;
+            uint8_t type = blockHead[0] & 0x7f;
+            uint32_t length = blockHead[1]<<16 | blockHead[2]<<8 | blockHead[3];
+
+            if (type == 0 && length == 34) {
+                // STREAMINFO - sizes the decoder's whole working set.
+                read(pHeader, 34);
+                if (!pFlac->parseStreamInfo(pHeader))
+                    throw "WaveFileBufferReader::Unsupported FLAC stream (max 2 channels, 24 bits).";
+            }
+            else if (type == 3) {
+                // SEEKTABLE - 18 bytes per point.
+                pFlac->reserveSeekPoints(length / 18);
+                for (uint32_t i=0; i<length/18; i++) {
+                    read(pHeader, 18);
+                    pFlac->addSeekPoint(pHeader);
+                }
+                if (length % 18)
+                    seekRel(length % 18);
+            }
+            else if (!seekRel(length))
+                throw "WaveFileBufferReader::Failed to skip FLAC metadata.";
+        }
+    } catch (FileException& fex) {
+        throw "WaveFileBufferReader::FLAC metadata is truncated.";
+    }
+
+    if (!pFlac->getSampleRate())
+        throw "WaveFileBufferReader::FLAC stream has no STREAMINFO.";
+
+    audioStart = dataStart = totalWavBytesReadSoFar;
+    totalFrames = pFlac->getTotalSamples();
+    numChannels = pFlac->getNumChannels();
+    bitsPerSample = pFlac->getBitsPerSample();
+    sampleRate = pFlac->getSampleRate();
+    if (bStreaming && sampleRate > MAX_PLAYBACK_RATE)
+        throw "WaveFileBufferReader::Sample rate is above what the player can stream.";
+    // Rates and sizes are reported as the PCM equivalent. An unknown length (legal, but rare)
+    // shows up as zero seconds.
+    byteRate = sampleRate * numChannels * ((bitsPerSample + 7) / 8);
+    totalWaveBytes = pFlac->getTotalSamples() * numChannels * ((bitsPerSample + 7) / 8);
+    if (!totalWaveBytes)
+        totalWaveBytes = 1;
+}
+
+void WaveFileBufferReader::readAndProcessClip(const ClipBankEntry& clip)
+{
+    if (clip.format != ClipBankEntry::FORMAT_DAC8)
+        throw "WaveFileBufferReader::Unsupported clip bank payload format.";
+
+    // The file is open at offset zero. One seek and we're on the first sample.
+    if (!seekRel(clip.offset))
+        throw "WaveFileBufferReader::Clip bank seek failed.";
+
+    formatTag = WAVE_FORMAT_PCM;
+    numChannels = 1;
+    bitsPerSample = 8;
+    sampleRate = clip.sampleRate;
+    if (!sampleRate || sampleRate > MAX_PLAYBACK_RATE)
+        throw "WaveFileBufferReader::Clip bank sample rate is out of range.";
+    byteRate = sampleRate;
+    totalWaveBytes = clip.length;
+    dataBytesLeft = clip.length;
+    dataStart = totalWavBytesReadSoFar;
+    frameBytes = 1;
+    totalFrames = clip.length;
+    beginStreaming();
+}
+
+void WaveFileBufferReader::beginStreaming(void)
+{
+    if (!bStreaming)
+        return;     // Sitting on the first data byte. readAllSamples() takes it from here.
+
     bIsBufferReady = true;
     bufferAlloc();
 
@@ -272,14 +456,13 @@ void WaveFileBufferReader::readAndProcessWavHeader(void)
 }
 
 //
-// TODO: Needs to take into consideration 16-bit samples & 2-channel also
-//       Currently ONLY lays down ramp-in for 8-bit mono
+// The first sample comes through readSamples() so it is already 8-bit mono whatever the file holds.
 //
 void WaveFileBufferReader::readFirstByteAndPrepRampIn() {
     uint8_t firstByte;
 
     try {
-        read(&firstByte, 1);
+        readSamples(&firstByte, 1);
     } catch (FileException& fex) {
         PrintLN("RampIn: EXIT - failed to read ONE BYTE.");
         return;
@@ -292,7 +475,9 @@ void WaveFileBufferReader::readFirstByteAndPrepRampIn() {
     printf("RampIn: Target: %u, step delta: %u\n", firstByte, rampInDelta);
 #endif
     assert(pWavBuffer);
-    for(uint8_t rampValue=0; rampValue<firstByte; pBufferWrite++, rampValue += rampInDelta)
+    // A first sample too close to zero for a step of one gets no ramp rather than an endless one.
+    rampInSamples = 0;
+    for(uint8_t rampValue=0; rampInDelta && rampValue<firstByte; pBufferWrite++, rampValue += rampInDelta, rampInSamples++)
         *pBufferWrite = rampValue;
 
     *pBufferWrite = firstByte;
@@ -305,6 +490,7 @@ void WaveFileBufferReader::prepRampOut() {
     // No matter what happens, our job here is "done".
     // Even if there's no room in the buffer, we'll just wind up with a 'pop' in ramp out
     bIsRampOutComplete = true;
+    rampOutSamples = 0;
 
     // Final byte of the file is sitting at pBufferWrite-1
     uint8_t startingValue;
@@ -340,6 +526,7 @@ void WaveFileBufferReader::prepRampOut() {
         // We've got space. Lay down the values and move the write pointer.
         for(uint8_t rampValue=startingValue; rampValue>=rampOutDelta; pBufferWrite++, rampValue -= rampOutDelta) {
             *pBufferWrite = rampValue;
+            rampOutSamples++;
         }
     }
     else
@@ -350,11 +537,11 @@ void WaveFileBufferReader::prepRampOut() {
 void WaveFileBufferReader::printFileInfo() {
     int seconds = totalWaveBytes / byteRate;
 #ifdef ESP_PLATFORM
-    Serial.printf("File: %s - %d-Channel, %d-Bits, %lu Hz, Byterate:%lu, Total Wave Bytes:%lu, Total Playout Time:%d seconds\n", 
-        fileName.c_str(), numChannels, bitsPerSample, sampleRate, byteRate, totalWaveBytes, seconds);
+    Serial.printf("File: %s - %d-Channel, %d-Bits %s, %lu Hz, Byterate:%lu, Total Wave Bytes:%lu, Total Playout Time:%d seconds\n", 
+        fileName.c_str(), numChannels, bitsPerSample, getFormatName(), sampleRate, byteRate, totalWaveBytes, seconds);
 #else
-    printf("File: %s - %d-Channel, %d-Bits, %lu Hz, Byterate:%lu, Total Wave Bytes:%lu, Total Playout Time:%d seconds\n", 
-        fileName.c_str(), numChannels, bitsPerSample, sampleRate, byteRate, totalWaveBytes, seconds);
+    printf("File: %s - %d-Channel, %d-Bits %s, %lu Hz, Byterate:%lu, Total Wave Bytes:%lu, Total Playout Time:%d seconds\n", 
+        fileName.c_str(), numChannels, bitsPerSample, getFormatName(), sampleRate, byteRate, totalWaveBytes, seconds);
 #endif
 }
 
@@ -395,9 +582,12 @@ void WaveFileBufferReader::bufferAlloc() {
     assert(bitsPerSample);
     assert(sampleRate);
 
+    // The ring holds what the player consumes. That is 8-bit mono for every format - one byte
+    // per sample - not the compressed (or multi-channel, wider) byteRate from the header.
+    uint32_t ringByteRate = sampleRate;
     uint8_t curIndex=0;
     for (curIndex=0; curIndex<MAX_SIZES_COUNT; curIndex++) {
-        if (byteRate <= bufferByteRates[curIndex]) {
+        if (ringByteRate <= bufferByteRates[curIndex]) {
             lengthWavBuffer = bufferSizes[curIndex];
             break;
         }
@@ -416,10 +606,15 @@ void WaveFileBufferReader::bufferAlloc() {
 
 bool WaveFileBufferReader::isPlaybackComplete() {
 
-    if (bIsDoneReadingFile && pBufferRead==pBufferWrite) {
+    if (!bSeeking && bIsDoneReadingFile && pBufferRead==pBufferWrite) {
 //        printf("Pausing the thread to avoid any issues.\n");
 #ifndef ESP_PLATFORM
         Pause();
+        // A seek which slipped in meanwhile needs the thread back.
+        if (bSeeking || !bIsDoneReadingFile) {
+            Start();
+            return false;
+        }
 #endif
         return true;
     }
@@ -450,7 +645,7 @@ void WaveFileBufferReader::bufferFill() {
     assert(pBufferRead);
     assert(pBufferWrite);
 
-    if (100*totalWavBytesReadSoFar/totalWaveBytes >= percentComplete) {
+    if (getFileReadPercentage() >= percentComplete) {
 #ifdef ESP_PLATFORM
         Serial.printf("%d%%  ", percentComplete);
 #else
@@ -463,16 +658,23 @@ void WaveFileBufferReader::bufferFill() {
     //
     // If pBufferRead is greater than pBufferWrite, then the difference is all we want to add.
     //
-    // If, however, pBufferWrite > pBufferRead, then we want to fill to the end and then fill from
+    // If, however, pBufferWrite >= pBufferRead, then we want to fill to the end and then fill from
     // the front of the buffer to where pBufferRead is at. Two separate memcpy() events.
     //
+    // One byte is always left unfilled just behind pBufferRead. That way pBufferRead==pBufferWrite
+    // only ever means 'empty' - which is what lets the player tell an underrun from a full buffer.
+    //
     if (pLocalRead > pBufferWrite || bIsFirstFill) {
+        bool wasFirstFill = bIsFirstFill;
         if (bIsFirstFill) {
             bIsFirstFill=false;
             bytesToFill = 2 * lengthWavBuffer / 5;      // Don't want to do a HUGE fill initially
         }
         else
-            bytesToFill = pLocalRead - pBufferWrite;
+            bytesToFill = pLocalRead - pBufferWrite - 1;
+
+        if (!bytesToFill)
+            return;
 
 #ifdef ESP_PLATFORM
 //        Serial.printf("Read > Write - need to fill %u%% (%u bytes)\n", 100*bytesToFill/lengthWavBuffer, bytesToFill);
@@ -482,7 +684,7 @@ void WaveFileBufferReader::bufferFill() {
         startPT = std::chrono::high_resolution_clock::now();
 #endif
         try {
-            read(pBufferWrite, bytesToFill);
+            readSamples(pBufferWrite, bytesToFill);
         } catch (FileException& fex) {
             if (fex.isEOF()) {
                 bIsDoneReadingFile=true;
@@ -490,9 +692,12 @@ void WaveFileBufferReader::bufferFill() {
                 // Guaranteed to be ok address math since Read > Write (above)
                 //   which implies there's no chance of an address wrap situation.
                 lastByteValueOfFile = *(pBufferWrite - 1);
+                bIsPrimed = true;
                 return;
             }
         }
+        if (wasFirstFill)
+            bIsPrimed = true;
 #ifdef ESP_PLATFORM
         readTimeEnd = micros();
         readTimeElapsed = readTimeEnd - readTimeStart;
@@ -509,11 +714,16 @@ void WaveFileBufferReader::bufferFill() {
         lastByteValueOfFile = *(pBufferWrite - 1);
         assert(pBufferWrite < pWavBuffer+lengthWavBuffer);
     }
-    else if (pBufferWrite > pLocalRead) {
+    else {
         // In this case, we have to fill from 'write' to the end of the buffer
-        // and then fill from the front of the buffer to 'read'
+        // and then fill from the front of the buffer to 'read' (less the one byte gap).
+        // Equal pointers means the buffer has run dry - the whole thing gets filled.
         uint32_t bytesToEndOfBuffer = (pWavBuffer+lengthWavBuffer) - pBufferWrite;
         uint32_t bytesAtFrontOfBuffer = pLocalRead - pWavBuffer;
+        if (bytesAtFrontOfBuffer)
+            bytesAtFrontOfBuffer--;
+        else
+            bytesToEndOfBuffer--;
         bytesToFill = bytesToEndOfBuffer + bytesAtFrontOfBuffer;
 
 #ifdef ESP_PLATFORM
@@ -530,14 +740,14 @@ void WaveFileBufferReader::bufferFill() {
     // And so the EOF would find the last byte at the write pointer minus one.
     //
         try {
-            read(pBufferWrite, bytesToEndOfBuffer);
+            if (bytesToEndOfBuffer)
+                readSamples(pBufferWrite, bytesToEndOfBuffer);
         } catch (FileException& fex) {
             if (fex.isEOF()) {
                 bIsDoneReadingFile=true;
                 pBufferWrite += fex.getPartial();
-                // Guaranteed to be ok address math since Read > Write (above)
-                //   which implies there's no chance of an address wrap situation.
-                lastByteValueOfFile = *(pBufferWrite - 1);
+                // A run-dry buffer may be at its first byte with nothing read.
+                lastByteValueOfFile = pBufferWrite == pWavBuffer ? pWavBuffer[lengthWavBuffer - 1] : *(pBufferWrite - 1);
 
                 return;
             }
@@ -547,14 +757,14 @@ void WaveFileBufferReader::bufferFill() {
         // And whether at the end of a read or an EOF, the last byte will be
         // at the write pointer minus one.
         try {
-            read(pWavBuffer, bytesAtFrontOfBuffer);
+            if (bytesAtFrontOfBuffer)
+                readSamples(pWavBuffer, bytesAtFrontOfBuffer);
         } catch (FileException& fex) {
             if (fex.isEOF()) {
                 bIsDoneReadingFile=true;
                 pBufferWrite = pWavBuffer + fex.getPartial();
-                // Guaranteed to be ok address math since Read > Write (above)
-                //   which implies there's no chance of an address wrap situation.
-                lastByteValueOfFile = *(pBufferWrite - 1);
+                // Nothing landed at the front - the last byte is the one at the very end.
+                lastByteValueOfFile = pBufferWrite == pWavBuffer ? pWavBuffer[lengthWavBuffer - 1] : *(pBufferWrite - 1);
 
                 return;
             }
@@ -572,33 +782,496 @@ void WaveFileBufferReader::bufferFill() {
 //        printf("READING (%lu%%) Two Parts: %5u bytes in %4u uS is a rate of %d kB/s\n", getFileReadPercentage(), bytesToFill, (uint32_t)(span.count()*1000000), rate/1024);
 #endif
 
-        pBufferWrite = pLocalRead;      // Skip ahead to where 'read' was when we entered.
-        lastByteValueOfFile = *(pBufferWrite - 1);
+        // Skip ahead to just behind where 'read' was when we entered - wrapping to the front
+        // when 'read' was on the second byte, and to the last byte when it was on the first.
+        pBufferWrite = pLocalRead == pWavBuffer ? pWavBuffer + lengthWavBuffer - 1 : pLocalRead - 1;
+        lastByteValueOfFile = pBufferWrite == pWavBuffer ? pWavBuffer[lengthWavBuffer - 1] : *(pBufferWrite - 1);
+    }
+}
+
+void WaveFileBufferReader::readSamples(uint8_t* pDest, size_t numSamples) {
+    size_t done = 0;
+
+    // A stop asked for before the loop was ever reached just never enters it.
+    if (bStopLooping && !bInLoopCycle)
+        bLooping = false;
+
+    try {
+        while (done < numSamples) {
+            size_t count = numSamples - done;
+            if (bInLoopCycle) {
+                if (bStopLooping && !loopPos) {
+                    // Between passes - back to the file where the first pass moved over to memory.
+                    bInLoopCycle = false;
+                    bLooping = false;
+                    loopExitIndex = streamIndex;
+                    if (!positionAtFrame(loopSwitch))
+                        throw FileException("ERROR found.", 0, false);
+                    continue;
+                }
+                if (count > loopLength - loopPos)
+                    count = loopLength - loopPos;
+                memcpy(pDest + done, &loopCycle[loopPos], count);
+                loopPos += count;
+                if (loopPos == loopLength)
+                    loopPos = 0;
+            }
+            else {
+                if (bLooping && readFrame == loopSwitch) {
+                    bInLoopCycle = true;
+                    loopPos = 0;
+                    loopEntryIndex = streamIndex;
+                    continue;
+                }
+                if (bLooping && readFrame < loopSwitch && count > loopSwitch - readFrame)
+                    count = loopSwitch - readFrame;
+                if (playEnd && readFrame + count > playEnd) {
+                    if (readFrame >= playEnd)
+                        throw FileException("EOF reached.", 0, true);
+                    count = playEnd - readFrame;
+                }
+                readFileSamples(pDest + done, count);
+                readFrame += count;
+            }
+            done += count;
+            streamIndex += count;
+        }
+    } catch (FileException& fex) {
+        readFrame += fex.getPartial();
+        streamIndex += fex.getPartial();
+        throw FileException(fex.isEOF() ? "EOF reached." : "ERROR found.", done + fex.getPartial(), fex.isEOF());
+    }
+}
+
+void WaveFileBufferReader::readFileSamples(uint8_t* pDest, size_t numSamples) {
+    if (pFlac) {
+        size_t done = 0;
+        while (done < numSamples) {
+            if (!pFlac->available() && !decodeFlacFrame(done))
+                throw FileException("EOF reached.", done, true);
+            done += pFlac->take(pDest + done, numSamples - done);
+        }
+        return;
+    }
+    if (pG711 && numChannels == 1) {
+        // Codes land in the ring and are translated where they sit.
+        try {
+            readData(pDest, numSamples);
+        } catch (FileException& fex) {
+            G711Decoder::decodeToDAC(pDest, pDest, fex.getPartial(), pG711DAC);
+            throw;
+        }
+        G711Decoder::decodeToDAC(pDest, pDest, numSamples, pG711DAC);
+        return;
+    }
+    if (pG711) {
+        // Stereo goes through a small scratch block and is averaged down to one channel.
+        uint8_t raw[256];
+        size_t done = 0;
+        while (done < numSamples) {
+            size_t frames = numSamples - done < sizeof(raw)/2 ? numSamples - done : sizeof(raw)/2;
+            try {
+                readData(raw, 2*frames);
+            } catch (FileException& fex) {
+                G711Decoder::decodeStereoToDAC(raw, pDest + done, fex.getPartial()/2, pG711);
+                throw FileException(fex.isEOF() ? "EOF reached." : "ERROR found.", done + fex.getPartial()/2, fex.isEOF());
+            }
+            G711Decoder::decodeStereoToDAC(raw, pDest + done, frames, pG711);
+            done += frames;
+        }
+        return;
+    }
+    if (pPcm) {
+        // Whole frames through the scratch buffer, converted straight into the ring.
+        uint8_t bpf = pPcm->getBytesPerFrame();
+        size_t done = 0;
+        while (done < numSamples) {
+            size_t frames = numSamples - done;
+            if (frames > convertBuffer.size() / bpf)
+                frames = convertBuffer.size() / bpf;
+            try {
+                readData(&convertBuffer[0], frames * bpf);
+            } catch (FileException& fex) {
+                pPcm->convert(&convertBuffer[0], pDest + done, fex.getPartial() / bpf);
+                throw FileException(fex.isEOF() ? "EOF reached." : "ERROR found.", done + fex.getPartial() / bpf, fex.isEOF());
+            }
+            pPcm->convert(&convertBuffer[0], pDest + done, frames);
+            done += frames;
+        }
+        return;
+    }
+    if (!pAdpcm) {
+        readData(pDest, numSamples);
+        return;
+    }
+
+    size_t done = 0;
+    while (done < numSamples) {
+        if (!pAdpcm->available()) {
+            // Stop at the end of the 'data' chunk - anything after it (LIST etc) isn't audio.
+            uint32_t want = dataBytesLeft < pAdpcm->getBlockAlign() ? dataBytesLeft : pAdpcm->getBlockAlign();
+            uint32_t got = want;
+            if (!want)
+                throw FileException("EOF reached.", done, true);
+            try {
+                read(pAdpcm->getBlockBuffer(), want);
+            } catch (FileException& fex) {
+                if (!fex.isEOF())
+                    throw FileException("ERROR found.", done, false);
+                got = fex.getPartial();
+                want = 0;
+            }
+            dataBytesLeft = want ? dataBytesLeft - got : 0;
+            pAdpcm->decodeBlock(got);
+            if (!pAdpcm->available())
+                throw FileException("EOF reached.", done, true);
+        }
+        done += pAdpcm->take(pDest + done, numSamples - done);
+    }
+}
+
+bool WaveFileBufferReader::decodeFlacFrame(size_t done) {
+    // Buffer a worst-case frame before decoding so a frame never straddles a read.
+    while (pFlac->needsInput()) {
+        size_t room;
+        uint8_t* pSpace = pFlac->getInputSpace(room);
+        try {
+            read(pSpace, room);
+            pFlac->inputAdded(room);
+        } catch (FileException& fex) {
+            if (!fex.isEOF())
+                throw FileException("ERROR found.", done, false);
+            pFlac->inputAdded(fex.getPartial());
+            pFlac->setInputEnd();
+        }
+    }
+    return pFlac->decodeFrame();
+}
+
+void WaveFileBufferReader::readData(uint8_t* pDest, size_t numBytes) {
+    // Stop at the end of the 'data' chunk - anything after it (LIST etc) isn't audio.
+    size_t want = numBytes < dataBytesLeft ? numBytes : dataBytesLeft;
+    try {
+        if (want)
+            read(pDest, want);
+    } catch (FileException& fex) {
+        dataBytesLeft = 0;
+        throw;
+    }
+    dataBytesLeft -= want;
+    if (want < numBytes)
+        throw FileException("EOF reached.", want, true);
+}
+
+const char* WaveFileBufferReader::getFormatName() {
+    switch (formatTag) {
+    case WAVE_FORMAT_PCM:                   return "PCM";
+    case PcmConverter::WAVE_FORMAT_IEEE_FLOAT: return "float";
+    case WAVE_FORMAT_IMA_ADPCM:             return "IMA ADPCM";
+    case G711Decoder::WAVE_FORMAT_ALAW:     return "A-law";
+    case G711Decoder::WAVE_FORMAT_MULAW:    return "mu-law";
+    case FORMAT_FLAC:                       return "FLAC";
+    default:                                return "unknown";
+    }
+}
+
+bool WaveFileBufferReader::positionAtFrame(uint32_t frame) {
+    uint32_t skip = 0;
+
+    if (pFlac) {
+        uint64_t pointSample, offset;
+        pFlac->findSeekPoint(frame, pointSample, offset);
+        if (!seekRel((long)(dataStart + offset) - (long)totalWavBytesReadSoFar))
+            return false;
+        pFlac->reset(pointSample);
+        skip = frame - pointSample;
+    }
+    else if (pAdpcm) {
+        // Blocks decode on their own - start the frame's block afresh and decode up to the frame.
+        uint16_t perBlock = ImaAdpcmDecoder::samplesPerBlock(frameBytes, numChannels);
+        uint32_t blockOffset = frame / perBlock * frameBytes;
+        if (!seekRel((long)(dataStart + blockOffset) - (long)totalWavBytesReadSoFar))
+            return false;
+        pAdpcm->reset();
+        dataBytesLeft = totalWaveBytes - blockOffset;
+        skip = frame % perBlock;
     }
     else {
-#ifdef ESP_PLATFORM
-//        Serial.println("WARN: Write and Read buffers are in the same location. Nothing to do.");
-#else
-//        printf("WARN: Write and Read buffers are in the same location. Nothing to do.\n");
-#endif
+        // Fixed-size frames - straight to the byte.
+        uint32_t byteOffset = frame * frameBytes;
+        if (!seekRel((long)(dataStart + byteOffset) - (long)totalWavBytesReadSoFar))
+            return false;
+        dataBytesLeft = totalWaveBytes - byteOffset;
     }
+    bIsDoneReadingFile = false;
+
+    uint8_t discard[256];
+    try {
+        while (skip) {
+            uint32_t count = skip < sizeof(discard) ? skip : sizeof(discard);
+            readFileSamples(discard, count);
+            skip -= count;
+        }
+    } catch (FileException& fex) {
+        bIsDoneReadingFile = true;
+    }
+    readFrame = frame;
+    return true;
+}
+
+bool WaveFileBufferReader::seekToFrame(uint32_t frame) {
+    if (totalFrames && frame > totalFrames)
+        frame = totalFrames;
+
+    if (!bStreaming)
+        return positionAtFrame(frame);
+
+    std::lock_guard<std::mutex> lock(fillLock);
+
+    // Hold the output. One sample period is plenty for an output call already past
+    // isStarved() to finish with the old ring before it is reset.
+    bSeeking = true;
+    SleepMS(1);
+
+    bool ok = positionAtFrame(frame);
+    if (ok) {
+        pBufferRead = pBufferWrite = pWavBuffer;
+        bIsFirstFill = true;
+        bIsPrimed = false;
+        bIsRampOutComplete = false;
+        positionBase = frame;
+        samplesOut = 0;
+        rampInSamples = 0;
+        streamIndex = 0;
+        bInLoopCycle = false;
+        loopEntryIndex = loopExitIndex = NO_INDEX;
+        if (!bIsDoneReadingFile) {
+            readFirstByteAndPrepRampIn();
+            // Fill here rather than on the thread's next pass - the new position plays right away.
+            bufferFill();
+        }
+        else
+            bIsPrimed = true;
+    }
+    bSeeking = false;
+    Start();
+    return ok;
+}
+
+uint32_t WaveFileBufferReader::getPositionFrames() {
+    // The ramp-in leads up to the first frame, which is then written over by the first fill.
+    uint32_t out = samplesOut.load(std::memory_order_relaxed);
+    uint32_t pos = positionBase;
+    if (out >= rampInSamples) {
+        uint32_t index = 1 + (out - rampInSamples);
+        if (loopEntryIndex == NO_INDEX || index < loopEntryIndex)
+            pos = positionBase + index;
+        else if (index < loopExitIndex)
+            pos = loopStart + (index - loopEntryIndex) % loopLength;
+        else
+            pos = loopSwitch + (index - loopExitIndex);
+    }
+    return !totalFrames || pos < totalFrames ? pos : totalFrames;
+}
+
+bool WaveFileBufferReader::setPlayRange(uint32_t startFrame, uint32_t endFrame) {
+    if (totalFrames && endFrame > totalFrames)
+        endFrame = totalFrames;
+    if (endFrame <= startFrame)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(fillLock);
+        playEnd = endFrame;
+    }
+    // Always re-position - the first fill may already have read past the new end.
+    return seekToFrame(startFrame);
+}
+
+bool WaveFileBufferReader::setLoop(uint32_t startFrame, uint32_t endFrame, uint32_t crossfadeFrames) {
+    if (!bStreaming)
+        return false;
+    if (!endFrame || (totalFrames && endFrame > totalFrames))
+        endFrame = totalFrames;
+    if (playEnd && endFrame > playEnd)
+        endFrame = playEnd;
+    if (endFrame <= startFrame)
+        return false;
+
+    std::lock_guard<std::mutex> lock(fillLock);
+
+    // A pass already being played from memory has to be left with stopLooping() first.
+    if (bInLoopCycle)
+        return false;
+
+    // Read the body once, here, and put the file back where the fill path had it.
+    uint32_t length = endFrame - startFrame;
+    uint32_t resumeFrame = readFrame;
+    bool bWasDone = bIsDoneReadingFile;
+    std::vector<uint8_t> body;
+    try {
+        body.resize(length);
+    } catch (std::bad_alloc&) {
+        PrintLN("setLoop: EXIT - no memory for the loop body.");
+        return false;
+    }
+    if (!positionAtFrame(startFrame))
+        return false;
+    try {
+        readFileSamples(&body[0], length);
+    } catch (FileException& fex) {
+        length = fex.getPartial();
+    }
+    if (!positionAtFrame(resumeFrame))
+        return false;
+    bIsDoneReadingFile = bWasDone;
+    if (length < 2)
+        return false;
+    endFrame = startFrame + length;
+
+    // Fold the last crossfadeFrames of the body over its first ones. A pass is then the blend
+    // followed by the body up to where the blend started, so the end flows into the start.
+    if (crossfadeFrames > length / 2)
+        crossfadeFrames = length / 2;
+    uint32_t fadeFrom = length - crossfadeFrames;
+    for (uint32_t i = 0; i < crossfadeFrames; i++)
+        body[i] = (body[fadeFrom + i] * (crossfadeFrames - i) + body[i] * i) / crossfadeFrames;
+    body.resize(fadeFrom);
+
+    uint32_t switchFrame = endFrame - crossfadeFrames;
+    bool bRewind = resumeFrame > switchFrame || (resumeFrame == switchFrame && bWasDone);
+    if (bRewind) {
+        // The fill has read past the loop end (or stopped at it). Wind the ring back to it if that
+        // hasn't played yet - along with any ramp-out laid down after the last sample.
+        uint32_t rewind = resumeFrame - switchFrame + (bIsRampOutComplete ? rampOutSamples : 0);
+        bSeeking = true;
+        SleepMS(1);
+        if (rewind > unplayedSamples() || loopEntryIndex != NO_INDEX) {
+            bSeeking = false;
+            PrintLN("setLoop: EXIT - the loop end has already been played.");
+            return false;
+        }
+        rewindRing(rewind);
+        readFrame = switchFrame;
+        streamIndex -= resumeFrame - switchFrame;
+        bIsDoneReadingFile = false;
+        bIsRampOutComplete = false;
+    }
+
+    loopCycle.swap(body);
+    loopLength = loopCycle.size();
+    loopStart = startFrame;
+    loopSwitch = switchFrame;
+    loopPos = 0;
+    loopExitIndex = NO_INDEX;
+    bStopLooping = false;
+    bLooping = true;
+
+    if (bRewind) {
+        bufferFill();
+        bSeeking = false;
+    }
+    Start();
+    return true;
+}
+
+void WaveFileBufferReader::stopLooping() {
+    std::lock_guard<std::mutex> lock(fillLock);
+
+    bStopLooping = true;
+    if (!bInLoopCycle)
+        return;
+
+    // Passes end at loopEntryIndex + n * loopLength. Find the end of the one the output is in.
+    bSeeking = true;
+    SleepMS(1);
+    uint32_t unplayed = unplayedSamples();
+    uint32_t playIndex = streamIndex > unplayed ? streamIndex - unplayed : 0;
+    uint32_t passEnd = loopEntryIndex;
+    if (playIndex > loopEntryIndex)
+        passEnd += (playIndex - loopEntryIndex + loopLength - 1) / loopLength * loopLength;
+    if (passEnd < streamIndex) {
+        // The fill has queued passes beyond it. The next fill leaves the loop from there.
+        rewindRing(streamIndex - passEnd);
+        streamIndex = passEnd;
+        loopPos = 0;
+        bufferFill();
+    }
+    bSeeking = false;
+}
+
+uint32_t WaveFileBufferReader::unplayedSamples() {
+    return pBufferWrite >= pBufferRead ? pBufferWrite - pBufferRead
+                                       : lengthWavBuffer - (pBufferRead - pBufferWrite);
+}
+
+void WaveFileBufferReader::rewindRing(uint32_t samples) {
+    if (samples <= (uint32_t)(pBufferWrite - pWavBuffer))
+        pBufferWrite -= samples;
+    else
+        pBufferWrite += lengthWavBuffer - samples;
+}
+
+bool WaveFileBufferReader::getClipLoop(uint32_t& startFrame, uint32_t& endFrame) {
+    // FLAC and bank clips have no RIFF chunks to look in.
+    if (formatTag == FORMAT_FLAC)
+        return false;
+
+    std::lock_guard<std::mutex> lock(fillLock);
+
+    uint32_t resumeAt = totalWavBytesReadSoFar;
+    bool bFound = false;
+    uint8_t chunk[60];
+    try {
+        if (seekRel(-(long)totalWavBytesReadSoFar)) {
+            read(chunk, 12);
+            bool bRiff = !memcmp(chunk, "RIFF", 4) && !memcmp(chunk + 8, "WAVE", 4);
+            while (bRiff && !bFound) {
+                read(chunk, 8);
+                uint32_t size = chunk[7]<<24 | chunk[6]<<16 | chunk[5]<<8 | chunk[4];
+                if (!memcmp(chunk, "smpl", 4) && size >= sizeof(chunk)) {
+                    // 36 bytes of sampler fields, then the first 24-byte loop record.
+                    read(chunk, sizeof(chunk));
+                    uint8_t* ptr = chunk + 28;
+                    uint32_t numLoops = ptr[3]<<24 | ptr[2]<<16 | ptr[1]<<8 | ptr[0];
+                    ptr = chunk + 36 + 8;
+                    startFrame = ptr[3]<<24 | ptr[2]<<16 | ptr[1]<<8 | ptr[0];
+                    ptr += 4;
+                    // The 'smpl' end is the last frame of the loop - ours is one past it.
+                    endFrame = (ptr[3]<<24 | ptr[2]<<16 | ptr[1]<<8 | ptr[0]) + 1;
+                    bFound = numLoops && endFrame > startFrame;
+                    break;
+                }
+                if (!seekRel(size + (size & 1)))
+                    break;
+            }
+        }
+    } catch (FileException& fex) {
+        // Ran off the end of the file - no loop.
+    }
+    seekRel((long)resumeAt - (long)totalWavBytesReadSoFar);
+    return bFound;
 }
 
 uint8_t WaveFileBufferReader::getFileReadPercentage() {
-    return 100*totalWavBytesReadSoFar/totalWaveBytes;
+    if (pFlac)
+        return pFlac->getPercentDecoded();
+    // From the 'data' chunk rather than the file position - a bank clip starts deep into its file.
+    return (uint64_t)100*(totalWaveBytes - dataBytesLeft)/totalWaveBytes;
 }
 
 uint8_t WaveFileBufferReader::getBufferFullPercentage() {
+    // Unread bytes between the read and write pointers as a percentage of the buffer.
     if (pBufferRead <= pBufferWrite)
-        return 100 - ((pBufferWrite - pBufferRead) / lengthWavBuffer);
+        return (uint64_t)(pBufferWrite - pBufferRead) * 100 / lengthWavBuffer;
     else {
         // length to end of buffer + read-pWaveBuffer
         uint32_t lenToEnd = (pWavBuffer + lengthWavBuffer) - pBufferRead;
-        return 100 - (((pBufferWrite-pWavBuffer)+lenToEnd) / lengthWavBuffer);
+        return (uint64_t)((pBufferWrite-pWavBuffer)+lenToEnd) * 100 / lengthWavBuffer;
     }
 }
 
-uint8_t* WaveFileBufferReader::getReadPointer() {
+const uint8_t* WaveFileBufferReader::getReadPointer() {
     return pBufferRead;
 }
 
@@ -611,20 +1284,156 @@ void WaveFileBufferReader::advanceReadPointer() {
         pBufferRead = pWavBuffer;
     else
         pBufferRead++;
+    samplesOut.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t WaveFileBufferReader::readNextSamples(uint8_t* pDest, size_t count) {
+    if (bStreaming || bIsDoneReadingFile)
+        return 0;
+
+    try {
+        readSamples(pDest, count);
+    } catch (FileException& fex) {
+        bIsDoneReadingFile = true;
+        return fex.getPartial();
+    }
+    return count;
+}
+
+bool WaveFileBufferReader::readAllSamples(std::vector<uint8_t>& samples, bool bRamps) {
+    const uint16_t CHUNK = 512;
+
+    if (bStreaming)
+        return false;
+
+    // readSamples() already delivers DAC-ready mono for every format. Pull until it runs dry.
+    uint32_t expected = totalWaveBytes / numChannels;
+    if (pFlac)
+        expected = pFlac->getTotalSamples();
+    else if (pAdpcm) {
+        uint32_t blocks = (totalWaveBytes + pAdpcm->getBlockAlign() - 1) / pAdpcm->getBlockAlign();
+        expected = blocks * ImaAdpcmDecoder::samplesPerBlock(pAdpcm->getBlockAlign(), numChannels);
+    }
+    else if (pPcm)
+        expected = totalWaveBytes / pPcm->getBytesPerFrame();
+
+    samples.clear();
+    samples.reserve(expected + 2 * rampTime * sampleRate / 1000000 + 2);
+    uint32_t got;
+    do {
+        size_t base = samples.size();
+        samples.resize(base + CHUNK);
+        got = CHUNK;
+        try {
+            readSamples(&samples[base], CHUNK);
+        } catch (FileException& fex) {
+            got = fex.getPartial();
+        }
+        samples.resize(base + got);
+    } while (got == CHUNK);
+
+    if (samples.empty())
+        return false;
+
+    // Same ramps the streaming path lays into its ring buffer: up from zero to the first sample
+    // and from the last sample back down to zero.
+    uint16_t rampSteps = rampTime / (1000000 / sampleRate);
+    if (bRamps && rampSteps) {
+        uint8_t first = samples.front();
+        uint8_t last = samples.back();
+        uint8_t rampInDelta = first / rampSteps;
+        uint8_t rampOutDelta = last / rampSteps;
+        std::vector<uint8_t> rampIn;
+
+        if (rampInDelta) {
+            for (uint16_t rampValue=0; rampValue<first; rampValue += rampInDelta)
+                rampIn.push_back(rampValue);
+            samples.insert(samples.begin(), rampIn.begin(), rampIn.end());
+        }
+        if (rampOutDelta) {
+            for (int16_t rampValue=last-rampOutDelta; rampValue>=0; rampValue -= rampOutDelta)
+                samples.push_back(rampValue);
+        }
+    }
+
+    return true;
+}
+
+bool WaveFileBufferReader::readAllSamples(std::vector<int16_t>& samples) {
+    const uint16_t CHUNK = 512;
+    std::vector<uint8_t> raw;
+    std::vector<int16_t> linear;
+    size_t got;
+
+    if (bStreaming)
+        return false;
+
+    samples.clear();
+    try {
+        do {
+            size_t base = samples.size();
+            samples.resize(base + CHUNK);
+            int16_t* pOut = &samples[base];
+            got = CHUNK;
+
+            if (pFlac) {
+                got = 0;
+                while (got < CHUNK && (pFlac->available() || decodeFlacFrame(got)))
+                    got += pFlac->take(pOut + got, CHUNK - got);
+            }
+            else if (pAdpcm) {
+                // Only ever 8-bit out of the decoder - widened as is.
+                raw.resize(CHUNK);
+                try {
+                    readSamples(&raw[0], CHUNK);
+                } catch (FileException& fex) {
+                    got = fex.getPartial();
+                }
+                for (size_t i=0; i<got; i++)
+                    pOut[i] = (raw[i] - 128) << 8;
+            }
+            else {
+                uint8_t bpf = pPcm ? pPcm->getBytesPerFrame() : numChannels;
+                raw.resize(CHUNK * bpf);
+                try {
+                    readData(&raw[0], CHUNK * bpf);
+                } catch (FileException& fex) {
+                    if (!fex.isEOF())
+                        throw;
+                    got = fex.getPartial() / bpf;
+                }
+                if (pG711) {
+                    // 16-bit linear through the table, channels averaged.
+                    linear.resize(got * numChannels);
+                    G711Decoder::decode(&raw[0], linear.data(), got * numChannels, pG711);
+                    for (size_t i=0; i<got; i++)
+                        pOut[i] = numChannels == 1 ? linear[i] : (linear[2*i] + linear[2*i+1]) / 2;
+                }
+                else if (pPcm)
+                    pPcm->convert16(&raw[0], pOut, got);
+                else
+                    for (size_t i=0; i<got; i++)
+                        pOut[i] = (raw[i] - 128) << 8;
+            }
+            samples.resize(base + got);
+        } while (got == CHUNK);
+    } catch (FileException& fex) {
+        return false;
+    }
+
+    return !samples.empty();
 }
 
 void WaveFileBufferReader::Run()
 {
-    if (bIsBufferReady && !bIsDoneReadingFile && hasElapsed(fillSleepTime)) {
+    // The first fill happens right away so that a freshly loaded file can start playing as soon
+    // as possible. After that, refills are paced by fillSleepTime.
+    std::unique_lock<std::mutex> lock(fillLock);
+
+    if (bIsBufferReady && !bIsDoneReadingFile && (bIsFirstFill || hasElapsed(fillSleepTime))) {
         // Do update stuff.
         resetElapsedTimer();
         bufferFill();
-        if (bIsDoneReadingFile && !bIsRampOutComplete) {
-            // Give a little time to allow the reader to drain the buffer.
-            // This gives us space to put the ramp-out data into the buffer.
-            SleepMS(10);
-            prepRampOut();
-        }
 
 #ifdef SIMULATE_READING
         // Artificially drain 33%
@@ -639,6 +1448,19 @@ void WaveFileBufferReader::Run()
 #endif
     }
 
+    // Apart from the thread's own fills, a seek's fill can be the one to reach the end.
+    if (bIsBufferReady && bIsDoneReadingFile && !bIsRampOutComplete) {
+        // Give a little time to allow the reader to drain the buffer.
+        // This gives us space to put the ramp-out data into the buffer.
+        // A seek may come in meanwhile, so look again afterwards.
+        lock.unlock();
+        SleepMS(10);
+        lock.lock();
+        if (bIsDoneReadingFile && !bIsRampOutComplete)
+            prepRampOut();
+    }
+    lock.unlock();
+
 #ifdef ESP_PLATFORM
       vTaskDelay( 10 / portTICK_PERIOD_MS ); // 50 ms wait period while task is 'paused'
 #else
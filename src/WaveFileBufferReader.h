@@ -32,6 +32,18 @@
 
 #include "FileException.h"
 #include "robotask.h"
+#include "AudioSampleSource.h"
+#include "ImaAdpcmDecoder.h"
+#include "G711Decoder.h"
+#include "FlacDecoder.h"
+#include "PcmConverter.h"
+#include "ClipBank.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 /*! @class WaveFileBufferReader
  *  @brief Workerbee class for handling a single audio file - parsing and buffer management.
@@ -45,16 +57,26 @@
  *           - Buffer size allocation is based upon byteRate, number of channels, resolution and rate.
  *           - Fairly complete WAV header processing ability in order to support as wide a variety as
  *             possible of PCM-based WAV / RIF files.
+ *           - IMA ADPCM (format 0x11) files are decoded block by block in the fill path, so the ring
+ *             buffer always holds DAC-ready samples and the player doesn't know the difference.
+ *           - G.711 A-law (6) and mu-law (7) are translated through 256-entry tables on the same path.
+ *           - Native FLAC files ("fLaC" instead of "RIFF") are decoded frame by frame the same way.
+ *           - PCM of 8/16/24/32 bits, 32-bit float and WAVE_FORMAT_EXTENSIBLE (subformat GUID) with up
+ *             to 8 channels is converted to 8-bit mono in the fill path as well.
+ *           - A clip in a ClipBank is opened with one seek to its payload - there is no header to walk.
+ *           - Non-streaming mode (_streaming=false) only parses the header. The caller then pulls
+ *             the whole clip into memory with readAllSamples() - used for pinning short clips in RAM.
  */
-class WaveFileBufferReader : RoboTask
+class WaveFileBufferReader : public AudioSampleSource, RoboTask
 {
 public:
     /*! @brief Constructor requires the filename to use
      *  @param fname - Filename to open/process/buffer
      *  @param rampTiming - optional - time in milliseconds to do ramp-in and ramp-out of the DAC/speaker.
      *                    This is in order to minimize or eliminate 'popping' at playout and finish time.
+     *  @param _streaming - optional - false to skip buffer allocation and the fill thread. @see readAllSamples
      */
-    WaveFileBufferReader(const char* fname, uint16_t rampTiming=500);
+    WaveFileBufferReader(const char* fname, uint16_t rampTiming=500, bool _streaming=true);
     ~WaveFileBufferReader();
     //! @brief Thread-based processing automates the reading / re-filling operation
     void Run();
@@ -65,8 +87,13 @@ public:
     bool isPlaybackComplete();
     //! @brief Indicates when the reading of the WAVE file is fully complete and in memory.
     bool isFileReadComplete() { return bIsDoneReadingFile; };
+    //! @brief True once the first buffer fill has landed and playout can start without static.
+    bool isBufferPrimed() { return bIsPrimed; };
     //! @brief Based upon the chosen and allocated memory buffer size, gives 0-100 result of fullness.
     uint8_t getBufferFullPercentage();
+    //! @brief The read pointer has caught up with the write pointer while the file is still being read.
+    //!        Also true while a seek is resetting the ring, which holds the output where it is.
+    bool isStarved() { return bSeeking || (!bIsDoneReadingFile && pBufferRead == pBufferWrite); };
     //! @brief Returns how far into the file we are as a percentage 0-100 at any given moment.
     uint8_t getFileReadPercentage();
     //! @brief Returns the parsed sample rate in bits per second
@@ -74,10 +101,76 @@ public:
     //! @brief The last byte of the file is useful for the ramp-out calculation. Internal, primarily.
     uint8_t  getLastByteOfFile() { return lastByteValueOfFile; };
     //! @brief Return the address of the read pointer at any moment in time.
-    uint8_t* getReadPointer();
+    const uint8_t* getReadPointer();
     //! @brief Bump the read pointer by one address and wrap around if necessary
     void advanceReadPointer();
-    const uint8_t WAV_HEADER = 46;  // Maximum header size
+    /*! @brief Read and convert the whole data chunk into DAC-ready 8-bit samples with the
+     *         ramp-in and ramp-out already applied. Only valid in non-streaming mode.
+     *  @param bRamps - optional - false for just the samples (ClipBankWriter stores them that way).
+     *  @return false if the reader is streaming or the data could not be read.
+     */
+    bool readAllSamples(std::vector<uint8_t>& samples, bool bRamps=true);
+    /*! @brief The whole data chunk as 16-bit signed mono at the file's rate, with no ramps and no
+     *         8-bit step - for offline processing (tools/transcoder). Only valid in non-streaming mode.
+     *  @details PCM, float, G.711 and FLAC keep their resolution (up to 16 bits). IMA ADPCM comes
+     *           from the decoder's 8-bit output.
+     */
+    bool readAllSamples(std::vector<int16_t>& samples);
+    /*! @brief The next count DAC-ready samples, for working through a clip a block at a time
+     *         without holding all of it. Only valid in non-streaming mode.
+     *  @return samples delivered - fewer than count at the end of the clip, 0 after it.
+     */
+    size_t readNextSamples(uint8_t* pDest, size_t count);
+    //! @brief WAVE 'fmt ' format tag - PCM, IEEE float, IMA ADPCM or G.711 A-law/mu-law.
+    //!        For WAVE_FORMAT_EXTENSIBLE files this is the tag from the subformat GUID.
+    uint16_t getFormatTag() { return formatTag; };
+    //! @brief Short human-readable name of the format tag.
+    const char* getFormatName();
+    /*! @brief Reposition to a frame (one sample per channel) and refill from there.
+     *  @details PCM, float, G.711 and bank clips go straight to the frame's byte offset in the
+     *           'data' chunk. IMA ADPCM goes to the start of the frame's block and FLAC to the
+     *           nearest seek point (or the first frame), then decode forward to the exact frame.
+     *           When streaming, the ring is reset and refilled before this returns, so the new
+     *           position is ready to play. The output is held (isStarved()) meanwhile, so it is
+     *           safe while playing and cheap enough to call repeatedly for scrubbing.
+     *  @return false if the file position could not be moved.
+     */
+    bool seekToFrame(uint32_t frame);
+    //! @brief Frame about to be output. Counts what the player has consumed, not what has been read.
+    uint32_t getPositionFrames();
+    uint32_t getTotalFrames() { return totalFrames; };
+    /*! @brief Loop frames [startFrame, endFrame) until stopLooping(). Streaming mode only.
+     *  @details The loop body is read into memory here, once. From the first time the fill path
+     *           reaches the end of the loop it copies from memory - no more file I/O and no gap.
+     *           A crossfade blends the last crossfadeFrames of the body into its first ones, which
+     *           shortens every pass after the first by that much. If the fill has already read past
+     *           the loop end, the unplayed part of the ring is wound back to it. A seek past the loop
+     *           end leaves the loop behind.
+     *  @return false for a non-streaming reader, an empty region, a loop end that has already been
+     *          played, or no memory for the body.
+     */
+    bool setLoop(uint32_t startFrame, uint32_t endFrame, uint32_t crossfadeFrames=0);
+    /*! @brief Finish the pass being played, then the rest of the file. The fill path can be passes
+     *         ahead of the output on a short loop - those are wound out of the ring.
+     */
+    void stopLooping();
+    //! @brief True until a loop that was set has been left with stopLooping().
+    bool isLooping() { return bLooping; };
+    //! @brief First loop of the 'smpl' chunk. The chunk may sit before or after 'data' - the file's
+    //!        chunks are walked for it and the fill position is put back afterwards.
+    bool getClipLoop(uint32_t& startFrame, uint32_t& endFrame);
+    /*! @brief The file ends at endFrame as far as the fill path is concerned, and playback starts
+     *         with a seek to startFrame. Non-streaming readers deliver just the range to readAllSamples().
+     */
+    bool setPlayRange(uint32_t startFrame, uint32_t endFrame);
+    static const uint16_t WAVE_FORMAT_PCM = 0x0001;
+    static const uint16_t WAVE_FORMAT_IMA_ADPCM = 0x0011;
+    static const uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+    //! Not a WAVE tag - reported for native FLAC streams.
+    static const uint16_t FORMAT_FLAC = 0xF1AC;
+    //! Highest rate the player streams. Non-streaming readers (offline tools, analysis) take any rate.
+    static const uint32_t MAX_PLAYBACK_RATE = 48000;
+    const uint8_t WAV_HEADER = 68;  // Maximum header size - the 40-byte EXTENSIBLE 'fmt ' chunk
     const uint8_t WAV_HEADER_TO_CHUNKLEN = 20;  // Just enough to know how much left to read.
     const uint16_t rampTime;
 
@@ -88,15 +181,44 @@ protected:
     virtual bool read(uint8_t* pDest, size_t numBytes) = 0;
     //! @brief Abstract function for closing the file
     virtual void close(void) = 0;
+    /*! @brief Stop the fill thread and wait for it. The filesystem readers call this first thing
+     *         in their destructors - the thread must not read() a closed file or fill a freed buffer.
+     */
+    void stopFilling() { Terminate(); };
+    //! @brief Move the file to frame and set up the decoder to deliver it next. No ring changes.
+    bool positionAtFrame(uint32_t frame);
+    //! @brief Samples in the ring the output has yet to take.
+    uint32_t unplayedSamples();
+    //! @brief Drop the last samples written to the ring. Hold the output and fillLock around it.
+    void rewindRing(uint32_t samples);
     //! @brief Abstract function for seeking, relatively, forward or backward from current location
     virtual bool seekRel(long offset) = 0;
     void readAndProcessWavHeader(void);
+    void readAndProcessFlacHeader(void);
+    //! @brief Position on a clip bank payload. The bank's index already says what it holds.
+    void readAndProcessClip(const ClipBankEntry& clip);
+    //! @brief Allocate the ring, lay in the ramp-in and start the fill thread. Streaming mode only.
+    void beginStreaming(void);
     void readFirstByteAndPrepRampIn();
     void prepRampOut();
     void bufferAlloc();
     void bufferFill();
+    /*! @brief Fill path's view of the file - DAC samples rather than file bytes.
+     *  @details 8-bit mono PCM is a straight read(). Other PCM goes through the converter, ADPCM
+     *           reads and decodes whole blocks. Either way a short read at the end of the data
+     *           throws FileException with the samples delivered so far.
+     */
+    void readSamples(uint8_t* pDest, size_t numSamples);
+    //! @brief readSamples() straight from the file - no loop. Seeks discard through this.
+    void readFileSamples(uint8_t* pDest, size_t numSamples);
+    //! @brief Buffer input and decode the next FLAC frame. done is reported if a read fails.
+    bool decodeFlacFrame(size_t done);
+    //! @brief read() that stops at the end of the 'data' chunk. Throws an EOF FileException there.
+    void readData(uint8_t* pDest, size_t numBytes);
 
     std::string fileName;
+    //! False when constructed only to read the whole clip with readAllSamples().
+    const bool bStreaming;
 
     // Buffer-specific items
     bool bIsRampOutComplete;
@@ -108,6 +230,7 @@ protected:
     bool bIsFirstFill;
     bool bIsBufferReady;
     bool bIsDoneReadingFile;
+    volatile bool bIsPrimed;
     uint32_t indexNotSureWhatYet;
     unsigned char* pHeader;
     uint32_t fillSleepTime;
@@ -121,10 +244,51 @@ protected:
 
 
     // Wave-specific items
+    uint16_t formatTag;
+    std::unique_ptr<ImaAdpcmDecoder> pAdpcm;
+    const int16_t* pG711;       // G.711 code to 16-bit linear. nullptr unless A-law/mu-law.
+    const uint8_t* pG711DAC;    // G.711 code straight to a DAC sample.
+    std::unique_ptr<FlacDecoder> pFlac;
+    std::unique_ptr<PcmConverter> pPcm; // Any PCM/float layout other than 8-bit mono.
+    std::vector<uint8_t> convertBuffer; // Whole frames of file data on their way through pPcm.
+    uint32_t audioStart;        // File offset of the first FLAC frame - seek table offsets are from here.
+    uint32_t dataStart;         // File offset of the first byte of audio ('data' payload, clip or FLAC frame).
+    uint16_t frameBytes;        // Bytes per frame - or per compressed block for IMA ADPCM.
+    uint32_t totalFrames;
+    uint32_t dataBytesLeft;     // Bytes of the 'data' chunk not yet read.
     uint8_t numChannels;
     uint8_t bitsPerSample;
     unsigned long sampleRate;
     unsigned long byteRate;
     unsigned long totalWaveBytes;
 
+    // Position and seek
+    //! Frame the ring was last (re)started from - 0 or the last seek.
+    uint32_t positionBase;
+    //! Samples the player has taken since then - ramp-in included. Bumped from the output path.
+    std::atomic<uint32_t> samplesOut;
+    //! Length of the ramp-in laid down at the last (re)start.
+    uint16_t rampInSamples;
+    //! A seek (or setLoop()) is changing the ring. The output path holds while this is set.
+    volatile bool bSeeking;
+    //! Held by the fill thread while it fills and by seekToFrame() - they never touch the ring together.
+    std::mutex fillLock;
+
+    // Looping
+    static const uint32_t NO_INDEX = 0xFFFFFFFF;
+    //! One pass of the loop after the first: the crossfade, then the body between the fades.
+    std::vector<uint8_t> loopCycle;
+    uint32_t loopLength;        // loopCycle.size() - read from the output path for the position.
+    uint32_t loopStart;
+    uint32_t loopSwitch;        // File frame where the fill path moves over to loopCycle - loop end less the crossfade.
+    uint32_t loopPos;           // Next sample of loopCycle.
+    volatile bool bLooping;
+    volatile bool bStopLooping;
+    bool bInLoopCycle;          // The fill path is copying from loopCycle rather than reading the file.
+    uint32_t readFrame;         // Next frame the file path delivers.
+    uint32_t playEnd;           // setPlayRange() end - the file path reports EOF here. 0 for none.
+    uint32_t streamIndex;       // Samples delivered to the ring since positionBase.
+    uint32_t loopEntryIndex;    // streamIndex where loopCycle took over. NO_INDEX until then.
+    uint32_t loopExitIndex;     // streamIndex where the file took over again. NO_INDEX until then.
+    uint16_t rampOutSamples;    // Length of the ramp-out laid down after the last sample.
 };
@@ -29,7 +29,7 @@
 
 #include "WaveFileLittleFSReader.h"
 
-WaveFileLittleFSReader::WaveFileLittleFSReader(const char* fname) : WaveFileBufferReader(fname)
+WaveFileLittleFSReader::WaveFileLittleFSReader(const char* fname, bool _streaming, const ClipBankEntry* pClip) : WaveFileBufferReader(fname, 500, _streaming)
 {
     bIsOpen = false;
 
@@ -44,11 +44,15 @@ WaveFileLittleFSReader::WaveFileLittleFSReader(const char* fname) : WaveFileBuff
 
     bIsOpen = true;
 
-    readAndProcessWavHeader();
+    if (pClip)
+        readAndProcessClip(*pClip);
+    else
+        readAndProcessWavHeader();
 }
 
 WaveFileLittleFSReader::~WaveFileLittleFSReader()
 {
+    stopFilling();
     if (bIsOpen)
         close();
 }
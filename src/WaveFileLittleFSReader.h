@@ -43,7 +43,9 @@ class WaveFileLittleFSReader : public WaveFileBufferReader
 {
 public:
     //! @brief Instantiate with filename to be opened
-    WaveFileLittleFSReader(const char* fname);
+    //! @param _streaming - false to only parse the header for use with readAllSamples()
+    //! @param pClip - optional - fname is a clip bank and this is the clip to play from it.
+    WaveFileLittleFSReader(const char* fname, bool _streaming=true, const ClipBankEntry* pClip=nullptr);
     ~WaveFileLittleFSReader();
 
 protected:
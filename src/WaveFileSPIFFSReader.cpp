@@ -29,7 +29,7 @@
 
 #include "WaveFileSPIFFSReader.h"
 
-WaveFileSPIFFSReader::WaveFileSPIFFSReader(const char* fname) : WaveFileBufferReader(fname)
+WaveFileSPIFFSReader::WaveFileSPIFFSReader(const char* fname, bool _streaming, const ClipBankEntry* pClip) : WaveFileBufferReader(fname, 500, _streaming)
 {
     bIsOpen = false;
 
@@ -44,11 +44,15 @@ WaveFileSPIFFSReader::WaveFileSPIFFSReader(const char* fname) : WaveFileBufferRe
 
     bIsOpen = true;
 
-    readAndProcessWavHeader();
+    if (pClip)
+        readAndProcessClip(*pClip);
+    else
+        readAndProcessWavHeader();
 }
 
 WaveFileSPIFFSReader::~WaveFileSPIFFSReader()
 {
+    stopFilling();
     if (bIsOpen)
         close();
 }
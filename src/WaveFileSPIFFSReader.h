@@ -46,7 +46,9 @@ class WaveFileSPIFFSReader : public WaveFileBufferReader
 {
 public:
     //! @brief Instantiate with filename to be opened
-    WaveFileSPIFFSReader(const char* fname);
+    //! @param _streaming - false to only parse the header for use with readAllSamples()
+    //! @param pClip - optional - fname is a clip bank and this is the clip to play from it.
+    WaveFileSPIFFSReader(const char* fname, bool _streaming=true, const ClipBankEntry* pClip=nullptr);
     ~WaveFileSPIFFSReader();
 
 protected:
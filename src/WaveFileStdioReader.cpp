@@ -28,7 +28,7 @@
 #ifndef ESP_PLATFORM
 #include "WaveFileStdioReader.h"
 
-WaveFileStdioReader::WaveFileStdioReader(const char* fname) : WaveFileBufferReader(fname)
+WaveFileStdioReader::WaveFileStdioReader(const char* fname, bool _streaming, const ClipBankEntry* pClip) : WaveFileBufferReader(fname, 500, _streaming)
 {
     totalWavBytesReadSoFar=0;
     pFile = nullptr;
@@ -36,11 +36,21 @@ WaveFileStdioReader::WaveFileStdioReader(const char* fname) : WaveFileBufferRead
     if (!open(fname))
         throw "WaveFileStdioReader::File did not open.";
 
-    readAndProcessWavHeader();
+    // The destructor doesn't run for a constructor that throws - don't leave the file open.
+    try {
+        if (pClip)
+            readAndProcessClip(*pClip);
+        else
+            readAndProcessWavHeader();
+    } catch(...) {
+        close();
+        throw;
+    }
 }
 
 WaveFileStdioReader::~WaveFileStdioReader()
 {
+    stopFilling();
     close();
 }
 
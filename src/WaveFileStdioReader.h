@@ -42,7 +42,9 @@ class WaveFileStdioReader : public WaveFileBufferReader
 {
 public:
     //! @brief Instantiate with filename to be opened
-    WaveFileStdioReader(const char* fname);
+    //! @param _streaming - false to only parse the header for use with readAllSamples()
+    //! @param pClip - optional - fname is a clip bank and this is the clip to play from it.
+    WaveFileStdioReader(const char* fname, bool _streaming=true, const ClipBankEntry* pClip=nullptr);
     ~WaveFileStdioReader();
 
 protected:
@@ -0,0 +1,67 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "WaveMemorySource.h"
+#include "utils.h"
+
+#ifdef ESP_PLATFORM
+const uint8_t* IRAM_ATTR WaveMemorySource::getReadPointer()
+#else
+const uint8_t* WaveMemorySource::getReadPointer()
+#endif
+{
+    return position < length ? pSamples + position : nullptr;
+}
+
+#ifdef ESP_PLATFORM
+void IRAM_ATTR WaveMemorySource::advanceReadPointer()
+#else
+void WaveMemorySource::advanceReadPointer()
+#endif
+{
+    if (position < length)
+        position++;
+}
+
+#ifdef ESP_PLATFORM
+bool IRAM_ATTR WaveMemorySource::isPlaybackComplete()
+#else
+bool WaveMemorySource::isPlaybackComplete()
+#endif
+{
+    return position >= length;
+}
+
+void WaveMemorySource::printFileInfo() {
+#ifdef ESP_PLATFORM
+    Serial.printf("Memory: %s - %u samples, %u Hz, Total Playout Time:%u ms\n",
+        name ? name : "(unnamed)", length, sampleRate, (uint32_t)((uint64_t)length * 1000 / sampleRate));
+#else
+    printf("Memory: %s - %u samples, %u Hz, Total Playout Time:%u ms\n",
+        name ? name : "(unnamed)", length, sampleRate, (uint32_t)((uint64_t)length * 1000 / sampleRate));
+#endif
+}
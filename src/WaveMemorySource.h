@@ -0,0 +1,83 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#pragma once
+
+#include "AudioSampleSource.h"
+#include "EmbeddedClip.h"
+
+#include <memory>
+#include <vector>
+
+/*! @class   WaveMemorySource
+ *  @brief   Plays DAC-ready 8-bit samples straight out of memory.
+ *  @details Used for clips which are pinned in RAM (the playlist intro) or which live in flash as
+ *           const arrays. There is no thread, no file and no copy - the player's output path walks
+ *           the caller's array directly. With a raw pointer the samples are not owned and the
+ *           caller must keep them alive until playback is finished or another file is loaded.
+ *           With a shared_ptr the source holds a reference, so the owner may drop or replace the
+ *           clip at any time (e.g. a new intro is pinned mid-play).
+ *           The per-sample accessors are in IRAM on ESP32 - the player's timer ISR calls them.
+ */
+class WaveMemorySource : public AudioSampleSource
+{
+public:
+    /*! @param _pSamples - 8-bit unsigned samples with any ramp-in/ramp-out already applied
+     *  @param _length - number of samples
+     *  @param _sampleRate - samples per second
+     *  @param _name - optional label for printFileInfo()
+     */
+    WaveMemorySource(const uint8_t* _pSamples, uint32_t _length, uint32_t _sampleRate, const char* _name=nullptr)
+        : pSamples(_pSamples), length(_length), position(0), sampleRate(_sampleRate), name(_name) {};
+    //! @brief Play a clip compiled into the program. Nothing is copied or allocated.
+    WaveMemorySource(const EmbeddedClip& clip)
+        : pSamples(clip.samples), length(clip.length), position(0), sampleRate(clip.sampleRate), name(clip.name) {};
+    //! @brief Play a clip held by shared_ptr. The clip stays alive at least as long as this source.
+    WaveMemorySource(std::shared_ptr<const std::vector<uint8_t> > _pClip, uint32_t _sampleRate, const char* _name=nullptr)
+        : pSamples(_pClip->data()), length(_pClip->size()), position(0), sampleRate(_sampleRate), name(_name), pClip(_pClip) {};
+
+    const uint8_t* getReadPointer();
+    void advanceReadPointer();
+    bool isPlaybackComplete();
+    uint32_t getSampleRate() { return sampleRate; };
+    void printFileInfo();
+    //! @brief Start over from the first sample.
+    void rewind() { position = 0; };
+    //! @brief Frames here are the samples as stored - any baked-in ramps included.
+    bool seekToFrame(uint32_t frame) { position = frame < length ? frame : length; return true; };
+    uint32_t getPositionFrames() { return position; };
+    uint32_t getTotalFrames() { return length; };
+
+protected:
+    const uint8_t* pSamples;
+    uint32_t length;
+    volatile uint32_t position;
+    uint32_t sampleRate;
+    const char* name;
+    //! Only set when constructed from a shared clip.
+    std::shared_ptr<const std::vector<uint8_t> > pClip;
+};
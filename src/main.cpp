@@ -30,14 +30,24 @@
 #else
 #include <stdint.h>
 #include <dirent.h>
+#include <sys/stat.h>
 #endif
 #include "WaveFileStdioReader.h"
 #include "AudioFilePlayer.h"
 #include <vector>
 #include <string>
 #include <iostream>
+#include <atomic>
 
 #include "AudioPlaylistManager.h"
+#include "ImaAdpcmDecoder.h"
+#include "G711Decoder.h"
+#include "PcmConverter.h"
+#include "ClipBank.h"
+#include "AlarmClips.h"
+#include "LevelMeter.h"
+#include "LoudnessAnalyzer.h"
+#include <math.h>
 #include "utils.h"
 
 /*! \mainpage Support classes for (limited) processing of WAVE/PCM files on an ESP32 device.
@@ -219,6 +229,11 @@ exit(1);
 #if 1
   AudioFilePlayer* pAFP = new AudioFilePlayer(0, 25);
   std::string fn;
+  static volatile bool bFinished;
+
+  // Chain to the next file as soon as the player says it's finished rather than polling.
+  pAFP->Subscribe([](const AudioPlayerEvent& ev, void*) { bFinished = true; },
+                  nullptr, AudioPlayerEvent::maskOf(AudioPlayerEvent::Finished));
 
   for (auto ent: myFiles) {
 #ifdef ESP_PLATFORM
@@ -230,11 +245,10 @@ exit(1);
 
     pAFP->pWave->printFileInfo();
 
-    SleepMS(1500);
-
+    bFinished = false;
     pAFP->PlayFile();
-    while (!pAFP->isDonePlaying()) {
-      SleepMS(1000);
+    while (!bFinished) {
+      SleepMS(1);
     }
     pAFP->PauseFile();
 
@@ -245,18 +259,2049 @@ exit(1);
   SleepMS(500);
 }
 
+//! @brief Exercise the play queue modes and getrand() without any audio hardware or files.
+void queueTest() {
+  AudioPlayQueue q(1234);
+  const char* modeNames[] = { "Sequential", "Shuffle", "Weighted" };
+
+  q.SetEntryCount(10);
+  q.SetNoRepeatWindow(3);
+  q.SetWeight(0, 10);   // Only matters in Weighted mode - entry 0 should dominate.
+
+  for (int m=AudioPlayQueue::Sequential; m<=AudioPlayQueue::Weighted; m++) {
+    q.SetMode((AudioPlayQueue::Mode)m);
+#ifdef ESP_PLATFORM
+    Serial.printf("%s (peek %d %d %d):", modeNames[m], q.Peek(0), q.Peek(1), q.Peek(2));
+    for (int i=0; i<30; i++)
+      Serial.printf(" %d", q.Next());
+    Serial.println();
+#else
+    printf("%s (peek %d %d %d):", modeNames[m], q.Peek(0), q.Peek(1), q.Peek(2));
+    for (int i=0; i<30; i++)
+      printf(" %d", q.Next());
+    printf("\n");
+#endif
+  }
+
+  // getrand() is inclusive on both ends and should be close to uniform.
+  uint32_t hist[5] = {0};
+  for (int i=0; i<50000; i++)
+    hist[getrand(0, 4)]++;
+#ifdef ESP_PLATFORM
+  Serial.printf("getrand(0,4) histogram: %u %u %u %u %u\n", hist[0], hist[1], hist[2], hist[3], hist[4]);
+#else
+  printf("getrand(0,4) histogram: %u %u %u %u %u\n", hist[0], hist[1], hist[2], hist[3], hist[4]);
+#endif
+
+  // Entry numbers past 16 bits must come back intact - a full shuffle pass covers every entry once.
+  const uint32_t bigCount = 100000;
+  std::vector<bool> seen(bigCount, false);
+  uint32_t distinct = 0, highest = 0;
+  q.SetEntryCount(bigCount);
+  q.SetMode(AudioPlayQueue::Shuffle);
+  for (uint32_t i=0; i<bigCount; i++) {
+    int32_t entry = q.Next();
+    if (entry >= 0 && (uint32_t)entry < bigCount && !seen[entry]) {
+      seen[entry] = true;
+      distinct++;
+    }
+    highest = std::max<uint32_t>(highest, entry);
+  }
+  int32_t bigRand = getrand(0, bigCount-1);
+#ifdef ESP_PLATFORM
+  Serial.printf("Shuffle of %u: %u distinct, highest %u, getrand %d - %s\n", bigCount, distinct, highest, bigRand,
+                distinct == bigCount && highest == bigCount-1 && bigRand >= 0 ? "PASS" : "FAIL");
+#else
+  printf("Shuffle of %u: %u distinct, highest %u, getrand %d - %s\n", bigCount, distinct, highest, bigRand,
+         distinct == bigCount && highest == bigCount-1 && bigRand >= 0 ? "PASS" : "FAIL");
+#endif
+}
+
+#ifndef ESP_PLATFORM
+/*! @brief Hammer the playlist manager's command queue from several threads at once.
+ *  @details Each producer issues a mix of volume/pause/play and the occasional play-entry request
+ *           at about 2000 commands per second. Every call must return immediately; the counters at
+ *           the end must add up (accepted == processed, accepted + rejected == issued).
+ */
+void commandStressTest(const char* dirName) {
+  std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, dirName);
+  pAPM->WaitForScan();
+  const int numThreads = 4;
+  const int commandsPerThread = 5000;
+  std::atomic<uint32_t> accepted(0), rejected(0);
+  std::atomic<uint32_t> worstCallUS(0);
+  std::vector<std::thread> producers;
+
+  uint32_t startUS = getMicros();
+  for (int t=0; t<numThreads; t++) {
+    producers.push_back(std::thread([&, t]() {
+      for (int i=0; i<commandsPerThread; i++) {
+        bool ok;
+        uint32_t callStart = getMicros();
+        switch (i % 4) {
+          case 0:  ok = pAPM->SetVolume((i + t) % 101); break;
+          case 1:  ok = pAPM->Pause(); break;
+          case 2:  ok = pAPM->Play(); break;
+          default: ok = (i % 64 == 3) ? pAPM->PlayEntryIndex(i % 8) : pAPM->SetVolume(50); break;
+        }
+        uint32_t callUS = getMicros() - callStart;
+        uint32_t worst = worstCallUS.load();
+        while (callUS > worst && !worstCallUS.compare_exchange_weak(worst, callUS))
+          ;
+        if (ok)
+          accepted++;
+        else
+          rejected++;
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+      }
+    }));
+  }
+  for (auto& th: producers)
+    th.join();
+  uint32_t elapsedUS = getMicros() - startUS;
+
+  uint32_t queued, processed, dropped;
+  for (int i=0; i<500; i++) {
+    pAPM->getCommandStats(queued, processed, dropped);
+    if (processed == queued)
+      break;
+    SleepMS(10);
+  }
+
+  printf("\nCommand stress: %d threads issued %d commands in %u ms (%u per second).\n",
+    numThreads, numThreads*commandsPerThread, elapsedUS/1000,
+    (uint32_t)((uint64_t)numThreads*commandsPerThread*1000000/elapsedUS));
+  printf("  accepted:%u rejected(queue full):%u | manager queued:%u processed:%u dropped:%u | worst call:%u uS\n",
+    accepted.load(), rejected.load(), queued, processed, dropped, worstCallUS.load());
+  printf("  %s\n", (queued == processed && accepted == queued && rejected == dropped
+                     && accepted + rejected == (uint32_t)(numThreads*commandsPerThread)) ? "PASS" : "FAIL");
+  exit(0);   // Don't wait for any clip which may still be playing.
+}
+
+/*! @brief Sensor-burst jig for the play request policies.
+ *  @details Fires a burst of 40 PlayRandomEntry() calls 5ms apart under each policy while a clip
+ *           is playing and checks how many were started versus coalesced, dropped or left
+ *           waiting. Only the started ones open a file. The clip playing is paused so it outlasts
+ *           the burst whatever its length, and each phase gets its own manager so it starts Idle
+ *           with nothing pending from the one before.
+ */
+void burstTest(const char* dirName) {
+  const struct {
+    AudioPlaylistManager::RequestPolicy policy; uint16_t param; const char* name;
+    uint32_t started, coalesced, dropped, pending;
+  } phases[] = {
+    { AudioPlaylistManager::DropWhileBusy, 0,   "drop-while-busy",    0,  0, 40, 0 },
+    { AudioPlaylistManager::LatestWins,    0,   "latest-wins",        0, 39,  0, 1 },
+    { AudioPlaylistManager::QueueUpToN,    3,   "queue-up-to-3",      0,  0, 37, 3 },
+    // The burst spans 200ms, so at least one request clears the interval - the last to do so waits.
+    { AudioPlaylistManager::MinInterval,   100, "min-interval-100ms", 0, 39,  0, 1 },
+  };
+  AudioPlaylistManager::RequestStats before, after;
+  bool bFailed = false;
+
+  for (auto& phase: phases) {
+    std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, dirName);
+    pAPM->WaitForScan();
+    pAPM->SetVolume(0);
+    pAPM->SetRequestPolicy(phase.policy, phase.param);
+
+    // The directory may hold more than waves - keep the manager busy with one which plays.
+    AudioPlaylistManager::FileListHandle files = pAPM->GetFileList();
+    std::string busyClip;
+    for (size_t i=0; i<files->size() && busyClip.empty(); i++) {
+      std::string path = files->getPath(i);
+      if (path.size() > 4 && path.compare(path.size() - 4, 4, ".wav") == 0)
+        busyClip = path;
+    }
+    bool bBusy = !busyClip.empty() && pAPM->getState() == AudioPlaylistManager::Idle
+                 && pAPM->PlayEntryName(busyClip.c_str());
+    for (int i=0; bBusy && i<200 && pAPM->getState() == AudioPlaylistManager::Idle; i++)
+      SleepMS(5);
+    pAPM->Pause();
+    SleepMS(20);
+    pAPM->getRequestStats(before);
+    bBusy = bBusy && before.started == 1 && pAPM->getState() == AudioPlaylistManager::PlayingSound;
+
+    for (int i=0; i<40; i++) {
+      pAPM->PlayRandomEntry();
+      SleepMS(5);
+    }
+    SleepMS(50);
+    pAPM->getRequestStats(after);
+    uint32_t received = after.received - before.received, started = after.started - before.started;
+    uint32_t coalesced = after.coalesced - before.coalesced, dropped = after.dropped - before.dropped;
+    uint32_t pending = received - started - coalesced - dropped;
+    bool bOK = bBusy && received == 40 && started == phase.started && coalesced == phase.coalesced
+               && dropped == phase.dropped && pending == phase.pending;
+    printf("%-20s received:%2u started:%2u coalesced:%2u dropped:%2u pending:%u - %s\n", phase.name,
+      received, started, coalesced, dropped, pending, bOK ? "ok" : "BAD");
+    bFailed |= !bOK;
+  }
+  exit(bFailed ? 1 : 0);   // Don't wait for the paused clips.
+}
+
+/*! @brief Amplifier timing jig using the emulated enable pin.
+ *  @details Checks warm-up, that a request inside the idle-off window doesn't cycle power and
+ *           that the amp goes off after the idle timeout. If a folder is given, three clips are
+ *           then played back to back through the playlist manager - expect a single power cycle.
+ */
+void ampTest(const char* dirName) {
+  AmpController amp(0, false, 100, 300);    // Active low, 100ms warm-up, 300ms idle-off
+  bool ok = amp.getEmulatedPinLevel() && !amp.isPowered();
+
+  uint32_t startUS = getMicros();
+  amp.Request();
+  ok = ok && amp.isPowered() && !amp.getEmulatedPinLevel() && !amp.isReady();
+  while (!amp.isReady())
+    SleepMS(1);
+  uint32_t warmUS = getMicros() - startUS;
+
+  amp.Release();
+  SleepMS(150);
+  amp.Service();
+  ok = ok && amp.isPowered();
+  amp.Request();                          // Inside the idle window - no new cycle, no warm-up
+  ok = ok && amp.isReady() && amp.getPowerCycles() == 1;
+
+  amp.Release();
+  uint32_t releaseUS = getMicros();
+  while (amp.isPowered() && getMicros() - releaseUS < 1000000) {
+    amp.Service();
+    SleepMS(5);
+  }
+  uint32_t idleUS = amp.getLastOffUS() - releaseUS;
+  ok = ok && !amp.isPowered() && amp.getEmulatedPinLevel() && amp.getPowerCycles() == 1;
+
+  printf("Amp: warm-up %u uS (want 100000), idle-off after %u uS (want 300000), cycles %u\n",
+    warmUS, idleUS, amp.getPowerCycles());
+  printf("  %s\n", ok ? "PASS" : "FAIL");
+
+  if (!dirName)
+    exit(0);
+
+  std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, dirName);
+  pAPM->WaitForScan();
+  AudioPlaylistManager::RequestStats stats;
+  pAPM->SetVolume(0);
+  pAPM->SetAmpTiming(100, 1000);
+  pAPM->SetRequestPolicy(AudioPlaylistManager::QueueUpToN, 3);
+  for (int i=0; i<3; i++)
+    pAPM->PlayNextEntry();
+  do {
+    SleepMS(100);
+    pAPM->getRequestStats(stats);
+  } while (stats.started < 3);
+  printf("Three clips back to back: %u amp power cycle(s) (want 1)\n", pAPM->getAmpPowerCycles());
+  exit(0);
+}
+
+/*! @brief File list snapshot jig.
+ *  @details One thread keeps re-publishing the list (clear + add) while two readers walk it and
+ *           the manager plays through it. Afterwards compares GetFileList() against a deep copy.
+ */
+void snapshotTest(const char* dirName) {
+  std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, dirName);
+  pAPM->WaitForScan();
+  std::atomic<bool> bStop(false);
+  std::atomic<uint32_t> reads(0), torn(0), versions(0);
+  std::vector<std::thread> threads;
+  const size_t folderSize = pAPM->GetFileList()->size();
+  size_t folderLen = 0;
+
+  if (!folderSize) {
+    printf("No files in %s\n", dirName);
+    exit(1);
+  }
+  AudioPlaylistManager::FileListHandle first = pAPM->GetFileList();
+  for (size_t i=0; i<first->size(); i++)
+    folderLen += strlen(first->getName(i));
+  pAPM->SetVolume(0);
+  pAPM->SetRequestPolicy(AudioPlaylistManager::LatestWins);
+  threads.push_back(std::thread([&]() {
+    while (!bStop) {
+      pAPM->ClearFileList();
+      pAPM->AddFilesFrom(dirName);
+      pAPM->WaitForScan();
+      pAPM->AddFilesFrom(dirName);
+      pAPM->WaitForScan();
+      versions += 3;
+    }
+  }));
+  for (int r=0; r<2; r++) {
+    threads.push_back(std::thread([&]() {
+      while (!bStop) {
+        AudioPlaylistManager::FileListHandle list = pAPM->GetFileList();
+        size_t len = 0;
+        for (size_t i=0; i<list->size(); i++)
+          len += strlen(list->getName(i));
+        // Every published version is empty, one copy of the folder or two - never in between.
+        if (list->size() % folderSize || list->size() > 2*folderSize || len != (list->size() / folderSize) * folderLen)
+          torn++;
+        reads++;
+      }
+    }));
+  }
+  for (int i=0; i<20; i++) {
+    pAPM->PlayNextEntry();
+    SleepMS(100);
+  }
+  bStop = true;
+  for (auto& th: threads)
+    th.join();
+
+  printf("Snapshots: %u versions published, %u list reads, %u inconsistent\n",
+    versions.load(), reads.load(), torn.load());
+
+  const int loops = 100000;
+  AudioPlaylistManager::FileListHandle handle = pAPM->GetFileList();
+  size_t total = 0;
+  uint32_t startUS = getMicros();
+  for (int i=0; i<loops; i++)
+    handle = pAPM->GetFileList();
+  uint32_t handleUS = getMicros() - startUS;
+  startUS = getMicros();
+  for (int i=0; i<loops; i++) {
+    AudioPlaylistManager::FileList copy(*handle);   // What GetFileList() used to cost each call
+    total += copy.size();
+  }
+  uint32_t copyUS = getMicros() - startUS;
+  printf("GetFileList: %u nS per handle vs %u nS per deep copy of %lu names\n",
+    (uint32_t)((uint64_t)handleUS*1000/loops), (uint32_t)((uint64_t)copyUS*1000/loops), (unsigned long)(total/loops));
+  exit(0);
+}
+
+/*! @brief Player event subscription jig.
+ *  @details Plays one file with a position marker at one second and prints every event with the
+ *           time it was posted and how long the notifier took to deliver it.
+ */
+void eventsTest(const char* fileName) {
+  struct Record { AudioPlayerEvent ev; uint32_t deliveredUS; };
+  static Record records[64];
+  static std::atomic<int> recordCount(0);
+  static volatile bool bFinished = false;
+  const char* names[] = { "Loaded", "Started", "FirstSample", "Paused", "BufferLow", "Underrun", "PositionReached", "Finished" };
+
+  std::unique_ptr<AudioFilePlayer> pAFP = make_unique<AudioFilePlayer>(0, 25);
+  pAFP->Subscribe([](const AudioPlayerEvent& ev, void*) {
+    int i = recordCount++;
+    if (i < 64) {
+      records[i].ev = ev;
+      records[i].deliveredUS = getMicros();
+    }
+    if (ev.type == AudioPlayerEvent::Finished)
+      bFinished = true;
+  });
+
+  uint32_t startUS = getMicros();
+  if (!pAFP->LoadFile(fileName)) {
+    printf("Unable to load %s\n", fileName);
+    exit(1);
+  }
+  pAFP->SetVolume(0);
+  pAFP->SetPositionMarker(pAFP->pWave->getSampleRate());
+  pAFP->PlayFile();
+  while (!bFinished)
+    SleepMS(1);
+  SleepMS(5);
+
+  uint32_t worstUS = 0;
+  printf("\n%-16s %10s %10s %12s\n", "event", "posted mS", "value", "delivery uS");
+  for (int i=0; i<recordCount && i<64; i++) {
+    uint32_t latency = records[i].deliveredUS - records[i].ev.timeUS;
+    worstUS = latency > worstUS ? latency : worstUS;
+    printf("%-16s %10.1f %10u %12u\n", names[records[i].ev.type], (records[i].ev.timeUS - startUS) / 1000.0,
+      records[i].ev.value, latency);
+  }
+  printf("Worst delivery latency: %u uS\n", worstUS);
+  exit(0);
+}
+
+/*! @brief IMA ADPCM against the same clip as PCM.
+ *  @details Decodes adpcmFile whole and streamed through the ring buffer and checks both against
+ *           pcmFile. Then times the block decoder on its own and the stdio read of each file's
+ *           data, all per second of audio. The break-even read rate is where reading the bytes
+ *           ADPCM saves costs as much as decoding it - any backend slower than that (LittleFS on
+ *           the ESP32 is far slower than a cached native file) comes out ahead with ADPCM.
+ */
+void adpcmTest(const char* pcmFile, const char* adpcmFile) {
+  std::vector<uint8_t> pcm, whole, streamed;
+  WaveFileStdioReader pcmReader(pcmFile, false);
+  WaveFileStdioReader adpcmReader(adpcmFile, false);
+  adpcmReader.printFileInfo();
+  if (adpcmReader.getFormatTag() != WaveFileBufferReader::WAVE_FORMAT_IMA_ADPCM
+      || !pcmReader.readAllSamples(pcm) || !adpcmReader.readAllSamples(whole)) {
+    printf("Need an 8/16-bit PCM file and an IMA ADPCM file.\n");
+    exit(1);
+  }
+
+  // Stream the same file through the fill thread, draining as fast as it fills.
+  {
+    WaveFileStdioReader reader(adpcmFile);
+    while (!reader.isPlaybackComplete()) {
+      if (!reader.isBufferPrimed() || reader.isStarved()) {
+        SleepMS(1);
+        continue;
+      }
+      streamed.push_back(*reader.getReadPointer());
+      reader.advanceReadPointer();
+    }
+  }
+
+  size_t len = pcm.size() < whole.size() ? pcm.size() : whole.size();
+  uint64_t errorSum = 0;
+  for (size_t i=0; i<len; i++)
+    errorSum += abs((int)pcm[i] - (int)whole[i]);
+  // The two paths lay down their ramps differently, so line the streamed samples up with the
+  // whole-clip decode and compare everything but the ramps.
+  const size_t rampSkip = 256;
+  size_t streamLen = streamed.size() < whole.size() ? streamed.size() : whole.size();
+  size_t mismatches = streamLen;
+  int bestShift = 0;
+  for (int shift=-32; shift<=32 && streamLen > 2*rampSkip+32; shift++) {
+    size_t count = 0;
+    for (size_t i=rampSkip; i<streamLen-rampSkip; i++)
+      count += streamed[i+shift] != whole[i];
+    if (count < mismatches) {
+      mismatches = count;
+      bestShift = shift;
+    }
+  }
+  printf("Samples: PCM %u, ADPCM whole %u, streamed %u. Mean abs error vs PCM %.2f LSB. Streamed vs whole mismatches: %u (offset %d)\n",
+    (unsigned)pcm.size(), (unsigned)whole.size(), (unsigned)streamed.size(), (double)errorSum / len, (unsigned)mismatches, bestShift);
+
+  // Raw 'data' chunk of each file, found by scanning for the chunk id.
+  auto loadData = [](const char* name, std::vector<uint8_t>& data, uint32_t& readUS) {
+    FILE* f = fopen(name, "rb");
+    std::vector<uint8_t> file;
+    uint8_t buf[4096];
+    size_t got;
+    uint32_t startUS = getMicros();
+    while ((got = fread(buf, 1, sizeof(buf), f)) > 0)
+      file.insert(file.end(), buf, buf + got);
+    readUS = getMicros() - startUS;
+    fclose(f);
+    for (size_t i=12; i+8<=file.size(); i++) {
+      if (!memcmp(&file[i], "data", 4)) {
+        uint32_t len = file[i+4] | file[i+5]<<8 | file[i+6]<<16 | (uint32_t)file[i+7]<<24;
+        data.assign(file.begin()+i+8, file.begin()+i+8+std::min<size_t>(len, file.size()-i-8));
+        return;
+      }
+    }
+  };
+  std::vector<uint8_t> pcmData, adpcmData;
+  uint32_t pcmReadUS = 0, adpcmReadUS = 0, pass;
+  const int readLoops = 50;
+  for (int i=0; i<readLoops; i++) {
+    pcmData.clear(); adpcmData.clear();
+    loadData(pcmFile, pcmData, pass); pcmReadUS += pass;
+    loadData(adpcmFile, adpcmData, pass); adpcmReadUS += pass;
+  }
+
+  uint16_t blockAlign = 0;
+  {
+    FILE* f = fopen(adpcmFile, "rb");
+    uint8_t head[40];
+    if (fread(head, 1, sizeof(head), f) == sizeof(head))
+      blockAlign = head[32] | head[33]<<8;
+    fclose(f);
+  }
+  uint8_t channels = adpcmData.size() > whole.size() / 2 + 1024 ? 2 : 1;
+  std::vector<uint8_t> out(ImaAdpcmDecoder::samplesPerBlock(blockAlign, channels));
+  uint64_t decoded = 0;
+  uint32_t startUS = getMicros();
+  while (getMicros() - startUS < 300000) {
+    for (size_t off=0; off<adpcmData.size(); off+=blockAlign)
+      decoded += ImaAdpcmDecoder::decodeBlock(&adpcmData[off], std::min<size_t>(blockAlign, adpcmData.size()-off), channels, out.data());
+  }
+  uint32_t decodeUS = getMicros() - startUS;
+
+  double audioSeconds = (double)pcm.size() / pcmReader.getSampleRate();
+  double nsPerSample = decodeUS * 1000.0 / decoded;
+  double decodeUSPerSec = nsPerSample * pcmReader.getSampleRate() / 1000.0;
+  double pcmUSPerSec = pcmReadUS / readLoops / audioSeconds;
+  double adpcmUSPerSec = adpcmReadUS / readLoops / audioSeconds;
+  double bytesSavedPerSec = (pcmData.size() - (double)adpcmData.size()) / audioSeconds;
+  printf("Decode: %.1f nS/sample, %.1f Msamples/s, %.0fx realtime at %u Hz\n",
+    nsPerSample, 1000.0 / nsPerSample, 1000000.0 / decodeUSPerSec, pcmReader.getSampleRate());
+  printf("Per second of audio: PCM reads %.0f bytes in %.1f uS; ADPCM reads %.0f bytes in %.1f uS + %.1f uS decode\n",
+    pcmData.size() / audioSeconds, pcmUSPerSec, adpcmData.size() / audioSeconds, adpcmUSPerSec, decodeUSPerSec);
+  if (bytesSavedPerSec > 0)
+    printf("Break-even read rate: %.0f kB/s - slower storage than this saves CPU with ADPCM\n",
+      bytesSavedPerSec / decodeUSPerSec * 1000000.0 / 1024);
+  exit(0);
+}
+
+/*! @brief G.711 table decode cost and a round trip against a PCM original.
+ *  @details Spot-checks both tables against the reference expansion, then times decoding a 64k
+ *           block of codes to 16-bit and straight to DAC samples, next to the 16-bit PCM to DAC
+ *           conversion the player already does. With files given, the G.711 file is decoded whole
+ *           and streamed through the ring buffer and compared with the PCM original.
+ */
+void g711Test(const char* pcmFile, const char* g711File) {
+  const int16_t* alaw = G711Decoder::getLinearTable(G711Decoder::WAVE_FORMAT_ALAW);
+  const int16_t* ulaw = G711Decoder::getLinearTable(G711Decoder::WAVE_FORMAT_MULAW);
+  bool tablesOk = ulaw[0x00] == -32124 && ulaw[0x80] == 32124 && ulaw[0xff] == 0
+    && alaw[0xd5] == 8 && alaw[0x55] == -8 && alaw[0xaa] == 32256 && alaw[0x2a] == -32256;
+  printf("Table spot checks: %s\n", tablesOk ? "PASS" : "FAIL");
+
+  const size_t count = 65536;
+  std::vector<uint8_t> codes(count), dac(count);
+  std::vector<int16_t> linear(count);
+  FastRand rng(711);
+  for (size_t i=0; i<count; i++)
+    codes[i] = rng.Next();
+
+  auto timeLoop = [&](std::function<void()> pass) {
+    uint32_t passes = 0;
+    uint32_t startUS = getMicros();
+    while (getMicros() - startUS < 200000) {
+      pass();
+      passes++;
+    }
+    return (getMicros() - startUS) * 1000.0 / ((double)passes * count);
+  };
+  uint32_t sink = 0;
+  double linearNS = timeLoop([&]() { G711Decoder::decode(codes.data(), linear.data(), count, ulaw); sink += linear[sink % count]; });
+  double dacNS = timeLoop([&]() {
+    G711Decoder::decodeToDAC(codes.data(), dac.data(), count, G711Decoder::getDACTable(G711Decoder::WAVE_FORMAT_MULAW));
+    sink += dac[sink % count];
+  });
+  double pcmNS = timeLoop([&]() {
+    for (size_t i=0; i<count; i++)
+      dac[i] = (linear[i] >> 8) + 128;
+    sink += dac[sink % count];
+  });
+  printf("Decode cost per sample: to 16-bit %.2f nS, to DAC %.2f nS. 16-bit PCM to DAC for comparison %.2f nS (%u)\n",
+    linearNS, dacNS, pcmNS, sink & 1);
+
+  if (!pcmFile || !g711File)
+    exit(tablesOk ? 0 : 1);
+
+  std::vector<uint8_t> pcm, whole, streamed;
+  WaveFileStdioReader pcmReader(pcmFile, false);
+  WaveFileStdioReader g711Reader(g711File, false);
+  g711Reader.printFileInfo();
+  if (!pcmReader.readAllSamples(pcm) || !g711Reader.readAllSamples(whole)) {
+    printf("Unable to read the files.\n");
+    exit(1);
+  }
+  {
+    WaveFileStdioReader reader(g711File);
+    while (!reader.isPlaybackComplete()) {
+      if (!reader.isBufferPrimed() || reader.isStarved()) {
+        SleepMS(1);
+        continue;
+      }
+      streamed.push_back(*reader.getReadPointer());
+      reader.advanceReadPointer();
+    }
+  }
+  size_t len = std::min(pcm.size(), whole.size());
+  uint64_t errorSum = 0;
+  for (size_t i=0; i<len; i++)
+    errorSum += abs((int)pcm[i] - (int)whole[i]);
+  // The streamed ramp-in drops the first sample, so streamed[i-1] lines up with whole[i].
+  size_t mismatches = 0, compared = 0;
+  for (size_t i=256; i+256<std::min(streamed.size(), whole.size()); i++, compared++)
+    mismatches += streamed[i-1] != whole[i];
+  printf("Samples: PCM %u, G.711 whole %u, streamed %u. Mean abs error vs PCM %.2f LSB. Streamed vs whole mismatches: %u of %u\n",
+    (unsigned)pcm.size(), (unsigned)whole.size(), (unsigned)streamed.size(), (double)errorSum / len, (unsigned)mismatches, (unsigned)compared);
+  exit(0);
+}
+
+/*! @brief FLAC decode against the PCM it was encoded from.
+ *  @details Checks the whole-file and streamed decodes against pcmFile sample for sample, then
+ *           times (per second of audio) a FLAC decode, a PCM read plus 16 to 8-bit conversion and
+ *           a plain read of the PCM file. Finally seeks to 10/50/90% and checks what follows.
+ *           Run it on a file with and without a SEEKTABLE to compare seek times.
+ */
+void flacTest(const char* pcmFile, const char* flacFile) {
+  std::vector<uint8_t> pcm, whole, streamed;
+  const int loops = 10;
+
+  // Reader construction and teardown (thread start/stop) are kept out of the timings.
+  auto timeRead = [&](const char* name, std::vector<uint8_t>& samples) {
+    uint32_t totalUS = 0;
+    for (int i=0; i<loops; i++) {
+      WaveFileStdioReader reader(name, false);
+      uint32_t startUS = getMicros();
+      if (!reader.readAllSamples(samples)) {
+        printf("Unable to read %s\n", name);
+        exit(1);
+      }
+      totalUS += getMicros() - startUS;
+    }
+    return totalUS / loops;
+  };
+  WaveFileStdioReader(flacFile, false).printFileInfo();
+  uint32_t flacUS = timeRead(flacFile, whole);
+  uint32_t pcmUS = timeRead(pcmFile, pcm);
+
+  size_t pcmBytes = 0, flacBytes = 0;
+  uint8_t buf[4096];
+  size_t got;
+  uint32_t startUS = getMicros();
+  for (int i=0; i<loops; i++) {
+    FILE* f = fopen(pcmFile, "rb");
+    for (pcmBytes = 0; (got = fread(buf, 1, sizeof(buf), f)) > 0; pcmBytes += got)
+      ;
+    fclose(f);
+  }
+  uint32_t rawUS = (getMicros() - startUS) / loops;
+  FILE* f = fopen(flacFile, "rb");
+  for (flacBytes = 0; (got = fread(buf, 1, sizeof(buf), f)) > 0; flacBytes += got)
+    ;
+  fclose(f);
+
+  {
+    WaveFileStdioReader reader(flacFile);
+    while (!reader.isPlaybackComplete()) {
+      if (!reader.isBufferPrimed() || reader.isStarved()) {
+        SleepMS(1);
+        continue;
+      }
+      streamed.push_back(*reader.getReadPointer());
+      reader.advanceReadPointer();
+    }
+  }
+
+  size_t mismatches = 0;
+  for (size_t i=0; i<std::min(pcm.size(), whole.size()); i++)
+    mismatches += pcm[i] != whole[i];
+  // The streamed ramp-in drops the first sample, so streamed[i-1] lines up with whole[i].
+  size_t streamMismatches = 0;
+  for (size_t i=256; i+256<std::min(streamed.size(), whole.size()); i++)
+    streamMismatches += streamed[i-1] != whole[i];
+  printf("Samples: PCM %u, FLAC %u (%u mismatches), streamed %u (%u mismatches)\n", (unsigned)pcm.size(),
+    (unsigned)whole.size(), (unsigned)mismatches, (unsigned)streamed.size(), (unsigned)streamMismatches);
+
+  uint32_t rate = WaveFileStdioReader(pcmFile, false).getSampleRate();
+  double seconds = (double)pcm.size() / rate;
+  printf("File bytes: PCM %u, FLAC %u (%.0f%%)\n", (unsigned)pcmBytes, (unsigned)flacBytes, 100.0 * flacBytes / pcmBytes);
+  printf("Per second of audio: FLAC decode %.0f uS (%.0fx realtime), PCM read+convert %.0f uS, raw PCM read %.0f uS\n",
+    flacUS / seconds, seconds * 1000000 / flacUS, pcmUS / seconds, rawUS / seconds);
+
+  for (int pct=10; pct<100; pct+=40) {
+    std::vector<uint8_t> tail;
+    uint32_t target = (uint64_t)pcm.size() * pct / 100;
+    WaveFileStdioReader reader(flacFile, false);
+    startUS = getMicros();
+    bool ok = reader.seekToFrame(target);
+    uint32_t seekUS = getMicros() - startUS;
+    reader.readAllSamples(tail);
+    // Both end in the same ramp-out, so line them up from the end.
+    size_t bad = 0, check = tail.size() > 256 ? tail.size() - 256 : 0;
+    for (size_t i=1; i<=check; i++)
+      bad += tail[tail.size()-i] != whole[whole.size()-i];
+    printf("Seek to %d%% (sample %u): %s in %u uS, %u of %u following samples differ\n",
+      pct, target, ok ? "ok" : "FAILED", seekUS, (unsigned)bad, (unsigned)check);
+  }
+  exit(0);
+}
+
+/*! @brief PCM layout conversion - cost per format and agreement with a file of known content.
+ *  @details Times every encoding at 1, 2 and 6 channels (nS per frame) and checks the output
+ *           against a plain per-sample loop. Then each file given is read whole and streamed and
+ *           compared with refFile - a 16-bit PCM copy of the same audio. Integer formats should
+ *           match exactly, float to within an LSB.
+ */
+void pcmconvTest(const char* refFile, int fileCount, char** files) {
+  const PcmConverter::Encoding encodings[] = { PcmConverter::Unsigned8, PcmConverter::Signed16,
+    PcmConverter::Signed24, PcmConverter::Signed32, PcmConverter::Float32 };
+  const char* names[] = { "U8", "S16", "S24", "S32", "F32" };
+  const uint8_t channelCounts[] = { 1, 2, 6 };
+  const size_t frames = 8192;
+  bool allOk = true;
+  FastRand rng(39);
+
+  printf("nS per frame     1ch     2ch     6ch\n");
+  for (int e=0; e<5; e++) {
+    printf("%-10s", names[e]);
+    for (uint8_t channels : channelCounts) {
+      PcmConverter conv(encodings[e], channels);
+      uint8_t width = conv.getBytesPerFrame() / channels;
+      std::vector<uint8_t> in(frames * conv.getBytesPerFrame()), out(frames), ref(frames);
+      if (encodings[e] == PcmConverter::Float32) {
+        // Mostly in range with a few out-of-range values to exercise the clamp.
+        for (size_t i=0; i<in.size()/4; i++) {
+          float v = ((int)(rng.Next() & 0xffff) - 32768) / 30000.0f;
+          memcpy(&in[i*4], &v, 4);
+        }
+      }
+      else
+        for (auto& b : in)
+          b = rng.Next();
+
+      // Reference - one sample at a time, no tricks.
+      for (size_t f=0; f<frames; f++) {
+        int32_t sum = 0;
+        for (uint8_t ch=0; ch<channels; ch++) {
+          const uint8_t* p = &in[(f*channels + ch) * width];
+          if (encodings[e] == PcmConverter::Float32) {
+            float v;
+            memcpy(&v, p, 4);
+            v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+            int s = (int)(v * 128.0f + 128.0f);
+            sum += s > 255 ? 255 : s;
+          }
+          else if (width == 1)
+            sum += p[0];
+          else
+            sum += ((int8_t)p[width-1]) + 128;
+        }
+        ref[f] = sum / channels;
+      }
+
+      uint32_t passes = 0, startUS = getMicros();
+      while (getMicros() - startUS < 100000) {
+        conv.convert(in.data(), out.data(), frames);
+        passes++;
+      }
+      double ns = (getMicros() - startUS) * 1000.0 / ((double)passes * frames);
+      bool ok = out == ref;
+      allOk &= ok;
+      printf(" %6.2f%s", ns, ok ? " " : "!");
+    }
+    printf("\n");
+  }
+  printf("Converter vs reference loop: %s\n", allOk ? "PASS" : "FAIL ('!' marks the mismatch)");
+
+  if (!refFile)
+    exit(allOk ? 0 : 1);
+
+  std::vector<uint8_t> ref;
+  if (!WaveFileStdioReader(refFile, false).readAllSamples(ref)) {
+    printf("Unable to read %s\n", refFile);
+    exit(1);
+  }
+  for (int n=0; n<fileCount; n++) {
+    std::vector<uint8_t> whole, streamed;
+    WaveFileStdioReader wholeReader(files[n], false);
+    wholeReader.printFileInfo();
+    uint32_t startUS = getMicros();
+    if (!wholeReader.readAllSamples(whole)) {
+      printf("Unable to read %s\n", files[n]);
+      exit(1);
+    }
+    uint32_t wholeUS = getMicros() - startUS;
+    {
+      WaveFileStdioReader reader(files[n]);
+      while (!reader.isPlaybackComplete()) {
+        if (!reader.isBufferPrimed() || reader.isStarved()) {
+          SleepMS(1);
+          continue;
+        }
+        streamed.push_back(*reader.getReadPointer());
+        reader.advanceReadPointer();
+      }
+    }
+    size_t mismatches = 0, maxError = 0;
+    for (size_t i=0; i<std::min(ref.size(), whole.size()); i++) {
+      size_t err = abs((int)ref[i] - (int)whole[i]);
+      mismatches += err != 0;
+      maxError = std::max(maxError, err);
+    }
+    // The streamed ramp-in drops the first sample, so streamed[i-1] lines up with whole[i].
+    size_t streamMismatches = 0;
+    for (size_t i=256; i+256<std::min(streamed.size(), whole.size()); i++)
+      streamMismatches += streamed[i-1] != whole[i];
+    printf("%s (%s): %u samples in %u uS, vs reference %u differ (max %u LSB). Streamed %u (%u mismatches)\n",
+      files[n], wholeReader.getFormatName(), (unsigned)whole.size(), wholeUS, (unsigned)mismatches, (unsigned)maxError, (unsigned)streamed.size(), (unsigned)streamMismatches);
+  }
+  exit(0);
+}
+
+/*! @brief Clip bank against the loose files it was built from.
+ *  @details Packs every playable file in dirName into bankName, then compares the start cost of a
+ *           play (construction until the first fill has landed) for a loose file, a clip streamed
+ *           from the bank and a clip from the mapped bank. Every clip is checked sample for sample
+ *           against its source both ways, and one is played by name through the playlist's bank mode.
+ */
+void bankTest(const char* dirName, const char* bankName) {
+  std::vector<std::string> paths;
+  ClipBankWriter writer;
+  size_t looseBytes = 0, looseBlocks = 0;
+  struct dirent* ent;
+  struct stat st;
+
+  DIR* dir = opendir(dirName);
+  if (!dir) {
+    printf("Unable to open %s\n", dirName);
+    exit(1);
+  }
+  uint32_t startUS = getMicros();
+  while ((ent = readdir(dir)) != NULL) {
+    std::string path = std::string(dirName) + "/" + ent->d_name;
+    if (ent->d_name[0] == '.' || stat(path.c_str(), &st) || !writer.addFile(path.c_str()))
+      continue;
+    paths.push_back(path);
+    looseBytes += st.st_size;
+    looseBlocks += (st.st_size + 4095) / 4096;
+  }
+  closedir(dir);
+  if (paths.empty() || !writer.write(bankName)) {
+    printf("Unable to build %s\n", bankName);
+    exit(1);
+  }
+  uint32_t buildUS = getMicros() - startUS;
+  stat(bankName, &st);
+  printf("Bank: %u clips built in %u mS. Loose files %u bytes (%u 4k blocks), bank %u bytes (%u blocks)\n",
+    (unsigned)paths.size(), buildUS/1000, (unsigned)looseBytes, (unsigned)looseBlocks, (unsigned)st.st_size,
+    (unsigned)((st.st_size + 4095) / 4096));
+
+  std::shared_ptr<ClipBank> fileBank = std::make_shared<ClipBank>();
+  std::shared_ptr<ClipBank> mappedBank = std::make_shared<ClipBank>();
+  startUS = getMicros();
+  bool loaded = fileBank->load(bankName);
+  uint32_t loadUS = getMicros() - startUS;
+  startUS = getMicros();
+  bool mapped = mappedBank->map(bankName);
+  uint32_t mapUS = getMicros() - startUS;
+  if (!loaded || !mapped) {
+    printf("Unable to open the bank\n");
+    exit(1);
+  }
+  printf("Index: load %u uS, map %u uS\n", loadUS, mapUS);
+
+  // Every clip both ways against what the file itself decodes to (ramps included).
+  size_t streamBad = 0, mappedBad = 0;
+  for (auto& path: paths) {
+    std::vector<uint8_t> ref, streamed, fromMap;
+    const char* name = strrchr(path.c_str(), '/') + 1;
+    int32_t clip = fileBank->find(name);
+    WaveFileStdioReader(path.c_str(), false).readAllSamples(ref);
+    WaveFileStdioReader(bankName, false, &fileBank->getEntry(clip)).readAllSamples(streamed);
+    std::unique_ptr<AudioSampleSource> pSource(ClipBank::openClip(mappedBank, mappedBank->find(name)));
+    for (const uint8_t* p; (p = pSource->getReadPointer()) != nullptr; pSource->advanceReadPointer())
+      fromMap.push_back(*p);
+    streamBad += clip < 0 || streamed != ref;
+    mappedBad += fromMap != ref;
+  }
+  printf("Clips differing from their source: streamed from bank %u, mapped %u (of %u)\n",
+    (unsigned)streamBad, (unsigned)mappedBad, (unsigned)paths.size());
+
+  // Start cost only - the reader's thread teardown (~50 mS) is outside the timings.
+  auto timeStart = [&](std::function<AudioSampleSource*(size_t)> open) {
+    uint32_t totalUS = 0;
+    for (size_t i=0; i<paths.size(); i++) {
+      uint32_t t0 = getMicros();
+      std::unique_ptr<AudioSampleSource> pSource(open(i));
+      while (!pSource->isBufferPrimed())
+        ;
+      totalUS += getMicros() - t0;
+    }
+    return totalUS / paths.size();
+  };
+  uint32_t looseUS = timeStart([&](size_t i) { return new WaveFileStdioReader(paths[i].c_str()); });
+  uint32_t streamUS = timeStart([&](size_t i) {
+    return ClipBank::openClip(fileBank, fileBank->find(strrchr(paths[i].c_str(), '/') + 1));
+  });
+  uint32_t mappedUS = timeStart([&](size_t i) {
+    return ClipBank::openClip(mappedBank, mappedBank->find(strrchr(paths[i].c_str(), '/') + 1));
+  });
+  printf("Start of play, average: loose file %u uS, bank file %u uS, mapped bank %u uS\n", looseUS, streamUS, mappedUS);
+
+  // Playlist bank mode - the shortest clip by name.
+  uint16_t shortest = 0;
+  for (uint16_t i=1; i<mappedBank->size(); i++)
+    if (mappedBank->getEntry(i).length < mappedBank->getEntry(shortest).length)
+      shortest = i;
+  std::string entryName = std::string(bankName) + "/" + mappedBank->getName(shortest);
+  AudioPlaylistManager::RequestStats stats;
+  std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, nullptr);
+  pAPM->SetVolume(0);
+  startUS = getMicros();
+  pAPM->LoadBank(bankName, true);
+  pAPM->WaitForScan();
+  uint32_t listUS = getMicros() - startUS;
+  pAPM->PlayEntryName(entryName.c_str());
+  do {
+    SleepMS(1);
+    pAPM->getRequestStats(stats);
+  } while (!stats.started && !stats.dropped);
+  uint32_t playUS = getMicros() - startUS - listUS;
+  printf("Playlist bank mode: %u entries listed in %u uS, '%s' started %u uS after the request\n",
+    (unsigned)pAPM->GetFileList()->size(), listUS, entryName.c_str(), playUS);
+  SleepMS(mappedBank->getEntry(shortest).length * 1000 / mappedBank->getEntry(shortest).sampleRate + 200);
+  exit(streamBad || mappedBad ? 1 : 0);
+}
+
+/*! @brief Time-to-first-playable with the background scan.
+ *  @details Times a plain synchronous directory read first (what construction used to block on),
+ *           then constructs the manager, asks for targetName straight away and reports when the
+ *           constructor returned, when the first entries were published, when the requested file
+ *           started and when the scan finished.
+ */
+void scanTest(const char* dirName, const char* targetName) {
+  uint32_t startUS = getMicros();
+  uint32_t syncCount = 0;
+  DIR* dir = opendir(dirName);
+  if (!dir) {
+    printf("Unable to open %s\n", dirName);
+    exit(1);
+  }
+  FileNameArena syncList;
+  std::string path;
+  struct dirent* ent;
+  while ((ent = readdir(dir)) != NULL) {
+    if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+      continue;
+    path = dirName;
+    path += "/";
+    path += ent->d_name;
+    syncList.add(path.c_str());
+    syncCount++;
+  }
+  closedir(dir);
+  uint32_t syncUS = getMicros() - startUS;
+
+  uint32_t firstUS = 0, playableUS = 0, callbackUS = 0;
+  uint32_t found, errors;
+  AudioPlaylistManager::RequestStats stats;
+  std::atomic<bool> bCallback(false);
+
+  startUS = getMicros();
+  std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, nullptr);
+  pAPM->SetScanCompleteCallback([&](uint32_t count, bool ok) { callbackUS = getMicros() - startUS; bCallback = true; });
+  pAPM->AddFilesFrom(dirName);
+  uint32_t ctorUS = getMicros() - startUS;
+  pAPM->SetVolume(0);
+  if (targetName)
+    pAPM->PlayEntryName(targetName);
+
+  while (!bCallback || (targetName && !playableUS)) {
+    if (!firstUS && pAPM->GetFileList()->size())
+      firstUS = getMicros() - startUS;
+    pAPM->getRequestStats(stats);
+    if (targetName && !playableUS && (stats.started || stats.dropped))
+      playableUS = getMicros() - startUS;
+    if (getMicros() - startUS > 60000000)
+      break;
+    SleepMS(1);
+  }
+  pAPM->getScanProgress(found, errors);
+
+  printf("Synchronous read of %s: %u entries in %u mS\n", dirName, syncCount, syncUS/1000);
+  printf("Background scan: constructor+AddFilesFrom %u uS, first entries published %u mS, scan complete %u mS (%u entries, %u errors)\n",
+    ctorUS, firstUS/1000, callbackUS/1000, (unsigned)pAPM->GetFileList()->size(), errors);
+  if (targetName)
+    printf("  %s started at %u mS\n", targetName, playableUS/1000);
+  exit(0);
+}
+
+/*! @brief 100k-entry synthetic library: FileNameArena against one std::string per path.
+ *  @details Reports heap bytes per entry, lookup time by full path and iteration time.
+ *           String bytes are estimated as the string object plus a heap block (rounded to 16)
+ *           for anything past the 15 character small-string buffer.
+ */
+void arenaTest() {
+  const size_t entries = 100000;
+  const int dirCount = 250;
+  FileNameArena arena;
+  std::vector<std::string> strings;
+  char path[128];
+  size_t stringBytes = 0;
+
+  uint32_t startUS = getMicros();
+  for (size_t i=0; i<entries; i++) {
+    snprintf(path, sizeof(path), "/sdcard/library/artist_%03d/track_%06u.wav", (int)(i*dirCount/entries), (unsigned)i);
+    arena.add(path);
+  }
+  arena.shrinkToFit();
+  uint32_t arenaBuildUS = getMicros() - startUS;
+
+  startUS = getMicros();
+  for (size_t i=0; i<entries; i++) {
+    snprintf(path, sizeof(path), "/sdcard/library/artist_%03d/track_%06u.wav", (int)(i*dirCount/entries), (unsigned)i);
+    strings.push_back(path);
+  }
+  strings.shrink_to_fit();
+  uint32_t stringBuildUS = getMicros() - startUS;
+  stringBytes = strings.capacity() * sizeof(std::string);
+  for (auto& str: strings)
+    stringBytes += str.size() > 15 ? (str.size() + 1 + 15) & ~15 : 0;
+
+  printf("%u entries, %u directories\n", (unsigned)arena.size(), (unsigned)arena.getDirCount());
+  printf("  bytes/entry: arena %.1f   std::string %.1f\n",
+    (double)arena.getBytesUsed() / entries, (double)stringBytes / entries);
+  printf("  build:       arena %u mS   std::string %u mS\n", arenaBuildUS/1000, stringBuildUS/1000);
+
+  const int lookups = 2000;
+  FastRand rng(1234);
+  int32_t found = 0;
+  startUS = getMicros();
+  for (int i=0; i<lookups; i++)
+    found += arena.find(strings[rng.Below(entries)].c_str()) >= 0;
+  uint32_t arenaFindUS = getMicros() - startUS;
+  startUS = getMicros();
+  for (int i=0; i<lookups; i++)
+    found += std::find(strings.begin(), strings.end(), strings[rng.Below(entries)]) != strings.end();
+  uint32_t stringFindUS = getMicros() - startUS;
+  printf("  lookup:      arena %u uS   std::string %u uS   (found %d of %d)\n",
+    arenaFindUS/lookups, stringFindUS/lookups, found, 2*lookups);
+
+  size_t total = 0;
+  startUS = getMicros();
+  for (size_t i=0; i<arena.size(); i++)
+    total += strlen(arena.getName(i));
+  uint32_t arenaIterUS = getMicros() - startUS;
+  startUS = getMicros();
+  for (auto& str: strings)
+    total += str.size() - str.rfind('/') - 1;
+  uint32_t stringIterUS = getMicros() - startUS;
+  startUS = getMicros();
+  for (size_t i=0; i<arena.size(); i++)
+    total += arena.getPath(i).size();
+  uint32_t arenaPathUS = getMicros() - startUS;
+  printf("  iterate:     arena %u nS/entry (names), %u nS/entry (full paths)   std::string %u nS/entry  [%lu]\n",
+    (uint32_t)((uint64_t)arenaIterUS*1000/entries), (uint32_t)((uint64_t)arenaPathUS*1000/entries),
+    (uint32_t)((uint64_t)stringIterUS*1000/entries), (unsigned long)total);
+  exit(0);
+}
+
+//! Heap accounting for embedTest() - every operator new in the process comes through here.
+static std::atomic<size_t> heapBytes(0);
+static std::atomic<size_t> heapAllocs(0);
+
+__attribute__((noinline)) void* operator new(size_t size) {
+  heapBytes += size;
+  heapAllocs++;
+  void* p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  free(p);
+}
+
+/*! @brief Embedded clip against the same clip as a file.
+ *  @details Checks the generated array matches what the reader decodes from fileName, then times
+ *           AudioFilePlayer::LoadFile() against LoadEmbedded() and counts the heap each one takes
+ *           to get to a playable state. The file reader's thread teardown is kept out of the timings.
+ *           Finally PlayEmbedded() through the playlist manager, request to Started.
+ */
+void embedTest(const char* fileName) {
+  const EmbeddedClip& clip = EmbeddedClips::alarm_beep;
+  const int rounds = 20;
+  std::vector<uint8_t> ref, fromArray;
+
+  WaveFileStdioReader(fileName, false).readAllSamples(ref);
+  WaveMemorySource source(clip);
+  for (const uint8_t* p; (p = source.getReadPointer()) != nullptr; source.advanceReadPointer())
+    fromArray.push_back(*p);
+  printf("Embedded '%s': %u samples at %u Hz, %u ms - %s the file\n", clip.name, clip.length, clip.sampleRate,
+    clip.durationMS(), fromArray == ref ? "identical to" : "DIFFERENT from");
+
+  AudioFilePlayer afp(0, 25);
+  uint32_t fileUS = 0, embedUS = 0;
+  size_t fileBytes = 0, fileAllocs = 0, embedBytes = 0, embedAllocs = 0;
+  for (int i=0; i<rounds; i++) {
+    size_t bytes = heapBytes, allocs = heapAllocs;
+    uint32_t t0 = getMicros();
+    afp.LoadFile(fileName);
+    fileUS += getMicros() - t0;
+    fileBytes += heapBytes - bytes;
+    fileAllocs += heapAllocs - allocs;
+
+    afp.LoadEmbedded(clip);     // Deletes the file reader - untimed.
+    bytes = heapBytes;
+    allocs = heapAllocs;
+    t0 = getMicros();
+    afp.LoadEmbedded(clip);
+    embedUS += getMicros() - t0;
+    embedBytes += heapBytes - bytes;
+    embedAllocs += heapAllocs - allocs;
+  }
+  printf("Load to playable, average: file %u uS, %u bytes in %u allocations. Embedded %u uS, %u bytes in %u allocations\n",
+    fileUS / rounds, (unsigned)(fileBytes / rounds), (unsigned)(fileAllocs / rounds),
+    embedUS / rounds, (unsigned)(embedBytes / rounds), (unsigned)(embedAllocs / rounds));
+
+  AudioPlaylistManager::RequestStats stats;
+  std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, nullptr);
+  pAPM->SetVolume(0);
+  SleepMS(100);
+  uint32_t startUS = getMicros();
+  pAPM->PlayEmbedded(clip);
+  do {
+    SleepMS(1);
+    pAPM->getRequestStats(stats);
+  } while (!stats.started && !stats.dropped);
+  printf("PlayEmbedded: started %u uS after the request\n", getMicros() - startUS);
+  SleepMS(clip.durationMS() + 200);
+  exit(fromArray == ref ? 0 : 1);
+}
+
+/*! @brief seekToFrame() and the playback position on each file given.
+ *  @details Non-streaming: seeks to a few frames and checks everything read from there against
+ *           the whole file. Streaming: seeks, then plays the ring out by hand checking each sample
+ *           against the frame getPositionFrames() reports. Then scrubs - 200 seeks to random frames
+ *           while another thread plays the ring out as fast as it fills - and times them.
+ */
+void seekTest(int fileCount, char** files) {
+  bool bFailed = false;
+
+  for (int f=0; f<fileCount; f++) {
+    std::vector<uint8_t> whole;
+    if (!WaveFileStdioReader(files[f], false).readAllSamples(whole, false)) {
+      printf("Unable to read %s\n", files[f]);
+      exit(1);
+    }
+    WaveFileStdioReader reader(files[f]);
+    while (!reader.isBufferPrimed())
+      SleepMS(1);
+    printf("%s: %s, %u frames (whole read %u)\n", files[f], reader.getFormatName(), reader.getTotalFrames(), (unsigned)whole.size());
+
+    size_t wholeBad = 0, streamBad = 0, checked = 0;
+    uint32_t seekUS = 0;
+    const int pcts[] = { 0, 13, 50, 87, 99 };
+    for (int pct: pcts) {
+      uint32_t target = (uint64_t)whole.size() * pct / 100;
+
+      std::vector<uint8_t> tail;
+      WaveFileStdioReader still(files[f], false);
+      if (!still.seekToFrame(target) || !still.readAllSamples(tail, false) || tail.size() != whole.size() - target)
+        wholeBad++;
+      else
+        wholeBad += !std::equal(tail.begin(), tail.end(), whole.begin() + target);
+
+      uint32_t t0 = getMicros();
+      if (!reader.seekToFrame(target)) {
+        streamBad++;
+        continue;
+      }
+      seekUS += getMicros() - t0;
+      for (int k=0; k<4000 && !reader.isPlaybackComplete(); ) {
+        if (reader.isStarved()) {
+          SleepMS(1);
+          continue;
+        }
+        uint32_t pos = reader.getPositionFrames();
+        if (pos > target && pos < whole.size()) {
+          streamBad += *reader.getReadPointer() != whole[pos];
+          checked++;
+          k++;
+        }
+        reader.advanceReadPointer();
+      }
+    }
+    printf("  seek to 0/13/50/87/99%%: whole-read %u bad, streamed %u of %u samples bad, average %u uS\n",
+      (unsigned)wholeBad, (unsigned)streamBad, (unsigned)checked, seekUS / 5);
+    bFailed |= wholeBad || streamBad || !checked;
+
+    // Scrub while another thread plays the ring out.
+    std::atomic<bool> bStop(false);
+    std::thread output([&]() {
+      while (!bStop) {
+        if (!reader.isStarved() && !reader.isPlaybackComplete())
+          reader.advanceReadPointer();
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
+      }
+    });
+    uint32_t worstUS = 0, totalUS = 0;
+    FastRand rng(f + 1);
+    for (int i=0; i<200; i++) {
+      uint32_t target = rng.Below(whole.size());
+      uint32_t t0 = getMicros();
+      reader.seekToFrame(target);
+      uint32_t us = getMicros() - t0;
+      totalUS += us;
+      worstUS = us > worstUS ? us : worstUS;
+      if (reader.getPositionFrames() < target || reader.getPositionFrames() > target + 1) {
+        printf("  position %u after seeking to %u\n", reader.getPositionFrames(), target);
+        bFailed = true;
+      }
+    }
+    bStop = true;
+    output.join();
+    printf("  scrub while playing: 200 seeks, average %u uS, worst %u uS, final position %u ms\n",
+      totalUS / 200, worstUS, reader.getPositionMS());
+  }
+  exit(bFailed ? 1 : 0);
+}
+
+/*! @brief Loop regions against the whole file read into memory.
+ *  @details Per file: the 'smpl' loop if there is one, otherwise the middle half with no crossfade,
+ *           then the whole file with a 20 ms crossfade (on a short clip that one has already been
+ *           read past, so it exercises winding the ring back). The output is checked sample for
+ *           sample against the loop built here from the whole read, over several passes, and the
+ *           file read() calls made once playback is inside the loop are counted - there should be
+ *           none. Then stopLooping() must finish the pass and play the rest of the file out.
+ */
+class CountingStdioReader : public WaveFileStdioReader {
+public:
+  CountingStdioReader(const char* fname) : WaveFileStdioReader(fname), reads(0) {};
+  std::atomic<uint32_t> reads;
+protected:
+  bool read(uint8_t* pDest, size_t numBytes) {
+    reads++;
+    return WaveFileStdioReader::read(pDest, numBytes);
+  }
+};
+
+void loopTest(int fileCount, char** files) {
+  bool bFailed = false;
+
+  for (int f=0; f<fileCount; f++) {
+    std::vector<uint8_t> whole;
+    if (!WaveFileStdioReader(files[f], false).readAllSamples(whole, false)) {
+      printf("Unable to read %s\n", files[f]);
+      exit(1);
+    }
+    uint32_t rate = WaveFileStdioReader(files[f], false).getSampleRate();
+
+    for (int variant=0; variant<2; variant++) {
+      CountingStdioReader reader(files[f]);
+      while (!reader.isBufferPrimed())
+        SleepMS(1);
+
+      uint32_t start = whole.size() / 4, end = 3 * whole.size() / 4, fade = 0;
+      const char* what = "middle half";
+      if (variant == 1) {
+        start = 0;
+        end = whole.size();
+        fade = rate / 50;
+        what = "whole file, 20 ms crossfade";
+      }
+      else if (reader.getClipLoop(start, end))
+        what = "'smpl' loop";
+
+      uint32_t t0 = getMicros();
+      if (!reader.setLoop(start, end, fade)) {
+        printf("%s: setLoop(%u, %u, %u) failed\n", files[f], start, end, fade);
+        bFailed = true;
+        continue;
+      }
+      uint32_t setUS = getMicros() - t0;
+
+      // The loop as setLoop() should have built it.
+      std::vector<uint8_t> cycle(whole.begin() + start, whole.begin() + end);
+      uint32_t length = cycle.size();
+      for (uint32_t i=0; i<fade; i++)
+        cycle[i] = (cycle[length - fade + i] * (fade - i) + cycle[i] * i) / fade;
+      cycle.resize(length - fade);
+      uint32_t switchFrame = end - fade;
+
+      // Stream index i of the output: 1 is the first sample after the ramp-in.
+      auto expected = [&](uint32_t i) {
+        return i < switchFrame ? whole[i] : cycle[(i - switchFrame) % cycle.size()];
+      };
+      auto framePos = [&](uint32_t i) {
+        return i < switchFrame ? i : start + (i - switchFrame) % (uint32_t)cycle.size();
+      };
+
+      uint32_t passes = 4, target = switchFrame + passes * cycle.size();
+      uint32_t index = 0, bad = 0, badPos = 0, readsInLoop = 0, readsAtEntry = 0;
+      while (index < target) {
+        if (reader.isPlaybackComplete())
+          break;
+        if (reader.isStarved()) {
+          SleepMS(1);
+          continue;
+        }
+        uint32_t pos = reader.getPositionFrames();
+        if (!index && pos == 1)
+          index = 1;
+        if (index) {
+          bad += *reader.getReadPointer() != expected(index);
+          badPos += pos != framePos(index);
+          if (index == switchFrame + cycle.size())
+            readsAtEntry = reader.reads;
+          index++;
+        }
+        reader.advanceReadPointer();
+      }
+      readsInLoop = reader.reads - readsAtEntry;
+
+      // Leave the loop - the pass in progress finishes, then the rest of the file.
+      reader.stopLooping();
+      uint32_t tailBad = 0, tailLeft = (cycle.size() - (index - switchFrame) % cycle.size()) % cycle.size();
+      uint32_t exitIndex = index + tailLeft, played = 0;
+      while (!reader.isPlaybackComplete()) {
+        if (reader.isStarved()) {
+          SleepMS(1);
+          continue;
+        }
+        uint32_t fileFrame = index < exitIndex ? 0 : switchFrame + (index - exitIndex);
+        if (index < exitIndex)
+          tailBad += *reader.getReadPointer() != expected(index);
+        else if (fileFrame < whole.size()) {
+          tailBad += *reader.getReadPointer() != whole[fileFrame];
+          played++;
+        }
+        index++;
+        reader.advanceReadPointer();
+      }
+
+      printf("%s: %s [%u, %u) of %u frames, setLoop %u uS\n", files[f], what, start, end, (unsigned)whole.size(), setUS);
+      printf("  %u passes: %u bad samples, %u bad positions, %u file reads after the first pass\n",
+        passes, bad, badPos, readsInLoop);
+      printf("  stopLooping: %u bad samples finishing the pass and playing the last %u frames\n", tailBad, played);
+      bFailed |= bad || badPos || readsInLoop || tailBad || index < target || played != whole.size() - switchFrame;
+    }
+  }
+  exit(bFailed ? 1 : 0);
+}
+
+//! @brief Runs gen to the end. Returns the tone samples - the ramps either side are left out.
+static std::vector<uint8_t> renderTone(ToneGenerator& gen) {
+  std::vector<uint8_t> out;
+  for (uint32_t pos = 0; gen.getReadPointer(); ) {
+    gen.advanceReadPointer();
+    if (gen.getPositionFrames() != pos) {
+      pos = gen.getPositionFrames();
+      out.push_back(*gen.getReadPointer());
+    }
+  }
+  return out;
+}
+
+//! @brief Rising crossings of the midpoint in samples [from, to).
+static unsigned risingCrossings(const std::vector<uint8_t>& s, size_t from, size_t to) {
+  unsigned n = 0;
+  for (size_t i = from + 1; i < to && i < s.size(); i++)
+    n += s[i-1] < 128 && s[i] >= 128;
+  return n;
+}
+
+//! @brief Largest swing away from the midpoint in samples [from, to).
+static int peakSwing(const std::vector<uint8_t>& s, size_t from, size_t to) {
+  int peak = 0;
+  for (size_t i = from; i < to && i < s.size(); i++)
+    peak = std::max(peak, abs((int)s[i] - 128));
+  return peak;
+}
+
+/*! @brief Synthesized tones checked against what was asked for.
+ *  @details Renders straight from a ToneGenerator at 16 kHz and checks pitch by counting crossings,
+ *           level by the peak swing, the ADSR shape at the segment boundaries, a chirp's sweep and
+ *           that a repeated sequence is as long as getTotalFrames() says. Then load-to-playable on
+ *           the player (time and heap - there should be none) and PlayTone() request to Started.
+ */
+void toneTest() {
+  const uint32_t rate = 16000;
+  ToneGenerator gen(rate);
+  bool bFailed = false;
+
+  // 1 kHz sine and square, level 100 - 100 cycles in 100 ms, peaks at 100/127 of the DAC's swing.
+  static const ToneStep waves[] = {
+    ToneStep::tone(ToneStep::Sine, 1000, 100), ToneStep::tone(ToneStep::Square, 1000, 100),
+    ToneStep::tone(ToneStep::Triangle, 1000, 100) };
+  const char* waveNames[] = { "sine", "square", "triangle" };
+  for (int w = 0; w < 3; w++) {
+    gen.start(waves[w]);
+    std::vector<uint8_t> s = renderTone(gen);
+    unsigned cycles = risingCrossings(s, 0, s.size());
+    int peak = peakSwing(s, rate / 100, s.size() - rate / 100);
+    bool bOK = s.size() == rate / 10 && cycles >= 99 && cycles <= 101 && peak >= 97 && peak <= 100;
+    printf("%-8s 1000 Hz, 100 ms: %u samples, %u cycles, peak %d - %s\n", waveNames[w], (unsigned)s.size(), cycles, peak, bOK ? "ok" : "BAD");
+    bFailed |= !bOK;
+  }
+
+  // ADSR - 20 ms attack to full, 20 ms decay to half, hold, 20 ms release over a 100 ms note.
+  static const ToneStep adsr = { ToneStep::Sine, 1000, 1000, 100, 120, 20, 20, 128, 20 };
+  gen.start(adsr);
+  std::vector<uint8_t> s = renderTone(gen);
+  const uint32_t ms = rate / 1000;
+  int attackStart = peakSwing(s, 0, 2 * ms), attackPeak = peakSwing(s, 18 * ms, 22 * ms);
+  int sustain = peakSwing(s, 45 * ms, 75 * ms), releaseEnd = peakSwing(s, 98 * ms, 100 * ms);
+  bool bOK = attackStart < 15 && attackPeak >= 110 && sustain >= 56 && sustain <= 62 && releaseEnd < 8;
+  printf("ADSR 20/20/50%%/20 ms at 120: start %d, attack peak %d, sustain %d, release end %d - %s\n",
+    attackStart, attackPeak, sustain, releaseEnd, bOK ? "ok" : "BAD");
+  bFailed |= !bOK;
+
+  // 500 Hz -> 2 kHz over 200 ms - 1250 Hz on average so 250 cycles, 10 ms at each end near the end pitches.
+  gen.start(ToneStep::chirp(500, 2000, 200));
+  s = renderTone(gen);
+  unsigned total = risingCrossings(s, 0, s.size()), first = risingCrossings(s, 0, 10 * ms), last = risingCrossings(s, 190 * ms, 200 * ms);
+  bOK = total >= 245 && total <= 255 && first >= 4 && first <= 7 && last >= 18 && last <= 21;
+  printf("chirp 500->2000 Hz, 200 ms: %u cycles (250), first 10 ms %u, last 10 ms %u - %s\n", total, first, last, bOK ? "ok" : "BAD");
+  bFailed |= !bOK;
+
+  // A two-tone alert with a gap, three times.
+  static const ToneStep alert[] = {
+    ToneStep::tone(ToneStep::Square, 880, 120, 80), ToneStep::rest(40), ToneStep::tone(ToneStep::Square, 660, 120, 80), ToneStep::rest(120) };
+  gen.start(alert, 4, 3);
+  uint32_t expected = gen.getTotalFrames();
+  s = renderTone(gen);
+  bOK = s.size() == expected && expected == 3 * 400 * ms && peakSwing(s, 125 * ms, 155 * ms) == 0;
+  printf("sequence 4 steps x 3: %u samples, getTotalFrames() %u - %s\n", (unsigned)s.size(), expected, bOK ? "ok" : "BAD");
+  bFailed |= !bOK;
+
+  // stop() on a forever-repeating sequence ends it at the end of the step playing.
+  gen.start(alert, 4, ToneGenerator::FOREVER);
+  for (int i = 0; i < 50 * (int)ms; i++)
+    gen.advanceReadPointer();
+  gen.stop();
+  s = renderTone(gen);
+  bOK = gen.getTotalFrames() == 0 && gen.getPositionFrames() == 120 * ms;
+  printf("forever, stop() at 50 ms: ended at %u samples - %s\n", gen.getPositionFrames(), bOK ? "ok" : "BAD");
+  bFailed |= !bOK;
+
+  std::unique_ptr<AudioFilePlayer> pAFP = make_unique<AudioFilePlayer>(0, 25);
+  const int rounds = 20;
+  uint32_t toneUS = 0;
+  size_t toneBytes = 0, toneAllocs = 0;
+  for (int i=0; i<rounds; i++) {
+    size_t bytes = heapBytes, allocs = heapAllocs;
+    uint32_t t0 = getMicros();
+    pAFP->LoadTone(alert, 4);
+    toneUS += getMicros() - t0;
+    toneBytes += heapBytes - bytes;
+    toneAllocs += heapAllocs - allocs;
+  }
+  printf("LoadTone to playable, average: %u uS, %u bytes in %u allocations\n",
+    toneUS / rounds, (unsigned)(toneBytes / rounds), (unsigned)(toneAllocs / rounds));
+  bFailed |= toneAllocs != 0;
+  // The player's wave and event queue are static - the manager's player must be the only one.
+  pAFP.reset();
+
+  AudioPlaylistManager::RequestStats stats;
+  std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, nullptr);
+  pAPM->SetVolume(0);
+  SleepMS(100);
+  uint32_t startUS = getMicros();
+  pAPM->PlayTone(alert, 4);
+  do {
+    SleepMS(1);
+    pAPM->getRequestStats(stats);
+  } while (!stats.started && !stats.dropped);
+  printf("PlayTone: started %u uS after the request\n", getMicros() - startUS);
+  SleepMS(600);
+  exit(bFailed ? 1 : 0);
+}
+
+/*! @brief PlayAt() against a best-effort PlayFile() at the same moment.
+ *  @details Each round loads fileName and asks for the first sample 100 ms out - once through
+ *           PlayAt(), once by sleeping to the deadline and calling PlayFile(). The FirstSample
+ *           event's time gives the error of each. Then PlayEntryIndexAt() through the manager on
+ *           the entries of dirName, reporting getLastStartErrorUS().
+ */
+void playAtTest(const char* fileName, const char* dirName) {
+  static std::atomic<uint32_t> firstSampleUS(0);
+  const int rounds = 10;
+  const uint32_t leadUS = 100000;
+
+  std::unique_ptr<AudioFilePlayer> pAFP = make_unique<AudioFilePlayer>(0, 25);
+  pAFP->SetVolume(0);
+  pAFP->Subscribe([](const AudioPlayerEvent& ev, void*) { firstSampleUS = ev.timeUS; },
+                nullptr, AudioPlayerEvent::maskOf(AudioPlayerEvent::FirstSample));
+
+  int32_t worst[2] = { 0, 0 };
+  int64_t sum[2] = { 0, 0 };
+  bool bFailed = false;
+  for (int i=0; i<rounds; i++) {
+    for (int scheduled=1; scheduled>=0; scheduled--) {
+      if (!pAFP->LoadFile(fileName)) {
+        printf("Unable to load %s\n", fileName);
+        exit(1);
+      }
+      firstSampleUS = 0;
+      uint32_t targetUS = getMicros() + leadUS;
+      if (scheduled)
+        pAFP->PlayAt(targetUS);
+      else {
+        SleepMS((targetUS - getMicros()) / 1000);
+        pAFP->PlayFile();
+      }
+      while (!firstSampleUS)
+        SleepMS(1);
+      int32_t err = (int32_t)(firstSampleUS - targetUS);
+      sum[scheduled] += abs(err);
+      worst[scheduled] = std::max(worst[scheduled], abs(err));
+      // The player's own measure is taken just before the event is posted - the two should agree.
+      if (scheduled && abs(pAFP->getLastStartErrorUS() - err) > 1000)
+        bFailed = true;
+      pAFP->PauseFile();
+    }
+  }
+  printf("First sample vs deadline over %d rounds: PlayAt() mean %d uS, worst %d uS. Sleep then PlayFile() mean %d uS, worst %d uS\n",
+    rounds, (int)(sum[1] / rounds), worst[1], (int)(sum[0] / rounds), worst[0]);
+  // The player's wave and event queue are static - the manager's player must be the only one.
+  pAFP.reset();
+
+  std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, dirName);
+  pAPM->SetVolume(0);
+  pAPM->WaitForScan();
+  AudioPlaylistManager::FileListHandle files = pAPM->GetFileList();
+  // Let the loudness pass finish first - it would only be competing for the CPU.
+  for (uint32_t measured = 0, failed = 0; measured + failed < files->size(); SleepMS(10))
+    pAPM->getLoudnessProgress(measured, failed);
+  for (uint16_t e=0; e<files->size(); e++) {
+    // Short clips only, so each has finished before the next is scheduled.
+    struct stat st;
+    std::string path = files->getPath(e);
+    if (path.size() < 4 || path.compare(path.size() - 4, 4, ".wav") || stat(path.c_str(), &st) || st.st_size > 32 * 1024)
+      continue;
+    pAPM->PlayEntryIndexAt(e, getMicros() + 300000);
+    // Leaves Idle once loaded and armed - well ahead of the deadline - then back at the end of the clip.
+    for (int w=0; w<100 && pAPM->getState() == AudioPlaylistManager::Idle; w++)
+      SleepMS(10);
+    while (pAPM->getState() != AudioPlaylistManager::Idle)
+      SleepMS(10);
+    printf("PlayEntryIndexAt(%u) %-50s start error %d uS\n", e, path.c_str(), pAPM->getLastStartErrorUS());
+    bFailed |= abs(pAPM->getLastStartErrorUS()) > 5000;
+  }
+  exit(bFailed ? 1 : 0);
+}
+
+//! @brief A clip as the readers play it - ramp from 0 to level, held, ramp back to 0.
+static std::vector<uint8_t> heldClip(uint8_t level, uint32_t length) {
+  std::vector<uint8_t> s;
+  for (int i = 0; i < 4; i++)
+    s.push_back(level * i / 4);
+  s.insert(s.end(), length, level);
+  for (int i = 3; i >= 0; i--)
+    s.push_back(level * i / 4);
+  return s;
+}
+
+//! @brief Runs a mixer to the end, or for at most limit samples.
+static std::vector<uint8_t> renderMix(DuckingMixer& mixer, size_t limit) {
+  std::vector<uint8_t> out;
+  while (out.size() < limit && mixer.getReadPointer()) {
+    out.push_back(*mixer.getReadPointer());
+    mixer.advanceReadPointer();
+  }
+  return out;
+}
+
+//! @brief Largest change between neighbouring samples in [from, to).
+static int largestStep(const std::vector<uint8_t>& s, size_t from, size_t to) {
+  int step = 0;
+  for (size_t i = from + 1; i < to && i < s.size(); i++)
+    step = std::max(step, abs((int)s[i] - (int)s[i-1]));
+  return step;
+}
+
+/*! @brief Priority preemption and ducking - the mixer's output, then request to first sample.
+ *  @details Renders a DuckingMixer straight from memory sources at 8 kHz. The back is a held
+ *           level and the front silence with ramps baked in, so each stage shows up as a level:
+ *           preempt must fade to zero in DuckingMixer::FADE_MS, play the front as is and come
+ *           back to the very sample it left; duck must settle at the duck level with the
+ *           front's ramps nowhere to be seen; drop must finish with the front. Then through the
+ *           manager: fileName (a path listed from dirName) plays and the embedded alarm interrupts it
+ *           at a higher priority under each PreemptPolicy, against the same alarm requested at
+ *           the same priority, which waits for the clip to finish. Last, an interruption of an
+ *           interruption.
+ */
+void preemptTest(const char* dirName, const char* fileName) {
+  const uint32_t rate = 8000;
+  const uint32_t fadeLen = DuckingMixer::FADE_MS * rate / 1000;
+  std::vector<uint8_t> back = heldClip(168, rate), front = heldClip(128, rate / 10);
+  DuckingMixer mixer;
+  bool bFailed = false;
+
+  // Preempt, resume - 100 ms in.
+  WaveMemorySource backSrc(back.data(), back.size(), rate, "back"), frontSrc(front.data(), front.size(), rate, "front");
+  backSrc.seekToFrame(rate / 10);
+  uint32_t leftAt = backSrc.getPositionFrames();
+  mixer.begin(&backSrc, &frontSrc, DuckingMixer::Preempt, true);
+  std::vector<uint8_t> s = renderMix(mixer, fadeLen + front.size() + fadeLen);
+  bool bFrontIntact = std::search(s.begin(), s.end(), front.begin(), front.end()) == s.begin() + fadeLen;
+  bool bOK = s[fadeLen - 1] <= 168 / fadeLen && bFrontIntact && backSrc.getPositionFrames() == leftAt
+          && s.back() >= 168 - 2 * 168 / fadeLen && largestStep(s, 0, fadeLen) <= (int)(168 / fadeLen) + 1;
+  s = renderMix(mixer, back.size());
+  bOK &= s.size() == back.size() - leftAt && s[0] == 168 && mixer.isPlaybackComplete();
+  printf("preempt, resume: faded out in %u samples, front as is, back resumed at frame %u - %s\n",
+    fadeLen, leftAt, bOK ? "ok" : "BAD");
+  bFailed |= !bOK;
+
+  // Preempt, drop - over as soon as the front is.
+  backSrc.seekToFrame(rate / 10);
+  frontSrc.rewind();
+  mixer.begin(&backSrc, &frontSrc, DuckingMixer::Preempt, false);
+  s = renderMix(mixer, back.size());
+  bOK = s.size() <= fadeLen + front.size() && mixer.isPlaybackComplete() && s.back() == 0;
+  printf("preempt, drop: %u samples for a %u sample front - %s\n", (unsigned)s.size(), (unsigned)front.size(), bOK ? "ok" : "BAD");
+  bFailed |= !bOK;
+
+  // Duck to 20%, resume - 168 is +40, so 128 + 8. The front's ramps may only just show.
+  const uint32_t duckLen = DuckingMixer::DUCK_MS * rate / 1000;
+  backSrc.seekToFrame(rate / 10);
+  frontSrc.rewind();
+  mixer.begin(&backSrc, &frontSrc, DuckingMixer::Duck, true, 20);
+  s = renderMix(mixer, front.size() + 2 * duckLen);
+  int lowest = *std::min_element(s.begin(), s.end());
+  int ducked = s[front.size() / 2];
+  bOK = lowest >= 130 && ducked == 136 && s.back() == 168 && backSrc.getPositionFrames() == rate / 10 + s.size() - 1
+     && largestStep(s, 0, s.size()) <= 4;
+  printf("duck 20%%, resume: ducked to %d (136), lowest %d, largest step %d, back ran on - %s\n",
+    ducked, lowest, largestStep(s, 0, s.size()), bOK ? "ok" : "BAD");
+  bFailed |= !bOK;
+
+  // Duck, drop - ramps out to zero once the front is done.
+  backSrc.seekToFrame(rate / 10);
+  frontSrc.rewind();
+  mixer.begin(&backSrc, &frontSrc, DuckingMixer::Duck, false, 20);
+  s = renderMix(mixer, back.size());
+  bOK = s.size() <= front.size() + fadeLen + 1 && mixer.isPlaybackComplete() && s.back() <= 136 / fadeLen;
+  printf("duck, drop: %u samples for a %u sample front, ended at %d - %s\n", (unsigned)s.size(), (unsigned)front.size(), s.back(), bOK ? "ok" : "BAD");
+  bFailed |= !bOK;
+
+  // A 16 kHz front over an 8 kHz back is stepped at its own rate - 100 ms is still 100 ms.
+  ToneGenerator tone(16000);
+  tone.start(ToneStep::tone(ToneStep::Sine, 1000, 100));
+  backSrc.seekToFrame(rate / 10);
+  mixer.begin(&backSrc, &tone, DuckingMixer::Preempt, false);
+  s = renderMix(mixer, back.size());
+  uint32_t frontLen = s.size() - (fadeLen - 1);
+  bOK = frontLen >= rate / 10 && frontLen <= rate / 10 + rate / 500;
+  printf("16 kHz front at 8 kHz: %u samples for 100 ms - %s\n", frontLen, bOK ? "ok" : "BAD");
+  bFailed |= !bOK;
+
+  // Each source at its own gain - a back at half gain doesn't take the front down with it.
+  // 168 at half about 127 is 148.
+  backSrc.seekToFrame(rate / 10);
+  frontSrc.rewind();
+  mixer.begin(&backSrc, &frontSrc, DuckingMixer::Preempt, true, 20, 128, 256);
+  s = renderMix(mixer, back.size());
+  bFrontIntact = std::search(s.begin(), s.end(), front.begin(), front.end()) == s.begin() + fadeLen;
+  bOK = bFrontIntact && s[0] <= 148 && s[fadeLen + front.size() + fadeLen] == 148;
+  printf("back at half gain, front at unity: front as is, back resumed at %d (148) - %s\n",
+    s[fadeLen + front.size() + fadeLen], bOK ? "ok" : "BAD");
+  bFailed |= !bOK;
+
+  std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, dirName);
+  pAPM->SetVolume(0);
+  pAPM->SetAmpTiming(0, 60000);
+  pAPM->WaitForScan();
+  AudioPlaylistManager::FileListHandle files = pAPM->GetFileList();
+  for (uint32_t measured = 0, failed = 0; measured + failed < files->size(); SleepMS(10))
+    pAPM->getLoudnessProgress(measured, failed);
+
+  const char* policyNames[] = { "preempt+resume", "preempt+drop", "duck+resume", "duck+drop" };
+  AudioPlaylistManager::RequestStats stats;
+  uint32_t idleMS[4];
+  for (int p = 0; p < 4; p++) {
+    pAPM->SetPreemptPolicy((AudioPlaylistManager::PreemptPolicy)p);
+    pAPM->PlayEntryName(fileName);
+    while (pAPM->getState() == AudioPlaylistManager::Idle)
+      SleepMS(1);
+    SleepMS(300);
+
+    pAPM->getRequestStats(stats);
+    uint32_t preempted = stats.preempted;
+    uint32_t startUS = getMicros();
+    pAPM->PlayEmbedded(EmbeddedClips::alarm_beep, 5);
+    do {
+      SleepMS(1);
+      pAPM->getRequestStats(stats);
+    } while (stats.preempted == preempted && getMicros() - startUS < 1000000);
+    while (!pAPM->getLastPreemptLatencyUS() && getMicros() - startUS < 1000000)
+      SleepMS(1);
+    uint32_t latency = pAPM->getLastPreemptLatencyUS();
+    while (pAPM->getState() != AudioPlaylistManager::Idle)
+      SleepMS(5);
+    idleMS[p] = (getMicros() - startUS) / 1000;
+    printf("%-15s request to first alarm sample %5u uS, idle again after %u ms\n", policyNames[p], latency, idleMS[p]);
+    bFailed |= !latency || latency > 20000;
+  }
+  // Dropping finishes with the alarm, resuming plays the rest of the clip after it.
+  bFailed |= idleMS[1] >= idleMS[0] || idleMS[3] >= idleMS[2];
+
+  // Nested - a tone at 3 over the clip, then an alarm file at 5 over the tone. Both resume.
+  static const ToneStep chime[] = { ToneStep::tone(ToneStep::Sine, 880, 150), ToneStep::tone(ToneStep::Sine, 660, 150) };
+  pAPM->SetPreemptPolicy(AudioPlaylistManager::DuckAndResume);
+  pAPM->PlayEntryName(fileName);
+  while (pAPM->getState() == AudioPlaylistManager::Idle)
+    SleepMS(1);
+  SleepMS(300);
+  pAPM->getRequestStats(stats);
+  uint32_t preempted = stats.preempted;
+  pAPM->PlayTone(chime, 2, 1, 3);
+  SleepMS(50);
+  pAPM->PlayEntryName("./waveExamples/alarm-beep.wav", 5);
+  while (pAPM->getState() != AudioPlaylistManager::Idle)
+    SleepMS(5);
+  pAPM->getRequestStats(stats);
+  printf("nested tone and file: %u preempted (2) - %s\n", stats.preempted - preempted, stats.preempted - preempted == 2 ? "ok" : "BAD");
+  bFailed |= stats.preempted - preempted != 2;
+
+  // The same alarm at the same priority isn't let in until the clip is done.
+  pAPM->SetRequestPolicy(AudioPlaylistManager::LatestWins);
+  pAPM->PlayEntryName(fileName);
+  while (pAPM->getState() == AudioPlaylistManager::Idle)
+    SleepMS(1);
+  SleepMS(300);
+  pAPM->getRequestStats(stats);
+  uint32_t started = stats.started;
+  uint32_t startUS = getMicros();
+  pAPM->PlayEmbedded(EmbeddedClips::alarm_beep);
+  do {
+    SleepMS(1);
+    pAPM->getRequestStats(stats);
+  } while (stats.started == started);
+  printf("%-15s request to start %u uS\n", "no priority", getMicros() - startUS);
+  SleepMS(500);
+  exit(bFailed ? 1 : 0);
+}
+#endif
+
+#ifndef ESP_PLATFORM
+/*! @brief LevelMeter correctness and cost.
+ *  @details reduce() (SIMD where the host has it) against reduceScalar() on random blocks and the
+ *           edge values, known signals through push()/process(), then what push() adds to a
+ *           stand-in for the output path (volume table lookup and a DAC write) and what metering a
+ *           block costs on the notifier thread. Finally fileName played through AudioFilePlayer
+ *           with GetLevels() polled along the way.
+ */
+void meterTest(const char* fileName) {
+  bool bFailed = false;
+  FastRand rng(45);
+
+  // SIMD and scalar must agree exactly.
+  std::vector<uint8_t> data(4096);
+  uint32_t mismatches = 0;
+  for (int round=0; round<20000; round++) {
+    size_t count = rng.Below(data.size());
+    uint8_t mode = rng.Below(4);
+    for (size_t i=0; i<count; i++)
+      data[i] = mode == 0 ? rng.Below(256) : mode == 1 ? (rng.Below(2) ? 0 : 255) : mode == 2 ? 128 : 120 + rng.Below(16);
+    uint8_t p1, p2;
+    uint32_t s1, s2, c1, c2;
+    LevelMeter::reduce(&data[0], count, p1, s1, c1);
+    LevelMeter::reduceScalar(&data[0], count, p2, s2, c2);
+    mismatches += p1 != p2 || s1 != s2 || c1 != c2;
+  }
+  printf("reduce() vs reduceScalar(): %u mismatches in 20000 random blocks\n", mismatches);
+  bFailed |= mismatches != 0;
+
+  // Known signals: silence, full-scale square, a sine at half scale.
+  struct { const char* name; uint8_t peak, rms; uint16_t clips; } want[] = {
+    { "silence", 0, 0, 0 }, { "full-scale square", 128, 128, 256 }, { "half-scale sine", 64, 45, 0 } };
+  for (int sig=0; sig<3; sig++) {
+    LevelMeter m;
+    LevelSnapshot snap;
+    for (int i=0; i<LevelMeter::BLOCK_SIZE; i++)
+      m.push(sig == 0 ? 128 : sig == 1 ? (i & 1 ? 255 : 0) : (uint8_t)(128.5 + 64 * sin(2 * M_PI * i / 64)));
+    m.process();
+    bool ok = m.getSnapshot(snap) && snap.peak == want[sig].peak && snap.clips == want[sig].clips &&
+              abs(snap.rms - want[sig].rms) <= 1 && snap.block == 1 && !snap.dropped;
+    printf("  %-18s peak %3u rms %3u clips %3u  %s\n", want[sig].name, snap.peak, snap.rms, snap.clips, ok ? "ok" : "WRONG");
+    bFailed |= !ok;
+  }
+
+  // Output path cost: the same loop with and without push().
+  const uint32_t samples = 20000000;
+  uint8_t table[256];
+  for (int i=0; i<256; i++)
+    table[i] = (i - 128) * 80 / 100 + 128;
+  for (size_t i=0; i<data.size(); i++)
+    data[i] = rng.Below(256);
+  volatile uint8_t dac;
+  LevelMeter m;
+  uint32_t plainUS = 0, meteredUS = 0;
+  for (int pass=0; pass<3; pass++) {
+    uint32_t t0 = getMicros();
+    for (uint32_t i=0; i<samples; i++)
+      dac = table[data[i & 4095]];
+    plainUS += getMicros() - t0;
+    t0 = getMicros();
+    for (uint32_t i=0; i<samples; i++) {
+      uint8_t v = table[data[i & 4095]];
+      m.push(v);
+      dac = v;
+    }
+    meteredUS += getMicros() - t0;
+  }
+  double addedNS = ((double)meteredUS - plainUS) * 1000 / (3.0 * samples);
+  (void)dac;
+  printf("Output path: %.2f nS/sample plain, %.2f nS/sample with push() - %.2f nS added, %.4f%% of a 44.1 kHz sample period\n",
+    plainUS * 1000.0 / (3.0 * samples), meteredUS * 1000.0 / (3.0 * samples), addedNS, addedNS * 100 / 22676);
+
+  // Metering a block, SIMD against scalar.
+  const int blocks = 200000;
+  uint8_t peak;
+  uint32_t sum, clips, check = 0;
+  uint32_t t0 = getMicros();
+  for (int b=0; b<blocks; b++) {
+    LevelMeter::reduce(&data[(b * 64) & 2047], LevelMeter::BLOCK_SIZE, peak, sum, clips);
+    check += peak + sum + clips;
+  }
+  uint32_t simdUS = getMicros() - t0;
+  t0 = getMicros();
+  for (int b=0; b<blocks; b++) {
+    LevelMeter::reduceScalar(&data[(b * 64) & 2047], LevelMeter::BLOCK_SIZE, peak, sum, clips);
+    check -= peak + sum + clips;
+  }
+  uint32_t scalarUS = getMicros() - t0;
+  printf("Metering a %u-sample block: reduce() %u nS, reduceScalar() %u nS (%.1fx) [%u]\n", LevelMeter::BLOCK_SIZE,
+    (uint32_t)((uint64_t)simdUS * 1000 / blocks), (uint32_t)((uint64_t)scalarUS * 1000 / blocks), (double)scalarUS / simdUS, check);
+
+  // Through the player.
+  AudioFilePlayer player(0, 25);
+  player.SetVolume(100);
+  if (!player.LoadFile(fileName)) {
+    printf("Unable to load %s\n", fileName);
+    exit(1);
+  }
+  player.PlayFile();
+  LevelSnapshot snap;
+  uint32_t reads = 0, lastBlock = 0;
+  while (!player.isDonePlaying()) {
+    SleepMS(20);
+    if (player.GetLevels(snap)) {
+      reads++;
+      if (snap.block != lastBlock && !(reads % 10))
+        printf("  %5u ms: block %5u peak %3u rms %3u clips %3u\n", player.getPositionMS(), snap.block, snap.peak, snap.rms, snap.clips);
+      lastBlock = snap.block;
+    }
+  }
+  SleepMS(10);
+  player.GetLevels(snap);
+  printf("%s: %u blocks metered (%u samples played), %u clipped samples, %u dropped\n", fileName,
+    snap.block, player.getSamplesPlayed(), snap.totalClips, snap.dropped);
+  bFailed |= snap.block != player.getSamplesPlayed() / LevelMeter::BLOCK_SIZE || snap.dropped;
+  exit(bFailed ? 1 : 0);
+}
+
+/*! @brief Loudness measurement and normalization.
+ *  @details LoudnessAnalyzer on synthetic tones of known level, then dirName measured once in the
+ *           jig thread and once by the manager's workers in the background. The values cached in
+ *           the list must match, and each entry played must get the gain SetLoudnessTarget() asks
+ *           for.
+ */
+void loudnessTest(const char* dirName) {
+  bool bFailed = false;
+
+  // K-weighting is +0.691 dB at 997 Hz, which the -0.691 offset takes back out: a sine measures its RMS level.
+  const uint32_t RATE = 16000;
+  float levels[] = { 0, -10, -20, -30 };
+  std::vector<uint8_t> tone(RATE * 3);
+  float lastLoudness = 0;
+  for (int l=0; l<4; l++) {
+    float amplitude = 127 * powf(10, levels[l] / 20);
+    for (size_t i=0; i<tone.size(); i++)
+      tone[i] = 128 + lroundf(amplitude * sinf(2 * M_PI * 997 * i / RATE));
+    LoudnessAnalyzer analyzer(RATE);
+    analyzer.add(&tone[0], tone.size());
+    float want = -3.01f + levels[l];
+    printf("997 Hz at %5.1f dBFS: %6.2f LUFS (expected %6.2f), peak %u\n", levels[l], analyzer.getLoudness(), want, analyzer.getPeak());
+    bFailed |= fabsf(analyzer.getLoudness() - want) > 0.3f;
+    lastLoudness = analyzer.getLoudness();
+  }
+  // Gating: a second of silence in the middle leaves out all but the blocks straddling it.
+  for (size_t i=RATE; i<2*RATE; i++)
+    tone[i] = 128;
+  LoudnessAnalyzer gated(RATE);
+  gated.add(&tone[0], tone.size());
+  printf("The last tone with a second of silence in the middle: %6.2f LUFS (ungated it would be %6.2f)\n",
+    gated.getLoudness(), lastLoudness + 10 * log10f(2.0f / 3));
+  bFailed |= fabsf(gated.getLoudness() - lastLoudness) > 1.0f;
+
+  // Reference values, one file at a time on this thread.
+  std::vector<std::string> paths;
+  getFiles(dirName, paths);
+  std::vector<float> reference(paths.size(), LoudnessAnalyzer::SILENCE);
+  uint32_t startUS = getMicros();
+  for (size_t f=0; f<paths.size(); f++) {
+    try {
+      WaveFileType reader(paths[f].c_str(), false);
+      LoudnessAnalyzer analyzer(reader.getSampleRate());
+      uint8_t block[256];
+      size_t got;
+      while ((got = reader.readNextSamples(block, sizeof(block))) > 0)
+        analyzer.add(block, got);
+      reference[f] = analyzer.getLoudness();
+    } catch(...) {
+      reference[f] = NAN;
+    }
+  }
+  uint32_t serialUS = getMicros() - startUS;
+
+  startUS = getMicros();
+  std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, dirName);
+  pAPM->WaitForScan();
+  uint32_t measured = 0, failed = 0;
+  AudioPlaylistManager::FileListHandle list;
+  // Done once every entry is accounted for and the last batch has been published.
+  while (getMicros() - startUS < 60000000) {
+    list = pAPM->GetFileList();
+    pAPM->getLoudnessProgress(measured, failed);
+    size_t cached = 0;
+    for (size_t i=0; i<list->size(); i++)
+      cached += list->getLoudness(i) != FileNameArena::NO_LOUDNESS;
+    if (measured + failed == list->size() && cached == measured)
+      break;
+    SleepMS(1);
+  }
+  uint32_t parallelUS = getMicros() - startUS;
+  printf("%u files: %u mS measured one by one, %u mS by the manager's %u workers incl. the scan (%u measured, %u unreadable)\n",
+    (unsigned)paths.size(), serialUS/1000, parallelUS/1000, std::thread::hardware_concurrency() < 4 ? std::thread::hardware_concurrency() : 4,
+    measured, failed);
+
+  uint32_t mismatches = 0;
+  for (size_t i=0; i<list->size(); i++) {
+    std::string path = list->getPath(i);
+    size_t f = std::find(paths.begin(), paths.end(), path) - paths.begin();
+    int16_t loudness = list->getLoudness(i);
+    bool ok = f < paths.size() && (isnan(reference[f]) ? loudness == FileNameArena::NO_LOUDNESS
+                                                       : loudness == (int16_t)lroundf(reference[f] * 100));
+    mismatches += !ok;
+    printf("  %-60s %7.2f LUFS  peak %3u%s\n", path.c_str(), loudness == FileNameArena::NO_LOUDNESS ? NAN : loudness / 100.0f,
+      list->getPeak(i), ok ? "" : "  MISMATCH");
+  }
+  bFailed |= mismatches != 0;
+
+  // Each entry gets target - loudness, limited by its peak. Nothing is measured at play time.
+  // Entries are started back to back, so the first few seconds of each are played.
+  pAPM->SetVolume(0);
+  pAPM->SetLoudnessTarget(-18);
+  pAPM->SetRequestPolicy(AudioPlaylistManager::LatestWins);
+  uint32_t gainErrors = 0;
+  AudioPlaylistManager::RequestStats stats;
+  for (size_t i=0; i<list->size() && i<8; i++) {
+    if (list->getLoudness(i) == FileNameArena::NO_LOUDNESS)
+      continue;
+    pAPM->getRequestStats(stats);
+    uint32_t started = stats.started;
+    pAPM->PlayEntryIndex(i);
+    while (stats.started == started) {
+      SleepMS(5);
+      pAPM->getRequestStats(stats);
+    }
+    // The player has been handed the entry - give it time to open and prime it.
+    SleepMS(200);
+    float want = powf(10, fmaxf(-30, fminf(12, (-1800 - list->getLoudness(i)) / 100.0f)) / 20);
+    if (list->getPeak(i) && want * list->getPeak(i) > 128)
+      want = 128.0f / list->getPeak(i);
+    uint16_t gain = pAPM->getClipGain();
+    printf("  entry %u: gain %5.3f (expected %5.3f)\n", (unsigned)i, gain / 256.0f, want);
+    gainErrors += abs((int)gain - (int)lroundf(want * 256)) > 1;
+  }
+  printf("Gain errors: %u\n", gainErrors);
+  bFailed |= gainErrors != 0;
+  exit(bFailed ? 1 : 0);
+}
+
+/*! @brief Silence trimming end to end.
+ *  @details The manager measures dirName's trims in the background. For each entry the range they
+ *           give must hold every sample above the silence level, setPlayRange() must deliver exactly
+ *           that range from a whole read and from the ring, and the time from PlayFile() to the
+ *           first metered sound is compared with and without the trim.
+ */
+void trimTest(const char* dirName) {
+  bool bFailed = false;
+
+  std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, dirName);
+  pAPM->WaitForScan();
+  AudioPlaylistManager::FileListHandle list;
+  uint32_t measured = 0, failed = 0;
+  for (int i=0; i<5000; i++) {
+    list = pAPM->GetFileList();
+    pAPM->getLoudnessProgress(measured, failed);
+    size_t cached = 0;
+    for (size_t e=0; e<list->size(); e++)
+      cached += list->getLoudness(e) != FileNameArena::NO_LOUDNESS;
+    if (measured + failed == list->size() && cached == measured)
+      break;
+    SleepMS(1);
+  }
+  pAPM.reset();
+
+  AudioFilePlayer player(0, 25);
+  for (size_t e=0; e<list->size(); e++) {
+    std::string path = list->getPath(e);
+    std::vector<uint8_t> whole;
+    if (list->getLoudness(e) == FileNameArena::NO_LOUDNESS || !WaveFileStdioReader(path.c_str(), false).readAllSamples(whole, false))
+      continue;
+    WaveFileStdioReader probe(path.c_str(), false);
+    uint32_t rate = probe.getSampleRate();
+    uint32_t start = (uint64_t)list->getLeadTrimMS(e) * rate / 1000;
+    uint32_t end = whole.size() - (uint64_t)list->getTailTrimMS(e) * rate / 1000;
+
+    // Nothing above the silence level is cut.
+    size_t first = 0, last = whole.size();
+    while (first < whole.size() && abs(whole[first] - 128) <= 2)
+      first++;
+    while (last > 0 && abs(whole[last - 1] - 128) <= 2)
+      last--;
+    bool bRangeOK = start <= first && end >= last;
+
+    std::vector<uint8_t> range;
+    WaveFileStdioReader still(path.c_str(), false);
+    bool bWholeOK = (start == 0 && end == whole.size()) || (still.setPlayRange(start, end) && still.readAllSamples(range, false)
+                    && range.size() == end - start && std::equal(range.begin(), range.end(), whole.begin() + start));
+
+    // From the ring: every sample up to the cut matches, and nothing past it comes out but the ramp-out.
+    WaveFileStdioReader streamed(path.c_str());
+    if (start || end < whole.size())
+      streamed.setPlayRange(start, end);
+    uint32_t bad = 0, outCount = 0;
+    while (!streamed.isPlaybackComplete() && outCount < whole.size() * 2) {
+      if (streamed.isStarved()) {
+        SleepMS(1);
+        continue;
+      }
+      uint32_t pos = streamed.getPositionFrames();
+      if (pos > start && pos < end)
+        bad += *streamed.getReadPointer() != whole[pos];
+      streamed.advanceReadPointer();
+      outCount++;
+    }
+    uint32_t rampMax = 500 / (1000000 / rate) * 2 + 2;
+    bool bStreamOK = !bad && outCount >= end - start && outCount <= end - start + 2 * rampMax;
+
+    // The same from a mapped bank - ClipBankSource works its ramps out again for the range.
+    ClipBankWriter writer;
+    std::shared_ptr<ClipBank> pBank = std::make_shared<ClipBank>();
+    bool bBankOK = writer.addFile(path.c_str(), "clip") && writer.write("/tmp/trimTest.bank") && pBank->map("/tmp/trimTest.bank");
+    if (bBankOK) {
+      std::unique_ptr<AudioSampleSource> pClip(ClipBank::openClip(pBank, 0));
+      if (start || end < whole.size())
+        bBankOK = pClip->setPlayRange(start, end);
+      uint32_t bankBad = 0, bankOut = 0;
+      for (; !pClip->isPlaybackComplete(); pClip->advanceReadPointer(), bankOut++) {
+        uint32_t pos = pClip->getPositionFrames();
+        if (pos > start && pos < end)
+          bankBad += *pClip->getReadPointer() != whole[pos];
+      }
+      bBankOK &= !bankBad && bankOut >= end - start && bankOut <= end - start + 2 * rampMax;
+    }
+
+    // Time from PlayFile() until output reaches the first sample above the silence level.
+    uint32_t soundMS[2];
+    for (int trimmed=0; trimmed<2; trimmed++) {
+      WaveFileType* pWave = new WaveFileType(path.c_str());
+      if (trimmed && (start || end < whole.size()))
+        pWave->setPlayRange(start, end);
+      player.LoadWave(pWave);
+      player.PlayFile();
+      uint32_t t0 = getMicros();
+      soundMS[trimmed] = 0;
+      while (!player.isDonePlaying()) {
+        if (pWave->getPositionFrames() >= first) {
+          soundMS[trimmed] = (getMicros() - t0) / 1000;
+          break;
+        }
+        SleepMS(1);
+      }
+      player.PauseFile();
+    }
+
+    printf("%-28s lead %4u ms, tail %4u ms -> frames [%6u, %6u) of %6u (sound at %u..%u)  range %s, whole read %s, ring %s (%u out), bank %s  first sound %4u ms -> %4u ms\n",
+      path.c_str(), list->getLeadTrimMS(e), list->getTailTrimMS(e), start, end, (unsigned)whole.size(), (unsigned)first, (unsigned)last,
+      bRangeOK ? "ok" : "BAD", bWholeOK ? "ok" : "BAD", bStreamOK ? "ok" : "BAD", outCount, bBankOK ? "ok" : "BAD", soundMS[0], soundMS[1]);
+    bFailed |= !bRangeOK || !bWholeOK || !bStreamOK || !bBankOK;
+  }
+  exit(bFailed ? 1 : 0);
+}
+#endif
+
 void playlistAction() {
   std::unique_ptr<AudioPlaylistManager> pAPM = make_unique<AudioPlaylistManager>(0, 25, "");
+  pAPM->WaitForScan();
 
-  std::vector<std::string> filelist;
-  pAPM->GetFileList(filelist);
+  AudioPlaylistManager::FileListHandle filelist = pAPM->GetFileList();
 
   PrintLN("Getting file list from playlist manager.");
-  for (auto x: filelist)
+  for (size_t i=0; i<filelist->size(); i++)
 #ifdef ESP_PLATFORM
-    Serial.printf("  %s\n", x.c_str());
+    Serial.printf("  %s\n", filelist->getPath(i).c_str());
 #else
-    printf("  %s\n", x.c_str());
+    printf("  %s\n", filelist->getPath(i).c_str());
 #endif
 
   pAPM->SetVolume(35);
@@ -321,6 +2366,95 @@ void loop() {
 }
 #else
 int main(int argc, char** argv) {
+  if (argc > 1 && !strcmp(argv[1], "queue")) {
+    queueTest();
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "cmdstress")) {
+    commandStressTest(argc > 2 ? argv[2] : "./waveFilesForPlaya");
+    return 0;
+  }
+  if (argc > 2 && !strcmp(argv[1], "events")) {
+    eventsTest(argv[2]);
+    return 0;
+  }
+  if (argc > 3 && !strcmp(argv[1], "adpcm")) {
+    adpcmTest(argv[2], argv[3]);
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "g711")) {
+    g711Test(argc > 3 ? argv[2] : nullptr, argc > 3 ? argv[3] : nullptr);
+    return 0;
+  }
+  if (argc > 3 && !strcmp(argv[1], "flac")) {
+    flacTest(argv[2], argv[3]);
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "pcmconv")) {
+    pcmconvTest(argc > 2 ? argv[2] : nullptr, argc - 3, argv + 3);
+    return 0;
+  }
+  if (argc > 3 && !strcmp(argv[1], "bank")) {
+    bankTest(argv[2], argv[3]);
+    return 0;
+  }
+  if (argc > 2 && !strcmp(argv[1], "scan")) {
+    scanTest(argv[2], argc > 3 ? argv[3] : nullptr);
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "arena")) {
+    arenaTest();
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "snapshot")) {
+    snapshotTest(argc > 2 ? argv[2] : "./waveFilesForPlaya");
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "amp")) {
+    ampTest(argc > 2 ? argv[2] : nullptr);
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "embed")) {
+    embedTest(argc > 2 ? argv[2] : "./waveExamples/alarm-beep.wav");
+    return 0;
+  }
+  if (argc > 2 && !strcmp(argv[1], "seek")) {
+    seekTest(argc - 2, argv + 2);
+    return 0;
+  }
+  if (argc > 2 && !strcmp(argv[1], "loop")) {
+    loopTest(argc - 2, argv + 2);
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "meter")) {
+    meterTest(argc > 2 ? argv[2] : "./waveExamples/alarm-beep.wav");
+    return 0;
+  }
+  if (argc > 2 && !strcmp(argv[1], "loudness")) {
+    loudnessTest(argv[2]);
+    return 0;
+  }
+  if (argc > 2 && !strcmp(argv[1], "trim")) {
+    trimTest(argv[2]);
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "tone")) {
+    toneTest();
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "playat")) {
+    playAtTest(argc > 2 ? argv[2] : "./waveExamples/alarm-beep.wav", argc > 3 ? argv[3] : "./waveExamples");
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "preempt")) {
+    preemptTest(argc > 2 ? argv[2] : "./waveExamples", argc > 3 ? argv[3] : "./waveExamples/670297__kinoton__airplane-seatbelt-sign-beep.wav");
+    return 0;
+  }
+  if (argc > 1 && !strcmp(argv[1], "burst")) {
+    burstTest(argc > 2 ? argv[2] : "./waveFilesForPlaya");
+    return 0;
+  }
+
   doActions();
 //  playlistAction();
 }
@@ -34,16 +34,26 @@ int16_t constrain(int16_t v, int16_t low, int16_t high) {
 #endif
 
 #ifdef ESP_PLATFORM
-int16_t getrand(int16_t low, int16_t high) {
-    return random(low, high);
+uint32_t IRAM_ATTR getMicros() {
+    // micros() is itself in IRAM in the Arduino core.
+    return micros();
 }
 #else
-int16_t getrand(int16_t low, int16_t high) {
-    int totalRange = high-low;
-    float v = rand()/RAND_MAX;  // Gives back 0-1 in float
-    int randRange = v*totalRange;   // Now we're normalized to the desired range
-    int fin = low + randRange;
-    printf("normalized 0-1 is: %f, randRange: %d, and final: %d\n", v, randRange, fin);
-    return fin;
+uint32_t getMicros() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 #endif
+
+static FastRand utilsRand;
+
+void seedrand(uint32_t seed) {
+    utilsRand.Seed(seed);
+}
+
+int32_t getrand(int32_t low, int32_t high) {
+    if (high <= low)
+        return low;
+
+    return low + (int32_t)utilsRand.Below((uint32_t)(high - low) + 1);
+}
@@ -60,8 +60,41 @@
 #define WaveFileType WaveFileStdioReader
 #endif
 
+/*! @class FastRand
+ *  @brief Small seedable pseudo-random generator (xorshift32).
+ *  @details rand() on native builds is slow, not seedable per-instance and its float math was the
+ *           source of getrand() nearly always returning the low value. This is a handful of shifts
+ *           and xors per value which is cheap enough to use from the playlist thread on an ESP32.
+ */
+class FastRand
+{
+public:
+    //! @brief Seed may be any value. Zero is a fixed point for xorshift so it is remapped.
+    FastRand(uint32_t seed=0x9E3779B9) { Seed(seed); };
+    //! @brief Restart the sequence from a given seed. Same seed yields the same sequence.
+    void Seed(uint32_t seed) { state = seed ? seed : 0x9E3779B9; };
+    //! @brief Next raw 32-bit value.
+    uint32_t Next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+    //! @brief Value in the range [0, range) via multiply-shift rather than modulo.
+    uint32_t Below(uint32_t range) { return (uint32_t)(((uint64_t)Next() * range) >> 32); };
+
+protected:
+    uint32_t state;
+};
+
+//! @brief Free-running microsecond counter (wraps at 32 bits). Use differences, not absolutes.
+//!        In IRAM on ESP32 - the player's timer ISR stamps its events with it.
+uint32_t getMicros();
+
 //! @brief gets a random number between two values (inclusive)
-int16_t getrand(int16_t low, int16_t high);
+int32_t getrand(int32_t low, int32_t high);
+//! @brief re-seed the generator behind getrand()
+void seedrand(uint32_t seed);
 
 #ifndef ESP_PLATFORM
 //! @brief returns a value based on the input 'v' and boundaries low and high
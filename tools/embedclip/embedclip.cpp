@@ -0,0 +1,134 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Embedded clip generator - turns audio files into a C++ header of constexpr sample arrays and
+// EmbeddedClip metadata, for clips which must play with no filesystem at all. Native only. Built
+// by the 'embedclip' environment in platformio.ini:
+//
+//   pio run -e embedclip
+//   .pio/build/embedclip/program [-n <namespace>] <output.h> <file> [<file> ...]
+//
+// Files are decoded by WaveFileStdioReader - anything the player can play - into the same
+// DAC-ready samples, ramps included, that the reader would put in its ring buffer.
+//
+#include "WaveFileStdioReader.h"
+
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+
+//! @brief The file name without directory or extension - the clip's name.
+static std::string baseName(const char* path) {
+    const char* slash = strrchr(path, '/');
+    std::string name = slash ? slash + 1 : path;
+    size_t dot = name.rfind('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+//! @brief A C++ identifier from the clip name - anything else becomes '_'.
+static std::string symbolName(const std::string& name) {
+    std::string sym;
+    for (char c: name)
+        sym += isalnum((unsigned char)c) ? c : '_';
+    if (sym.empty() || isdigit((unsigned char)sym[0]))
+        sym = "clip_" + sym;
+    return sym;
+}
+
+int main(int argc, char** argv) {
+    const char* nameSpace = "EmbeddedClips";
+    int arg = 1;
+
+    if (argc > 2 && !strcmp(argv[1], "-n")) {
+        nameSpace = argv[2];
+        arg = 3;
+    }
+    if (argc - arg < 2) {
+        printf("Usage: embedclip [-n <namespace>] <output.h> <file> [<file> ...]\n");
+        return 2;
+    }
+    const char* outName = argv[arg++];
+
+    std::string body;
+    std::vector<std::string> symbols;
+    uint32_t totalBytes = 0;
+    char line[160];
+
+    for (; arg < argc; arg++) {
+        std::vector<uint8_t> samples;
+        uint32_t sampleRate;
+        try {
+            WaveFileStdioReader reader(argv[arg], false);
+            if (!reader.readAllSamples(samples) || samples.empty())
+                throw "no samples";
+            sampleRate = reader.getSampleRate();
+        } catch(...) {
+            printf("Unable to decode %s\n", argv[arg]);
+            return 1;
+        }
+
+        std::string name = baseName(argv[arg]);
+        std::string sym = symbolName(name);
+        for (auto& s: symbols) {
+            if (s == sym) {
+                printf("%s: '%s' is already in use - rename the file\n", argv[arg], sym.c_str());
+                return 1;
+            }
+        }
+        symbols.push_back(sym);
+
+        snprintf(line, sizeof(line), "\n// %s: %u samples at %u Hz (%u ms)\nconstexpr uint8_t %s_samples[%u] = {",
+            name.c_str(), (unsigned)samples.size(), sampleRate, (unsigned)((uint64_t)samples.size() * 1000 / sampleRate),
+            sym.c_str(), (unsigned)samples.size());
+        body += line;
+        for (size_t i=0; i<samples.size(); i++) {
+            snprintf(line, sizeof(line), "%s0x%02x,", i % 16 ? " " : "\n    ", samples[i]);
+            body += line;
+        }
+        snprintf(line, sizeof(line), "\n};\nconstexpr EmbeddedClip %s = { \"%s\", %s_samples, %u, %u };\n",
+            sym.c_str(), name.c_str(), sym.c_str(), (unsigned)samples.size(), sampleRate);
+        body += line;
+        totalBytes += samples.size();
+    }
+
+    FILE* f = fopen(outName, "w");
+    if (!f) {
+        printf("Unable to write %s\n", outName);
+        return 1;
+    }
+    fprintf(f, "// Generated by tools/embedclip - do not edit. Include from one .cpp file only.\n"
+               "#pragma once\n#include \"EmbeddedClip.h\"\n\nnamespace %s {\n%s\n} // namespace %s\n",
+               nameSpace, body.c_str(), nameSpace);
+    if (fclose(f)) {
+        printf("Unable to write %s\n", outName);
+        return 1;
+    }
+    printf("%u clips, %u bytes of samples written to %s\n", (unsigned)symbols.size(), totalBytes, outName);
+    return 0;
+}
@@ -0,0 +1,281 @@
+// Copyright 2022 Robert M. Wolff (bob dot wolff 68 at gmail dot com)
+//
+// Redistribution and use in source and binary forms, with or without modification, 
+// are permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this 
+// list of conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, 
+// this list of conditions and the following disclaimer in the documentation and/or 
+// other materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors 
+// may be used to endorse or promote products derived from this software without 
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND 
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//
+// Batch transcoder - turns a directory of audio files into DAC-ready 8-bit mono, either as WAV
+// files or as one clip bank. Native only. Built by the 'transcoder' environment in platformio.ini:
+//
+//   pio run -e transcoder
+//   .pio/build/transcoder/program [options] <input dir> (-o <output dir> | -b <bank file>)
+//
+// Every file goes through the library's own header parser and decoders (WaveFileStdioReader), so
+// anything the player can play can be converted, and higher rates too. Then AudioDSP resamples,
+// trims silence, normalizes and dithers down to 8 bits. Files are spread over all cores.
+//
+#include "WaveFileStdioReader.h"
+#include "ClipBank.h"
+#include "AudioDSP.h"
+#include "FileNameArena.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Options {
+    uint32_t sampleRate = 8000;
+    float peakDB = -1.0f;
+    float trimDB = -50.0f;
+    uint16_t padMS = 20;
+    bool bTrim = true;
+    bool bNormalize = true;
+    AudioDSP::Dither dither = AudioDSP::Shaped;
+    unsigned threads = 0;
+    const char* inDir = nullptr;
+    const char* outDir = nullptr;
+    const char* bankName = nullptr;
+};
+
+struct Job {
+    std::string path;
+    std::string name;       // Output name - the input's with a .wav extension
+    size_t inBytes;
+    std::vector<uint8_t> samples;
+    enum { Pending, Done, Silent, Failed } result;
+};
+
+static void usage() {
+    printf("Usage: transcoder [options] <input dir> (-o <output dir> | -b <bank file>)\n"
+           "  -r <Hz>       output sample rate (8000)\n"
+           "  -p <dBFS>     normalize the peak to this level (-1)\n"
+           "  -t <dBFS>     trim leading/trailing audio below this level (-50)\n"
+           "  -k <ms>       keep this much either side of the trimmed audio (20)\n"
+           "  -d <mode>     dither: none, tpdf or shaped (shaped)\n"
+           "  -j <n>        worker threads (all cores)\n"
+           "  --no-trim     keep leading/trailing silence\n"
+           "  --no-normalize\n");
+}
+
+//! @brief Minimal 44-byte header WAV - 8-bit unsigned mono PCM, the format the reader passes straight through.
+static bool writeWav(const std::string& fileName, const std::vector<uint8_t>& samples, uint32_t sampleRate) {
+    uint8_t h[44];
+    uint32_t dataBytes = samples.size();
+    auto put32 = [&](int at, uint32_t v) { h[at] = v; h[at+1] = v >> 8; h[at+2] = v >> 16; h[at+3] = v >> 24; };
+    auto put16 = [&](int at, uint16_t v) { h[at] = v; h[at+1] = v >> 8; };
+
+    memcpy(h, "RIFF", 4);
+    put32(4, 36 + dataBytes + (dataBytes & 1));
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put32(16, 16);
+    put16(20, 1);               // PCM
+    put16(22, 1);               // mono
+    put32(24, sampleRate);
+    put32(28, sampleRate);      // byte rate
+    put16(32, 1);               // block align
+    put16(34, 8);
+    memcpy(h + 36, "data", 4);
+    put32(40, dataBytes);
+
+    FILE* f = fopen(fileName.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(h, 1, sizeof(h), f) == sizeof(h) && fwrite(samples.data(), 1, dataBytes, f) == dataBytes;
+    if (dataBytes & 1)
+        ok = ok && fputc(0, f) == 0;    // RIFF chunks are padded to an even size
+    return fclose(f) == 0 && ok;
+}
+
+static void transcode(Job& job, const Options& opt) {
+    std::vector<int16_t> wide;
+    std::vector<float> in, out;
+    uint32_t rate;
+
+    try {
+        WaveFileStdioReader reader(job.path.c_str(), false);
+        if (!reader.readAllSamples(wide)) {
+            job.result = Job::Failed;
+            return;
+        }
+        rate = reader.getSampleRate();
+    } catch(...) {
+        job.result = Job::Failed;
+        return;
+    }
+
+    // The reader has already downmixed to mono.
+    AudioDSP::toFloat(wide.data(), wide.size(), in);
+    AudioDSP::resample(in, rate, opt.sampleRate, out);
+
+    if (opt.bTrim) {
+        size_t start, end;
+        if (!AudioDSP::findContent(out, opt.trimDB, opt.padMS * opt.sampleRate / 1000, start, end)) {
+            job.result = Job::Silent;
+            return;
+        }
+        out = std::vector<float>(out.begin() + start, out.begin() + end);
+    }
+    if (opt.bNormalize)
+        AudioDSP::normalize(out, opt.peakDB);
+
+    job.samples.resize(out.size());
+    AudioDSP::toDAC(out.data(), job.samples.data(), out.size(), opt.dither, FileNameArena::hashName(job.name.c_str()));
+    if (opt.outDir && !writeWav(std::string(opt.outDir) + "/" + job.name, job.samples, opt.sampleRate)) {
+        job.result = Job::Failed;
+        return;
+    }
+    job.result = Job::Done;
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+
+    for (int i=1; i<argc; i++) {
+        bool bValue = i+1 < argc;
+        if (!strcmp(argv[i], "-r") && bValue)
+            opt.sampleRate = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-p") && bValue)
+            opt.peakDB = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-t") && bValue)
+            opt.trimDB = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-k") && bValue)
+            opt.padMS = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-j") && bValue)
+            opt.threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-o") && bValue)
+            opt.outDir = argv[++i];
+        else if (!strcmp(argv[i], "-b") && bValue)
+            opt.bankName = argv[++i];
+        else if (!strcmp(argv[i], "-d") && bValue) {
+            i++;
+            opt.dither = !strcmp(argv[i], "none") ? AudioDSP::NoDither : (!strcmp(argv[i], "tpdf") ? AudioDSP::Tpdf : AudioDSP::Shaped);
+        }
+        else if (!strcmp(argv[i], "--no-trim"))
+            opt.bTrim = false;
+        else if (!strcmp(argv[i], "--no-normalize"))
+            opt.bNormalize = false;
+        else if (argv[i][0] != '-' && !opt.inDir)
+            opt.inDir = argv[i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (!opt.inDir || !opt.outDir == !opt.bankName || !opt.sampleRate || opt.sampleRate > WaveFileBufferReader::MAX_PLAYBACK_RATE) {
+        usage();
+        return 2;
+    }
+    if (!opt.threads)
+        opt.threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+
+    // Gather the work up front so the workers only ever pull an index.
+    std::vector<Job> jobs;
+    DIR* dir = opendir(opt.inDir);
+    struct dirent* ent;
+    struct stat st;
+    if (!dir) {
+        printf("Unable to open %s\n", opt.inDir);
+        return 1;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        Job job;
+        job.path = std::string(opt.inDir) + "/" + ent->d_name;
+        if (ent->d_name[0] == '.' || stat(job.path.c_str(), &st) || !S_ISREG(st.st_mode))
+            continue;
+        job.name = ent->d_name;
+        size_t dot = job.name.rfind('.');
+        std::string ext = dot == std::string::npos ? "" : job.name.substr(dot);
+        if (strcasecmp(ext.c_str(), ".wav") && strcasecmp(ext.c_str(), ".flac"))
+            continue;   // Only RIFF and fLaC are parsed - anything else would just be reported as failed
+        job.name = job.name.substr(0, dot) + ".wav";
+        job.inBytes = st.st_size;
+        job.result = Job::Pending;
+        jobs.push_back(std::move(job));
+    }
+    closedir(dir);
+    // x.flac and x.wav would both become x.wav - the later one keeps its whole name.
+    for (size_t i=1; i<jobs.size(); i++)
+        for (size_t j=0; j<i; j++)
+            if (jobs[i].name == jobs[j].name) {
+                jobs[i].name = jobs[i].path.substr(strlen(opt.inDir) + 1) + ".wav";
+                break;
+            }
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    uint32_t startUS = getMicros();
+    for (unsigned t=0; t<opt.threads; t++) {
+        workers.emplace_back([&]() {
+            for (size_t i; (i = next.fetch_add(1)) < jobs.size(); )
+                transcode(jobs[i], opt);
+        });
+    }
+    for (auto& w: workers)
+        w.join();
+
+    size_t inBytes = 0, outBytes = 0, done = 0, silent = 0, failed = 0;
+    ClipBankWriter bank;
+    for (auto& job: jobs) {
+        if (job.result == Job::Done && opt.bankName && !bank.addClip(job.name.c_str(), job.samples, opt.sampleRate)) {
+            printf("  %s: not added to the bank\n", job.path.c_str());
+            failed++;
+        }
+        else if (job.result == Job::Done) {
+            inBytes += job.inBytes;
+            outBytes += job.samples.size() + (opt.outDir ? 44 + (job.samples.size() & 1) : 0);
+            done++;
+        }
+        else if (job.result == Job::Silent) {
+            printf("  %s: silent - skipped\n", job.path.c_str());
+            silent++;
+        }
+        else {
+            printf("  %s: unable to decode\n", job.path.c_str());
+            failed++;
+        }
+    }
+    if (opt.bankName) {
+        if (!bank.write(opt.bankName)) {
+            printf("Unable to write %s\n", opt.bankName);
+            return 1;
+        }
+        stat(opt.bankName, &st);
+        outBytes = st.st_size;
+    }
+    double seconds = (getMicros() - startUS) / 1000000.0;
+
+    printf("%u files converted (%u silent, %u failed) in %.2f s on %u threads - %.1f files/s\n",
+        (unsigned)done, (unsigned)silent, (unsigned)failed, seconds, opt.threads, done / seconds);
+    printf("Input %u bytes, output %u bytes - %u bytes saved (%.0f%%)\n", (unsigned)inBytes, (unsigned)outBytes,
+        (unsigned)(inBytes > outBytes ? inBytes - outBytes : 0), inBytes ? 100.0 * (inBytes - (double)outBytes) / inBytes : 0.0);
+    return failed ? 1 : 0;
+}